@@ -9,6 +9,8 @@
 #include "RealSenseID/AuthFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollmentCallback.h"
+#include "RealSenseID/FaceprintsExportCallback.h"
+#include "RealSenseID/FaceprintsImportStats.h"
 #include "RealSenseID/Faceprints.h"
 #include "RealSenseID/SerialConfig.h"
 
@@ -299,6 +301,22 @@ public:
      */
     Status GetUsersFaceprints(Faceprints* user_features, unsigned int& num_of_users);
 
+    /**
+     * Stream the features descriptor of each user in the device's DB, from start_index to the last user, to the callback.
+     * Up to pipeline_depth requests are kept in flight on a single session, so the device's replies follow each other on
+     * the serial link instead of waiting a round trip per user.
+     * If the export fails (e.g. the link was interrupted), the users delivered so far stay valid: call again with
+     * start_index = stats.next_index to resume.
+     *
+     * @param[in] callback User defined callback to receive the faceprints as they arrive.
+     * @param[in] start_index DB index of the first user to export.
+     * @param[in] pipeline_depth Max number of requests in flight (1 to 16). 1 sends each request after the previous reply.
+     * @param[out] stats Optional. Progress of the export, valid on failure too.
+     * @return Status (Status::Ok on success, or if the callback stopped the export).
+     */
+    Status ExportUsersFaceprints(FaceprintsExportCallback& callback, unsigned int start_index = 0, unsigned int pipeline_depth = 8,
+                                 FaceprintsExportStats* stats = nullptr);
+
     /**
      * Insert each user entry from the array into the device's database.
      * @param[in] user_features Array of user IDs and feature descriptors.
@@ -307,6 +325,30 @@ public:
      */
     Status SetUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users);
 
+    /**
+     * Insert each user entry from the array into the device's database, without saving it to the device's storage.
+     * All users are sent back to back on a single session: up to pipeline_depth users are sent ahead of the device's
+     * acknowledgements, and each acknowledgement lets the next user go. A user whose acknowledgement arrives corrupt is
+     * sent again once. A user the device rejects doesn't stop the import: its status is reported in user_statuses.
+     * Call SaveDatabase() once the users are imported, to commit them to the device's storage.
+     *
+     * @param[in] user_features Array of user IDs and feature descriptors.
+     * @param[in] num_of_users Number of users in the array.
+     * @param[out] user_statuses Optional array of num_of_users entries, receives each user's status.
+     * @param[in] pipeline_depth Max number of users sent ahead of their acknowledgement (1 to 8).
+     * @param[out] stats Optional. Counts and throughput of the import.
+     * @return Status (Status::Ok if all users were imported, else the status of the first failed user).
+     */
+    Status ImportUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users, Status* user_statuses = nullptr,
+                                 unsigned int pipeline_depth = 2, FaceprintsImportStats* stats = nullptr);
+
+    /**
+     * Save the device's database to the device's storage, e.g. to commit the users of ImportUsersFaceprints().
+     *
+     * @return Status (Status::Ok on success).
+     */
+    Status SaveDatabase();
+
 private:
     Impl::IFaceAuthenticator* _impl = nullptr;
 };
@@ -0,0 +1,45 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "Faceprints.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+/**
+ * Progress of a faceprints export (see FaceAuthenticator::ExportUsersFaceprints()).
+ */
+struct FaceprintsExportStats
+{
+    unsigned int total_users = 0;    // users in the device's DB
+    unsigned int exported_users = 0; // users delivered to the callback by this export
+    unsigned int next_index = 0;     // DB index of the next user to export. pass it as start_index to resume
+    size_t bytes = 0;                // faceprints bytes received
+    size_t link_bytes = 0;           // bytes sent and received on the serial link, including packet framing
+    double seconds = 0;              // since the first request was sent
+    double bytes_per_second = 0;     // effective faceprints bytes per second
+};
+
+/**
+ * User defined callback for faceprints export.
+ * Callback will be called once per user, in DB index order, as its faceprints arrive from the device.
+ */
+class FaceprintsExportCallback
+{
+public:
+    virtual ~FaceprintsExportCallback() = default;
+
+    /**
+     * Called for each exported user.
+     *
+     * @param[in] index The user's index in the device's DB (same order as QueryUserIds()).
+     * @param[in] faceprints The user's faceprints.
+     * @param[in] stats Progress so far, including this user.
+     * @return true to continue the export, false to stop it (the export then returns Status::Ok).
+     */
+    virtual bool OnFaceprints(unsigned int index, const Faceprints& faceprints, const FaceprintsExportStats& stats) = 0;
+};
+
+} // namespace RealSenseID
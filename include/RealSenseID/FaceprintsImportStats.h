@@ -0,0 +1,25 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <cstddef>
+
+namespace RealSenseID
+{
+/**
+ * Result of a faceprints import (see FaceAuthenticator::ImportUsersFaceprints()).
+ */
+struct FaceprintsImportStats
+{
+    unsigned int imported_users = 0; // acknowledged Ok by the device
+    unsigned int failed_users = 0;   // rejected by the host or the device, or not acknowledged
+    unsigned int resent_users = 0;   // sent again after a corrupt acknowledgement
+    size_t bytes = 0;                // faceprints bytes of the imported users
+    size_t link_bytes = 0;           // bytes sent and received on the serial link, including packet framing
+    double seconds = 0;              // since the session started
+    double users_per_second = 0;     // imported users per second
+    double bytes_per_second = 0;     // effective faceprints bytes per second
+};
+
+} // namespace RealSenseID
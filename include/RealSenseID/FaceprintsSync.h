@@ -0,0 +1,121 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/FaceAuthenticator.h"
+#include "RealSenseID/Faceprints.h"
+#include "RealSenseID/RealSenseIDExports.h"
+#include "RealSenseID/Status.h"
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class FaceprintsSyncImpl;
+
+/**
+ * How FaceprintsSync::Sync() checks that its manifest still describes the device's DB.
+ */
+enum class SyncVerify
+{
+    UserCount,  // the device's number of users matches the manifest (a single GetNumberOfUsers exchange), else as UserIds
+    UserIds,    // the device's user ids match the manifest (an exchange per 50 users)
+    Faceprints, // read and hash all the device's faceprints (an exchange per user)
+};
+
+/**
+ * Result of a sync (see FaceprintsSync::Sync()).
+ */
+struct FaceprintsSyncStats
+{
+    unsigned int device_users = 0;    // users in the device's DB before the sync
+    unsigned int hashed_users = 0;    // device users whose faceprints were read and hashed, to rebuild the manifest
+    unsigned int added_users = 0;     // set on the device, that it didn't have
+    unsigned int changed_users = 0;   // set on the device, replacing different faceprints
+    unsigned int removed_users = 0;   // removed from the device
+    unsigned int unchanged_users = 0; // not transferred
+    unsigned int failed_users = 0;    // not added, changed or removed. the next sync retries them
+    bool saved = false;               // the device's DB was saved
+    double seconds = 0;
+};
+
+/**
+ * Incremental sync of a device's DB to a list of users kept on the host.
+ *
+ * The device can't hash its DB, so each FaceprintsSync keeps a manifest of its device: the id and the content hash of
+ * each user it believes the device has, as left by the last sync. Sync() hashes the host's users, compares them with the
+ * manifest, and only transfers the difference: the added and changed users are imported and the removed users are
+ * removed, followed by a single SaveDatabase. When nothing changed, the sync is the single exchange of the manifest's
+ * check (see SyncVerify).
+ * When the device's user ids don't match the manifest (the DB was changed by others since the last sync), the users
+ * removed by others are set again and the users added by others are set or removed, without reading any faceprints.
+ * A new manifest, or one that a failed sync left uncertain, is rebuilt by reading and hashing the device's faceprints,
+ * so even the first sync only transfers the difference.
+ *
+ * Use one FaceprintsSync per device, and keep its manifest across runs with SaveManifest() and LoadManifest().
+ *
+ * @note Changes to the faceprints of a device user that keeps its id (the device's adaptive learning, or a re-enrollment
+ * by others) are only seen with SyncVerify::Faceprints, and are then overwritten by the host's faceprints.
+ * @note Supports move semantics. Moved-from object should not be used
+ */
+class RSID_API FaceprintsSync
+{
+public:
+    FaceprintsSync();
+    ~FaceprintsSync();
+    FaceprintsSync(const FaceprintsSync&) = delete;
+    FaceprintsSync& operator=(const FaceprintsSync&) = delete;
+    FaceprintsSync(FaceprintsSync&& other) noexcept;
+    FaceprintsSync& operator=(FaceprintsSync&& other) noexcept;
+
+    /**
+     * Make the device's DB hold exactly the given users, and save it.
+     *
+     * @param[in] authenticator Connected to the device.
+     * @param[in] users The users the device should have. User ids must be valid and unique.
+     * @param[in] num_of_users Number of users.
+     * @param[in] verify How to check the manifest before using it.
+     * @param[out] user_statuses Optional array of num_of_users statuses: Status::Ok if the device has the user's
+     * faceprints after the sync, the failure otherwise.
+     * @param[out] stats Optional result of the sync.
+     * @return Status::Ok if the device has all the users and no others, the first failure otherwise.
+     */
+    Status Sync(FaceAuthenticator& authenticator, const UserFaceprints* users, unsigned int num_of_users,
+                SyncVerify verify = SyncVerify::UserCount, Status* user_statuses = nullptr, FaceprintsSyncStats* stats = nullptr);
+
+    /**
+     * Load a manifest saved by SaveManifest(), for the same device.
+     *
+     * @param[in] path Manifest file.
+     * @return Status::Ok on success. On failure the manifest is reset.
+     */
+    Status LoadManifest(const char* path);
+
+    /**
+     * Save the manifest, replacing the file atomically.
+     *
+     * @param[in] path Manifest file.
+     * @return Status (Status::Ok on success).
+     */
+    Status SaveManifest(const char* path) const;
+
+    /**
+     * Forget the device's DB. The next sync reads and hashes all the device's faceprints.
+     */
+    void ResetManifest();
+
+    /**
+     * Number of users in the manifest.
+     */
+    unsigned int ManifestSize() const;
+
+    /**
+     * Content hash of a user: its id and the faceprints the device keeps (version, type and descriptors).
+     * Never 0.
+     */
+    static uint64_t ContentHash(const char* user_id, const Faceprints& faceprints);
+
+private:
+    FaceprintsSyncImpl* _impl = nullptr;
+};
+} // namespace RealSenseID
@@ -0,0 +1,115 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include "RealSenseID/MatcherDefines.h"
+#include "RealSenseID/RealSenseIDExports.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace RealSenseID
+{
+/**
+ * Host matcher engine: 1:1, 1:N and batch matching with adaptive update, behind a single interface so deployments can
+ * pick an implementation by name (see MatcherEngineRegistry) without changing the callers.
+ *
+ * Every engine must give the results of the "reference" engine (the SDK's matcher) for the same input - scores,
+ * decisions and updated faceprints - and is checked against it by the conformance check of rsid-matcher-bench.
+ * Engines are shared by all callers, so all methods must be thread safe.
+ */
+class IMatcherEngine
+{
+public:
+    virtual ~IMatcherEngine() = default;
+
+    /**
+     * Registry name.
+     */
+    virtual const char* Name() const = 0;
+
+    /**
+     * Match a probe vs. a single user's faceprints.
+     */
+    virtual MatchResultInternal MatchFaceprints(const MatchElement& probe_faceprints, const Faceprints& existing_faceprints,
+                                                Faceprints& updated_faceprints, ThresholdsConfidenceEnum confidenceLevel) = 0;
+
+    /**
+     * Match a probe vs. an array of users. result.userId is the array index of the best match, and updated_faceprints its
+     * adapted faceprints if result.should_update is set.
+     */
+    virtual ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints,
+                                                       const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                                       Faceprints& updated_faceprints, ThresholdsConfidenceEnum confidenceLevel) = 0;
+
+    /**
+     * Match a batch of probes vs. an array of users: results[i] and updated_faceprints[i] as MatchFaceprintsToArray() of
+     * probes[i].
+     */
+    virtual void MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes,
+                                             const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                             std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                             ThresholdsConfidenceEnum confidenceLevel) = 0;
+
+    /**
+     * Adaptive update steps: blend a new vector into the adaptive one, then blend the anchor vector in until the adaptive
+     * vector is close enough to it (false if it didn't get there within the iteration limit).
+     */
+    virtual void BlendAverageVector(feature_t* user_adaptive_faceprints, const feature_t* user_probe_faceprints) = 0;
+
+    virtual bool LimitAdaptiveVector(feature_t* adaptive_faceprints_vec, const feature_t* anchor_faceprints_vec,
+                                     const AdaptiveThresholds& adaptiveThresholds) = 0;
+};
+
+/**
+ * Named matcher engines, and the active one used by the SDK's host matching (e.g. FaceAuthenticator::MatchFaceprints()).
+ *
+ * Built in engines:
+ *  - "reference" - the SDK's matcher, serial.
+ *  - "threaded"  - the SDK's matcher, with 1:N and batch scans split across a thread pool of all cores.
+ * Further engines are added with Register() before first use.
+ *
+ * The active engine is, by priority: the one set with SetActive(), the RSID_MATCHER_ENGINE environment variable, or the
+ * build default (RSID_MATCHER_ENGINE cmake variable, "reference" unless set). An unknown name falls back to "reference".
+ * Engines are created on first use and live until exit. Thread safe.
+ */
+class RSID_API MatcherEngineRegistry
+{
+public:
+    using Factory = std::function<std::unique_ptr<IMatcherEngine>()>;
+
+    static constexpr const char* ReferenceEngine = "reference";
+    static constexpr const char* EnvironmentVariable = "RSID_MATCHER_ENGINE";
+
+    /**
+     * Register an engine, created by factory on its first use.
+     *
+     * @param name Engine name, for SetActive() and RSID_MATCHER_ENGINE.
+     * @param factory Creates the engine.
+     * @return false if the name is taken.
+     */
+    static bool Register(const char* name, Factory factory);
+
+    /**
+     * Registered names, in registration order.
+     */
+    static std::vector<std::string> Names();
+
+    /**
+     * @return The engine of the given name, or nullptr if not registered.
+     */
+    static IMatcherEngine* Get(const char* name);
+
+    /**
+     * Select the engine used by the SDK's host matching.
+     *
+     * @return false (and keeps the active engine) if the name is not registered.
+     */
+    static bool SetActive(const char* name);
+
+    static IMatcherEngine& Active();
+};
+} // namespace RealSenseID
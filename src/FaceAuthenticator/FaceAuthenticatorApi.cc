@@ -228,9 +228,29 @@ Status FaceAuthenticator::GetUsersFaceprints(Faceprints* user_features, unsigned
     // return _impl->GetUsersFaceprints(user_features, num_of_users);
 }
 
+Status FaceAuthenticator::ExportUsersFaceprints(FaceprintsExportCallback& callback, unsigned int start_index, unsigned int pipeline_depth,
+                                                FaceprintsExportStats* stats)
+{
+    WITH_LICENSE_CHECK(ExportUsersFaceprints, callback, start_index, pipeline_depth, stats);
+    // return _impl->ExportUsersFaceprints(callback, start_index, pipeline_depth, stats);
+}
+
 Status FaceAuthenticator::SetUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users)
 {
     WITH_LICENSE_CHECK(SetUsersFaceprints, user_features, num_of_users);
     // return _impl->SetUsersFaceprints(user_features, num_of_users);
 }
+
+Status FaceAuthenticator::ImportUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users, Status* user_statuses,
+                                                unsigned int pipeline_depth, FaceprintsImportStats* stats)
+{
+    WITH_LICENSE_CHECK(ImportUsersFaceprints, user_features, num_of_users, user_statuses, pipeline_depth, stats);
+    // return _impl->ImportUsersFaceprints(user_features, num_of_users, user_statuses, pipeline_depth, stats);
+}
+
+Status FaceAuthenticator::SaveDatabase()
+{
+    WITH_LICENSE_CHECK(SaveDatabase);
+    // return _impl->SaveDatabase();
+}
 } // namespace RealSenseID
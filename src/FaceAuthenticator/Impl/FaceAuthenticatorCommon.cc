@@ -9,6 +9,7 @@
 #include "StatusHelper.h"
 #include "RealSenseID/MatcherDefines.h"
 #include "RealSenseID/Faceprints.h"
+#include "RealSenseID/MatcherEngine.h"
 #include "Matcher/Matcher.h"
 
 #include <cstring>
@@ -19,6 +20,8 @@
 #include <chrono>
 #include <string>
 #include <algorithm>
+#include <deque>
+#include <vector>
 
 #ifdef _WIN32
 #include "PacketManager/WindowsSerial.h"
@@ -44,6 +47,10 @@ static constexpr unsigned int QUERY_CHUNK_SIZE = 50;
 static constexpr unsigned int MAX_UPLOAD_IMG_SIZE = 900 * 1024;
 static constexpr std::chrono::milliseconds ENROLL_MAX_TIMEOUT {12000};
 static constexpr std::chrono::milliseconds AUTH_MAX_TIMEOUT {10000};
+// requests queued at the device during an export. kept small: the device buffers them in its serial input
+static constexpr unsigned int MAX_EXPORT_PIPELINE_DEPTH = 16;
+// users sent ahead of their acknowledgement during an import. each is a 3KB packet in the device's serial input
+static constexpr unsigned int MAX_IMPORT_PIPELINE_DEPTH = 8;
 
 // save callback functions to use in the secure session later
 FaceAuthenticatorCommon::FaceAuthenticatorCommon(SignatureCallback* callback) :
@@ -1622,7 +1629,8 @@ MatchResultHost FaceAuthenticatorCommon::MatchFaceprints(MatchElement& new_facep
 {
     MatchResultHost finalResult;
 
-    auto result = Matcher::MatchFaceprints(new_faceprints, existing_faceprints, updated_faceprints, matcher_confidence_level);
+    auto& engine = MatcherEngineRegistry::Active();
+    auto result = engine.MatchFaceprints(new_faceprints, existing_faceprints, updated_faceprints, matcher_confidence_level);
     finalResult.success = result.success;
     finalResult.should_update = result.should_update;
     finalResult.score = result.score;
@@ -1649,6 +1657,25 @@ bool FaceAuthenticatorCommon::ValidateUserId(const char* user_id)
     return is_valid;
 }
 
+// bytes of a binary packet on the serial link
+static size_t LinkBytes(const PacketManager::SerialPacket& packet)
+{
+    return ::strlen(PacketManager::Commands::face_api) + sizeof(packet.header) + packet.header.payload_size + sizeof(packet.hmac) +
+           sizeof(packet.crc);
+}
+
+// SetUserFeatures packet of a user: the user id (MaxUserIdSize + 1 bytes), then the faceprints
+static PacketManager::DataPacket UserFaceprintsPacket(const UserFaceprints& features)
+{
+    char buffer[sizeof(DBFaceprintsElement) + PacketManager::MaxUserIdSize + 1] = {0};
+    strncpy(buffer, features.user_id, PacketManager::MaxUserIdSize + 1);
+    size_t offset = PacketManager::MaxUserIdSize + 1;
+    const DBFaceprintsElement* desc = &(features.faceprints.data);
+    memcpy(buffer + offset, (const char*)desc, sizeof(DBFaceprintsElement));
+    offset += sizeof(*desc);
+    return PacketManager::DataPacket {PacketManager::MsgId::SetUserFeatures, buffer, offset};
+}
+
 Status FaceAuthenticatorCommon::SendUserFaceprints(UserFaceprints& features)
 {
     try
@@ -1658,13 +1685,7 @@ Status FaceAuthenticatorCommon::SendUserFaceprints(UserFaceprints& features)
         {
             return Status::Error;
         }
-        char buffer[sizeof(DBFaceprintsElement) + PacketManager::MaxUserIdSize + 1] = {0};
-        strncpy(buffer, user_id, PacketManager::MaxUserIdSize + 1);
-        size_t offset = PacketManager::MaxUserIdSize + 1;
-        const DBFaceprintsElement* desc = &(features.faceprints.data);
-        memcpy(buffer + offset, (char*)desc, sizeof(DBFaceprintsElement));
-        offset += sizeof(*desc);
-        PacketManager::DataPacket data_packet {PacketManager::MsgId::SetUserFeatures, buffer, offset};
+        auto data_packet = UserFaceprintsPacket(features);
 
         auto status = _session.SendPacket(data_packet);
         if (status != PacketManager::SerialStatus::Ok)
@@ -1700,6 +1721,38 @@ Status FaceAuthenticatorCommon::SendUserFaceprints(UserFaceprints& features)
     }
 }
 
+// save the DB on the open session
+Status FaceAuthenticatorCommon::SendSaveDatabase()
+{
+    auto save_db_packet = std::make_unique<PacketManager::FaPacket>(PacketManager::MsgId::SaveDatabase);
+    auto status = _session.SendPacket(*save_db_packet);
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed sending SaveDatabase packet (status %d)", static_cast<int>(status));
+        return ToStatus(status);
+    }
+    // Wait for savedb reply
+    status = _session.RecvFaPacket(*save_db_packet);
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed receiving savedb reply packet (status %d)", static_cast<int>(status));
+        return ToStatus(status);
+    }
+    auto msg_id = save_db_packet->header.id;
+    if (PacketManager::MsgId::Reply != msg_id)
+    {
+        LOG_ERROR(LOG_TAG, "Got unexpected message id %d instead of MsgId::Reply", static_cast<int>(msg_id));
+        return Status::Error;
+    }
+    auto status_code = save_db_packet->GetStatusCode();
+    auto save_status = static_cast<Status>(status_code);
+    if (save_status != Status::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed saving DB to device. Status: %d", static_cast<int>(status_code));
+    }
+    return save_status;
+}
+
 Status FaceAuthenticatorCommon::SetUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users)
 {
     // set start index and end index for chunk
@@ -1732,31 +1785,9 @@ Status FaceAuthenticatorCommon::SetUsersFaceprints(UserFaceprints* user_features
         }
 
         // ask the device to save to its storage before proceeding
-        auto save_db_packet = std::make_unique<PacketManager::FaPacket>(PacketManager::MsgId::SaveDatabase);
-        status = _session.SendPacket(*save_db_packet);
-        if (status != PacketManager::SerialStatus::Ok)
-        {
-            LOG_ERROR(LOG_TAG, "Failed sending SaveDatabase packet (status %d)", static_cast<int>(status));
-            return ToStatus(status);
-        }
-        // Wait for savedb reply
-        status = _session.RecvFaPacket(*save_db_packet);
-        if (status != PacketManager::SerialStatus::Ok)
-        {
-            LOG_ERROR(LOG_TAG, "Failed receiving savedb reply packet (status %d)", static_cast<int>(status));
-            return ToStatus(status);
-        }
-        auto msg_id = save_db_packet->header.id;
-        if (PacketManager::MsgId::Reply != msg_id)
-        {
-            LOG_ERROR(LOG_TAG, "Got unexpected message id %d instead of MsgId::Reply", static_cast<int>(msg_id));
-            return Status::Error;
-        }
-        auto status_code = save_db_packet->GetStatusCode();
-        auto save_status = static_cast<Status>(status_code);
+        auto save_status = SendSaveDatabase();
         if (save_status != Status::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed saving DB to device. Status: %d", static_cast<int>(status_code));
             return save_status;
         }
 
@@ -1771,6 +1802,217 @@ Status FaceAuthenticatorCommon::SetUsersFaceprints(UserFaceprints* user_features
     return Status::Ok;
 }
 
+Status FaceAuthenticatorCommon::ImportUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users, Status* user_statuses,
+                                                      unsigned int pipeline_depth, FaceprintsImportStats* stats)
+{
+    FaceprintsImportStats import_stats;
+    if (stats != nullptr)
+    {
+        *stats = import_stats;
+    }
+    if (user_features == nullptr || pipeline_depth == 0 || pipeline_depth > MAX_IMPORT_PIPELINE_DEPTH)
+    {
+        LOG_ERROR(LOG_TAG, "ImportUsersFaceprints: Got invalid params (nullptr, or pipeline depth not 1 to %u)", MAX_IMPORT_PIPELINE_DEPTH);
+        return Status::Error;
+    }
+
+    std::vector<Status> statuses(num_of_users, Status::Error);
+    std::vector<unsigned int> to_send; // user indexes, in order
+    for (unsigned int i = 0; i < num_of_users; i++)
+    {
+        if (ValidateUserId(user_features[i].user_id))
+        {
+            to_send.push_back(i);
+        }
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    Status link_status = Status::Ok;
+    try
+    {
+        auto status = _session.Start(_serial.get());
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            link_status = ToStatus(status);
+        }
+
+        // the device acknowledges the users in the order sent, so the front of in_flight is the user of the next
+        // acknowledgement. a corrupt acknowledgement leaves its user's status unknown: inserting a user is idempotent, so
+        // such users are sent again, once, after the others.
+        for (int round = 0; round < 2 && link_status == Status::Ok && !to_send.empty(); round++)
+        {
+            std::deque<unsigned int> in_flight;
+            std::vector<unsigned int> to_resend;
+            size_t next = 0;
+            while ((next < to_send.size() || !in_flight.empty()) && link_status == Status::Ok)
+            {
+                while (next < to_send.size() && in_flight.size() < pipeline_depth)
+                {
+                    auto packet = UserFaceprintsPacket(user_features[to_send[next]]);
+                    status = _session.SendPacket(packet);
+                    if (status != PacketManager::SerialStatus::Ok)
+                    {
+                        LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", static_cast<int>(status));
+                        link_status = ToStatus(status);
+                        break;
+                    }
+                    import_stats.link_bytes += LinkBytes(packet);
+                    in_flight.push_back(to_send[next++]);
+                }
+                if (link_status != Status::Ok)
+                {
+                    break;
+                }
+
+                auto user = in_flight.front();
+                in_flight.pop_front();
+                PacketManager::FaPacket ack {PacketManager::MsgId::Reply};
+                status = _session.RecvPacket(ack);
+                if (status == PacketManager::SerialStatus::CrcError)
+                {
+                    LOG_ERROR(LOG_TAG, "Corrupt acknowledgement of user \"%s\"", user_features[user].user_id);
+                    if (round == 0)
+                    {
+                        to_resend.push_back(user);
+                    }
+                    statuses[user] = ToStatus(status);
+                    continue;
+                }
+                if (status != PacketManager::SerialStatus::Ok)
+                {
+                    LOG_ERROR(LOG_TAG, "Failed receiving acknowledgement of user \"%s\" (status %d)", user_features[user].user_id,
+                              static_cast<int>(status));
+                    statuses[user] = ToStatus(status);
+                    link_status = ToStatus(status);
+                    break;
+                }
+                import_stats.link_bytes += LinkBytes(ack) - ::strlen(PacketManager::Commands::face_api);
+                if (ack.header.id != PacketManager::MsgId::Reply)
+                {
+                    LOG_ERROR(LOG_TAG, "Got unexpected message id %d instead of MsgId::Reply", static_cast<int>(ack.header.id));
+                    continue;
+                }
+                statuses[user] = static_cast<Status>(ack.GetStatusCode());
+                if (statuses[user] == Status::Ok)
+                {
+                    import_stats.bytes += sizeof(DBFaceprintsElement);
+                }
+                else
+                {
+                    LOG_ERROR(LOG_TAG, "Device rejected user \"%s\": %s", user_features[user].user_id, Description(statuses[user]));
+                }
+            }
+
+            // after a link failure, the users in flight or not sent yet get its status
+            if (link_status != Status::Ok)
+            {
+                for (auto user : in_flight)
+                {
+                    statuses[user] = link_status;
+                }
+                for (; next < to_send.size(); next++)
+                {
+                    statuses[to_send[next]] = link_status;
+                }
+                for (auto user : to_resend)
+                {
+                    statuses[user] = link_status;
+                }
+            }
+            import_stats.resent_users += static_cast<unsigned int>(to_resend.size());
+            to_send = std::move(to_resend);
+        }
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        link_status = Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        link_status = Status::Error;
+    }
+
+    Status import_status = link_status;
+    for (unsigned int i = 0; i < num_of_users; i++)
+    {
+        if (statuses[i] == Status::Ok)
+        {
+            import_stats.imported_users++;
+        }
+        else
+        {
+            import_stats.failed_users++;
+            if (import_status == Status::Ok)
+            {
+                import_status = statuses[i];
+            }
+        }
+        if (user_statuses != nullptr)
+        {
+            user_statuses[i] = statuses[i];
+        }
+    }
+    import_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    if (import_stats.seconds > 0)
+    {
+        import_stats.users_per_second = import_stats.imported_users / import_stats.seconds;
+        import_stats.bytes_per_second = static_cast<double>(import_stats.bytes) / import_stats.seconds;
+    }
+    if (stats != nullptr)
+    {
+        *stats = import_stats;
+    }
+    LOG_INFO(LOG_TAG, "ImportUsersFaceprints: %u of %u users imported, %.1f users/sec", import_stats.imported_users, num_of_users,
+             import_stats.users_per_second);
+    return import_status;
+}
+
+Status FaceAuthenticatorCommon::SaveDatabase()
+{
+    try
+    {
+        auto status = _session.Start(_serial.get());
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            return ToStatus(status);
+        }
+        return SendSaveDatabase();
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        return Status::Error;
+    }
+}
+
+
+// copy the faceprints of a GetUserFeatures reply
+static void CopyDeviceFaceprints(const DBFaceprintsElement& desc, Faceprints& faceprints)
+{
+    faceprints.data.version = desc.version;
+    faceprints.data.featuresType = static_cast<FaceprintsTypeEnum>(desc.featuresType);
+
+    static_assert(sizeof(faceprints.data.adaptiveDescriptorWithoutMask) == sizeof(desc.adaptiveDescriptorWithoutMask),
+                  "adaptive faceprints sizes (without mask) does not match");
+    ::memcpy(faceprints.data.adaptiveDescriptorWithoutMask, desc.adaptiveDescriptorWithoutMask, sizeof(desc.adaptiveDescriptorWithoutMask));
+
+    static_assert(sizeof(faceprints.data.adaptiveDescriptorWithMask) == sizeof(desc.adaptiveDescriptorWithMask),
+                  "adaptive faceprints sizes (with mask) does not match");
+    ::memcpy(faceprints.data.adaptiveDescriptorWithMask, desc.adaptiveDescriptorWithMask, sizeof(desc.adaptiveDescriptorWithMask));
+
+    static_assert(sizeof(faceprints.data.enrollmentDescriptor) == sizeof(desc.enrollmentDescriptor),
+                  "enrollment faceprints sizes does not match");
+    ::memcpy(faceprints.data.enrollmentDescriptor, desc.enrollmentDescriptor, sizeof(desc.enrollmentDescriptor));
+}
 
 Status FaceAuthenticatorCommon::GetUsersFaceprints(Faceprints* user_features, unsigned int& num_of_users)
 {
@@ -1809,23 +2051,7 @@ Status FaceAuthenticatorCommon::GetUsersFaceprints(Faceprints* user_features, un
             {
                 LOG_DEBUG(LOG_TAG, "Got faceprints from device!");
                 auto* desc = reinterpret_cast<DBFaceprintsElement*>(get_features_return_packet.payload.message.data_msg.data);
-
-                user_features[i].data.version = desc->version;
-                user_features[i].data.featuresType = static_cast<FaceprintsTypeEnum>(desc->featuresType);
-
-                static_assert(sizeof(user_features[i].data.adaptiveDescriptorWithoutMask) == sizeof(desc->adaptiveDescriptorWithoutMask),
-                              "adaptive faceprints sizes (without mask) does not match");
-                ::memcpy(user_features[i].data.adaptiveDescriptorWithoutMask, desc->adaptiveDescriptorWithoutMask,
-                         sizeof(desc->adaptiveDescriptorWithoutMask));
-
-                static_assert(sizeof(user_features[i].data.adaptiveDescriptorWithMask) == sizeof(desc->adaptiveDescriptorWithMask),
-                              "adaptive faceprints sizes (with mask) does not match");
-                ::memcpy(user_features[i].data.adaptiveDescriptorWithMask, desc->adaptiveDescriptorWithMask,
-                         sizeof(desc->adaptiveDescriptorWithMask));
-
-                static_assert(sizeof(user_features[i].data.enrollmentDescriptor) == sizeof(desc->enrollmentDescriptor),
-                              "enrollment faceprints sizes does not match");
-                ::memcpy(user_features[i].data.enrollmentDescriptor, desc->enrollmentDescriptor, sizeof(desc->enrollmentDescriptor));
+                CopyDeviceFaceprints(*desc, user_features[i]);
             }
             else
             {
@@ -1854,5 +2080,129 @@ Status FaceAuthenticatorCommon::GetUsersFaceprints(Faceprints* user_features, un
     return all_is_well ? Status::Ok : ToStatus(bad_status);
 }
 
+Status FaceAuthenticatorCommon::ExportUsersFaceprints(FaceprintsExportCallback& callback, unsigned int start_index,
+                                                      unsigned int pipeline_depth, FaceprintsExportStats* stats)
+{
+    FaceprintsExportStats export_stats;
+    export_stats.next_index = start_index;
+    if (stats != nullptr)
+    {
+        *stats = export_stats;
+    }
+
+    if (pipeline_depth == 0 || pipeline_depth > MAX_EXPORT_PIPELINE_DEPTH)
+    {
+        LOG_ERROR(LOG_TAG, "ExportUsersFaceprints: pipeline depth must be 1 to %u", MAX_EXPORT_PIPELINE_DEPTH);
+        return Status::Error;
+    }
+
+    // starts the session the export runs on
+    unsigned int num_of_users = 0;
+    auto query_status = QueryNumberOfUsers(num_of_users);
+    if (query_status != Status::Ok)
+    {
+        return query_status;
+    }
+    // the device addresses users by a 16 bit index
+    num_of_users = (std::min)(num_of_users, 0x10000u);
+    export_stats.total_users = num_of_users;
+
+    // requests [next_index, next_request) are in flight. the device replies in request order, so each reply is the faceprints of
+    // next_index.
+    unsigned int next_request = start_index;
+    unsigned int replies_lost = 0; // received, but not delivered
+    Status export_status = Status::Ok;
+    bool stopped = false;
+    auto start_time = std::chrono::steady_clock::now();
+    try
+    {
+        while (export_stats.next_index < num_of_users && !stopped)
+        {
+            while (next_request < num_of_users && next_request - export_stats.next_index < pipeline_depth)
+            {
+                auto index = static_cast<uint16_t>(next_request);
+                PacketManager::DataPacket request {PacketManager::MsgId::GetUserFeatures, reinterpret_cast<char*>(&index), sizeof(index)};
+                auto status = _session.SendPacket(request);
+                if (status != PacketManager::SerialStatus::Ok)
+                {
+                    LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", static_cast<int>(status));
+                    export_status = ToStatus(status);
+                    break;
+                }
+                export_stats.link_bytes += LinkBytes(request);
+                next_request++;
+            }
+            if (export_status != Status::Ok)
+            {
+                break;
+            }
+
+            PacketManager::DataPacket reply {PacketManager::MsgId::GetUserFeatures};
+            auto status = _session.RecvDataPacket(reply);
+            if (status != PacketManager::SerialStatus::Ok)
+            {
+                LOG_ERROR(LOG_TAG, "Failed receiving faceprints of user %u (status %d)", export_stats.next_index, static_cast<int>(status));
+                export_status = ToStatus(status);
+                // anything but a timeout read the reply off the link
+                replies_lost = status != PacketManager::SerialStatus::RecvTimeout ? 1 : 0;
+                break;
+            }
+            export_stats.link_bytes += LinkBytes(reply) - ::strlen(PacketManager::Commands::face_api);
+            if (reply.header.id != PacketManager::MsgId::GetUserFeatures)
+            {
+                LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c", static_cast<char>(reply.header.id));
+                export_status = Status::Error;
+                replies_lost = 1;
+                break;
+            }
+
+            Faceprints faceprints;
+            CopyDeviceFaceprints(*reinterpret_cast<const DBFaceprintsElement*>(reply.Data().data), faceprints);
+            auto index = export_stats.next_index++;
+            export_stats.exported_users++;
+            export_stats.bytes += sizeof(DBFaceprintsElement);
+            export_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            export_stats.bytes_per_second = export_stats.seconds > 0 ? static_cast<double>(export_stats.bytes) / export_stats.seconds : 0;
+            if (stats != nullptr)
+            {
+                *stats = export_stats;
+            }
+            stopped = !callback.OnFaceprints(index, faceprints, export_stats);
+        }
+
+        // collect the replies still in flight, so they are not taken for the replies of the next session's requests.
+        // give up at the first failure: the link is down, or the device dropped the requests.
+        for (next_request -= replies_lost; next_request > export_stats.next_index; next_request--)
+        {
+            PacketManager::DataPacket reply {PacketManager::MsgId::GetUserFeatures};
+            if (_session.RecvDataPacket(reply) != PacketManager::SerialStatus::Ok)
+            {
+                break;
+            }
+            export_stats.link_bytes += LinkBytes(reply) - ::strlen(PacketManager::Commands::face_api);
+        }
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        export_status = Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        export_status = Status::Error;
+    }
+
+    export_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    export_stats.bytes_per_second = export_stats.seconds > 0 ? static_cast<double>(export_stats.bytes) / export_stats.seconds : 0;
+    if (stats != nullptr)
+    {
+        *stats = export_stats;
+    }
+    LOG_INFO(LOG_TAG, "ExportUsersFaceprints: %u users (%u to %u of %u), %.0f bytes/sec", export_stats.exported_users, start_index,
+             export_stats.next_index, num_of_users, export_stats.bytes_per_second);
+    return export_status;
+}
+
 } // namespace Impl
 } // namespace RealSenseID
@@ -8,6 +8,8 @@
 #include "RealSenseID/AuthFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollmentCallback.h"
+#include "RealSenseID/FaceprintsExportCallback.h"
+#include "RealSenseID/FaceprintsImportStats.h"
 #include "RealSenseID/Faceprints.h"
 #include "RealSenseID/SerialConfig.h"
 #include "RealSenseID/SignatureCallback.h"
@@ -81,7 +83,12 @@ public:
                                     ThresholdsConfidenceEnum matcher_confidence_level) override;
 
     Status GetUsersFaceprints(Faceprints* user_features, unsigned int& num_of_users) override;
+    Status ExportUsersFaceprints(FaceprintsExportCallback& callback, unsigned int start_index, unsigned int pipeline_depth,
+                                 FaceprintsExportStats* stats) override;
     Status SetUsersFaceprints(UserFaceprints* users_faceprints, unsigned int num_of_users) override;
+    Status ImportUsersFaceprints(UserFaceprints* users_faceprints, unsigned int num_of_users, Status* user_statuses,
+                                 unsigned int pipeline_depth, FaceprintsImportStats* stats) override;
+    Status SaveDatabase() override;
 
 protected:
 #ifdef RSID_SECURE
@@ -100,6 +107,7 @@ protected:
     void AuthLoopSleep(std::chrono::milliseconds timeout) const;
     static bool ValidateUserId(const char* user_id);
     Status SendUserFaceprints(UserFaceprints& features);
+    Status SendSaveDatabase();
 };
 } // namespace Impl
 } // namespace RealSenseID
@@ -8,6 +8,8 @@
 #include "RealSenseID/AuthFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollmentCallback.h"
+#include "RealSenseID/FaceprintsExportCallback.h"
+#include "RealSenseID/FaceprintsImportStats.h"
 #include "RealSenseID/Faceprints.h"
 #include "RealSenseID/SerialConfig.h"
 #include "RealSenseID/Status.h"
@@ -66,7 +68,12 @@ public:
                                             ThresholdsConfidenceEnum matcher_confidence_level) = 0;
 
     virtual Status GetUsersFaceprints(Faceprints* user_features, unsigned int& num_of_users) = 0;
+    virtual Status ExportUsersFaceprints(FaceprintsExportCallback& callback, unsigned int start_index, unsigned int pipeline_depth,
+                                         FaceprintsExportStats* stats) = 0;
     virtual Status SetUsersFaceprints(UserFaceprints* users_faceprints, unsigned int num_of_users) = 0;
+    virtual Status ImportUsersFaceprints(UserFaceprints* users_faceprints, unsigned int num_of_users, Status* user_statuses,
+                                         unsigned int pipeline_depth, FaceprintsImportStats* stats) = 0;
+    virtual Status SaveDatabase() = 0;
 };
 
 } // namespace Impl
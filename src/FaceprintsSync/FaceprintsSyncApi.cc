@@ -0,0 +1,74 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/FaceprintsSync.h"
+#include "FaceprintsSyncImpl.h"
+
+namespace RealSenseID
+{
+FaceprintsSync::FaceprintsSync() : _impl {new FaceprintsSyncImpl()}
+{
+}
+
+FaceprintsSync::~FaceprintsSync()
+{
+    try
+    {
+        delete _impl;
+    }
+    catch (...)
+    {
+    }
+    _impl = nullptr;
+}
+
+// Move constructor
+FaceprintsSync::FaceprintsSync(FaceprintsSync&& other) noexcept
+{
+    _impl = other._impl;
+    other._impl = nullptr;
+}
+
+// Move assignment
+FaceprintsSync& FaceprintsSync::operator=(FaceprintsSync&& other) noexcept
+{
+    if (this != &other)
+    {
+        delete _impl;
+        _impl = other._impl;
+        other._impl = nullptr;
+    }
+    return *this;
+}
+
+Status FaceprintsSync::Sync(FaceAuthenticator& authenticator, const UserFaceprints* users, unsigned int num_of_users, SyncVerify verify,
+                            Status* user_statuses, FaceprintsSyncStats* stats)
+{
+    return _impl->Sync(authenticator, users, num_of_users, verify, user_statuses, stats);
+}
+
+Status FaceprintsSync::LoadManifest(const char* path)
+{
+    return _impl->LoadManifest(path);
+}
+
+Status FaceprintsSync::SaveManifest(const char* path) const
+{
+    return _impl->SaveManifest(path);
+}
+
+void FaceprintsSync::ResetManifest()
+{
+    _impl->ResetManifest();
+}
+
+unsigned int FaceprintsSync::ManifestSize() const
+{
+    return _impl->ManifestSize();
+}
+
+uint64_t FaceprintsSync::ContentHash(const char* user_id, const Faceprints& faceprints)
+{
+    return FaceprintsSyncImpl::ContentHash(user_id, faceprints);
+}
+} // namespace RealSenseID
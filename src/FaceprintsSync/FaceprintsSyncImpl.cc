@@ -0,0 +1,538 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "FaceprintsSyncImpl.h"
+#include "PacketManager/SerialPacket.h"
+#include "FileHelper.h"
+#include "Logger.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "FaceprintsSync";
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint32_t ManifestMagic = 0x314d5352; // "RSM1"
+static constexpr uint32_t ManifestTrusted = 1;
+static constexpr uint32_t ManifestUnsaved = 2;
+static constexpr uint64_t FnvOffsetBasis = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FnvPrime = 0x100000001b3ULL;
+static constexpr uint64_t UnknownHash = 0; // a device user of unknown content. ContentHash() is never 0
+
+#pragma pack(push, 1)
+struct ManifestHeader
+{
+    uint32_t magic = ManifestMagic;
+    uint32_t count = 0;
+    uint32_t flags = 0; // ManifestTrusted, ManifestUnsaved
+    uint32_t reserved = 0;
+    uint64_t checksum = 0; // of the records
+};
+
+struct ManifestRecord
+{
+    char user_id[RSID_MAX_USER_ID_LENGTH_IN_DB + 1] = {}; // null padded
+    uint64_t hash = 0;
+};
+#pragma pack(pop)
+
+namespace
+{
+// hashes the exported faceprints of each device user, by its index in the user ids
+class HashCallback : public FaceprintsExportCallback
+{
+public:
+    HashCallback(const std::vector<std::string>& user_ids, std::map<std::string, uint64_t>& hashes) : _user_ids(user_ids), _hashes(hashes)
+    {
+    }
+
+    bool OnFaceprints(unsigned int index, const Faceprints& faceprints, const FaceprintsExportStats&) override
+    {
+        if (index >= _user_ids.size())
+        {
+            return false; // a user was added since the ids were read
+        }
+        _hashes[_user_ids[index]] = FaceprintsSyncImpl::ContentHash(_user_ids[index].c_str(), faceprints);
+        return true;
+    }
+
+private:
+    const std::vector<std::string>& _user_ids;
+    std::map<std::string, uint64_t>& _hashes;
+};
+} // namespace
+
+// 64 bit FNV-1a
+static uint64_t Fnv1a(const void* data, size_t size, uint64_t hash = FnvOffsetBasis)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * FnvPrime;
+    }
+    return hash;
+}
+
+// a failure that leaves unknown whether the device handled the request
+static bool IsLinkFailure(Status status)
+{
+    return status == Status::SerialError || status == Status::SecurityError || status == Status::CrcError;
+}
+
+static void SetStatuses(Status* statuses, unsigned int count, Status status)
+{
+    for (unsigned int i = 0; statuses != nullptr && i < count; i++)
+    {
+        statuses[i] = status;
+    }
+}
+
+uint64_t FaceprintsSyncImpl::ContentHash(const char* user_id, const Faceprints& faceprints)
+{
+    // the fields a GetUserFeatures reply returns, so a user hashes the same on the host and as read from the device
+    const auto& data = faceprints.data;
+    auto hash = Fnv1a(user_id, ::strnlen(user_id, RSID_MAX_USER_ID_LENGTH_IN_DB) + 1);
+    hash = Fnv1a(&data.version, sizeof(data.version), hash);
+    hash = Fnv1a(&data.featuresType, sizeof(data.featuresType), hash);
+    hash = Fnv1a(data.adaptiveDescriptorWithoutMask, sizeof(data.adaptiveDescriptorWithoutMask), hash);
+    hash = Fnv1a(data.adaptiveDescriptorWithMask, sizeof(data.adaptiveDescriptorWithMask), hash);
+    hash = Fnv1a(data.enrollmentDescriptor, sizeof(data.enrollmentDescriptor), hash);
+    return hash != UnknownHash ? hash : 1;
+}
+
+Status FaceprintsSyncImpl::QueryUserIds(FaceAuthenticator& authenticator, unsigned int device_users, std::vector<std::string>& user_ids)
+{
+    user_ids.clear();
+    if (device_users == 0)
+    {
+        return Status::Ok;
+    }
+    constexpr size_t id_size = PacketManager::MaxUserIdSize + 1;
+    std::vector<char> buffer(device_users * id_size);
+    std::vector<char*> ids(device_users);
+    for (unsigned int i = 0; i < device_users; i++)
+    {
+        ids[i] = &buffer[i * id_size];
+    }
+    unsigned int count = device_users;
+    auto status = authenticator.QueryUserIds(ids.data(), count);
+    if (status != Status::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed querying the device's user ids (status %d)", static_cast<int>(status));
+        return status;
+    }
+    for (unsigned int i = 0; i < count; i++)
+    {
+        user_ids.emplace_back(ids[i]);
+    }
+    return Status::Ok;
+}
+
+// rebuild the manifest from the device's faceprints
+Status FaceprintsSyncImpl::HashDevice(FaceAuthenticator& authenticator, unsigned int device_users, FaceprintsSyncStats& stats)
+{
+    std::vector<std::string> user_ids;
+    auto status = QueryUserIds(authenticator, device_users, user_ids);
+    if (status != Status::Ok)
+    {
+        return status;
+    }
+
+    Manifest hashes;
+    if (!user_ids.empty())
+    {
+        HashCallback callback(user_ids, hashes);
+        FaceprintsExportStats export_stats;
+        status = authenticator.ExportUsersFaceprints(callback, 0, 8, &export_stats);
+        if (status != Status::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed reading the device's faceprints (status %d)", static_cast<int>(status));
+            return status;
+        }
+        if (export_stats.total_users != user_ids.size() || hashes.size() != user_ids.size())
+        {
+            LOG_ERROR(LOG_TAG, "The device's DB changed while it was read (%zu ids, %u users)", user_ids.size(), export_stats.total_users);
+            return Status::Error;
+        }
+    }
+
+    stats.hashed_users = static_cast<unsigned int>(hashes.size());
+    _manifest = std::move(hashes);
+    _trusted = true;
+    return Status::Ok;
+}
+
+Status FaceprintsSyncImpl::ReadDevice(FaceAuthenticator& authenticator, SyncVerify verify, FaceprintsSyncStats& stats)
+{
+    unsigned int device_users = 0;
+    auto status = authenticator.QueryNumberOfUsers(device_users);
+    if (status != Status::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed querying the device's number of users (status %d)", static_cast<int>(status));
+        return status;
+    }
+    stats.device_users = device_users;
+
+    if (!_trusted || verify == SyncVerify::Faceprints)
+    {
+        return HashDevice(authenticator, device_users, stats);
+    }
+    if (verify == SyncVerify::UserCount && device_users == _manifest.size())
+    {
+        return Status::Ok;
+    }
+
+    std::vector<std::string> user_ids;
+    status = QueryUserIds(authenticator, device_users, user_ids);
+    if (status != Status::Ok)
+    {
+        return status;
+    }
+    // device ids are unique: same count and all known is the same set
+    bool same_ids = user_ids.size() == _manifest.size();
+    for (size_t i = 0; same_ids && i < user_ids.size(); i++)
+    {
+        same_ids = _manifest.count(user_ids[i]) != 0;
+    }
+    if (same_ids)
+    {
+        return Status::Ok;
+    }
+
+    // changed by others since the last sync. users they removed are dropped from the manifest, and users they added are kept with
+    // an unknown hash, so the sync sets or removes them without reading any faceprints
+    LOG_INFO(LOG_TAG, "The device's DB was changed since the last sync (%u users, %zu in the manifest)", device_users, _manifest.size());
+    Manifest device;
+    for (const auto& user_id : user_ids)
+    {
+        auto known = _manifest.find(user_id);
+        device[user_id] = known != _manifest.end() ? known->second : UnknownHash;
+    }
+    _manifest = std::move(device);
+    return Status::Ok;
+}
+
+Status FaceprintsSyncImpl::Sync(FaceAuthenticator& authenticator, const UserFaceprints* users, unsigned int num_of_users, SyncVerify verify,
+                                Status* user_statuses, FaceprintsSyncStats* stats)
+{
+    try
+    {
+        return SyncUsers(authenticator, users, num_of_users, verify, user_statuses, stats);
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+    }
+    // the device's DB is unknown
+    _trusted = false;
+    _unsaved = true;
+    return Status::Error;
+}
+
+Status FaceprintsSyncImpl::SyncUsers(FaceAuthenticator& authenticator, const UserFaceprints* users, unsigned int num_of_users,
+                                     SyncVerify verify, Status* user_statuses, FaceprintsSyncStats* stats)
+{
+    auto start = Clock::now();
+    FaceprintsSyncStats result;
+    auto finish = [&](Status status) {
+        result.seconds = SecondsSince(start);
+        if (stats != nullptr)
+        {
+            *stats = result;
+        }
+        return status;
+    };
+
+    if (users == nullptr && num_of_users > 0)
+    {
+        LOG_ERROR(LOG_TAG, "Sync: got invalid params (nullptr)");
+        return finish(Status::Error);
+    }
+
+    // validate and hash the host's users before touching the device
+    std::vector<uint64_t> host_hashes(num_of_users);
+    std::map<std::string, unsigned int> host_users;
+    for (unsigned int i = 0; i < num_of_users; i++)
+    {
+        auto length = ::strnlen(users[i].user_id, sizeof(users[i].user_id));
+        if (length == 0 || length > PacketManager::MaxUserIdSize)
+        {
+            LOG_ERROR(LOG_TAG, "Sync: invalid user id at index %u", i);
+            SetStatuses(user_statuses, num_of_users, Status::Error);
+            return finish(Status::Error);
+        }
+        std::string user_id(users[i].user_id, length);
+        if (!host_users.emplace(user_id, i).second)
+        {
+            LOG_ERROR(LOG_TAG, "Sync: duplicate user id %s", user_id.c_str());
+            SetStatuses(user_statuses, num_of_users, Status::Error);
+            return finish(Status::Error);
+        }
+        host_hashes[i] = ContentHash(user_id.c_str(), users[i].faceprints);
+    }
+
+    auto status = ReadDevice(authenticator, verify, result);
+    if (status != Status::Ok)
+    {
+        SetStatuses(user_statuses, num_of_users, status);
+        return finish(status);
+    }
+
+    // the difference
+    std::vector<unsigned int> to_set;
+    for (unsigned int i = 0; i < num_of_users; i++)
+    {
+        auto known = _manifest.find(users[i].user_id);
+        if (known == _manifest.end() || known->second != host_hashes[i])
+        {
+            to_set.push_back(i);
+            continue;
+        }
+        result.unchanged_users++;
+        if (user_statuses != nullptr)
+        {
+            user_statuses[i] = Status::Ok;
+        }
+    }
+    std::vector<std::string> to_remove;
+    for (const auto& entry : _manifest)
+    {
+        if (host_users.count(entry.first) == 0)
+        {
+            to_remove.push_back(entry.first);
+        }
+    }
+
+    // removes first, to make room for the added users. a link failure stops the transfers
+    Status first_failure = Status::Ok;
+    bool link_failed = false;
+    for (const auto& user_id : to_remove)
+    {
+        if (link_failed)
+        {
+            result.failed_users++;
+            continue;
+        }
+        auto remove_status = authenticator.RemoveUser(user_id.c_str());
+        if (remove_status == Status::Ok)
+        {
+            _manifest.erase(user_id);
+            result.removed_users++;
+            continue;
+        }
+        LOG_ERROR(LOG_TAG, "Sync: failed removing user %s (status %d)", user_id.c_str(), static_cast<int>(remove_status));
+        result.failed_users++;
+        if (first_failure == Status::Ok)
+        {
+            first_failure = remove_status;
+        }
+        link_failed = IsLinkFailure(remove_status);
+    }
+
+    if (!to_set.empty() && link_failed)
+    {
+        result.failed_users += static_cast<unsigned int>(to_set.size());
+        for (size_t j = 0; user_statuses != nullptr && j < to_set.size(); j++)
+        {
+            user_statuses[to_set[j]] = first_failure;
+        }
+    }
+    else if (!to_set.empty())
+    {
+        std::vector<UserFaceprints> batch(to_set.size());
+        for (size_t j = 0; j < to_set.size(); j++)
+        {
+            batch[j] = users[to_set[j]];
+        }
+        std::vector<Status> batch_statuses(batch.size(), Status::Error);
+        auto import_status =
+            authenticator.ImportUsersFaceprints(batch.data(), static_cast<unsigned int>(batch.size()), batch_statuses.data());
+
+        for (size_t j = 0; j < to_set.size(); j++)
+        {
+            auto i = to_set[j];
+            auto user_status = batch_statuses[j];
+            if (user_statuses != nullptr)
+            {
+                user_statuses[i] = user_status;
+            }
+            if (user_status != Status::Ok)
+            {
+                // a rejected user is left as it was on the device. one that wasn't acknowledged might have been set
+                result.failed_users++;
+                _trusted = _trusted && !IsLinkFailure(user_status);
+                continue;
+            }
+            if (_manifest.count(batch[j].user_id) == 0)
+            {
+                result.added_users++;
+            }
+            else
+            {
+                result.changed_users++;
+            }
+            _manifest[batch[j].user_id] = host_hashes[i];
+        }
+        if (first_failure == Status::Ok)
+        {
+            first_failure = import_status;
+        }
+        link_failed = IsLinkFailure(import_status);
+    }
+
+    // commit once. after a link failure the device's DB is unknown: the next sync rebuilds the manifest, and saves
+    bool transferred = result.removed_users + result.added_users + result.changed_users + result.failed_users > 0;
+    if (link_failed)
+    {
+        _trusted = false;
+        _unsaved = _unsaved || transferred;
+    }
+    else if (_unsaved || result.removed_users + result.added_users + result.changed_users > 0)
+    {
+        auto save_status = authenticator.SaveDatabase();
+        if (save_status == Status::Ok)
+        {
+            result.saved = true;
+            _unsaved = false;
+        }
+        else
+        {
+            // the changes are in the device's live DB only, and would be lost on reboot
+            LOG_ERROR(LOG_TAG, "Sync: failed saving the device's DB (status %d)", static_cast<int>(save_status));
+            _trusted = false;
+            _unsaved = true;
+            if (first_failure == Status::Ok)
+            {
+                first_failure = save_status;
+            }
+        }
+    }
+
+    LOG_INFO(LOG_TAG, "Sync: %u added, %u changed, %u removed, %u unchanged, %u failed, %u device users hashed", result.added_users,
+             result.changed_users, result.removed_users, result.unchanged_users, result.failed_users, result.hashed_users);
+    return finish(first_failure);
+}
+
+Status FaceprintsSyncImpl::LoadManifest(const char* path)
+{
+    ResetManifest();
+    try
+    {
+        return ReadManifest(path);
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+    }
+    ResetManifest();
+    return Status::Error;
+}
+
+Status FaceprintsSyncImpl::ReadManifest(const char* path)
+{
+    std::FILE* file = path != nullptr ? std::fopen(path, "rb") : nullptr;
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed opening %s", path != nullptr ? path : "(null)");
+        return Status::Error;
+    }
+
+    // the header's count must match the file size before the records are allocated
+    const long file_bytes = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+    ManifestHeader header;
+    bool ok = file_bytes >= 0 && std::fseek(file, 0, SEEK_SET) == 0 && std::fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == ManifestMagic &&
+              static_cast<uint64_t>(file_bytes) == sizeof(header) + static_cast<uint64_t>(header.count) * sizeof(ManifestRecord);
+    std::vector<ManifestRecord> records;
+    try
+    {
+        records.resize(ok ? header.count : 0);
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        throw;
+    }
+    ok = ok && (records.empty() || std::fread(records.data(), sizeof(ManifestRecord), records.size(), file) == records.size());
+    std::fclose(file);
+    ok = ok && Fnv1a(records.data(), records.size() * sizeof(ManifestRecord)) == header.checksum;
+
+    Manifest manifest;
+    for (size_t i = 0; ok && i < records.size(); i++)
+    {
+        auto length = ::strnlen(records[i].user_id, sizeof(records[i].user_id));
+        ok = length > 0 && length <= PacketManager::MaxUserIdSize && manifest.emplace(records[i].user_id, records[i].hash).second;
+    }
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid manifest %s", path);
+        return Status::Error;
+    }
+
+    _manifest = std::move(manifest);
+    _trusted = (header.flags & ManifestTrusted) != 0;
+    _unsaved = (header.flags & ManifestUnsaved) != 0;
+    return Status::Ok;
+}
+
+Status FaceprintsSyncImpl::SaveManifest(const char* path) const
+{
+    if (path == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "SaveManifest: got invalid params (nullptr)");
+        return Status::Error;
+    }
+
+    std::vector<ManifestRecord> records(_manifest.size());
+    size_t i = 0;
+    for (const auto& entry : _manifest)
+    {
+        ::strncpy(records[i].user_id, entry.first.c_str(), sizeof(records[i].user_id) - 1);
+        records[i++].hash = entry.second;
+    }
+    ManifestHeader header;
+    header.count = static_cast<uint32_t>(records.size());
+    header.flags = (_trusted ? ManifestTrusted : 0) | (_unsaved ? ManifestUnsaved : 0);
+    header.checksum = Fnv1a(records.data(), records.size() * sizeof(ManifestRecord));
+
+    // write a temporary file and rename it over the manifest, so a crash leaves the old or the new manifest
+    std::string tmp_path = std::string(path) + ".tmp";
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    bool ok = file != nullptr && std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && (records.empty() || std::fwrite(records.data(), sizeof(ManifestRecord), records.size(), file) == records.size());
+    ok = ok && SyncFile(file);
+    if (file != nullptr)
+    {
+        ok = std::fclose(file) == 0 && ok;
+    }
+    if (!ok || !RenameReplacing(tmp_path.c_str(), path))
+    {
+        LOG_ERROR(LOG_TAG, "Failed writing %s", path);
+        return Status::Error;
+    }
+    return Status::Ok;
+}
+
+void FaceprintsSyncImpl::ResetManifest()
+{
+    _manifest.clear();
+    _trusted = false;
+    _unsaved = false;
+}
+
+unsigned int FaceprintsSyncImpl::ManifestSize() const
+{
+    return static_cast<unsigned int>(_manifest.size());
+}
+} // namespace RealSenseID
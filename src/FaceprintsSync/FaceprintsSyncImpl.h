@@ -0,0 +1,48 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/FaceprintsSync.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class FaceprintsSyncImpl
+{
+public:
+    FaceprintsSyncImpl() = default;
+    ~FaceprintsSyncImpl() = default;
+
+    FaceprintsSyncImpl(const FaceprintsSyncImpl&) = delete;
+    FaceprintsSyncImpl& operator=(const FaceprintsSyncImpl&) = delete;
+
+    Status Sync(FaceAuthenticator& authenticator, const UserFaceprints* users, unsigned int num_of_users, SyncVerify verify,
+                Status* user_statuses, FaceprintsSyncStats* stats);
+    Status LoadManifest(const char* path);
+    Status SaveManifest(const char* path) const;
+    void ResetManifest();
+    unsigned int ManifestSize() const;
+
+    static uint64_t ContentHash(const char* user_id, const Faceprints& faceprints);
+
+private:
+    // user id -> content hash
+    using Manifest = std::map<std::string, uint64_t>;
+
+    Status SyncUsers(FaceAuthenticator& authenticator, const UserFaceprints* users, unsigned int num_of_users, SyncVerify verify,
+                     Status* user_statuses, FaceprintsSyncStats* stats);
+    // the device's users: from the manifest if it passes the verify check, otherwise read and hashed
+    Status ReadDevice(FaceAuthenticator& authenticator, SyncVerify verify, FaceprintsSyncStats& stats);
+    Status HashDevice(FaceAuthenticator& authenticator, unsigned int device_users, FaceprintsSyncStats& stats);
+    Status QueryUserIds(FaceAuthenticator& authenticator, unsigned int device_users, std::vector<std::string>& user_ids);
+    Status ReadManifest(const char* path);
+
+    Manifest _manifest;
+    bool _trusted = false; // the manifest describes the device's DB. false until the first read, and after uncertain failures
+    bool _unsaved = false; // a failed sync may have left changes in the device's live DB only: the next sync saves
+};
+} // namespace RealSenseID
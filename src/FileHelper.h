@@ -0,0 +1,21 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+namespace RealSenseID
+{
+// seconds elapsed since start (e.g. for throughput stats).
+double SecondsSince(std::chrono::steady_clock::time_point start);
+
+// flush the file's buffers, and the OS cache of the file, to the storage device.
+bool SyncFile(std::FILE* file);
+
+// rename from to to, replacing an existing file (std::rename fails on windows if the target exists). the rename is
+// synced to the storage device, so a tmp file written, synced and renamed over the target survives a crash as either the
+// old or the new file.
+bool RenameReplacing(const char* from, const char* to);
+} // namespace RealSenseID
@@ -0,0 +1,127 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace RealSenseID
+{
+// growable heap buffer of trivially copyable elements, aligned to a cache line (which is also the widest simd load).
+// with huge pages set, later allocations are aligned to HugePageSize and (on Linux) advised for transparent huge pages,
+// which saves tlb misses when a large buffer is scanned end to end.
+template <typename T>
+class AlignedBuffer
+{
+    static_assert(std::is_trivially_copyable<T>::value, "AlignedBuffer supports trivially copyable types only");
+
+public:
+    static constexpr size_t Alignment = 64;
+    static constexpr size_t HugePageSize = 2u << 20;
+
+    AlignedBuffer() = default;
+
+    ~AlignedBuffer()
+    {
+        std::free(_raw);
+    }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+    {
+        Swap(other);
+    }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            AlignedBuffer tmp;
+            Swap(tmp);
+            Swap(other);
+        }
+        return *this;
+    }
+
+    // grow to at least count elements, keeping the current content. throws std::bad_alloc on failure.
+    void Reserve(size_t count)
+    {
+        if (count <= _capacity)
+        {
+            return;
+        }
+        const size_t alignment = _huge_pages ? HugePageSize : Alignment;
+        void* raw = std::malloc(count * sizeof(T) + alignment);
+        if (raw == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        auto addr = reinterpret_cast<uintptr_t>(raw);
+        T* data = reinterpret_cast<T*>((addr + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (_huge_pages)
+        {
+            ::madvise(data, count * sizeof(T), MADV_HUGEPAGE);
+        }
+#endif
+        if (_data != nullptr)
+        {
+            ::memcpy(data, _data, _capacity * sizeof(T));
+        }
+        std::free(_raw);
+        _raw = raw;
+        _data = data;
+        _capacity = count;
+    }
+
+    void SetHugePages(bool huge_pages)
+    {
+        _huge_pages = huge_pages;
+    }
+
+    bool HugePages() const
+    {
+        return _huge_pages;
+    }
+
+    void Swap(AlignedBuffer& other) noexcept
+    {
+        std::swap(_huge_pages, other._huge_pages);
+        std::swap(_raw, other._raw);
+        std::swap(_data, other._data);
+        std::swap(_capacity, other._capacity);
+    }
+
+    T* Data()
+    {
+        return _data;
+    }
+
+    const T* Data() const
+    {
+        return _data;
+    }
+
+    size_t Capacity() const
+    {
+        return _capacity;
+    }
+
+private:
+    void* _raw = nullptr;
+    T* _data = nullptr;
+    size_t _capacity = 0;
+    bool _huge_pages = false;
+};
+} // namespace RealSenseID
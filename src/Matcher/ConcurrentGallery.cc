@@ -0,0 +1,321 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "ConcurrentGallery.h"
+#include "Matcher.h"
+#include "Logger.h"
+#include <functional>
+#include <limits>
+#include <thread>
+#include <utility>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "ConcurrentGallery";
+
+// Reclamation works on a global epoch, advanced by every published change:
+//  * a reader announces the current epoch in a free reader slot, then loads the table.
+//  * a writer publishes the new table, then advances the epoch and retires the old table at the epoch it replaced.
+//  * a retired table is freed when every announced epoch is newer than its retire epoch.
+// A reader that loaded the old table announced an epoch no newer than its retire epoch, so the table is kept.
+// A reader whose announcement came after the writer's check loads the new table. All atomics here are sequentially
+// consistent, which this argument relies on.
+
+ConcurrentGallery::ConcurrentGallery()
+{
+    _table.store(new Table());
+}
+
+ConcurrentGallery::~ConcurrentGallery()
+{
+    // no snapshot may be held anymore.
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    const Table* table = _table.load();
+    for (const Entry* entry : table->entries)
+    {
+        delete entry;
+    }
+    delete table;
+    for (const auto& retired : _retired)
+    {
+        for (const Entry* entry : retired.entries)
+        {
+            delete entry;
+        }
+        delete retired.table;
+    }
+}
+
+GallerySnapshot ConcurrentGallery::Acquire() const
+{
+    // claim a free reader slot, starting at a per thread position so threads rarely compete for a slot.
+    static thread_local size_t s_first_slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % MaxReaders;
+
+    GallerySnapshot snapshot;
+    for (size_t attempt = 0;; attempt++)
+    {
+        size_t slot = (s_first_slot + attempt) % MaxReaders;
+        uint64_t free_epoch = 0;
+        if (_readers[slot].epoch.compare_exchange_strong(free_epoch, _epoch.load()))
+        {
+            s_first_slot = slot;
+            snapshot._gallery = this;
+            snapshot._reader = &_readers[slot].epoch;
+            snapshot._table = _table.load();
+            return snapshot;
+        }
+
+        if ((attempt + 1) % MaxReaders == 0)
+        {
+            // all slots are taken
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ConcurrentGallery::ReleaseReader(std::atomic<uint64_t>* reader) const
+{
+    reader->store(0);
+}
+
+bool ConcurrentGallery::CheckNewFaceprints(const Table& table, const Entry* replaced, const Faceprints& faceprints) const
+{
+    if (!Matcher::ValidateFaceprints(faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Invalid faceprints vector range");
+        return false;
+    }
+
+    bool is_only_entry = table.entries.empty() || (table.entries.size() == 1 && replaced != nullptr);
+    if (!is_only_entry && faceprints.data.version != table.version)
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+    return true;
+}
+
+bool ConcurrentGallery::Set(const char* user_id, const Faceprints& faceprints)
+{
+    if (user_id == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Null user id");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    const Table& current = *_table.load();
+    auto it = _index.find(user_id);
+    const Entry* replaced = (it != _index.end()) ? current.entries[it->second] : nullptr;
+    if (!CheckNewFaceprints(current, replaced, faceprints))
+    {
+        return false;
+    }
+
+    Entry* entry = new Entry {user_id, faceprints};
+    Table* table = new Table(current);
+    table->version = faceprints.data.version;
+    std::vector<const Entry*> retired_entries;
+    if (replaced != nullptr)
+    {
+        table->entries[it->second] = entry;
+        table->faceprints[it->second] = &entry->faceprints;
+        retired_entries.push_back(replaced);
+    }
+    else
+    {
+        _index[entry->user_id] = table->entries.size();
+        table->entries.push_back(entry);
+        table->faceprints.push_back(&entry->faceprints);
+    }
+    Publish(table, std::move(retired_entries));
+    return true;
+}
+
+bool ConcurrentGallery::Update(const GallerySnapshot& snapshot, size_t index, const Faceprints& updated_faceprints)
+{
+    if (snapshot._gallery != this || index >= snapshot.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Snapshot index not in this gallery");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    const Entry* matched = snapshot._table->entries[index];
+    const Table& current = *_table.load();
+
+    // the matched entry is still current only if its user maps to it. retired entries are never reused while the
+    // snapshot is held, so comparing pointers is enough.
+    auto it = _index.find(matched->user_id);
+    if (it == _index.end() || current.entries[it->second] != matched)
+    {
+        LOG_DEBUG(LOG_TAG, "Skipping update of a user changed since the snapshot");
+        return false;
+    }
+
+    if (!CheckNewFaceprints(current, matched, updated_faceprints))
+    {
+        return false;
+    }
+
+    Entry* entry = new Entry {matched->user_id, updated_faceprints};
+    Table* table = new Table(current);
+    table->version = updated_faceprints.data.version;
+    table->entries[it->second] = entry;
+    table->faceprints[it->second] = &entry->faceprints;
+    Publish(table, {matched});
+    return true;
+}
+
+bool ConcurrentGallery::Remove(const char* user_id)
+{
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    auto it = (user_id != nullptr) ? _index.find(user_id) : _index.end();
+    if (it == _index.end())
+    {
+        return false;
+    }
+
+    // swap with last, so removal doesn't shift the table
+    size_t index = it->second;
+    Table* table = new Table(*_table.load());
+    const Entry* removed = table->entries[index];
+    _index.erase(it);
+    if (index + 1 != table->entries.size())
+    {
+        table->entries[index] = table->entries.back();
+        table->faceprints[index] = table->faceprints.back();
+        _index[table->entries[index]->user_id] = index;
+    }
+    table->entries.pop_back();
+    table->faceprints.pop_back();
+    Publish(table, {removed});
+    return true;
+}
+
+void ConcurrentGallery::Clear()
+{
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    const Table& current = *_table.load();
+    std::vector<const Entry*> retired_entries = current.entries;
+    _index.clear();
+    Publish(new Table(), std::move(retired_entries));
+}
+
+size_t ConcurrentGallery::Size() const
+{
+    return _table.load()->entries.size();
+}
+
+void ConcurrentGallery::Publish(Table* table, std::vector<const Entry*> retired_entries)
+{
+    const Table* old_table = _table.exchange(table);
+    uint64_t retire_epoch = _epoch.fetch_add(1);
+    _retired.push_back({retire_epoch, old_table, std::move(retired_entries)});
+    ReclaimLocked();
+}
+
+void ConcurrentGallery::Reclaim()
+{
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    ReclaimLocked();
+}
+
+void ConcurrentGallery::ReclaimLocked()
+{
+    uint64_t oldest_reader = std::numeric_limits<uint64_t>::max();
+    for (const auto& reader : _readers)
+    {
+        uint64_t epoch = reader.epoch.load();
+        if (epoch != 0 && epoch < oldest_reader)
+        {
+            oldest_reader = epoch;
+        }
+    }
+
+    // retired in epoch order, so the reclaimable ones are a prefix.
+    size_t num_reclaimed = 0;
+    while (num_reclaimed < _retired.size() && _retired[num_reclaimed].epoch < oldest_reader)
+    {
+        for (const Entry* entry : _retired[num_reclaimed].entries)
+        {
+            delete entry;
+        }
+        delete _retired[num_reclaimed].table;
+        num_reclaimed++;
+    }
+    _retired.erase(_retired.begin(), _retired.begin() + static_cast<std::ptrdiff_t>(num_reclaimed));
+}
+
+size_t ConcurrentGallery::NumRetired() const
+{
+    std::lock_guard<std::mutex> lock(_write_mutex);
+    return _retired.size();
+}
+
+GallerySnapshot::~GallerySnapshot()
+{
+    Release();
+}
+
+GallerySnapshot::GallerySnapshot(GallerySnapshot&& other) noexcept :
+    _gallery(other._gallery), _reader(other._reader), _table(other._table)
+{
+    other._gallery = nullptr;
+    other._reader = nullptr;
+    other._table = nullptr;
+}
+
+GallerySnapshot& GallerySnapshot::operator=(GallerySnapshot&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        std::swap(_gallery, other._gallery);
+        std::swap(_reader, other._reader);
+        std::swap(_table, other._table);
+    }
+    return *this;
+}
+
+void GallerySnapshot::Release()
+{
+    if (_reader != nullptr)
+    {
+        _gallery->ReleaseReader(_reader);
+    }
+    _gallery = nullptr;
+    _reader = nullptr;
+    _table = nullptr;
+}
+
+size_t GallerySnapshot::Size() const
+{
+    return (_table != nullptr) ? _table->entries.size() : 0;
+}
+
+bool GallerySnapshot::Empty() const
+{
+    return Size() == 0;
+}
+
+const char* GallerySnapshot::GetUserId(size_t index) const
+{
+    return _table->entries[index]->user_id.c_str();
+}
+
+const Faceprints& GallerySnapshot::GetFaceprints(size_t index) const
+{
+    return *_table->faceprints[index];
+}
+
+const Faceprints* const* GallerySnapshot::AllFaceprints() const
+{
+    return (_table != nullptr) ? _table->faceprints.data() : nullptr;
+}
+
+int GallerySnapshot::GetVersion() const
+{
+    return (_table != nullptr) ? _table->version : RSID_FACEPRINTS_VERSION;
+}
+} // namespace RealSenseID
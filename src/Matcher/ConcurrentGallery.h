@@ -0,0 +1,149 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class GallerySnapshot;
+
+// Gallery for concurrent 1:N matching and adaptive updates (see Matcher::MatchFaceprintsToArray()).
+//
+// Readers take a snapshot (Acquire()) and match against it without locks: a snapshot is an immutable table of
+// immutable entries, so it stays consistent while writers change the gallery.
+// Writers are serialized with each other but never wait for readers: a change copies the changed entry and the table of
+// entry pointers (16 bytes per user, not the faceprints), publishes the new table, and retires the old table and entry.
+// Retired data is freed once every snapshot that could see it was released (epoch based reclamation).
+//
+// Typical use:
+//      auto snapshot = gallery.Acquire();
+//      auto result = Matcher::MatchFaceprintsToArray(probe, snapshot, updated_faceprints);
+//      if (result.should_update)
+//          gallery.Update(snapshot, result.userId, updated_faceprints);
+//
+// Snapshots must be released before the gallery is destroyed.
+class ConcurrentGallery
+{
+public:
+    // snapshots that can be held at the same time. Acquire() yields until a reader slot is free beyond that.
+    static constexpr size_t MaxReaders = 256;
+
+    ConcurrentGallery();
+    ~ConcurrentGallery();
+
+    ConcurrentGallery(const ConcurrentGallery&) = delete;
+    ConcurrentGallery& operator=(const ConcurrentGallery&) = delete;
+
+    // current state of the gallery. lock free.
+    GallerySnapshot Acquire() const;
+
+    // insert a new user, or replace the faceprints of an existing user.
+    // returns false if the faceprints failed validation or their version differs from the gallery's.
+    bool Set(const char* user_id, const Faceprints& faceprints);
+
+    // write back an adaptive update of snapshot entry index (result.userId of the snapshot match).
+    // returns false if that user was changed or removed since the snapshot was taken (e.g. a concurrent update of the
+    // same user got there first), so a stale update never overwrites a newer one.
+    bool Update(const GallerySnapshot& snapshot, size_t index, const Faceprints& updated_faceprints);
+
+    // returns false if user was not found. the last entry moves to the removed index in later snapshots.
+    bool Remove(const char* user_id);
+
+    void Clear();
+
+    size_t Size() const;
+
+    // free retired tables and entries no snapshot can see anymore. writers also do this on every change.
+    void Reclaim();
+
+    // retired tables waiting for snapshots to be released.
+    size_t NumRetired() const;
+
+private:
+    friend class GallerySnapshot;
+
+    struct Entry
+    {
+        std::string user_id;
+        Faceprints faceprints;
+    };
+
+    struct Table
+    {
+        std::vector<const Entry*> entries;
+        std::vector<const Faceprints*> faceprints; // faceprints of entries[i], scanned by the matcher
+        int version = RSID_FACEPRINTS_VERSION;
+    };
+
+    struct Retired
+    {
+        uint64_t epoch;
+        const Table* table;
+        std::vector<const Entry*> entries;
+    };
+
+    // epoch announced by a snapshot holder, 0 if free. one cache line each, so readers don't share lines.
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<uint64_t> epoch {0};
+    };
+
+    // the following must be called with _write_mutex held.
+    bool CheckNewFaceprints(const Table& table, const Entry* replaced, const Faceprints& faceprints) const;
+    void Publish(Table* table, std::vector<const Entry*> retired_entries);
+    void ReclaimLocked();
+
+    void ReleaseReader(std::atomic<uint64_t>* reader) const;
+
+    std::atomic<const Table*> _table {nullptr};
+    mutable std::atomic<uint64_t> _epoch {1};
+    mutable ReaderSlot _readers[MaxReaders];
+
+    mutable std::mutex _write_mutex;
+    std::unordered_map<std::string, size_t> _index; // user id -> index in the current table
+    std::vector<Retired> _retired;
+};
+
+// Read view of a ConcurrentGallery (see ConcurrentGallery::Acquire()).
+// Entries and user ids stay valid and unchanged until the snapshot is released (destroyed, moved from, or Release()).
+class GallerySnapshot
+{
+public:
+    GallerySnapshot() = default;
+    ~GallerySnapshot();
+
+    GallerySnapshot(GallerySnapshot&& other) noexcept;
+    GallerySnapshot& operator=(GallerySnapshot&& other) noexcept;
+    GallerySnapshot(const GallerySnapshot&) = delete;
+    GallerySnapshot& operator=(const GallerySnapshot&) = delete;
+
+    void Release();
+
+    size_t Size() const;
+    bool Empty() const;
+
+    const char* GetUserId(size_t index) const;
+    const Faceprints& GetFaceprints(size_t index) const;
+
+    // faceprints of all entries (index i at [i]).
+    const Faceprints* const* AllFaceprints() const;
+
+    // faceprints version shared by all entries.
+    int GetVersion() const;
+
+private:
+    friend class ConcurrentGallery;
+
+    const ConcurrentGallery* _gallery = nullptr;
+    std::atomic<uint64_t>* _reader = nullptr;
+    const ConcurrentGallery::Table* _table = nullptr;
+};
+} // namespace RealSenseID
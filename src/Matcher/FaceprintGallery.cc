@@ -0,0 +1,233 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "FaceprintGallery.h"
+#include "Matcher.h"
+#include "MatcherKernels.h"
+#include "Logger.h"
+#include <cstring>
+#include <algorithm>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "FaceprintGallery";
+
+static_assert((FaceprintGallery::RowLength * sizeof(feature_t)) % AlignedBuffer<feature_t>::Alignment == 0,
+              "gallery rows must keep the 64-byte alignment");
+static_assert(FaceprintGallery::RowLength % 64 == 0, "sign sketch must fill whole 64-bit words");
+
+bool FaceprintGallery::Set(const char* user_id, const Faceprints& faceprints)
+{
+    if (user_id == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Null user id");
+        return false;
+    }
+
+    if (!Matcher::ValidateFaceprints(faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Invalid faceprints vector range");
+        return false;
+    }
+
+    auto it = _slots.find(user_id);
+    bool is_only_entry = Empty() || (Size() == 1 && it != _slots.end());
+    if (!is_only_entry && faceprints.data.version != _version)
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+    _version = faceprints.data.version;
+
+    if (it != _slots.end())
+    {
+        WriteSlot(it->second, faceprints);
+        return true;
+    }
+
+    size_t slot = Size();
+    Reserve(slot + 1);
+    _faceprints.emplace_back();
+    _user_ids.emplace_back(user_id);
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set].push_back(0);
+        _norm_msbs[row_set].push_back(0);
+        _sketches[row_set].resize(_sketches[row_set].size() + SketchWords);
+    }
+    WriteSlot(slot, faceprints);
+    _slots[_user_ids.back()] = slot;
+    return true;
+}
+
+bool FaceprintGallery::Remove(const char* user_id)
+{
+    auto it = (user_id != nullptr) ? _slots.find(user_id) : _slots.end();
+    if (it == _slots.end())
+    {
+        return false;
+    }
+
+    // swap with last, so removal is O(1)
+    size_t slot = it->second;
+    size_t last = Size() - 1;
+    _slots.erase(it);
+    if (slot != last)
+    {
+        MoveSlot(last, slot);
+        _slots[_user_ids[slot]] = slot;
+    }
+
+    _faceprints.pop_back();
+    _user_ids.pop_back();
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set].pop_back();
+        _norm_msbs[row_set].pop_back();
+        _sketches[row_set].resize(_sketches[row_set].size() - SketchWords);
+    }
+    return true;
+}
+
+void FaceprintGallery::Clear()
+{
+    _faceprints.clear();
+    _user_ids.clear();
+    _slots.clear();
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set].clear();
+        _norm_msbs[row_set].clear();
+        _sketches[row_set].clear();
+    }
+}
+
+void FaceprintGallery::Reserve(size_t count)
+{
+    size_t capacity = _descriptors[0].Capacity() / RowLength;
+    if (count <= capacity)
+    {
+        return;
+    }
+    capacity = std::max(count, capacity * 2);
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _descriptors[row_set].Reserve(capacity * RowLength);
+        _norms[row_set].reserve(capacity);
+        _norm_msbs[row_set].reserve(capacity);
+        _sketches[row_set].reserve(capacity * SketchWords);
+    }
+    _faceprints.reserve(capacity);
+    _user_ids.reserve(capacity);
+}
+
+void FaceprintGallery::SetHugePages(bool huge_pages)
+{
+    for (auto& descriptors : _descriptors)
+    {
+        descriptors.SetHugePages(huge_pages);
+    }
+}
+
+size_t FaceprintGallery::Size() const
+{
+    return _faceprints.size();
+}
+
+bool FaceprintGallery::Empty() const
+{
+    return _faceprints.empty();
+}
+
+int FaceprintGallery::Find(const char* user_id) const
+{
+    auto it = (user_id != nullptr) ? _slots.find(user_id) : _slots.end();
+    return (it != _slots.end()) ? static_cast<int>(it->second) : -1;
+}
+
+const char* FaceprintGallery::GetUserId(size_t slot) const
+{
+    return _user_ids[slot].c_str();
+}
+
+const Faceprints& FaceprintGallery::GetFaceprints(size_t slot) const
+{
+    return _faceprints[slot];
+}
+
+int FaceprintGallery::GetVersion() const
+{
+    return _version;
+}
+
+const feature_t* FaceprintGallery::Descriptors(bool probe_has_mask) const
+{
+    return _descriptors[probe_has_mask ? 1 : 0].Data();
+}
+
+const uint32_t* FaceprintGallery::Norms(bool probe_has_mask) const
+{
+    return _norms[probe_has_mask ? 1 : 0].data();
+}
+
+const short* FaceprintGallery::NormMsbs(bool probe_has_mask) const
+{
+    return _norm_msbs[probe_has_mask ? 1 : 0].data();
+}
+
+const uint64_t* FaceprintGallery::Sketches(bool probe_has_mask) const
+{
+    return _sketches[probe_has_mask ? 1 : 0].data();
+}
+
+void FaceprintGallery::ComputeSketch(const feature_t* descriptor, uint64_t* sketch)
+{
+    for (size_t word = 0; word < SketchWords; word++)
+    {
+        uint64_t bits = 0;
+        for (size_t bit = 0; bit < 64; bit++)
+        {
+            bits |= static_cast<uint64_t>(descriptor[word * 64 + bit] >= 0) << bit;
+        }
+        sketch[word] = bits;
+    }
+}
+
+void FaceprintGallery::WriteSlot(size_t slot, const Faceprints& faceprints)
+{
+    _faceprints[slot] = faceprints;
+
+    const auto& data = faceprints.data;
+    feature_t vec_flags = data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool mask_is_valid = (vec_flags == FaVectorFlagsEnum::VecFlagValidWithMask);
+    WriteRow(0, slot, &data.adaptiveDescriptorWithoutMask[0]);
+    WriteRow(1, slot, mask_is_valid ? &data.adaptiveDescriptorWithMask[0] : &data.adaptiveDescriptorWithoutMask[0]);
+}
+
+void FaceprintGallery::WriteRow(int row_set, size_t slot, const feature_t* descriptor)
+{
+    feature_t* row = _descriptors[row_set].Data() + slot * RowLength;
+    ::memcpy(row, descriptor, RowLength * sizeof(feature_t));
+
+    // same norm handling as MatchTwoVectors() : protect division by 0.
+    uint32_t norm = static_cast<uint32_t>(MatcherKernels::Active().dot(row, row, static_cast<uint32_t>(RowLength)));
+    norm = (norm == 0) ? 1 : norm;
+    _norms[row_set][slot] = norm;
+    _norm_msbs[row_set][slot] = Matcher::GetMsb(norm);
+    ComputeSketch(row, &_sketches[row_set][slot * SketchWords]);
+}
+
+void FaceprintGallery::MoveSlot(size_t from, size_t to)
+{
+    _faceprints[to] = _faceprints[from];
+    _user_ids[to] = std::move(_user_ids[from]);
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        ::memcpy(_descriptors[row_set].Data() + to * RowLength, _descriptors[row_set].Data() + from * RowLength,
+                 RowLength * sizeof(feature_t));
+        _norms[row_set][to] = _norms[row_set][from];
+        _norm_msbs[row_set][to] = _norm_msbs[row_set][from];
+        ::memcpy(&_sketches[row_set][to * SketchWords], &_sketches[row_set][from * SketchWords], SketchWords * sizeof(uint64_t));
+    }
+}
+} // namespace RealSenseID
@@ -0,0 +1,89 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "AlignedBuffer.h"
+#include "RealSenseID/Faceprints.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// Host side gallery for 1:N matching (see Matcher::MatchFaceprintsToArray()).
+//
+// Keeps the data scanned per probe in structure-of-arrays layout:
+//  * the active descriptor of each user, for probes without and with mask, in contiguous 64-byte aligned rows.
+//    (the with-mask row holds the adaptive with-mask vector if valid, otherwise the no-mask one - same as GetScores()).
+//  * the squared norm and its msb of each row, computed once at Set() time.
+//  * a 512-bit sign sketch of each row (bit i set if feature i >= 0), for the hamming prefilter (see
+//    Matcher::MatchFaceprintsToArrayPrefiltered()).
+// The full Faceprints (needed for adaptive updates) and the user ids are kept aside and not touched by the scan.
+//
+// Faceprints are validated once when set, and all entries share a single faceprints version.
+// Removal moves the last entry into the removed slot, so slots are stable only until the next Remove().
+// Not thread safe.
+class FaceprintGallery
+{
+public:
+    static constexpr size_t RowLength = RSID_NUM_OF_RECOGNITION_FEATURES;
+    static constexpr size_t SketchWords = RowLength / 64;
+
+    FaceprintGallery() = default;
+    FaceprintGallery(const FaceprintGallery&) = delete;
+    FaceprintGallery& operator=(const FaceprintGallery&) = delete;
+
+    // insert a new user, or replace the faceprints of an existing user (e.g. after adaptive update).
+    // returns false if the faceprints failed validation or their version differs from the gallery's.
+    bool Set(const char* user_id, const Faceprints& faceprints);
+
+    // returns false if user was not found.
+    bool Remove(const char* user_id);
+
+    void Clear();
+    void Reserve(size_t count);
+
+    // allocate the descriptor rows on huge pages (see AlignedBuffer) from the next growth on.
+    void SetHugePages(bool huge_pages);
+
+    size_t Size() const;
+    bool Empty() const;
+
+    // slot of the given user, or -1 if not found.
+    int Find(const char* user_id) const;
+
+    const char* GetUserId(size_t slot) const;
+    const Faceprints& GetFaceprints(size_t slot) const;
+
+    // faceprints version shared by all entries.
+    int GetVersion() const;
+
+    // first row of the descriptors used against a probe with/without mask. row i starts at i * RowLength.
+    const feature_t* Descriptors(bool probe_has_mask) const;
+    const uint32_t* Norms(bool probe_has_mask) const;
+    const short* NormMsbs(bool probe_has_mask) const;
+    // sketch of row i starts at i * SketchWords.
+    const uint64_t* Sketches(bool probe_has_mask) const;
+
+    // sign sketch of a descriptor of RowLength features into SketchWords words.
+    static void ComputeSketch(const feature_t* descriptor, uint64_t* sketch);
+
+private:
+    void WriteSlot(size_t slot, const Faceprints& faceprints);
+    void WriteRow(int row_set, size_t slot, const feature_t* descriptor);
+    void MoveSlot(size_t from, size_t to);
+
+    // row sets, indexed by probe_has_mask.
+    AlignedBuffer<feature_t> _descriptors[2];
+    std::vector<uint32_t> _norms[2];
+    std::vector<short> _norm_msbs[2];
+    std::vector<uint64_t> _sketches[2];
+
+    std::vector<Faceprints> _faceprints;
+    std::vector<std::string> _user_ids;
+    std::unordered_map<std::string, size_t> _slots;
+    int _version = RSID_FACEPRINTS_VERSION;
+};
+} // namespace RealSenseID
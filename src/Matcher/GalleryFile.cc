@@ -0,0 +1,406 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "GalleryFile.h"
+#include "FaceprintGallery.h"
+#include "FileHelper.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/types.h>
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "GalleryFile";
+
+using Clock = std::chrono::steady_clock;
+
+static_assert(sizeof(GalleryFile::Record) == GalleryFile::UserIdSize + sizeof(DBFaceprintsElement), "packed record");
+
+static bool SeekTo(std::FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t FileBytesOf(std::FILE* file)
+{
+#ifdef _WIN32
+    if (_fseeki64(file, 0, SEEK_END) != 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(_ftelli64(file));
+#else
+    if (fseeko(file, 0, SEEK_END) != 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+// page cache hints, Linux only.
+static void AdviseSequential(std::FILE* file)
+{
+#if defined(__linux__)
+    ::posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)file;
+#endif
+}
+
+static void DropPages(std::FILE* file, uint64_t offset, uint64_t length)
+{
+#if defined(__linux__)
+    ::posix_fadvise(fileno(file), static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+    (void)file;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+static uint64_t RecordOffset(size_t index)
+{
+    return sizeof(GalleryFile::Header) + static_cast<uint64_t>(index) * sizeof(GalleryFile::Record);
+}
+
+GalleryFile::GalleryFile(size_t chunk_records, bool drop_cache) :
+    _chunk_records(std::max<size_t>(chunk_records, 1)), _drop_cache(drop_cache)
+{
+}
+
+bool GalleryFile::Open(const char* path)
+{
+    Close();
+
+    std::FILE* file = std::fopen(path, "rb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed opening %s", path);
+        return false;
+    }
+
+    Header header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && header.magic == Magic;
+    ok = ok && FileBytesOf(file) == RecordOffset(header.count);
+    std::fclose(file);
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid gallery file %s", path);
+        return false;
+    }
+
+    _path = path;
+    _count = header.count;
+    _open = true;
+    return true;
+}
+
+void GalleryFile::Close()
+{
+    _path.clear();
+    _count = 0;
+    _open = false;
+}
+
+bool GalleryFile::IsOpen() const
+{
+    return _open;
+}
+
+const std::string& GalleryFile::Path() const
+{
+    return _path;
+}
+
+size_t GalleryFile::Size() const
+{
+    return _count;
+}
+
+size_t GalleryFile::ChunkRecords() const
+{
+    return _chunk_records;
+}
+
+uint64_t GalleryFile::FileBytes() const
+{
+    return _open ? RecordOffset(_count) : 0;
+}
+
+bool GalleryFile::ReadRecord(size_t index, Record& record) const
+{
+    if (!_open || index >= _count)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid record index %zu", index);
+        return false;
+    }
+
+    std::FILE* file = std::fopen(_path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed opening %s", _path.c_str());
+        return false;
+    }
+    bool ok = SeekTo(file, RecordOffset(index)) && std::fread(&record, sizeof(record), 1, file) == 1;
+    std::fclose(file);
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed reading record %zu of %s", index, _path.c_str());
+    }
+    return ok;
+}
+
+bool GalleryFile::Scan(const ChunkCallback& on_chunk, GalleryFileScanStats* stats) const
+{
+    if (!_open)
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file is not open");
+        return false;
+    }
+
+    std::FILE* file = std::fopen(_path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed opening %s", _path.c_str());
+        return false;
+    }
+    AdviseSequential(file);
+    if (!SeekTo(file, RecordOffset(0)))
+    {
+        std::fclose(file);
+        LOG_ERROR(LOG_TAG, "Failed reading %s", _path.c_str());
+        return false;
+    }
+
+    // chunk k is read to buffers[k % 2]. a buffer is ready from the end of its read until its callback returns.
+    struct Buffer
+    {
+        std::vector<Record> records;
+        std::vector<Faceprints> faceprints;
+        Chunk chunk;
+        bool ready = false;
+        bool read_ok = false;
+    };
+    const size_t buffer_records = std::min(_chunk_records, std::max<size_t>(_count, 1));
+    const size_t num_chunks = (_count + _chunk_records - 1) / _chunk_records;
+    Buffer buffers[2];
+    for (auto& buffer : buffers)
+    {
+        buffer.records.resize(buffer_records);
+        buffer.faceprints.resize(buffer_records);
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop = false;
+    double read_seconds = 0;
+    auto start = Clock::now();
+
+    std::thread reader([&] {
+        for (size_t k = 0; k < num_chunks; k++)
+        {
+            Buffer& buffer = buffers[k % 2];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return !buffer.ready || stop; });
+                if (stop)
+                {
+                    return;
+                }
+            }
+
+            auto read_start = Clock::now();
+            const size_t first = k * _chunk_records;
+            const size_t count = std::min(_chunk_records, _count - first);
+            bool read_ok = std::fread(buffer.records.data(), sizeof(Record), count, file) == count;
+            for (size_t i = 0; read_ok && i < count; i++)
+            {
+                ::memcpy(&buffer.faceprints[i].data, &buffer.records[i].faceprints, sizeof(DBFaceprintsElement));
+            }
+            read_seconds += SecondsSince(read_start);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                buffer.chunk.first = first;
+                buffer.chunk.count = count;
+                buffer.chunk.records = buffer.records.data();
+                buffer.chunk.faceprints = buffer.faceprints.data();
+                buffer.read_ok = read_ok;
+                buffer.ready = true;
+            }
+            cv.notify_all();
+            if (!read_ok)
+            {
+                return;
+            }
+        }
+    });
+
+    bool ok = true;
+    double wait_seconds = 0;
+    for (size_t k = 0; k < num_chunks && ok; k++)
+    {
+        Buffer& buffer = buffers[k % 2];
+        {
+            auto wait_start = Clock::now();
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return buffer.ready; });
+            wait_seconds += SecondsSince(wait_start);
+        }
+
+        if (!buffer.read_ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed reading %s", _path.c_str());
+            ok = false;
+        }
+        else
+        {
+            ok = on_chunk(buffer.chunk);
+            if (_drop_cache)
+            {
+                DropPages(file, RecordOffset(buffer.chunk.first), buffer.chunk.count * sizeof(Record));
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffer.ready = false;
+            stop = !ok;
+        }
+        cv.notify_all();
+    }
+
+    reader.join();
+    std::fclose(file);
+
+    if (stats != nullptr)
+    {
+        stats->bytes_read = RecordOffset(_count);
+        stats->elapsed_seconds = SecondsSince(start);
+        stats->read_seconds = read_seconds;
+        stats->wait_seconds = wait_seconds;
+    }
+    return ok;
+}
+
+void GalleryFile::DropCache() const
+{
+    if (!_open)
+    {
+        return;
+    }
+    std::FILE* file = std::fopen(_path.c_str(), "rb");
+    if (file != nullptr)
+    {
+        DropPages(file, 0, 0);
+        std::fclose(file);
+    }
+}
+
+std::string GalleryFile::GetUserId(const Record& record)
+{
+    return std::string(record.user_id, ::strnlen(record.user_id, sizeof(record.user_id)));
+}
+
+bool GalleryFile::Write(const char* path, const FaceprintGallery& gallery)
+{
+    std::string tmp_path = std::string(path) + ".tmp";
+    GalleryFileWriter writer;
+    bool ok = writer.Open(tmp_path.c_str());
+    for (size_t slot = 0; ok && slot < gallery.Size(); slot++)
+    {
+        ok = writer.Append(gallery.GetUserId(slot), gallery.GetFaceprints(slot));
+    }
+    ok = writer.Close() && ok;
+
+    if (!ok || !RenameReplacing(tmp_path.c_str(), path))
+    {
+        LOG_ERROR(LOG_TAG, "Failed writing %s", path);
+        return false;
+    }
+    return true;
+}
+
+GalleryFileWriter::~GalleryFileWriter()
+{
+    Close();
+}
+
+bool GalleryFileWriter::Open(const char* path)
+{
+    Close();
+
+    _file = std::fopen(path, "wb");
+    if (_file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed creating %s", path);
+        return false;
+    }
+    _count = 0;
+
+    // count is written by Close().
+    GalleryFile::Header header;
+    _ok = std::fwrite(&header, sizeof(header), 1, _file) == 1;
+    return _ok;
+}
+
+bool GalleryFileWriter::Append(const char* user_id, const Faceprints& faceprints)
+{
+    if (_file == nullptr || !_ok)
+    {
+        return false;
+    }
+    if (_count >= UINT32_MAX)
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file is full");
+        _ok = false;
+        return false;
+    }
+
+    GalleryFile::Record record;
+    ::strncpy(record.user_id, user_id, sizeof(record.user_id) - 1);
+    ::memcpy(&record.faceprints, &faceprints.data, sizeof(DBFaceprintsElement));
+    _ok = std::fwrite(&record, sizeof(record), 1, _file) == 1;
+    _count += _ok ? 1 : 0;
+    return _ok;
+}
+
+bool GalleryFileWriter::Close()
+{
+    if (_file == nullptr)
+    {
+        return false;
+    }
+
+    GalleryFile::Header header;
+    header.count = static_cast<uint32_t>(_count);
+    bool ok = _ok && SeekTo(_file, 0) && std::fwrite(&header, sizeof(header), 1, _file) == 1 && SyncFile(_file);
+    ok = (std::fclose(_file) == 0) && ok;
+    _file = nullptr;
+    _ok = false;
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed writing gallery file");
+    }
+    return ok;
+}
+
+size_t GalleryFileWriter::Count() const
+{
+    return _count;
+}
+} // namespace RealSenseID
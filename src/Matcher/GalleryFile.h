@@ -0,0 +1,134 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class FaceprintGallery;
+
+// statistics of a GalleryFile::Scan().
+struct GalleryFileScanStats
+{
+    uint64_t bytes_read = 0;
+    double elapsed_seconds = 0;
+    double read_seconds = 0; // reader thread time spent reading
+    double wait_seconds = 0; // scanning thread time spent waiting for a chunk to be read
+};
+
+// Gallery kept in a file, for galleries larger than the host memory (see Matcher::MatchFaceprintsToArray()).
+//
+// File layout: a Header, then Header::count fixed size Records in host byte order (the rsid-match-server db format).
+// Scan() streams the file sequentially in chunks of ChunkRecords() records, double buffered: a reader thread reads the
+// next chunk while the caller handles the current one, so only two chunks are ever in memory. The reader also copies
+// the faceprints out of the packed records to aligned Faceprints, off the scanning thread.
+// On Linux the file is read with sequential readahead, and with drop_cache the pages of each handled chunk are dropped
+// from the page cache, so every scan reads from the storage device and the scan doesn't evict other data.
+//
+// The file is not locked: it must not be written while open. All const methods are thread safe (each Scan() reads with
+// its own file handle).
+class GalleryFile
+{
+public:
+    static constexpr uint32_t Magic = 0x31424452; // "RDB1"
+    static constexpr size_t UserIdSize = RSID_MAX_USER_ID_LENGTH_IN_DB + 1; // null padded
+    static constexpr size_t DefaultChunkRecords = 4096;                     // about 12MB per buffer
+
+#pragma pack(push, 1)
+    struct Header
+    {
+        uint32_t magic = Magic;
+        uint32_t count = 0;
+    };
+
+    struct Record
+    {
+        char user_id[UserIdSize] = {};
+        DBFaceprintsElement faceprints;
+    };
+#pragma pack(pop)
+
+    // records first .. first + count - 1 of the file.
+    struct Chunk
+    {
+        size_t first = 0;
+        size_t count = 0;
+        const Record* records = nullptr;       // as read, for the user ids
+        const Faceprints* faceprints = nullptr; // aligned copy of records[i].faceprints
+    };
+
+    // return false to stop the scan.
+    using ChunkCallback = std::function<bool(const Chunk& chunk)>;
+
+    explicit GalleryFile(size_t chunk_records = DefaultChunkRecords, bool drop_cache = false);
+    GalleryFile(const GalleryFile&) = delete;
+    GalleryFile& operator=(const GalleryFile&) = delete;
+
+    // returns false if the file can't be read or its header or size are invalid.
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const;
+    const std::string& Path() const;
+    size_t Size() const;
+    size_t ChunkRecords() const;
+    uint64_t FileBytes() const;
+
+    // random access to a single record, e.g. the user id of a match. returns false on read error.
+    bool ReadRecord(size_t index, Record& record) const;
+
+    // handle all records in order, one chunk at a time.
+    // returns false on read error, or if the callback stopped the scan.
+    bool Scan(const ChunkCallback& on_chunk, GalleryFileScanStats* stats = nullptr) const;
+
+    // drop the whole file from the page cache (Linux only, no-op elsewhere), e.g. to measure cold scans.
+    void DropCache() const;
+
+    // user id of a record, which may not be null terminated.
+    static std::string GetUserId(const Record& record);
+
+    // write all users of gallery to path: a new file is written and renamed over the old one, so a failed write never
+    // loses the previous file. returns false on error.
+    static bool Write(const char* path, const FaceprintGallery& gallery);
+
+private:
+    size_t _chunk_records;
+    bool _drop_cache;
+    std::string _path;
+    size_t _count = 0;
+    bool _open = false;
+};
+
+// Sequential writer of a GalleryFile, for files too large to build as a FaceprintGallery first.
+// The header count is written by Close(), which also flushes the file to the storage device.
+class GalleryFileWriter
+{
+public:
+    GalleryFileWriter() = default;
+    ~GalleryFileWriter();
+    GalleryFileWriter(const GalleryFileWriter&) = delete;
+    GalleryFileWriter& operator=(const GalleryFileWriter&) = delete;
+
+    bool Open(const char* path);
+
+    // user ids longer than RSID_MAX_USER_ID_LENGTH_IN_DB are truncated.
+    bool Append(const char* user_id, const Faceprints& faceprints);
+
+    // returns false if any write failed.
+    bool Close();
+
+    size_t Count() const;
+
+private:
+    std::FILE* _file = nullptr;
+    size_t _count = 0;
+    bool _ok = false;
+};
+} // namespace RealSenseID
@@ -0,0 +1,677 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "GalleryLog.h"
+#include "GalleryFile.h"
+#include "FaceprintGallery.h"
+#include "MappedGallery.h"
+#include "FileHelper.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "GalleryLog";
+
+using Clock = std::chrono::steady_clock;
+
+static_assert(sizeof(GalleryLog::SegmentHeader) == 16, "segment header layout must not depend on the compiler");
+static_assert(sizeof(GalleryLog::RecordHeader) == 17 + GalleryLog::UserIdSize, "record header layout must not depend on the compiler");
+
+// a record is at most a header and a Set payload.
+static constexpr uint32_t MaxPayloadSize = sizeof(DBFaceprintsElement);
+
+// payload size of each record type, or -1 for an unknown type.
+static int64_t PayloadSize(uint8_t type)
+{
+    switch (static_cast<GalleryLog::RecordType>(type))
+    {
+    case GalleryLog::RecordType::Set:
+        return sizeof(DBFaceprintsElement);
+    case GalleryLog::RecordType::Remove:
+        return 0;
+    case GalleryLog::RecordType::Vector:
+        return sizeof(GalleryLog::VectorPayload);
+    default:
+        return -1;
+    }
+}
+
+static uint32_t RecordCrc(const GalleryLog::RecordHeader& header, const void* payload)
+{
+    const size_t after_crc = offsetof(GalleryLog::RecordHeader, payload_size);
+    uint32_t crc = MappedGallery::Crc32(reinterpret_cast<const char*>(&header) + after_crc, sizeof(header) - after_crc);
+    return MappedGallery::Crc32(payload, header.payload_size, crc);
+}
+
+static std::string RecordUserId(const GalleryLog::RecordHeader& header)
+{
+    return std::string(header.user_id, ::strnlen(header.user_id, sizeof(header.user_id)));
+}
+
+static feature_t* DescriptorOf(DBFaceprintsElement& data, int descriptor)
+{
+    switch (descriptor)
+    {
+    case GalleryLog::AdaptiveWithoutMask:
+        return data.adaptiveDescriptorWithoutMask;
+    case GalleryLog::AdaptiveWithMask:
+        return data.adaptiveDescriptorWithMask;
+    default:
+        return data.enrollmentDescriptor;
+    }
+}
+
+static const feature_t* DescriptorOf(const DBFaceprintsElement& data, int descriptor)
+{
+    return DescriptorOf(const_cast<DBFaceprintsElement&>(data), descriptor);
+}
+
+// indexes of the segments of base_path, ascending.
+static std::vector<uint64_t> ListSegments(const std::string& base_path)
+{
+    const auto separator = base_path.find_last_of("/\\");
+    const std::string dir = (separator == std::string::npos) ? "." : base_path.substr(0, separator);
+    const std::string prefix = ((separator == std::string::npos) ? base_path : base_path.substr(separator + 1)) + ".wal.";
+
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = ::FindFirstFileA((dir + "\\" + prefix + "*").c_str(), &entry);
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            names.push_back(entry.cFileName);
+        } while (::FindNextFileA(find, &entry));
+        ::FindClose(find);
+    }
+#else
+    DIR* dir_handle = ::opendir(dir.c_str());
+    if (dir_handle != nullptr)
+    {
+        while (dirent* entry = ::readdir(dir_handle))
+        {
+            names.push_back(entry->d_name);
+        }
+        ::closedir(dir_handle);
+    }
+#endif
+
+    std::vector<uint64_t> indexes;
+    for (const auto& name : names)
+    {
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.find_first_not_of("0123456789", prefix.size()) != std::string::npos)
+        {
+            continue;
+        }
+        indexes.push_back(std::stoull(name.substr(prefix.size())));
+    }
+    std::sort(indexes.begin(), indexes.end());
+    return indexes;
+}
+
+using RecordCallback = std::function<void(const GalleryLog::RecordHeader& header, const char* payload)>;
+
+// call on_record for every valid record of the segment, in order. a record that is partial, fails its checksum or
+// doesn't follow the previous sequence ends the segment (torn).
+// returns false if the segment can't be read.
+static bool ReadSegment(const std::string& path, const RecordCallback& on_record, bool& torn, uint64_t& first_sequence)
+{
+    torn = false;
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed opening %s", path.c_str());
+        return false;
+    }
+
+    GalleryLog::SegmentHeader segment;
+    if (std::fread(&segment, sizeof(segment), 1, file) != 1 || segment.magic != GalleryLog::Magic ||
+        segment.format_version != GalleryLog::FormatVersion)
+    {
+        // a crash right after the segment was created, before its header was synced.
+        std::fclose(file);
+        torn = true;
+        first_sequence = 0;
+        return true;
+    }
+    first_sequence = segment.first_sequence;
+
+    GalleryLog::RecordHeader header;
+    std::vector<char> payload(MaxPayloadSize);
+    uint64_t expected_sequence = segment.first_sequence;
+    while (true)
+    {
+        // no bytes left: the end of the last commit. a partial header: a commit cut by a crash.
+        size_t header_bytes = std::fread(&header, 1, sizeof(header), file);
+        if (header_bytes != sizeof(header))
+        {
+            torn = (header_bytes != 0);
+            break;
+        }
+        bool valid = PayloadSize(header.type) == static_cast<int64_t>(header.payload_size) && header.sequence == expected_sequence &&
+                     (header.payload_size == 0 || std::fread(payload.data(), header.payload_size, 1, file) == 1) &&
+                     RecordCrc(header, payload.data()) == header.crc;
+        if (!valid)
+        {
+            torn = true;
+            break;
+        }
+        on_record(header, payload.data());
+        expected_sequence++;
+    }
+    std::fclose(file);
+    return true;
+}
+
+GalleryLog::GalleryLog(const GalleryLogOptions& options) : _options(options)
+{
+}
+
+GalleryLog::~GalleryLog()
+{
+    Close();
+}
+
+std::vector<uint64_t> GalleryLog::SegmentIndexes(const char* base_path)
+{
+    return ListSegments(base_path);
+}
+
+std::string GalleryLog::SegmentPath(const char* base_path, uint64_t index)
+{
+    return std::string(base_path) + ".wal." + std::to_string(index);
+}
+
+bool GalleryLog::Replay(const char* base_path, FaceprintGallery& gallery, GalleryLogReplayStats* stats)
+{
+    GalleryLogReplayStats replay;
+    bool ok = true;
+    for (uint64_t index : ListSegments(base_path))
+    {
+        bool torn = false;
+        uint64_t first_sequence = 0;
+        bool read = ReadSegment(
+            SegmentPath(base_path, index),
+            [&](const RecordHeader& header, const char* payload) {
+                std::string user_id = RecordUserId(header);
+                switch (static_cast<RecordType>(header.type))
+                {
+                case RecordType::Set: {
+                    Faceprints faceprints;
+                    ::memcpy(&faceprints.data, payload, sizeof(faceprints.data));
+                    gallery.Set(user_id.c_str(), faceprints);
+                    break;
+                }
+                case RecordType::Remove:
+                    gallery.Remove(user_id.c_str());
+                    break;
+                case RecordType::Vector: {
+                    // an update of a user removed later in a folded segment: nothing to update.
+                    int slot = gallery.Find(user_id.c_str());
+                    if (slot >= 0)
+                    {
+                        VectorPayload vector;
+                        ::memcpy(&vector, payload, sizeof(vector));
+                        Faceprints faceprints = gallery.GetFaceprints(static_cast<size_t>(slot));
+                        ::memcpy(DescriptorOf(faceprints.data, vector.descriptor), vector.features, sizeof(vector.features));
+                        gallery.Set(user_id.c_str(), faceprints);
+                    }
+                    break;
+                }
+                }
+                replay.records++;
+                replay.last_sequence = header.sequence;
+            },
+            torn, first_sequence);
+        ok = ok && read;
+        replay.segments++;
+        replay.torn_segments += torn ? 1 : 0;
+        if (first_sequence > 0)
+        {
+            replay.last_sequence = (std::max)(replay.last_sequence, first_sequence - 1);
+        }
+    }
+    if (replay.torn_segments > 0)
+    {
+        LOG_ERROR(LOG_TAG, "%zu log segments of %s end with a partial record", replay.torn_segments, base_path);
+    }
+    if (stats != nullptr)
+    {
+        *stats = replay;
+    }
+    return ok;
+}
+
+bool GalleryLog::Open(const char* base_path, uint64_t next_sequence)
+{
+    Close();
+
+    _base_path = base_path;
+    auto segments = ListSegments(_base_path);
+    uint64_t index = segments.empty() ? 0 : segments.back() + 1;
+    std::remove((_base_path + ".compact").c_str()); // left by a crash during a compaction
+
+    _last_sequence = std::max<uint64_t>(next_sequence, 1) - 1;
+    _durable_sequence = _last_sequence;
+    _stats = GalleryLogStats();
+    _stats.durable_sequence = _durable_sequence;
+    _failed = false;
+    _stop = false;
+    _compact_pending = segments.size() > 0 && _options.compact_bytes > 0;
+    if (!StartSegment(index, _last_sequence + 1))
+    {
+        return false;
+    }
+
+    _open = true;
+    _writer = std::thread([this] { WriteLoop(); });
+    if (_options.compact_bytes > 0)
+    {
+        _compactor = std::thread([this] { CompactLoop(); });
+    }
+    return true;
+}
+
+bool GalleryLog::Close()
+{
+    if (!_open)
+    {
+        return !_failed;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _write_cv.notify_all();
+    _compact_cv.notify_all();
+    _writer.join();
+    if (_compactor.joinable())
+    {
+        _compactor.join();
+    }
+
+    bool ok = (std::fclose(_file) == 0) && !_failed;
+    _file = nullptr;
+    _open = false;
+    return ok;
+}
+
+bool GalleryLog::IsOpen() const
+{
+    return _open;
+}
+
+bool GalleryLog::StartSegment(uint64_t index, uint64_t first_sequence)
+{
+    std::string path = SegmentPath(_base_path.c_str(), index);
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed creating %s", path.c_str());
+        return false;
+    }
+    SegmentHeader header;
+    header.first_sequence = first_sequence;
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1 || !SyncFile(file))
+    {
+        LOG_ERROR(LOG_TAG, "Failed writing %s", path.c_str());
+        std::fclose(file);
+        return false;
+    }
+
+    if (_file != nullptr)
+    {
+        std::fclose(_file);
+    }
+    _file = file;
+    _segment_bytes = sizeof(header);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _active_index = index;
+    return true;
+}
+
+uint64_t GalleryLog::Append(RecordType type, const char* user_id, const void* payload, uint32_t payload_size)
+{
+    RecordHeader header;
+    header.payload_size = payload_size;
+    header.type = static_cast<uint8_t>(type);
+    if (user_id != nullptr)
+    {
+        ::strncpy(header.user_id, user_id, sizeof(header.user_id) - 1);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_open || _failed || _stop)
+        {
+            return 0;
+        }
+        header.sequence = ++_last_sequence;
+        header.crc = RecordCrc(header, payload);
+        _stats.records++;
+        _stats.bytes += sizeof(header) + payload_size;
+        const char* header_bytes = reinterpret_cast<const char*>(&header);
+        _buffer.insert(_buffer.end(), header_bytes, header_bytes + sizeof(header));
+        _buffer.insert(_buffer.end(), static_cast<const char*>(payload), static_cast<const char*>(payload) + payload_size);
+    }
+    _write_cv.notify_one();
+    return header.sequence;
+}
+
+uint64_t GalleryLog::AppendSet(const char* user_id, const Faceprints& faceprints)
+{
+    return Append(RecordType::Set, user_id, &faceprints.data, sizeof(faceprints.data));
+}
+
+uint64_t GalleryLog::AppendRemove(const char* user_id)
+{
+    return Append(RecordType::Remove, user_id, nullptr, 0);
+}
+
+uint64_t GalleryLog::AppendUpdate(const char* user_id, const Faceprints& previous, const Faceprints& updated)
+{
+    const auto& before = previous.data;
+    const auto& after = updated.data;
+    bool same_header = ::memcmp(before.reserved, after.reserved, sizeof(before.reserved)) == 0 && before.version == after.version &&
+                       before.featuresType == after.featuresType && before.flags == after.flags;
+
+    int changed = -1;
+    int num_changed = 0;
+    for (int descriptor = 0; descriptor < NumDescriptors; descriptor++)
+    {
+        if (::memcmp(DescriptorOf(before, descriptor), DescriptorOf(after, descriptor), sizeof(before.enrollmentDescriptor)) != 0)
+        {
+            changed = descriptor;
+            num_changed++;
+        }
+    }
+
+    if (!same_header || num_changed > 1)
+    {
+        return AppendSet(user_id, updated);
+    }
+    if (num_changed == 0)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return (_open && !_failed) ? _last_sequence : 0;
+    }
+    VectorPayload vector;
+    vector.descriptor = static_cast<uint8_t>(changed);
+    ::memcpy(vector.features, DescriptorOf(after, changed), sizeof(vector.features));
+    return Append(RecordType::Vector, user_id, &vector, sizeof(vector));
+}
+
+bool GalleryLog::Sync(uint64_t sequence)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _durable_cv.wait(lock, [&] { return _durable_sequence >= sequence || _failed || !_open; });
+    return _durable_sequence >= sequence && !_failed;
+}
+
+bool GalleryLog::Failed() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _failed;
+}
+
+GalleryLogStats GalleryLog::Stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void GalleryLog::WriteLoop()
+{
+    std::vector<char> batch;
+    while (true)
+    {
+        uint64_t last_sequence = 0;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _write_cv.wait(lock, [&] { return !_buffer.empty() || _stop; });
+            if (_buffer.empty())
+            {
+                return;
+            }
+            batch.swap(_buffer);
+            last_sequence = _last_sequence;
+        }
+
+        // everything appended while the previous commit ran goes in this one.
+        bool ok = std::fwrite(batch.data(), batch.size(), 1, _file) == 1 && SyncFile(_file);
+        _segment_bytes += batch.size();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (ok)
+            {
+                _durable_sequence = last_sequence;
+                _stats.durable_sequence = last_sequence;
+                _stats.commits++;
+            }
+            else
+            {
+                LOG_ERROR(LOG_TAG, "Failed writing log segment %llu of %s", static_cast<unsigned long long>(_active_index),
+                          _base_path.c_str());
+                _failed = true;
+                _buffer.clear();
+            }
+        }
+        _durable_cv.notify_all();
+        batch.clear();
+        if (!ok)
+        {
+            return;
+        }
+
+        // seal the segment at a commit boundary, so a sealed segment never ends with a torn record.
+        if (_options.compact_bytes > 0 && _segment_bytes >= _options.compact_bytes)
+        {
+            uint64_t index = 0;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                index = _active_index + 1;
+            }
+            if (StartSegment(index, last_sequence + 1))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _compact_pending = true;
+                }
+                _compact_cv.notify_one();
+            }
+        }
+    }
+}
+
+void GalleryLog::CompactLoop()
+{
+    while (true)
+    {
+        uint64_t active_index = 0;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _compact_cv.wait(lock, [&] { return _compact_pending || _stop; });
+            if (_stop)
+            {
+                return;
+            }
+            _compact_pending = false;
+            active_index = _active_index;
+        }
+
+        std::vector<uint64_t> sealed;
+        for (uint64_t index : ListSegments(_base_path))
+        {
+            if (index < active_index)
+            {
+                sealed.push_back(index);
+            }
+        }
+        if (sealed.empty())
+        {
+            continue;
+        }
+
+        auto start = Clock::now();
+        bool ok = Compact(sealed);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ok)
+        {
+            _stats.compactions++;
+            _stats.compact_seconds = SecondsSince(start);
+        }
+    }
+}
+
+bool GalleryLog::Compact(const std::vector<uint64_t>& segments)
+{
+    // the last state of every user changed in the segments.
+    struct Change
+    {
+        enum State
+        {
+            Patched, // descriptors of the base record replaced
+            Full,
+            Removed
+        } state = Patched;
+        bool patched[NumDescriptors] = {};
+        Faceprints faceprints;
+    };
+    std::unordered_map<std::string, Change> changes;
+    std::vector<std::string> order; // of first change, for the users not in the base file
+
+    for (uint64_t index : segments)
+    {
+        bool torn = false;
+        uint64_t first_sequence = 0;
+        bool read = ReadSegment(
+            SegmentPath(_base_path.c_str(), index),
+            [&](const RecordHeader& header, const char* payload) {
+                std::string user_id = RecordUserId(header);
+                auto it = changes.find(user_id);
+                if (it == changes.end())
+                {
+                    it = changes.emplace(user_id, Change()).first;
+                    order.push_back(user_id);
+                }
+                auto& change = it->second;
+                switch (static_cast<RecordType>(header.type))
+                {
+                case RecordType::Set:
+                    change.state = Change::Full;
+                    ::memcpy(&change.faceprints.data, payload, sizeof(change.faceprints.data));
+                    break;
+                case RecordType::Remove:
+                    change.state = Change::Removed;
+                    break;
+                case RecordType::Vector: {
+                    VectorPayload vector;
+                    ::memcpy(&vector, payload, sizeof(vector));
+                    if (change.state != Change::Removed)
+                    {
+                        int descriptor = std::min<int>(vector.descriptor, Enrollment);
+                        ::memcpy(DescriptorOf(change.faceprints.data, descriptor), vector.features, sizeof(vector.features));
+                        change.patched[descriptor] = true;
+                    }
+                    break;
+                }
+                }
+            },
+            torn, first_sequence);
+        if (!read)
+        {
+            return false;
+        }
+    }
+
+    // stream the base file through the changes into a new base file.
+    const std::string tmp_path = _base_path + ".compact";
+    GalleryFileWriter writer;
+    bool ok = writer.Open(tmp_path.c_str());
+    std::FILE* base = std::fopen(_base_path.c_str(), "rb");
+    if (base != nullptr)
+    {
+        std::fclose(base);
+        GalleryFile base_file;
+        ok = ok && base_file.Open(_base_path.c_str()) && base_file.Scan([&](const GalleryFile::Chunk& chunk) {
+            for (size_t i = 0; i < chunk.count; i++)
+            {
+                std::string user_id = GalleryFile::GetUserId(chunk.records[i]);
+                auto it = changes.find(user_id);
+                if (it == changes.end())
+                {
+                    ok = ok && writer.Append(user_id.c_str(), chunk.faceprints[i]);
+                    continue;
+                }
+                auto& change = it->second;
+                if (change.state == Change::Patched)
+                {
+                    Faceprints faceprints = chunk.faceprints[i];
+                    for (int descriptor = 0; descriptor < NumDescriptors; descriptor++)
+                    {
+                        if (change.patched[descriptor])
+                        {
+                            ::memcpy(DescriptorOf(faceprints.data, descriptor), DescriptorOf(change.faceprints.data, descriptor),
+                                     sizeof(faceprints.data.enrollmentDescriptor));
+                        }
+                    }
+                    ok = ok && writer.Append(user_id.c_str(), faceprints);
+                }
+                else if (change.state == Change::Full)
+                {
+                    ok = ok && writer.Append(user_id.c_str(), change.faceprints);
+                }
+                change.state = Change::Removed; // written
+            }
+            return ok;
+        });
+    }
+    for (const auto& user_id : order)
+    {
+        const auto& change = changes[user_id];
+        if (change.state == Change::Full)
+        {
+            ok = ok && writer.Append(user_id.c_str(), change.faceprints);
+        }
+    }
+    ok = writer.Close() && ok;
+
+    if (!ok || !RenameReplacing(tmp_path.c_str(), _base_path.c_str()))
+    {
+        LOG_ERROR(LOG_TAG, "Failed compacting the log of %s", _base_path.c_str());
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    // oldest first, so a crash leaves the newest segments, in order.
+    for (uint64_t index : segments)
+    {
+        std::remove(SegmentPath(_base_path.c_str(), index).c_str());
+    }
+    return true;
+}
+
+bool GalleryLog::RemoveSegments(const char* base_path)
+{
+    bool ok = true;
+    for (uint64_t index : ListSegments(base_path))
+    {
+        ok = (std::remove(SegmentPath(base_path, index).c_str()) == 0) && ok;
+    }
+    return ok;
+}
+} // namespace RealSenseID
@@ -0,0 +1,182 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class FaceprintGallery;
+
+struct GalleryLogOptions
+{
+    // seal the active segment once it is this large, and fold the sealed segments into the base file. 0: never.
+    uint64_t compact_bytes = 64u << 20;
+};
+
+// statistics since GalleryLog::Open().
+struct GalleryLogStats
+{
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    uint64_t commits = 0; // writes + fsyncs, each covering all the records appended before it started
+    uint64_t compactions = 0;
+    uint64_t durable_sequence = 0;
+    double compact_seconds = 0; // of the last compaction
+};
+
+// result of GalleryLog::Replay().
+struct GalleryLogReplayStats
+{
+    size_t segments = 0;
+    size_t records = 0;           // records replayed onto the gallery
+    size_t torn_segments = 0;     // segments that end with a partial or corrupt record (a crash during a write)
+    uint64_t last_sequence = 0;   // pass last_sequence + 1 to GalleryLog::Open()
+};
+
+// Write-ahead log of the changes to a gallery saved as a GalleryFile (the base file), so changes - most of all the
+// adaptive updates of every match - are durable without rewriting the base file.
+//
+// The log is a sequence of segment files next to the base file (<base>.wal.<index>). A record holds a single change:
+// a full Set of a user, a Remove, or a Vector update - a single descriptor of a user, which is all an adaptive update
+// changes (a third of a Set). Every record carries a sequence number and a checksum, so a record torn by a crash ends
+// the replay of its segment.
+//
+// Append*() only copy the record to a buffer and never wait for the storage device. A writer thread writes and fsyncs
+// the buffer, so every commit covers all records appended while the previous one ran (group commit): under load many
+// records share one fsync. Sync() waits until a record is durable, e.g. before acknowledging a change.
+//
+// Once the active segment reaches GalleryLogOptions::compact_bytes, the writer seals it and starts a new one, and a
+// compactor thread folds the sealed segments into a new base file (streamed: only the changed users are held in
+// memory), renames it over the old one and deletes the folded segments. Replaying a change onto a state that already
+// has it gives the same state, so a crash at any point of a compaction is recovered by replaying the segments left.
+//
+// Recovery: load the base file, Replay() the segments onto the gallery, then Open() a new segment for the changes that
+// follow. Append*(), Sync() and Stats() are thread safe.
+class GalleryLog
+{
+public:
+    static constexpr uint32_t Magic = 0x314C5752; // "RWL1"
+    static constexpr uint32_t FormatVersion = 1;
+    static constexpr size_t UserIdSize = RSID_MAX_USER_ID_LENGTH_IN_DB + 1; // null padded
+
+    enum class RecordType : uint8_t
+    {
+        Set = 1, // payload: DBFaceprintsElement
+        Remove,  // no payload
+        Vector,  // payload: VectorPayload
+    };
+
+    // descriptors of a Vector record.
+    enum Descriptor : uint8_t
+    {
+        AdaptiveWithoutMask,
+        AdaptiveWithMask,
+        Enrollment,
+        NumDescriptors
+    };
+
+#pragma pack(push, 1)
+    struct SegmentHeader
+    {
+        uint32_t magic = Magic;
+        uint32_t format_version = FormatVersion;
+        uint64_t first_sequence = 0;
+    };
+
+    struct RecordHeader
+    {
+        uint32_t crc = 0; // crc32 of the rest of the header and the payload
+        uint32_t payload_size = 0;
+        uint64_t sequence = 0;
+        uint8_t type = 0;
+        char user_id[UserIdSize] = {};
+    };
+
+    struct VectorPayload
+    {
+        uint8_t descriptor = 0;
+        feature_t features[RSID_FEATURES_VECTOR_ALLOC_SIZE];
+    };
+#pragma pack(pop)
+
+    explicit GalleryLog(const GalleryLogOptions& options = GalleryLogOptions());
+    ~GalleryLog();
+    GalleryLog(const GalleryLog&) = delete;
+    GalleryLog& operator=(const GalleryLog&) = delete;
+
+    // replay the log segments of base_path, in order, onto gallery (as loaded from the base file, or empty if there is
+    // none). returns false if a segment can't be read.
+    static bool Replay(const char* base_path, FaceprintGallery& gallery, GalleryLogReplayStats* stats = nullptr);
+
+    // start a new segment after the existing ones, whose first record gets next_sequence, and start the writer and the
+    // compactor. returns false if the segment can't be created.
+    bool Open(const char* base_path, uint64_t next_sequence = 1);
+
+    // write and sync the records appended so far, wait for a running compaction and stop the threads.
+    // returns false if any write failed.
+    bool Close();
+
+    bool IsOpen() const;
+
+    // sequence number of the appended record, or 0 if the log is not open or failed.
+    uint64_t AppendSet(const char* user_id, const Faceprints& faceprints);
+    uint64_t AppendRemove(const char* user_id);
+
+    // the change from previous to updated: a Vector record if a single descriptor changed, else a Set.
+    // returns the last sequence number without appending if nothing changed.
+    uint64_t AppendUpdate(const char* user_id, const Faceprints& previous, const Faceprints& updated);
+
+    // wait until the records up to sequence are on the storage device. returns false if a write failed.
+    bool Sync(uint64_t sequence);
+
+    // true once a write or fsync failed: records appended after it are dropped.
+    bool Failed() const;
+
+    GalleryLogStats Stats() const;
+
+    // indexes of the segments of base_path, ascending.
+    static std::vector<uint64_t> SegmentIndexes(const char* base_path);
+
+    // remove all segments of base_path, e.g. after the whole gallery was saved to it. the log must not be open.
+    static bool RemoveSegments(const char* base_path);
+
+    static std::string SegmentPath(const char* base_path, uint64_t index);
+
+private:
+    uint64_t Append(RecordType type, const char* user_id, const void* payload, uint32_t payload_size);
+    void WriteLoop();
+    void CompactLoop();
+    bool StartSegment(uint64_t index, uint64_t first_sequence);
+    bool Compact(const std::vector<uint64_t>& segments);
+
+    GalleryLogOptions _options;
+    std::string _base_path;
+    std::FILE* _file = nullptr; // active segment, written by the writer thread only
+    uint64_t _segment_bytes = 0;
+    std::thread _writer;
+    std::thread _compactor;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _write_cv;
+    std::condition_variable _durable_cv;
+    std::condition_variable _compact_cv;
+    std::vector<char> _buffer; // appended, not yet written
+    uint64_t _last_sequence = 0;
+    uint64_t _durable_sequence = 0;
+    uint64_t _active_index = 0;
+    bool _compact_pending = false;
+    bool _open = false;
+    bool _failed = false;
+    bool _stop = false;
+    GalleryLogStats _stats;
+};
+} // namespace RealSenseID
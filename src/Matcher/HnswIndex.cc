@@ -0,0 +1,637 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "HnswIndex.h"
+#include "Matcher.h"
+#include "MatcherKernels.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "HnswIndex";
+
+static const char HNSW_FILE_MAGIC[8] = {'R', 'S', 'I', 'D', 'H', 'N', 'S', 'W'};
+static constexpr uint32_t HNSW_FILE_VERSION = 1;
+
+HnswIndex::HnswIndex() : HnswIndex(Params())
+{
+}
+
+HnswIndex::HnswIndex(const Params& params)
+{
+    SetParams(params);
+}
+
+void HnswIndex::SetParams(const Params& params)
+{
+    _params = params;
+    _params.M = std::max<size_t>(2, _params.M);
+    _params.ef_construction = std::max(_params.ef_construction, _params.M);
+    _params.ef_search = std::max<size_t>(1, _params.ef_search);
+    _level_mult = 1.0 / std::log(static_cast<double>(_params.M));
+    _rng.seed(_params.seed);
+}
+
+const HnswIndex::Params& HnswIndex::GetParams() const
+{
+    return _params;
+}
+
+void HnswIndex::SetEfSearch(size_t ef_search)
+{
+    _params.ef_search = std::max<size_t>(1, ef_search);
+}
+
+bool HnswIndex::Insert(const char* user_id, const Faceprints& faceprints)
+{
+    if (user_id == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Null user id");
+        return false;
+    }
+
+    if (!Matcher::ValidateFaceprints(faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Invalid faceprints vector range");
+        return false;
+    }
+
+    auto it = _nodes.find(user_id);
+    bool is_only_entry = Empty() || (Size() == 1 && it != _nodes.end());
+    if (!is_only_entry && faceprints.data.version != _version)
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+    _version = faceprints.data.version;
+
+    // an update moves the user to a (usually the same) node with fresh links, since its neighbourhood may change.
+    if (it != _nodes.end())
+    {
+        Remove(user_id);
+    }
+
+    int level = 0;
+    int node = AllocateNode(level);
+    WriteNode(static_cast<size_t>(node), user_id, faceprints);
+    _nodes[_user_ids[node]] = static_cast<size_t>(node);
+
+    if (_entry_point < 0)
+    {
+        _entry_point = node;
+        _max_level = level;
+        return true;
+    }
+
+    Connect(node, level);
+
+    if (level > _max_level)
+    {
+        _entry_point = node;
+        _max_level = level;
+    }
+    return true;
+}
+
+bool HnswIndex::Remove(const char* user_id)
+{
+    auto it = (user_id != nullptr) ? _nodes.find(user_id) : _nodes.end();
+    if (it == _nodes.end())
+    {
+        return false;
+    }
+
+    // the node stays in the graph to keep it connected. the entry point is never reused, since inserts start from it.
+    int node = static_cast<int>(it->second);
+    _nodes.erase(it);
+    _deleted[node] = 1;
+    _user_ids[node].clear();
+    if (node != _entry_point)
+    {
+        _free_nodes.push_back(node);
+    }
+    return true;
+}
+
+void HnswIndex::Clear()
+{
+    _norms.clear();
+    _norm_msbs.clear();
+    _faceprints.clear();
+    _user_ids.clear();
+    _deleted.clear();
+    _links.clear();
+    _nodes.clear();
+    _free_nodes.clear();
+    _entry_point = -1;
+    _max_level = -1;
+    _rng.seed(_params.seed);
+}
+
+size_t HnswIndex::Size() const
+{
+    return _nodes.size();
+}
+
+bool HnswIndex::Empty() const
+{
+    return _nodes.empty();
+}
+
+int HnswIndex::Find(const char* user_id) const
+{
+    auto it = (user_id != nullptr) ? _nodes.find(user_id) : _nodes.end();
+    return (it != _nodes.end()) ? static_cast<int>(it->second) : -1;
+}
+
+const char* HnswIndex::GetUserId(size_t node) const
+{
+    return _user_ids[node].c_str();
+}
+
+const Faceprints& HnswIndex::GetFaceprints(size_t node) const
+{
+    return _faceprints[node];
+}
+
+int HnswIndex::GetVersion() const
+{
+    return _version;
+}
+
+size_t HnswIndex::Search(const feature_t* probe_vector, TagResult* results, size_t k, size_t ef) const
+{
+    if (Empty() || results == nullptr || k == 0)
+    {
+        return 0;
+    }
+
+    uint32_t norm = static_cast<uint32_t>(MatcherKernels::Active().dot(probe_vector, probe_vector, static_cast<uint32_t>(RowLength)));
+    norm = (norm == 0) ? 1 : norm;
+    short norm_msb = Matcher::GetMsb(norm);
+
+    ScoredNode current(Score(probe_vector, norm, norm_msb, _entry_point), _entry_point);
+    for (int level = _max_level; level > 0; level--)
+    {
+        current = SearchGreedy(probe_vector, norm, norm_msb, current, level, -1);
+    }
+
+    ef = std::max((ef == 0) ? _params.ef_search : ef, k);
+    std::vector<ScoredNode> found = SearchLayer(probe_vector, norm, norm_msb, {current}, ef, 0, true, -1);
+
+    size_t num_results = std::min(k, found.size());
+    for (size_t i = 0; i < num_results; i++)
+    {
+        results[i].score = found[i].first;
+        results[i].idx = found[i].second;
+    }
+    return num_results;
+}
+
+int HnswIndex::AllocateNode(int& level)
+{
+    // a reused node keeps its level, so the layers above it stay consistent.
+    if (!_free_nodes.empty())
+    {
+        int node = _free_nodes.back();
+        _free_nodes.pop_back();
+        level = static_cast<int>(_links[node].size()) - 1;
+        for (auto& layer_links : _links[node])
+        {
+            layer_links.clear();
+        }
+        return node;
+    }
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    level = static_cast<int>(-std::log(1.0 - uniform(_rng)) * _level_mult);
+
+    size_t node = _faceprints.size();
+    size_t capacity = _descriptors.Capacity() / RowLength;
+    if (node + 1 > capacity)
+    {
+        _descriptors.Reserve(std::max<size_t>(node + 1, capacity * 2) * RowLength);
+    }
+    _norms.push_back(0);
+    _norm_msbs.push_back(0);
+    _faceprints.emplace_back();
+    _user_ids.emplace_back();
+    _deleted.push_back(0);
+    _links.emplace_back(static_cast<size_t>(level) + 1);
+    return static_cast<int>(node);
+}
+
+void HnswIndex::WriteNode(size_t node, const char* user_id, const Faceprints& faceprints)
+{
+    _faceprints[node] = faceprints;
+    _user_ids[node] = user_id;
+    _deleted[node] = 0;
+
+    feature_t* row = _descriptors.Data() + node * RowLength;
+    ::memcpy(row, &faceprints.data.adaptiveDescriptorWithoutMask[0], RowLength * sizeof(feature_t));
+
+    // same norm handling as MatchTwoVectors() : protect division by 0.
+    uint32_t norm = static_cast<uint32_t>(MatcherKernels::Active().dot(row, row, static_cast<uint32_t>(RowLength)));
+    norm = (norm == 0) ? 1 : norm;
+    _norms[node] = norm;
+    _norm_msbs[node] = Matcher::GetMsb(norm);
+}
+
+void HnswIndex::Connect(int node, int level)
+{
+    const feature_t* vector = _descriptors.Data() + static_cast<size_t>(node) * RowLength;
+    uint32_t norm = _norms[node];
+    short norm_msb = _norm_msbs[node];
+
+    ScoredNode current(Score(vector, norm, norm_msb, _entry_point), _entry_point);
+    for (int l = _max_level; l > level; l--)
+    {
+        current = SearchGreedy(vector, norm, norm_msb, current, l, node);
+    }
+
+    std::vector<ScoredNode> entry_points = {current};
+    for (int l = std::min(level, _max_level); l >= 0; l--)
+    {
+        std::vector<ScoredNode> candidates = SearchLayer(vector, norm, norm_msb, entry_points, _params.ef_construction, l, false, node);
+        _links[node][l] = SelectNeighbors(candidates, _params.M);
+
+        for (int neighbor : _links[node][l])
+        {
+            auto& neighbor_links = _links[neighbor][l];
+            neighbor_links.push_back(node);
+            if (neighbor_links.size() > MaxLinks(l))
+            {
+                std::vector<ScoredNode> neighbor_candidates;
+                neighbor_candidates.reserve(neighbor_links.size());
+                for (int other : neighbor_links)
+                {
+                    neighbor_candidates.emplace_back(Score(neighbor, other), other);
+                }
+                std::sort(neighbor_candidates.begin(), neighbor_candidates.end(), std::greater<ScoredNode>());
+                neighbor_links = SelectNeighbors(neighbor_candidates, MaxLinks(l));
+            }
+        }
+
+        if (!candidates.empty())
+        {
+            entry_points = std::move(candidates);
+        }
+    }
+}
+
+match_calc_t HnswIndex::Score(const feature_t* vector, uint32_t norm, short norm_msb, int node) const
+{
+    const feature_t* row = _descriptors.Data() + static_cast<size_t>(node) * RowLength;
+    int32_t corr = MatcherKernels::Active().dot(vector, row, static_cast<uint32_t>(RowLength));
+    return Matcher::NormalizeCorrelation(corr, norm, norm_msb, _norms[node], _norm_msbs[node]);
+}
+
+match_calc_t HnswIndex::Score(int node_a, int node_b) const
+{
+    const feature_t* row_a = _descriptors.Data() + static_cast<size_t>(node_a) * RowLength;
+    return Score(row_a, _norms[node_a], _norm_msbs[node_a], node_b);
+}
+
+std::vector<HnswIndex::ScoredNode> HnswIndex::SearchLayer(const feature_t* vector, uint32_t norm, short norm_msb,
+                                                          const std::vector<ScoredNode>& entry_points, size_t ef, int level,
+                                                          bool skip_deleted, int exclude) const
+{
+    auto visited = AcquireVisited();
+    auto is_visited = [&](int node) {
+        if (visited->tags[node] == visited->epoch)
+        {
+            return true;
+        }
+        visited->tags[node] = visited->epoch;
+        return false;
+    };
+    if (exclude >= 0)
+    {
+        is_visited(exclude);
+    }
+
+    // candidates to expand (best on top), and the best ef found (worst on top).
+    std::priority_queue<ScoredNode> candidates;
+    std::priority_queue<ScoredNode, std::vector<ScoredNode>, std::greater<ScoredNode>> found;
+    for (const auto& entry_point : entry_points)
+    {
+        if (is_visited(entry_point.second))
+        {
+            continue;
+        }
+        candidates.push(entry_point);
+        if (!skip_deleted || !_deleted[entry_point.second])
+        {
+            found.push(entry_point);
+        }
+    }
+    while (found.size() > ef)
+    {
+        found.pop();
+    }
+
+    while (!candidates.empty())
+    {
+        ScoredNode current = candidates.top();
+        if (found.size() >= ef && current.first < found.top().first)
+        {
+            break;
+        }
+        candidates.pop();
+
+        if (level >= static_cast<int>(_links[current.second].size()))
+        {
+            continue;
+        }
+        for (int neighbor : _links[current.second][level])
+        {
+            if (is_visited(neighbor))
+            {
+                continue;
+            }
+            match_calc_t score = Score(vector, norm, norm_msb, neighbor);
+            if (found.size() < ef || score > found.top().first)
+            {
+                candidates.emplace(score, neighbor);
+                // deleted nodes route the search but are not returned.
+                if (!skip_deleted || !_deleted[neighbor])
+                {
+                    found.emplace(score, neighbor);
+                    if (found.size() > ef)
+                    {
+                        found.pop();
+                    }
+                }
+            }
+        }
+    }
+    ReleaseVisited(std::move(visited));
+
+    std::vector<ScoredNode> result;
+    result.reserve(found.size());
+    while (!found.empty())
+    {
+        result.push_back(found.top());
+        found.pop();
+    }
+    // best first, lower node first on equal scores.
+    std::sort(result.begin(), result.end(), [](const ScoredNode& a, const ScoredNode& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    return result;
+}
+
+HnswIndex::ScoredNode HnswIndex::SearchGreedy(const feature_t* vector, uint32_t norm, short norm_msb, ScoredNode current, int level,
+                                              int exclude) const
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        if (level >= static_cast<int>(_links[current.second].size()))
+        {
+            break;
+        }
+        for (int neighbor : _links[current.second][level])
+        {
+            if (neighbor == exclude)
+            {
+                continue;
+            }
+            match_calc_t score = Score(vector, norm, norm_msb, neighbor);
+            if (score > current.first)
+            {
+                current = ScoredNode(score, neighbor);
+                changed = true;
+            }
+        }
+    }
+    return current;
+}
+
+std::vector<int> HnswIndex::SelectNeighbors(const std::vector<ScoredNode>& candidates, size_t max_neighbors) const
+{
+    std::vector<int> selected;
+    selected.reserve(max_neighbors);
+    for (const auto& candidate : candidates)
+    {
+        if (selected.size() >= max_neighbors)
+        {
+            break;
+        }
+        bool is_diverse = true;
+        for (int other : selected)
+        {
+            if (Score(candidate.second, other) > candidate.first)
+            {
+                is_diverse = false;
+                break;
+            }
+        }
+        if (is_diverse)
+        {
+            selected.push_back(candidate.second);
+        }
+    }
+    return selected;
+}
+
+size_t HnswIndex::MaxLinks(int level) const
+{
+    return (level == 0) ? 2 * _params.M : _params.M;
+}
+
+std::unique_ptr<HnswIndex::VisitedList> HnswIndex::AcquireVisited() const
+{
+    std::unique_ptr<VisitedList> visited;
+    {
+        std::lock_guard<std::mutex> lock(_visited_mutex);
+        if (!_visited_pool.empty())
+        {
+            visited = std::move(_visited_pool.back());
+            _visited_pool.pop_back();
+        }
+    }
+    if (!visited)
+    {
+        visited.reset(new VisitedList());
+    }
+
+    if (visited->tags.size() < _links.size())
+    {
+        visited->tags.resize(_links.size(), 0);
+    }
+    if (++visited->epoch == 0)
+    {
+        std::fill(visited->tags.begin(), visited->tags.end(), static_cast<uint16_t>(0));
+        visited->epoch = 1;
+    }
+    return visited;
+}
+
+void HnswIndex::ReleaseVisited(std::unique_ptr<VisitedList> visited) const
+{
+    std::lock_guard<std::mutex> lock(_visited_mutex);
+    _visited_pool.push_back(std::move(visited));
+}
+
+template <typename T>
+static void WriteValue(std::ofstream& file, const T& value)
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool ReadValue(std::ifstream& file, T& value)
+{
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool HnswIndex::Save(const char* path) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open %s for writing", path);
+        return false;
+    }
+
+    file.write(HNSW_FILE_MAGIC, sizeof(HNSW_FILE_MAGIC));
+    WriteValue(file, HNSW_FILE_VERSION);
+    WriteValue(file, static_cast<uint32_t>(RowLength));
+    WriteValue(file, static_cast<uint64_t>(_params.M));
+    WriteValue(file, static_cast<uint64_t>(_params.ef_construction));
+    WriteValue(file, static_cast<uint64_t>(_params.ef_search));
+    WriteValue(file, _params.seed);
+    WriteValue(file, static_cast<int32_t>(_version));
+    WriteValue(file, static_cast<uint64_t>(_links.size()));
+    WriteValue(file, static_cast<int32_t>(_entry_point));
+    WriteValue(file, static_cast<int32_t>(_max_level));
+
+    for (size_t node = 0; node < _links.size(); node++)
+    {
+        WriteValue(file, _deleted[node]);
+        WriteValue(file, static_cast<uint32_t>(_user_ids[node].size()));
+        file.write(_user_ids[node].data(), _user_ids[node].size());
+        WriteValue(file, _faceprints[node].data);
+        WriteValue(file, static_cast<uint32_t>(_links[node].size()));
+        for (const auto& layer_links : _links[node])
+        {
+            WriteValue(file, static_cast<uint32_t>(layer_links.size()));
+            file.write(reinterpret_cast<const char*>(layer_links.data()), layer_links.size() * sizeof(int));
+        }
+    }
+
+    if (!file.flush())
+    {
+        LOG_ERROR(LOG_TAG, "Failed to write %s", path);
+        return false;
+    }
+    LOG_DEBUG(LOG_TAG, "Saved %zu users (%zu nodes) to %s", Size(), _links.size(), path);
+    return true;
+}
+
+bool HnswIndex::Load(const char* path)
+{
+    Clear();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open %s", path);
+        return false;
+    }
+
+    char magic[sizeof(HNSW_FILE_MAGIC)] = {};
+    uint32_t file_version = 0, row_length = 0;
+    uint64_t m = 0, ef_construction = 0, ef_search = 0, num_nodes = 0;
+    uint32_t seed = 0;
+    int32_t version = 0, entry_point = -1, max_level = -1;
+    bool ok = static_cast<bool>(file.read(magic, sizeof(magic))) && ReadValue(file, file_version) && ReadValue(file, row_length) &&
+              ReadValue(file, m) && ReadValue(file, ef_construction) && ReadValue(file, ef_search) && ReadValue(file, seed) &&
+              ReadValue(file, version) && ReadValue(file, num_nodes) && ReadValue(file, entry_point) && ReadValue(file, max_level);
+    if (!ok || ::memcmp(magic, HNSW_FILE_MAGIC, sizeof(magic)) != 0 || file_version != HNSW_FILE_VERSION || row_length != RowLength)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid or unsupported index file %s", path);
+        return false;
+    }
+
+    Params params;
+    params.M = static_cast<size_t>(m);
+    params.ef_construction = static_cast<size_t>(ef_construction);
+    params.ef_search = static_cast<size_t>(ef_search);
+    params.seed = seed;
+    SetParams(params);
+    _version = version;
+
+    _descriptors.Reserve(static_cast<size_t>(num_nodes) * RowLength);
+    _norms.resize(num_nodes);
+    _norm_msbs.resize(num_nodes);
+    _faceprints.resize(num_nodes);
+    _user_ids.resize(num_nodes);
+    _deleted.resize(num_nodes);
+    _links.resize(num_nodes);
+
+    for (size_t node = 0; ok && node < num_nodes; node++)
+    {
+        uint8_t deleted = 0;
+        uint32_t id_length = 0, num_levels = 0;
+        Faceprints faceprints;
+        ok = ReadValue(file, deleted) && ReadValue(file, id_length);
+        std::string user_id(ok ? id_length : 0, '\0');
+        ok = ok && file.read(&user_id[0], id_length) && ReadValue(file, faceprints.data) && ReadValue(file, num_levels) && num_levels > 0;
+        if (!ok)
+        {
+            break;
+        }
+
+        WriteNode(node, user_id.c_str(), faceprints);
+        _deleted[node] = deleted;
+        _links[node].resize(num_levels);
+        for (auto& layer_links : _links[node])
+        {
+            uint32_t num_links = 0;
+            ok = ok && ReadValue(file, num_links);
+            layer_links.resize(ok ? num_links : 0);
+            ok = ok && file.read(reinterpret_cast<char*>(layer_links.data()), num_links * sizeof(int));
+            for (int neighbor : layer_links)
+            {
+                ok = ok && neighbor >= 0 && static_cast<uint64_t>(neighbor) < num_nodes;
+            }
+        }
+
+        if (deleted)
+        {
+            _user_ids[node].clear();
+            if (static_cast<int>(node) != entry_point)
+            {
+                _free_nodes.push_back(static_cast<int>(node));
+            }
+        }
+        else
+        {
+            _nodes[_user_ids[node]] = node;
+        }
+    }
+
+    ok = ok && (num_nodes == 0 || (entry_point >= 0 && static_cast<uint64_t>(entry_point) < num_nodes &&
+                                   static_cast<int>(_links[entry_point].size()) == max_level + 1));
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Corrupted index file %s", path);
+        Clear();
+        return false;
+    }
+
+    _entry_point = entry_point;
+    _max_level = max_level;
+    LOG_DEBUG(LOG_TAG, "Loaded %zu users (%zu nodes) from %s", Size(), _links.size(), path);
+    return true;
+}
+} // namespace RealSenseID
@@ -0,0 +1,133 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "AlignedBuffer.h"
+#include "RealSenseID/Faceprints.h"
+#include "RealSenseID/MatcherDefines.h"
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// Approximate nearest neighbour index (hierarchical navigable small world graph) for 1:N identification over very
+// large galleries (see Matcher::MatchFaceprintsToArray()).
+//
+// The graph is built over the adaptive no-mask descriptors, with the matcher's integer ncc as similarity.
+// Search() returns approximate candidates only - the matcher rescores them exactly and applies the calibrated thresholds.
+// Removed users are marked deleted: their node keeps routing searches but is never returned, and is reused by a later
+// Insert().
+// Not thread safe, except for concurrent Search() calls.
+class HnswIndex
+{
+public:
+    static constexpr size_t RowLength = RSID_NUM_OF_RECOGNITION_FEATURES;
+
+    struct Params
+    {
+        size_t M = 16;                // max links per node on the upper layers (2 * M on layer 0)
+        size_t ef_construction = 200; // candidate list size while inserting
+        size_t ef_search = 64;        // default candidate list size while searching
+        uint32_t seed = 100;          // layer assignment seed
+    };
+
+    HnswIndex();
+    explicit HnswIndex(const Params& params);
+    HnswIndex(const HnswIndex&) = delete;
+    HnswIndex& operator=(const HnswIndex&) = delete;
+
+    const Params& GetParams() const;
+    void SetEfSearch(size_t ef_search);
+
+    // insert a new user, or replace the faceprints of an existing user (e.g. after adaptive update).
+    // returns false if the faceprints failed validation or their version differs from the index's.
+    bool Insert(const char* user_id, const Faceprints& faceprints);
+
+    // returns false if user was not found.
+    bool Remove(const char* user_id);
+
+    void Clear();
+
+    // number of users (deleted nodes excluded).
+    size_t Size() const;
+    bool Empty() const;
+
+    // node of the given user, or -1 if not found.
+    int Find(const char* user_id) const;
+
+    const char* GetUserId(size_t node) const;
+    const Faceprints& GetFaceprints(size_t node) const;
+
+    // faceprints version shared by all entries.
+    int GetVersion() const;
+
+    // up to k nodes with the highest ncc vs. probe_vector, best first (TagResult::idx is the node).
+    // ef = 0 uses the ef_search parameter. larger ef gives better recall for more time.
+    size_t Search(const feature_t* probe_vector, TagResult* results, size_t k, size_t ef = 0) const;
+
+    // save/load the whole index (params, faceprints and graph). norms are recomputed on load.
+    bool Save(const char* path) const;
+    bool Load(const char* path);
+
+private:
+    using ScoredNode = std::pair<match_calc_t, int>;
+
+    // tags of the nodes seen by one search. reused across searches, a new epoch clears all tags.
+    struct VisitedList
+    {
+        std::vector<uint16_t> tags;
+        uint16_t epoch = 0;
+    };
+
+    void SetParams(const Params& params);
+    int AllocateNode(int& level);
+    void WriteNode(size_t node, const char* user_id, const Faceprints& faceprints);
+    void Connect(int node, int level);
+
+    match_calc_t Score(const feature_t* vector, uint32_t norm, short norm_msb, int node) const;
+    match_calc_t Score(int node_a, int node_b) const;
+
+    // best ef nodes of a layer reachable from entry_points, best first.
+    std::vector<ScoredNode> SearchLayer(const feature_t* vector, uint32_t norm, short norm_msb, const std::vector<ScoredNode>& entry_points,
+                                        size_t ef, int level, bool skip_deleted, int exclude) const;
+
+    // greedy search on a single layer, for the layers above the target one.
+    ScoredNode SearchGreedy(const feature_t* vector, uint32_t norm, short norm_msb, ScoredNode current, int level, int exclude) const;
+
+    // neighbour selection heuristic: keep a candidate only if it is closer to the base than to any selected neighbour.
+    std::vector<int> SelectNeighbors(const std::vector<ScoredNode>& candidates, size_t max_neighbors) const;
+
+    size_t MaxLinks(int level) const;
+
+    std::unique_ptr<VisitedList> AcquireVisited() const;
+    void ReleaseVisited(std::unique_ptr<VisitedList> visited) const;
+
+    Params _params;
+    double _level_mult = 0;
+    std::mt19937 _rng;
+
+    AlignedBuffer<feature_t> _descriptors;
+    std::vector<uint32_t> _norms;
+    std::vector<short> _norm_msbs;
+    std::vector<Faceprints> _faceprints;
+    std::vector<std::string> _user_ids;
+    std::vector<uint8_t> _deleted;
+    std::vector<std::vector<std::vector<int>>> _links; // node -> layer -> neighbours
+
+    std::unordered_map<std::string, size_t> _nodes;
+    std::vector<int> _free_nodes;
+    int _entry_point = -1;
+    int _max_level = -1;
+    int _version = RSID_FACEPRINTS_VERSION;
+
+    mutable std::mutex _visited_mutex;
+    mutable std::vector<std::unique_ptr<VisitedList>> _visited_pool;
+};
+} // namespace RealSenseID
@@ -0,0 +1,496 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MappedGallery.h"
+#include "FileHelper.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MappedGallery";
+
+static_assert(sizeof(MappedGallery::Header) <= MappedGallery::PageSize, "header must fit its page");
+static_assert(sizeof(MappedGallery::Header) == 192, "header layout must not depend on the compiler");
+
+static uint64_t AlignToPage(uint64_t offset)
+{
+    return (offset + MappedGallery::PageSize - 1) & ~static_cast<uint64_t>(MappedGallery::PageSize - 1);
+}
+
+// bytes of each section of a gallery of count users.
+static uint64_t SectionSize(MappedGallery::Section section, uint64_t count)
+{
+    switch (section)
+    {
+    case MappedGallery::UserIds:
+        return count * MappedGallery::UserIdSize;
+    case MappedGallery::IdIndex:
+        return count * sizeof(uint32_t);
+    case MappedGallery::Descriptors0:
+    case MappedGallery::Descriptors1:
+        return count * MappedGallery::RowLength * sizeof(feature_t);
+    case MappedGallery::Norms0:
+    case MappedGallery::Norms1:
+        return count * sizeof(uint32_t);
+    case MappedGallery::NormMsbs0:
+    case MappedGallery::NormMsbs1:
+        return count * sizeof(short);
+    case MappedGallery::FaceprintsRows:
+        return count * sizeof(Faceprints);
+    default:
+        return 0;
+    }
+}
+
+static uint32_t HeaderCrc(const MappedGallery::Header& header)
+{
+    return MappedGallery::Crc32(&header, offsetof(MappedGallery::Header, header_crc));
+}
+
+// sequential writer of the sections, which keeps the running data checksum.
+class SectionWriter
+{
+public:
+    explicit SectionWriter(std::FILE* file) : _file(file)
+    {
+    }
+
+    // pad with zeros up to offset, where the next section starts.
+    void PadTo(uint64_t offset)
+    {
+        static const char zeros[MappedGallery::PageSize] = {};
+        while (_ok && _offset < offset)
+        {
+            size_t size = static_cast<size_t>(std::min<uint64_t>(offset - _offset, sizeof(zeros)));
+            _ok = std::fwrite(zeros, size, 1, _file) == 1;
+            _offset += size;
+        }
+    }
+
+    void Write(const void* data, size_t size)
+    {
+        if (!_ok || size == 0)
+        {
+            return;
+        }
+        _ok = std::fwrite(data, size, 1, _file) == 1;
+        _offset += size;
+        _crc = MappedGallery::Crc32(data, size, _crc);
+    }
+
+    bool Ok() const
+    {
+        return _ok;
+    }
+
+    uint32_t Crc() const
+    {
+        return _crc;
+    }
+
+private:
+    std::FILE* _file;
+    uint64_t _offset = 0;
+    uint32_t _crc = 0;
+    bool _ok = true;
+};
+
+MappedGallery::~MappedGallery()
+{
+    Close();
+}
+
+bool MappedGallery::Open(const char* path, bool verify)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                                nullptr);
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(file, &file_size))
+    {
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            ::CloseHandle(file);
+        }
+        LOG_ERROR(LOG_TAG, "Failed opening %s", path);
+        return false;
+    }
+    _file_handle = file;
+    _file_bytes = static_cast<uint64_t>(file_size.QuadPart);
+    if (_file_bytes >= sizeof(Header))
+    {
+        _mapping_handle = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping_handle != nullptr)
+        {
+            _data = static_cast<const char*>(::MapViewOfFile(_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+#else
+    int fd = ::open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        LOG_ERROR(LOG_TAG, "Failed opening %s", path);
+        return false;
+    }
+    _file_bytes = static_cast<uint64_t>(st.st_size);
+    if (_file_bytes >= sizeof(Header))
+    {
+        void* data = ::mmap(nullptr, static_cast<size_t>(_file_bytes), PROT_READ, MAP_SHARED, fd, 0);
+        _data = (data != MAP_FAILED) ? static_cast<const char*>(data) : nullptr;
+    }
+    // the mapping keeps the file open.
+    ::close(fd);
+#endif
+
+    if (_data == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed mapping %s", path);
+        Close();
+        return false;
+    }
+
+    ::memcpy(&_header, _data, sizeof(_header));
+    if (!CheckHeader(_file_bytes))
+    {
+        LOG_ERROR(LOG_TAG, "Invalid gallery file %s", path);
+        Close();
+        return false;
+    }
+    _path = path;
+
+    if (verify && !Verify())
+    {
+        LOG_ERROR(LOG_TAG, "Checksum mismatch in %s", path);
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedGallery::Close()
+{
+#ifdef _WIN32
+    if (_data != nullptr)
+    {
+        ::UnmapViewOfFile(_data);
+    }
+    if (_mapping_handle != nullptr)
+    {
+        ::CloseHandle(_mapping_handle);
+    }
+    if (_file_handle != nullptr)
+    {
+        ::CloseHandle(_file_handle);
+    }
+    _mapping_handle = nullptr;
+    _file_handle = nullptr;
+#else
+    if (_data != nullptr)
+    {
+        ::munmap(const_cast<char*>(_data), static_cast<size_t>(_file_bytes));
+    }
+#endif
+    _data = nullptr;
+    _file_bytes = 0;
+    _header = Header();
+    _path.clear();
+}
+
+bool MappedGallery::CheckHeader(uint64_t file_bytes) const
+{
+    const Header& header = _header;
+    if (header.magic != Magic || header.format_version != FormatVersion || header.header_size != sizeof(Header) ||
+        header.header_crc != HeaderCrc(header))
+    {
+        return false;
+    }
+
+    // a file of another build's layout can't be scored in place.
+    if (header.row_length != RowLength || header.user_id_size != UserIdSize || header.faceprints_size != sizeof(Faceprints) ||
+        header.count > static_cast<uint64_t>((std::numeric_limits<int>::max)()))
+    {
+        return false;
+    }
+
+    for (int section = 0; section < NumSections; section++)
+    {
+        const SectionRange& range = header.sections[section];
+        if (range.size != SectionSize(static_cast<Section>(section), header.count) || range.offset % PageSize != 0 ||
+            range.offset < PageSize || (range.size > 0 && range.offset + range.size > file_bytes))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MappedGallery::IsOpen() const
+{
+    return _data != nullptr;
+}
+
+const std::string& MappedGallery::Path() const
+{
+    return _path;
+}
+
+uint64_t MappedGallery::FileBytes() const
+{
+    return _file_bytes;
+}
+
+bool MappedGallery::Verify() const
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+    uint32_t crc = 0;
+    for (const auto& range : _header.sections)
+    {
+        crc = Crc32(_data + range.offset, static_cast<size_t>(range.size), crc);
+    }
+    return crc == _header.data_crc;
+}
+
+void MappedGallery::Prefetch() const
+{
+#ifndef _WIN32
+    if (!IsOpen())
+    {
+        return;
+    }
+    for (int section = Descriptors0; section <= NormMsbs1; section++)
+    {
+        const SectionRange& range = _header.sections[section];
+        if (range.size > 0)
+        {
+            ::madvise(const_cast<char*>(_data + range.offset), static_cast<size_t>(range.size), MADV_WILLNEED);
+        }
+    }
+#endif
+}
+
+size_t MappedGallery::Size() const
+{
+    return static_cast<size_t>(_header.count);
+}
+
+bool MappedGallery::Empty() const
+{
+    return _header.count == 0;
+}
+
+int MappedGallery::Find(const char* user_id) const
+{
+    if (user_id == nullptr || Empty())
+    {
+        return -1;
+    }
+
+    const uint32_t* index = SectionData<uint32_t>(IdIndex);
+    const char* user_ids = SectionData<char>(UserIds);
+    size_t low = 0, high = Size();
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        uint32_t slot = index[middle];
+        if (slot >= Size())
+        {
+            return -1; // corrupt index, see Verify()
+        }
+        int cmp = ::strncmp(user_id, user_ids + slot * UserIdSize, UserIdSize);
+        if (cmp == 0)
+        {
+            return static_cast<int>(slot);
+        }
+        if (cmp < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return -1;
+}
+
+const char* MappedGallery::GetUserId(size_t slot) const
+{
+    return SectionData<char>(UserIds) + slot * UserIdSize;
+}
+
+const Faceprints& MappedGallery::GetFaceprints(size_t slot) const
+{
+    return SectionData<Faceprints>(FaceprintsRows)[slot];
+}
+
+int MappedGallery::GetVersion() const
+{
+    return _header.faceprints_version;
+}
+
+const feature_t* MappedGallery::Descriptors(bool probe_has_mask) const
+{
+    return SectionData<feature_t>(probe_has_mask ? Descriptors1 : Descriptors0);
+}
+
+const uint32_t* MappedGallery::Norms(bool probe_has_mask) const
+{
+    return SectionData<uint32_t>(probe_has_mask ? Norms1 : Norms0);
+}
+
+const short* MappedGallery::NormMsbs(bool probe_has_mask) const
+{
+    return SectionData<short>(probe_has_mask ? NormMsbs1 : NormMsbs0);
+}
+
+bool MappedGallery::Write(const char* path, const FaceprintGallery& gallery)
+{
+    const size_t count = gallery.Size();
+    for (size_t slot = 0; slot < count; slot++)
+    {
+        if (::strlen(gallery.GetUserId(slot)) >= UserIdSize)
+        {
+            LOG_ERROR(LOG_TAG, "User id too long: %s", gallery.GetUserId(slot));
+            return false;
+        }
+    }
+
+    std::vector<uint32_t> index(count);
+    for (size_t slot = 0; slot < count; slot++)
+    {
+        index[slot] = static_cast<uint32_t>(slot);
+    }
+    std::sort(index.begin(), index.end(),
+              [&](uint32_t a, uint32_t b) { return ::strcmp(gallery.GetUserId(a), gallery.GetUserId(b)) < 0; });
+
+    Header header;
+    header.faceprints_version = gallery.GetVersion();
+    header.count = count;
+    uint64_t offset = PageSize;
+    for (int section = 0; section < NumSections; section++)
+    {
+        header.sections[section].offset = offset;
+        header.sections[section].size = SectionSize(static_cast<Section>(section), count);
+        offset = AlignToPage(offset + header.sections[section].size);
+    }
+
+    std::string tmp_path = std::string(path) + ".tmp";
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed creating %s", tmp_path.c_str());
+        return false;
+    }
+
+    // sections first (the header page is left zero), then the header with their checksum.
+    SectionWriter writer(file);
+    writer.PadTo(header.sections[UserIds].offset);
+    for (size_t slot = 0; slot < count; slot++)
+    {
+        char user_id[UserIdSize] = {};
+        ::strncpy(user_id, gallery.GetUserId(slot), UserIdSize - 1);
+        writer.Write(user_id, sizeof(user_id));
+    }
+    writer.PadTo(header.sections[IdIndex].offset);
+    writer.Write(index.data(), index.size() * sizeof(uint32_t));
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        writer.PadTo(header.sections[Descriptors0 + row_set].offset);
+        writer.Write(gallery.Descriptors(row_set == 1), count * RowLength * sizeof(feature_t));
+    }
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        writer.PadTo(header.sections[Norms0 + row_set].offset);
+        writer.Write(gallery.Norms(row_set == 1), count * sizeof(uint32_t));
+    }
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        writer.PadTo(header.sections[NormMsbs0 + row_set].offset);
+        writer.Write(gallery.NormMsbs(row_set == 1), count * sizeof(short));
+    }
+    writer.PadTo(header.sections[FaceprintsRows].offset);
+    for (size_t slot = 0; slot < count; slot++)
+    {
+        writer.Write(&gallery.GetFaceprints(slot), sizeof(Faceprints));
+    }
+
+    header.data_crc = writer.Crc();
+    header.header_crc = HeaderCrc(header);
+    bool ok = writer.Ok() && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1 && SyncFile(file);
+    ok = (std::fclose(file) == 0) && ok;
+
+    if (!ok || !RenameReplacing(tmp_path.c_str(), path))
+    {
+        LOG_ERROR(LOG_TAG, "Failed writing %s", path);
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint32_t MappedGallery::Crc32(const void* data, size_t size, uint32_t crc)
+{
+    // slicing by 8: table[k][b] is the crc of byte b followed by k zero bytes, so 8 bytes are folded per step.
+    static const auto table = [] {
+        std::vector<uint32_t> entries(8 * 256);
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t entry = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                entry = (entry & 1) ? (0xEDB88320u ^ (entry >> 1)) : (entry >> 1);
+            }
+            entries[i] = entry;
+        }
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            for (int k = 1; k < 8; k++)
+            {
+                uint32_t prev = entries[(k - 1) * 256 + i];
+                entries[k * 256 + i] = (prev >> 8) ^ entries[prev & 0xFF];
+            }
+        }
+        return entries;
+    }();
+    const uint32_t* t = table.data();
+
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (; size >= 8; size -= 8, bytes += 8)
+    {
+        uint32_t low = crc ^ (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24));
+        crc = t[7 * 256 + (low & 0xFF)] ^ t[6 * 256 + ((low >> 8) & 0xFF)] ^ t[5 * 256 + ((low >> 16) & 0xFF)] ^ t[4 * 256 + (low >> 24)] ^
+              t[3 * 256 + bytes[4]] ^ t[2 * 256 + bytes[5]] ^ t[1 * 256 + bytes[6]] ^ t[bytes[7]];
+    }
+    for (; size > 0; size--, bytes++)
+    {
+        crc = t[(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+} // namespace RealSenseID
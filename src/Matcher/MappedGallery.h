@@ -0,0 +1,137 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "FaceprintGallery.h"
+#include "RealSenseID/Faceprints.h"
+#include <string>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// Read-only gallery image in a file, memory mapped and scored in place (see Matcher::MatchFaceprintsToArray()).
+//
+// The file holds the scanned data of a FaceprintGallery as written by Write(): the descriptor rows of both mask states,
+// their norms and norm msbs, the full faceprints (for adaptive updates), the user ids and an id index (slots sorted by
+// user id, for a binary search Find()). Every section starts on a page boundary, so the rows keep the alignment of
+// FaceprintGallery rows in the mapping.
+// Opening only maps the file and checks the header, so a restart takes the same time for any gallery size, and the
+// pages come from the page cache - shared by all processes that map the same file - on first touch.
+//
+// The header is checksummed and checked by Open(). The sections are checksummed too, but checking them reads the whole
+// file, so that is left to Verify() (or Open() with verify).
+// Numbers are in host byte order. The file must not be written while mapped: replace it with Write(), which writes a
+// new file and renames it over the old one. All const methods are thread safe.
+class MappedGallery
+{
+public:
+    static constexpr uint32_t Magic = 0x31474D52; // "RMG1"
+    static constexpr uint32_t FormatVersion = 1;
+    static constexpr size_t PageSize = 4096;
+    static constexpr size_t RowLength = FaceprintGallery::RowLength;
+    static constexpr size_t UserIdSize = RSID_MAX_USER_ID_LENGTH_IN_DB + 1; // null padded
+
+    // sections of the file, in file order. the row sets (0: probes without mask, 1: with mask) are laid out as in
+    // FaceprintGallery.
+    enum Section
+    {
+        UserIds,        // UserIdSize chars per slot
+        IdIndex,        // uint32_t slots, sorted by user id
+        Descriptors0,   // RowLength features per slot
+        Descriptors1,
+        Norms0,         // uint32_t per slot
+        Norms1,
+        NormMsbs0,      // short per slot
+        NormMsbs1,
+        FaceprintsRows, // Faceprints per slot
+        NumSections
+    };
+
+    struct SectionRange
+    {
+        uint64_t offset = 0; // page aligned
+        uint64_t size = 0;
+    };
+
+    struct Header
+    {
+        uint32_t magic = Magic;
+        uint32_t format_version = FormatVersion;
+        uint32_t header_size = sizeof(Header);
+        int32_t faceprints_version = RSID_FACEPRINTS_VERSION;
+        uint64_t count = 0;
+        uint32_t row_length = static_cast<uint32_t>(RowLength);
+        uint32_t user_id_size = static_cast<uint32_t>(UserIdSize);
+        uint32_t faceprints_size = sizeof(Faceprints);
+        uint32_t reserved = 0;
+        SectionRange sections[NumSections];
+        uint32_t data_crc = 0;   // crc32 of all sections in order
+        uint32_t header_crc = 0; // crc32 of the header up to header_crc
+    };
+
+    MappedGallery() = default;
+    ~MappedGallery();
+    MappedGallery(const MappedGallery&) = delete;
+    MappedGallery& operator=(const MappedGallery&) = delete;
+
+    // map the file. returns false if it can't be mapped or its header is invalid, or (with verify) a section checksum
+    // differs.
+    bool Open(const char* path, bool verify = false);
+    void Close();
+
+    bool IsOpen() const;
+    const std::string& Path() const;
+    uint64_t FileBytes() const;
+
+    // check the section checksums, reading the whole file.
+    bool Verify() const;
+
+    // ask the kernel to read the descriptor rows and norms ahead, e.g. right after Open() so the first scans don't
+    // fault the pages in one at a time (POSIX only, no-op elsewhere).
+    void Prefetch() const;
+
+    size_t Size() const;
+    bool Empty() const;
+
+    // slot of the given user, or -1 if not found. O(log n) on the id index.
+    int Find(const char* user_id) const;
+
+    const char* GetUserId(size_t slot) const;
+    const Faceprints& GetFaceprints(size_t slot) const;
+
+    // faceprints version shared by all entries.
+    int GetVersion() const;
+
+    // same layout as the FaceprintGallery accessors.
+    const feature_t* Descriptors(bool probe_has_mask) const;
+    const uint32_t* Norms(bool probe_has_mask) const;
+    const short* NormMsbs(bool probe_has_mask) const;
+
+    // write all users of gallery to path: a new file is written and renamed over the old one, so a failed write never
+    // loses the previous file, and processes that have the old file mapped keep their mapping.
+    // returns false on error, or if a user id is longer than RSID_MAX_USER_ID_LENGTH_IN_DB.
+    static bool Write(const char* path, const FaceprintGallery& gallery);
+
+    // crc32 (ieee 802.3) of size bytes, continuing from crc.
+    static uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0);
+
+private:
+    bool CheckHeader(uint64_t file_bytes) const;
+
+    template <typename T>
+    const T* SectionData(Section section) const
+    {
+        return reinterpret_cast<const T*>(_data + _header.sections[section].offset);
+    }
+
+    std::string _path;
+    Header _header;
+    const char* _data = nullptr;
+    uint64_t _file_bytes = 0;
+#ifdef _WIN32
+    void* _file_handle = nullptr;
+    void* _mapping_handle = nullptr;
+#endif
+};
+} // namespace RealSenseID
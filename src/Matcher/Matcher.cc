@@ -2,8 +2,20 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 
 #include "Matcher.h"
+#include "MatcherKernels.h"
+#include "FaceprintGallery.h"
+#include "PackedGallery.h"
+#include "MatcherThreadPool.h"
+#include "MatcherTopK.h"
+#include "HnswIndex.h"
+#include "ConcurrentGallery.h"
+#include "RecentMatches.h"
+#include "GalleryFile.h"
+#include "ShardedGallery.h"
+#include "MappedGallery.h"
 #include "Logger.h"
 #include "RealSenseID/Faceprints.h"
+#include <chrono>
 #include <cmath>
 #include <assert.h>
 #include <cstring>
@@ -27,6 +39,38 @@ using match_calc_t = short;
 
 static const char* LOG_TAG = "Matcher";
 
+// non zero if any feature is out of the valid range. no early exit and an int accumulator, so the loop vectorizes.
+static inline int OutOfRangeFeatures(const feature_t* vec, uint32_t vec_length)
+{
+    int out_of_range = 0;
+    for (uint32_t i = 0; i < vec_length; i++)
+    {
+        out_of_range |= (vec[i] > s_maxFeatureValue) | (vec[i] < s_minFeatureValue);
+    }
+    return out_of_range;
+}
+
+template <uint32_t VecLength>
+static inline bool IsInFeatureRange(const feature_t* vec)
+{
+    return OutOfRangeFeatures(vec, VecLength) == 0;
+}
+
+// MatchTwoVectors() of validated vectors of a compile time length, with the caller's kernel table.
+template <uint32_t VecLength>
+static inline match_calc_t ScoreVectors(const MatcherKernels::KernelTable& kernels, const feature_t* T1, const feature_t* T2)
+{
+    static_assert(VecLength <= 512, "Vector length is higher than 512 - see MatchTwoVectors()");
+
+    MatcherKernels::NccSums sums;
+    kernels.ncc_sums(T1, T2, VecLength, sums);
+
+    // protect division by 0.
+    uint32_t norm1 = (sums.norm1 == 0) ? 1 : sums.norm1;
+    uint32_t norm2 = (sums.norm2 == 0) ? 1 : sums.norm2;
+    return Matcher::NormalizeCorrelation(sums.corr, norm1, Matcher::GetMsb(norm1), norm2, Matcher::GetMsb(norm2));
+}
+
 bool Matcher::IsSameVersion(const Faceprints& newFaceprints, const Faceprints& existingFaceprints)
 {
     bool versionsMatch = (newFaceprints.data.version == existingFaceprints.data.version);
@@ -49,331 +93,2322 @@ bool Matcher::IsSameVersion(const MatchElement& newFaceprints, const Faceprints&
 
 void Matcher::SetToDefaultThresholds(Thresholds& thresholds, const ThresholdsConfidenceEnum confidenceLevel)
 {
+    // unknown levels get the high confidence level thresholds.
+    const bool is_known_level = (confidenceLevel >= 0) && (confidenceLevel < ThresholdsConfidenceEnum::NumThresholdsConfidenceLevels);
+    thresholds = s_defaultThresholds[is_known_level ? confidenceLevel : ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High];
     thresholds.confidenceLevel = confidenceLevel;
 
-    switch (confidenceLevel)
+    // LOG_DEBUG(LOG_TAG, "----> Thresholds confidence level in matcher is : %d.", confidenceLevel);
+}
+
+void Matcher::InitAdaptiveThresholds(const Thresholds& thresholds, AdaptiveThresholds& adaptiveThresholds)
+{
+    adaptiveThresholds.thresholds = thresholds;
+}
+
+void Matcher::HandleThresholdsConfiguration(const bool& probe_has_mask, const Faceprints& existing_faceprints,
+                                            AdaptiveThresholds& adaptiveThresholds)
+{
+    // Fix for Enroll from Image : we need different strong threshold.
+    // Does the DB entry of the user is W10type ?
+    bool isEnrolledTypeInDbIsRgb = (FaceprintsTypeEnum::RGB == existing_faceprints.data.featuresType);
+
+    // here we handle with/without mask adaptive learning.
+    // we adjust the correct thresholds and adaptiveVector for w/wo mask scenarios:
+    // no mask probe - adaptation on the WithoutMask[] vector.
+    // with mask probe - adaptation on the WithMask[] vector if it is valid, otherwise open it (first time).
+    ThresholdsConfigEnum config = ThresholdsConfigEnum::ThresholdConfig_pNM_gNM;
+    if (probe_has_mask)
     {
-    case ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_Low:
-        thresholds.identicalThreshold_gNMgNM = s_identicalThreshold_gNMgNM_LowConfLevel;
-        thresholds.identicalThreshold_gMgNM = s_identicalThreshold_gMgNM_LowConfLevel;
+        feature_t vec_flags = existing_faceprints.data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        bool is_valid = (vec_flags == FaVectorFlagsEnum::VecFlagValidWithMask);
+        config = is_valid ? ThresholdsConfigEnum::ThresholdConfig_pM_gM : ThresholdsConfigEnum::ThresholdConfig_pM_gNM;
+    }
 
-        thresholds.strongThreshold_pNMgNM = s_strongThreshold_pNMgNM_LowConfLevel;
-        thresholds.strongThreshold_pMgM = s_strongThreshold_pMgM_LowConfLevel;
-        thresholds.strongThreshold_pMgNM = s_strongThreshold_pMgNM_LowConfLevel;
-        thresholds.strongThreshold_pNMgNM_rgbImgEnroll = s_strongThreshold_pNMgNM_rgbImgEnroll_LowConfLevel;
+    const ActiveThresholdFields& fields = s_activeThresholdFields[config];
+    const Thresholds& thresholds = adaptiveThresholds.thresholds;
+    adaptiveThresholds.activeConfig = config;
+    adaptiveThresholds.activeIdenticalThreshold = thresholds.*fields.identical;
+    adaptiveThresholds.activeStrongThreshold = thresholds.*fields.strong;
+    adaptiveThresholds.activeUpdateThreshold = thresholds.*fields.update;
 
-        thresholds.updateThreshold_pNMgNM = s_updateThreshold_pNMgNM_LowConfLevel;
-        thresholds.updateThreshold_pMgM = s_updateThreshold_pMgM_LowConfLevel;
-        thresholds.updateThreshold_pMgNM_First = s_updateThreshold_pMgNM_First_LowConfLevel;
-        break;
+    // use different (lower) strong threshold in case the DB enrollment was from rgb image.
+    if (!probe_has_mask && isEnrolledTypeInDbIsRgb)
+    {
+        adaptiveThresholds.activeStrongThreshold = thresholds.strongThreshold_pNMgNM_rgbImgEnroll;
+    }
 
-    case ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_Medium:
-        thresholds.identicalThreshold_gNMgNM = s_identicalThreshold_gNMgNM_MediumConfLevel;
-        thresholds.identicalThreshold_gMgNM = s_identicalThreshold_gMgNM_MediumConfLevel;
+#if (RSID_MATCHER_DEBUG_LOGS)
+    LOG_DEBUG(LOG_TAG, "----> Matcher active setup = %d : hasMask = %d, strongTH = %d, updateTH = %d, identicalTH = %d.",
+              adaptiveThresholds.activeConfig, probe_has_mask, adaptiveThresholds.activeStrongThreshold,
+              adaptiveThresholds.activeUpdateThreshold, adaptiveThresholds.activeIdenticalThreshold);
+#endif
 
-        thresholds.strongThreshold_pNMgNM = s_strongThreshold_pNMgNM_MediumConfLevel;
-        thresholds.strongThreshold_pMgM = s_strongThreshold_pMgM_MediumConfLevel;
-        thresholds.strongThreshold_pMgNM = s_strongThreshold_pMgNM_MediumConfLevel;
-        thresholds.strongThreshold_pNMgNM_rgbImgEnroll = s_strongThreshold_pNMgNM_rgbImgEnroll_MediumConfLevel;
+    return;
+}
 
-        thresholds.updateThreshold_pNMgNM = s_updateThreshold_pNMgNM_MediumConfLevel;
-        thresholds.updateThreshold_pMgM = s_updateThreshold_pMgM_MediumConfLevel;
-        thresholds.updateThreshold_pMgNM_First = s_updateThreshold_pMgNM_First_MediumConfLevel;
-        break;
+// split a scan of count entries across the pool (if any) and merge the best score of each chunk.
+// chunks are merged in order with a strict comparison, so ties resolve to the lowest index as in a serial scan.
+template <typename ScanRangeFn>
+static bool ScanInChunks(MatcherThreadPool* pool, size_t count, TagResult& result, ScanRangeFn scan_range)
+{
+    size_t num_chunks = (pool != nullptr) ? pool->NumChunks(count) : 1;
+    if (num_chunks <= 1)
+    {
+        return scan_range(0, count, result);
+    }
 
-    case ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High:
-    default:
-        thresholds.identicalThreshold_gNMgNM = s_identicalThreshold_gNMgNM_HighConfLevel;
-        thresholds.identicalThreshold_gMgNM = s_identicalThreshold_gMgNM_HighConfLevel;
+    std::vector<TagResult> chunk_results(num_chunks);
+    std::vector<char> chunk_success(num_chunks, 0);
+    pool->Run(num_chunks, [&](size_t chunk) {
+        size_t begin = count * chunk / num_chunks;
+        size_t end = count * (chunk + 1) / num_chunks;
+        chunk_success[chunk] = scan_range(begin, end, chunk_results[chunk]) ? 1 : 0;
+    });
 
-        thresholds.strongThreshold_pNMgNM = s_strongThreshold_pNMgNM_HighConfLevel;
-        thresholds.strongThreshold_pMgM = s_strongThreshold_pMgM_HighConfLevel;
-        thresholds.strongThreshold_pMgNM = s_strongThreshold_pMgNM_HighConfLevel;
-        thresholds.strongThreshold_pNMgNM_rgbImgEnroll = s_strongThreshold_pNMgNM_rgbImgEnroll_HighConfLevel;
+    for (size_t chunk = 0; chunk < num_chunks; chunk++)
+    {
+        if (!chunk_success[chunk])
+        {
+            return false;
+        }
+        if (chunk == 0 || chunk_results[chunk].score > result.score)
+        {
+            result.score = chunk_results[chunk].score;
+            result.idx = chunk_results[chunk].idx;
+        }
+    }
+    return true;
+}
 
-        thresholds.updateThreshold_pNMgNM = s_updateThreshold_pNMgNM_HighConfLevel;
-        thresholds.updateThreshold_pMgM = s_updateThreshold_pMgM_HighConfLevel;
-        thresholds.updateThreshold_pMgNM_First = s_updateThreshold_pMgNM_First_HighConfLevel;
-        break;
+// split a top-k scan of count entries across the pool (if any). each chunk keeps its own k best, merged after the scan.
+// candidates are totally ordered (score, then index), so the merged set is the same as the serial one.
+// returns the number of candidates, sorted best first in top_k.
+template <typename ScanRangeFn>
+static size_t ScanTopKInChunks(MatcherThreadPool* pool, size_t count, TagResult* top_k, size_t k, ScanRangeFn scan_range)
+{
+    MatcherTopK result(top_k, k);
+    size_t num_chunks = (pool != nullptr) ? pool->NumChunks(count) : 1;
+    if (num_chunks <= 1)
+    {
+        scan_range(0, count, result);
+    }
+    else
+    {
+        std::vector<TagResult> chunk_storage(num_chunks * k);
+        std::vector<MatcherTopK> chunk_results;
+        chunk_results.reserve(num_chunks);
+        for (size_t chunk = 0; chunk < num_chunks; chunk++)
+        {
+            chunk_results.emplace_back(&chunk_storage[chunk * k], k);
+        }
+        pool->Run(num_chunks, [&](size_t chunk) {
+            size_t begin = count * chunk / num_chunks;
+            size_t end = count * (chunk + 1) / num_chunks;
+            scan_range(begin, end, chunk_results[chunk]);
+        });
+        for (const auto& chunk_result : chunk_results)
+        {
+            result.Merge(chunk_result);
+        }
     }
 
-    // LOG_DEBUG(LOG_TAG, "----> Thresholds confidence level in matcher is : %d.", confidenceLevel);
+    result.Sort();
+    return result.Size();
 }
 
-void Matcher::InitAdaptiveThresholds(const Thresholds& thresholds, AdaptiveThresholds& adaptiveThresholds)
+void Matcher::GetProbeNorm(const feature_t* probeVector, uint32_t& probeNorm, short& probeNormMsb)
 {
-    adaptiveThresholds.thresholds = thresholds;
+    // same norm handling as MatchTwoVectors() : protect division by 0.
+    probeNorm =
+        static_cast<uint32_t>(MatcherKernels::Active().dot(probeVector, probeVector, static_cast<uint32_t>(FaceprintGallery::RowLength)));
+    probeNorm = (probeNorm == 0) ? 1 : probeNorm;
+    probeNormMsb = GetMsb(probeNorm);
 }
 
-void Matcher::HandleThresholdsConfiguration(const bool& probe_has_mask, const Faceprints& existing_faceprints,
-                                            AdaptiveThresholds& adaptiveThresholds)
+void Matcher::GetQuantizedProbe(const feature_t* probeVector, int8_t* quantizedVector, uint32_t& probeNorm, short& probeNormMsb)
 {
-    // Fix for Enroll from Image : we need different strong threshold.
-    // Does the DB entry of the user is W10type ?
-    bool isEnrolledTypeInDbIsRgb = (FaceprintsTypeEnum::RGB == existing_faceprints.data.featuresType);
+    // the probe is quantized the same way as the gallery rows, so the int8 ncc approximates the exact one.
+    PackedGallery::Quantize(probeVector, quantizedVector);
+    probeNorm = static_cast<uint32_t>(
+        MatcherKernels::Active().dot_int8(quantizedVector, quantizedVector, static_cast<uint32_t>(PackedGallery::RowLength)));
+    probeNorm = (probeNorm == 0) ? 1 : probeNorm;
+    probeNormMsb = GetMsb(probeNorm);
+}
 
-    // here we handle with/without mask adaptive learning.
-    // we adjust the correct thresholds and adaptiveVector for w/wo mask scenarios.
-    if (!probe_has_mask)
+bool Matcher::GetScores(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, TagResult& result,
+                        const bool& probe_has_mask, MatcherThreadPool* pool)
+{
+    if (faceprints.count == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty array.");
+        return false;
+    }
+
+    result.score = 0;
+    result.idx = -1;
+
+    return ScanInChunks(pool, faceprints.count, result, [&](size_t begin, size_t end, TagResult& range_result) {
+        return GetScoresInRange(probe_faceprints, faceprints, begin, end, range_result, probe_has_mask);
+    });
+}
+
+bool Matcher::GetScoresInRange(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, size_t begin, size_t end,
+                               TagResult& result, const bool& probe_has_mask)
+{
+    const uint32_t vec_length = RSID_NUM_OF_RECOGNITION_FEATURES;
+    if (probe_has_mask)
+    {
+        return GetScoresInRange<true, vec_length>(probe_faceprints, faceprints, begin, end, result);
+    }
+    return GetScoresInRange<false, vec_length>(probe_faceprints, faceprints, begin, end, result);
+}
+
+template <bool ProbeHasMask, uint32_t VecLength>
+bool Matcher::GetScoresInRange(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, size_t begin, size_t end,
+                               TagResult& result)
+{
+    match_calc_t maxScore = -1; // must init to -1 so that maximum will be saved if matchScore is 0 !!!
+    int maxSubject = -1;
+    const auto& kernels = MatcherKernels::Active();
+
+    const feature_t* probeVector = &probe_faceprints.data.featuresVector[0];
+    const int probeVersion = probe_faceprints.data.version;
+
+    for (size_t subjectIndex = begin; subjectIndex < end; subjectIndex++)
     {
-        adaptiveThresholds.activeConfig = ThresholdsConfigEnum::ThresholdConfig_pNM_gNM;
-        adaptiveThresholds.activeIdenticalThreshold = adaptiveThresholds.thresholds.identicalThreshold_gNMgNM;
-        adaptiveThresholds.activeStrongThreshold = adaptiveThresholds.thresholds.strongThreshold_pNMgNM;
-        adaptiveThresholds.activeUpdateThreshold = adaptiveThresholds.thresholds.updateThreshold_pNMgNM;
+        const Faceprints& existing_faceprints = faceprints[subjectIndex];
+
+        // same checks as ValidateFaceprints() and IsSameVersion().
+        if (!IsInFeatureRange<VecLength>(&existing_faceprints.data.adaptiveDescriptorWithoutMask[0]))
+        {
+            LOG_ERROR(LOG_TAG, "Invalid faceprints vector range");
+            return false;
+        }
+
+        if (existing_faceprints.data.version != probeVersion)
+        {
+            LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+            return false;
+        }
 
-        // use different (lower) strong threshold in case the DB enrollment was from rgb image.
-        if (isEnrolledTypeInDbIsRgb)
+        // here we handle adaptive-learning for with/without mask vectors.
+        // choose the correct adaptiveVector.
+        const feature_t* galeryAdaptiveVector = GetGalleryVector<ProbeHasMask>(existing_faceprints);
+        match_calc_t matchScore = ScoreVectors<VecLength>(kernels, probeVector, galeryAdaptiveVector);
+
+        // save max found so far
+        if (matchScore > maxScore)
         {
-            adaptiveThresholds.activeStrongThreshold = adaptiveThresholds.thresholds.strongThreshold_pNMgNM_rgbImgEnroll;
+            maxScore = matchScore;
+            maxSubject = static_cast<int>(subjectIndex);
         }
     }
-    else
+
+    result.score = maxScore;
+    result.idx = maxSubject;
+
+    return true;
+}
+
+template <typename RowGallery>
+bool Matcher::GetScores(const MatchElement& probe_faceprints, const RowGallery& gallery, TagResult& result, const bool& probe_has_mask,
+                        MatcherThreadPool* pool)
+{
+    if (gallery.Empty())
     {
-        // does the withMask vector is valid ?
-        feature_t vec_flags = existing_faceprints.data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
-        bool is_valid = (vec_flags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return false;
+    }
+
+    // gallery entries are validated and share the same version since FaceprintGallery::Set() (a MappedGallery is
+    // written from a FaceprintGallery).
+    if (probe_faceprints.data.version != gallery.GetVersion())
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+
+    result.score = 0;
+    result.idx = -1;
+
+    // probe norm is computed once, gallery norms are precomputed.
+    const feature_t* probeVector = &probe_faceprints.data.featuresVector[0];
+    uint32_t probeNorm;
+    short probeNormMsb;
+    GetProbeNorm(probeVector, probeNorm, probeNormMsb);
+
+    return ScanInChunks(pool, gallery.Size(), result, [&](size_t begin, size_t end, TagResult& range_result) {
+        GetScoresInRange(probeVector, probeNorm, probeNormMsb, gallery, begin, end, range_result, probe_has_mask);
+        return true;
+    });
+}
+
+template <typename RowGallery>
+void Matcher::GetScoresInRange(const feature_t* probeVector, uint32_t probeNorm, short probeNormMsb, const RowGallery& gallery,
+                               size_t begin, size_t end, TagResult& result, const bool& probe_has_mask)
+{
+    match_calc_t maxScore = -1; // must init to -1 so that maximum will be saved if matchScore is 0 !!!
+    int maxSubject = -1;
+    const uint32_t vec_length = static_cast<uint32_t>(FaceprintGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    const feature_t* galeryVectors = gallery.Descriptors(probe_has_mask);
+    const uint32_t* galeryNorms = gallery.Norms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.NormMsbs(probe_has_mask);
+
+    for (int subjectIndex = (int)begin; subjectIndex < (int)end; subjectIndex++)
+    {
+        int32_t corr = kernels.dot(probeVector, galeryVectors + static_cast<size_t>(subjectIndex) * vec_length, vec_length);
+        match_calc_t matchScore =
+            NormalizeCorrelation(corr, probeNorm, probeNormMsb, galeryNorms[subjectIndex], galeryNormMsbs[subjectIndex]);
 
-        if (is_valid)
+        // save max found so far
+        if (matchScore > maxScore)
         {
-            // apply adaptation on the WithMask[] vector
-            adaptiveThresholds.activeConfig = ThresholdsConfigEnum::ThresholdConfig_pM_gM;
-            // if with-mask the anchor vector is the _gNM vector anyway, so identical threshold
-            // is _pMgNM.
-            adaptiveThresholds.activeIdenticalThreshold = adaptiveThresholds.thresholds.identicalThreshold_gMgNM;
-            adaptiveThresholds.activeStrongThreshold = adaptiveThresholds.thresholds.strongThreshold_pMgM;
-            adaptiveThresholds.activeUpdateThreshold = adaptiveThresholds.thresholds.updateThreshold_pMgM;
+            maxScore = matchScore;
+            maxSubject = subjectIndex;
         }
-        else
+    }
+
+    result.score = maxScore;
+    result.idx = maxSubject;
+}
+
+bool Matcher::GetTopKScores(const MatchElement& probe_faceprints, const FaceprintGallery& gallery, TagResult* top_k, size_t k,
+                            size_t& num_candidates, const bool& probe_has_mask, MatcherThreadPool* pool)
+{
+    num_candidates = 0;
+
+    if (gallery.Empty())
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return false;
+    }
+
+    if (probe_faceprints.data.version != gallery.GetVersion())
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+
+    const feature_t* probeVector = &probe_faceprints.data.featuresVector[0];
+    uint32_t probeNorm;
+    short probeNormMsb;
+    GetProbeNorm(probeVector, probeNorm, probeNormMsb);
+
+    num_candidates = ScanTopKInChunks(pool, gallery.Size(), top_k, k, [&](size_t begin, size_t end, MatcherTopK& range_top_k) {
+        GetTopKScoresInRange(probeVector, probeNorm, probeNormMsb, gallery, begin, end, range_top_k, probe_has_mask);
+    });
+    return true;
+}
+
+void Matcher::GetTopKScoresInRange(const feature_t* probeVector, uint32_t probeNorm, short probeNormMsb, const FaceprintGallery& gallery,
+                                   size_t begin, size_t end, MatcherTopK& top_k, const bool& probe_has_mask)
+{
+    const uint32_t vec_length = static_cast<uint32_t>(FaceprintGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    const feature_t* galeryVectors = gallery.Descriptors(probe_has_mask);
+    const uint32_t* galeryNorms = gallery.Norms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.NormMsbs(probe_has_mask);
+
+    for (int subjectIndex = (int)begin; subjectIndex < (int)end; subjectIndex++)
+    {
+        int32_t corr = kernels.dot(probeVector, galeryVectors + static_cast<size_t>(subjectIndex) * vec_length, vec_length);
+        match_calc_t matchScore =
+            NormalizeCorrelation(corr, probeNorm, probeNormMsb, galeryNorms[subjectIndex], galeryNormMsbs[subjectIndex]);
+
+        if (top_k.Accepts(matchScore))
         {
-            // apply adaptation on the WithoutMask[] vector
-            adaptiveThresholds.activeConfig = ThresholdsConfigEnum::ThresholdConfig_pM_gNM;
-            // if with-mask the anchor vector is the _gNM vector anyway, so identical threshold
-            // is _pMgNM.
-            adaptiveThresholds.activeIdenticalThreshold = adaptiveThresholds.thresholds.identicalThreshold_gMgNM;
-            adaptiveThresholds.activeStrongThreshold = adaptiveThresholds.thresholds.strongThreshold_pMgNM;
-            adaptiveThresholds.activeUpdateThreshold = adaptiveThresholds.thresholds.updateThreshold_pMgNM_First;
+            top_k.Push(matchScore, subjectIndex);
         }
     }
+}
 
-#if (RSID_MATCHER_DEBUG_LOGS)
-    LOG_DEBUG(LOG_TAG, "----> Matcher active setup = %d : hasMask = %d, strongTH = %d, updateTH = %d, identicalTH = %d.",
-              adaptiveThresholds.activeConfig, probe_has_mask, adaptiveThresholds.activeStrongThreshold,
-              adaptiveThresholds.activeUpdateThreshold, adaptiveThresholds.activeIdenticalThreshold);
-#endif
+bool Matcher::GetPrefilterCandidates(const MatchElement& probe_faceprints, const FaceprintGallery& gallery, TagResult* candidates,
+                                     size_t num_rescore, size_t& num_candidates, const bool& probe_has_mask, MatcherThreadPool* pool)
+{
+    num_candidates = 0;
+
+    if (gallery.Empty())
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return false;
+    }
+
+    if (probe_faceprints.data.version != gallery.GetVersion())
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+
+    uint64_t probeSketch[FaceprintGallery::SketchWords];
+    FaceprintGallery::ComputeSketch(&probe_faceprints.data.featuresVector[0], probeSketch);
+
+    auto scan_range = [&](size_t begin, size_t end, MatcherTopK& range_top_k) {
+        GetSketchScoresInRange(probeSketch, gallery, begin, end, range_top_k, probe_has_mask);
+    };
+    num_candidates = ScanTopKInChunks(pool, gallery.Size(), candidates, num_rescore, scan_range);
+    return true;
+}
+
+void Matcher::GetSketchScoresInRange(const uint64_t* probeSketch, const FaceprintGallery& gallery, size_t begin, size_t end,
+                                     MatcherTopK& top_k, const bool& probe_has_mask)
+{
+    const uint32_t num_words = static_cast<uint32_t>(FaceprintGallery::SketchWords);
+    const uint32_t num_bits = num_words * 64;
+    const auto& kernels = MatcherKernels::Active();
+
+    const uint64_t* galerySketches = gallery.Sketches(probe_has_mask);
+
+    for (int subjectIndex = (int)begin; subjectIndex < (int)end; subjectIndex++)
+    {
+        // number of agreeing signs, so higher is better as with ncc scores.
+        uint32_t distance = kernels.hamming(probeSketch, galerySketches + subjectIndex * num_words, num_words);
+        match_calc_t sketchScore = static_cast<match_calc_t>(num_bits - distance);
+
+        if (top_k.Accepts(sketchScore))
+        {
+            top_k.Push(sketchScore, subjectIndex);
+        }
+    }
+}
+
+void Matcher::RescoreCandidates(const feature_t* probeVector, const FaceprintGallery& gallery, const TagResult* candidates,
+                                size_t num_candidates, TagResult& result, const bool& probe_has_mask)
+{
+    uint32_t probeNorm;
+    short probeNormMsb;
+    GetProbeNorm(probeVector, probeNorm, probeNormMsb);
+
+    const uint32_t vec_length = static_cast<uint32_t>(FaceprintGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    const feature_t* galeryVectors = gallery.Descriptors(probe_has_mask);
+    const uint32_t* galeryNorms = gallery.Norms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.NormMsbs(probe_has_mask);
+
+    result.score = -1;
+    result.idx = -1;
+
+    for (size_t i = 0; i < num_candidates; i++)
+    {
+        int subjectIndex = candidates[i].idx;
+        int32_t corr = kernels.dot(probeVector, galeryVectors + static_cast<size_t>(subjectIndex) * vec_length, vec_length);
+        match_calc_t matchScore =
+            NormalizeCorrelation(corr, probeNorm, probeNormMsb, galeryNorms[subjectIndex], galeryNormMsbs[subjectIndex]);
+
+        // candidates are not in index order, so ties are resolved explicitly to the lowest index as in GetScores().
+        if (matchScore > result.score || (matchScore == result.score && subjectIndex < result.idx))
+        {
+            result.score = matchScore;
+            result.idx = subjectIndex;
+        }
+    }
+}
+
+bool Matcher::GetScores(const MatchElement& probe_faceprints, const PackedGallery& gallery, TagResult& result,
+                        const bool& probe_has_mask, MatcherThreadPool* pool)
+{
+    if (gallery.Empty())
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return false;
+    }
+
+    if (probe_faceprints.data.version != gallery.GetVersion())
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+
+    result.score = 0;
+    result.idx = -1;
+
+    const feature_t* probeVector = &probe_faceprints.data.featuresVector[0];
+    uint32_t probeNorm;
+    short probeNormMsb;
+    GetProbeNorm(probeVector, probeNorm, probeNormMsb);
+
+    return ScanInChunks(pool, gallery.Size(), result, [&](size_t begin, size_t end, TagResult& range_result) {
+        GetScoresInRange(probeVector, probeNorm, probeNormMsb, gallery, begin, end, range_result, probe_has_mask);
+        return true;
+    });
+}
+
+void Matcher::GetScoresInRange(const feature_t* probeVector, uint32_t probeNorm, short probeNormMsb, const PackedGallery& gallery,
+                               size_t begin, size_t end, TagResult& result, const bool& probe_has_mask)
+{
+    match_calc_t maxScore = -1; // must init to -1 so that maximum will be saved if matchScore is 0 !!!
+    int maxSubject = -1;
+    const uint32_t vec_length = static_cast<uint32_t>(PackedGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    const uint32_t* galeryNorms = gallery.Norms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.NormMsbs(probe_has_mask);
+
+    for (int subjectIndex = (int)begin; subjectIndex < (int)end; subjectIndex++)
+    {
+        int32_t corr = kernels.dot_packed(probeVector, gallery.Row(subjectIndex, probe_has_mask), vec_length);
+        match_calc_t matchScore =
+            NormalizeCorrelation(corr, probeNorm, probeNormMsb, galeryNorms[subjectIndex], galeryNormMsbs[subjectIndex]);
+
+        if (matchScore > maxScore)
+        {
+            maxScore = matchScore;
+            maxSubject = subjectIndex;
+        }
+    }
+
+    result.score = maxScore;
+    result.idx = maxSubject;
+}
+
+bool Matcher::GetQuantizedCandidates(const MatchElement& probe_faceprints, const PackedGallery& gallery, TagResult* candidates,
+                                     size_t num_rescore, size_t& num_candidates, const bool& probe_has_mask, MatcherThreadPool* pool)
+{
+    num_candidates = 0;
+
+    if (!gallery.IsQuantized())
+    {
+        LOG_ERROR(LOG_TAG, "Gallery has no quantized rows.");
+        return false;
+    }
+
+    if (gallery.Empty())
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return false;
+    }
+
+    if (probe_faceprints.data.version != gallery.GetVersion())
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+
+    int8_t probeVector[PackedGallery::RowLength];
+    uint32_t probeNorm;
+    short probeNormMsb;
+    GetQuantizedProbe(&probe_faceprints.data.featuresVector[0], probeVector, probeNorm, probeNormMsb);
+
+    auto scan_range = [&](size_t begin, size_t end, MatcherTopK& range_top_k) {
+        GetQuantizedScoresInRange(probeVector, probeNorm, probeNormMsb, gallery, begin, end, range_top_k, probe_has_mask);
+    };
+    num_candidates = ScanTopKInChunks(pool, gallery.Size(), candidates, num_rescore, scan_range);
+    return true;
+}
+
+void Matcher::GetQuantizedScoresInRange(const int8_t* probeVector, uint32_t probeNorm, short probeNormMsb, const PackedGallery& gallery,
+                                        size_t begin, size_t end, MatcherTopK& top_k, const bool& probe_has_mask)
+{
+    const uint32_t vec_length = static_cast<uint32_t>(PackedGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    const uint32_t* galeryNorms = gallery.QuantizedNorms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.QuantizedNormMsbs(probe_has_mask);
+
+    for (int subjectIndex = (int)begin; subjectIndex < (int)end; subjectIndex++)
+    {
+        int32_t corr = kernels.dot_int8(probeVector, gallery.QuantizedRow(subjectIndex, probe_has_mask), vec_length);
+        match_calc_t matchScore =
+            NormalizeCorrelation(corr, probeNorm, probeNormMsb, galeryNorms[subjectIndex], galeryNormMsbs[subjectIndex]);
+
+        if (top_k.Accepts(matchScore))
+        {
+            top_k.Push(matchScore, subjectIndex);
+        }
+    }
+}
+
+void Matcher::RescoreCandidates(const feature_t* probeVector, const PackedGallery& gallery, const TagResult* candidates,
+                                size_t num_candidates, TagResult& result, const bool& probe_has_mask)
+{
+    uint32_t probeNorm;
+    short probeNormMsb;
+    GetProbeNorm(probeVector, probeNorm, probeNormMsb);
+
+    const uint32_t vec_length = static_cast<uint32_t>(PackedGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    const uint32_t* galeryNorms = gallery.Norms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.NormMsbs(probe_has_mask);
+
+    result.score = -1;
+    result.idx = -1;
+
+    for (size_t i = 0; i < num_candidates; i++)
+    {
+        int subjectIndex = candidates[i].idx;
+        int32_t corr = kernels.dot_packed(probeVector, gallery.Row(subjectIndex, probe_has_mask), vec_length);
+        match_calc_t matchScore =
+            NormalizeCorrelation(corr, probeNorm, probeNormMsb, galeryNorms[subjectIndex], galeryNormMsbs[subjectIndex]);
+
+        if (matchScore > result.score || (matchScore == result.score && subjectIndex < result.idx))
+        {
+            result.score = matchScore;
+            result.idx = subjectIndex;
+        }
+    }
+}
+
+void Matcher::RescoreIndexCandidates(const MatchElement& probe_faceprints, const HnswIndex& index, const TagResult* candidates,
+                                     size_t num_candidates, TagResult& result, const bool& probe_has_mask)
+{
+    const feature_t* probeVector = &probe_faceprints.data.featuresVector[0];
+
+    result.score = -1;
+    result.idx = -1;
+
+    for (size_t i = 0; i < num_candidates; i++)
+    {
+        int node = candidates[i].idx;
+        match_calc_t matchScore = s_minPossibleScore;
+        MatchTwoVectors(probeVector, GetGalleryVector(index.GetFaceprints(static_cast<size_t>(node)), probe_has_mask), &matchScore);
+
+        if (matchScore > result.score || (matchScore == result.score && node < result.idx))
+        {
+            result.score = matchScore;
+            result.idx = node;
+        }
+    }
+}
+
+const feature_t* Matcher::GetGalleryVector(const Faceprints& faceprints, const bool& probe_has_mask)
+{
+    return probe_has_mask ? GetGalleryVector<true>(faceprints) : GetGalleryVector<false>(faceprints);
+}
+
+template <bool ProbeHasMask>
+const feature_t* Matcher::GetGalleryVector(const Faceprints& faceprints)
+{
+    if (!ProbeHasMask)
+    {
+        return &faceprints.data.adaptiveDescriptorWithoutMask[0];
+    }
+    // a select rather than a branch, since the flag varies from entry to entry.
+    feature_t vec_flags = faceprints.data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool is_valid = (vec_flags == FaVectorFlagsEnum::VecFlagValidWithMask);
+    return is_valid ? &faceprints.data.adaptiveDescriptorWithMask[0] : &faceprints.data.adaptiveDescriptorWithoutMask[0];
+}
+
+template <typename RowGallery>
+void Matcher::GetBatchScoresInRange(const feature_t* const* probeVectors, const uint32_t* probeNorms, const short* probeNormMsbs,
+                                    size_t num_probes, const RowGallery& gallery, size_t begin, size_t end, TagResult* results,
+                                    const bool& probe_has_mask)
+{
+    // gallery block of 32 rows (32KB) stays in cache while all probes are scored against it.
+    // probes are scored 4 at a time (dot4), so each row chunk is loaded once per 4 probes.
+    const size_t galleryBlock = 32;
+    const size_t probeBlock = 4;
+    const uint32_t vec_length = static_cast<uint32_t>(FaceprintGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    const feature_t* galeryVectors = gallery.Descriptors(probe_has_mask);
+    const uint32_t* galeryNorms = gallery.Norms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.NormMsbs(probe_has_mask);
+
+    for (size_t p = 0; p < num_probes; p++)
+    {
+        results[p].score = -1; // must init to -1 so that maximum will be saved if matchScore is 0 !!!
+        results[p].idx = -1;
+    }
+
+    for (size_t blockBegin = begin; blockBegin < end; blockBegin += galleryBlock)
+    {
+        size_t blockEnd = std::min(blockBegin + galleryBlock, end);
+
+        for (size_t p0 = 0; p0 < num_probes; p0 += probeBlock)
+        {
+            size_t numBlockProbes = std::min(probeBlock, num_probes - p0);
+
+            for (size_t subjectIndex = blockBegin; subjectIndex < blockEnd; subjectIndex++)
+            {
+                const feature_t* galeryVector = galeryVectors + subjectIndex * vec_length;
+                int32_t corrs[4];
+                if (numBlockProbes == probeBlock)
+                {
+                    kernels.dot4(galeryVector, probeVectors + p0, vec_length, corrs);
+                }
+                else
+                {
+                    for (size_t k = 0; k < numBlockProbes; k++)
+                    {
+                        corrs[k] = kernels.dot(galeryVector, probeVectors[p0 + k], vec_length);
+                    }
+                }
+
+                for (size_t k = 0; k < numBlockProbes; k++)
+                {
+                    size_t p = p0 + k;
+                    match_calc_t matchScore = NormalizeCorrelation(corrs[k], probeNorms[p], probeNormMsbs[p], galeryNorms[subjectIndex],
+                                                                   galeryNormMsbs[subjectIndex]);
+                    // save max found so far
+                    if (matchScore > results[p].score)
+                    {
+                        results[p].score = matchScore;
+                        results[p].idx = static_cast<int>(subjectIndex);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Matcher::MatchFaceprintsArrayBatch(const std::vector<MatchElement>& probes, const FaceprintsArray& faceprints,
+                                        std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                        const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    const size_t num_probes = probes.size();
+    results.assign(num_probes, ExtendedMatchResult());
+    updated_faceprints.resize(num_probes);
+
+    if (faceprints.count == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
+        return;
+    }
+
+    // same probe checks as MatchFaceprintsArray().
+    std::vector<char> active(num_probes, 0);
+    std::vector<char> probe_has_mask(num_probes, 0);
+    for (size_t i = 0; i < num_probes; i++)
+    {
+        if (!ValidateFaceprints(probes[i]))
+        {
+            LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation (probe %zu).", i);
+            continue;
+        }
+        if (probes[i].data.version != faceprints[0].data.version)
+        {
+            LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors (probe %zu). Skipping this match()!", i);
+            continue;
+        }
+        feature_t probeFaceFlags = probes[i].data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        probe_has_mask[i] = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? 1 : 0;
+        active[i] = 1;
+    }
+
+    // each chunk of the array keeps the best of every probe, scanning blocks of 32 entries (32KB) that stay in cache while
+    // all probes are scored against them. blocks and chunks are merged in array order with a strict comparison, so ties
+    // resolve to the lowest index as in the single probe scan, and an invalid entry fails the probes that reach it.
+    const size_t block = 32;
+    const size_t num_chunks = (pool != nullptr) ? pool->NumChunks(faceprints.count) : 1;
+    std::vector<TagResult> chunk_best(num_chunks * num_probes);
+    std::vector<char> chunk_failed(num_chunks * num_probes, 0);
+    auto scan_chunk = [&](size_t chunk) {
+        size_t begin = faceprints.count * chunk / num_chunks;
+        size_t end = faceprints.count * (chunk + 1) / num_chunks;
+        TagResult* best = &chunk_best[chunk * num_probes];
+        char* failed = &chunk_failed[chunk * num_probes];
+        for (size_t block_begin = begin; block_begin < end; block_begin += block)
+        {
+            size_t block_end = std::min(block_begin + block, end);
+            for (size_t i = 0; i < num_probes; i++)
+            {
+                if (!active[i] || failed[i])
+                {
+                    continue;
+                }
+                TagResult block_result;
+                if (!GetScoresInRange(probes[i], faceprints, block_begin, block_end, block_result, probe_has_mask[i] != 0))
+                {
+                    failed[i] = 1;
+                    continue;
+                }
+                if (block_begin == begin || block_result.score > best[i].score)
+                {
+                    best[i] = block_result;
+                }
+            }
+        }
+    };
+    if (num_chunks <= 1)
+    {
+        scan_chunk(0);
+    }
+    else
+    {
+        pool->Run(num_chunks, scan_chunk);
+    }
+
+    for (size_t i = 0; i < num_probes; i++)
+    {
+        if (!active[i])
+        {
+            continue;
+        }
+        TagResult best;
+        bool failed = false;
+        bool first = true;
+        for (size_t chunk = 0; chunk < num_chunks; chunk++)
+        {
+            const size_t index = chunk * num_probes + i;
+            failed = failed || chunk_failed[index];
+            if (faceprints.count * chunk / num_chunks == faceprints.count * (chunk + 1) / num_chunks)
+            {
+                continue;
+            }
+            if (first || chunk_best[index].score > best.score)
+            {
+                best = chunk_best[index];
+                first = false;
+            }
+        }
+        if (failed)
+        {
+            LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+            continue;
+        }
+
+        results[i].maxScore = best.score;
+        results[i].userId = best.idx;
+        if (best.idx < 0)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+            continue;
+        }
+        HandleMatchResult(probes[i], faceprints[static_cast<size_t>(best.idx)], probe_has_mask[i] != 0, thresholds, results[i],
+                          updated_faceprints[i]);
+    }
+}
+
+void Matcher::FaceMatch(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, ExtendedMatchResult& result,
+                        const bool& probe_has_mask, MatcherThreadPool* pool)
+{
+    result.isSame = false;
+    result.maxScore = 0;
+    result.userId = -1;
+    result.should_update = false;
+
+    TagResult scoresResult;
+    // this function returns the index and info of the best score winner in the array.
+    bool isScoreSuccess = GetScores(probe_faceprints, faceprints, scoresResult, probe_has_mask, pool);
+
+    if (!isScoreSuccess)
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return;
+    }
+
+    result.maxScore = scoresResult.score;
+    result.userId = scoresResult.idx;
+
+    // don't set yet - we must call HandleThresholdsConfiguration() first!
+    // result.isSame = (scoresResult.score > thresholds.activeStrongThreshold);
+}
+
+bool Matcher::ValidateFaceprints(const Faceprints& faceprints, bool check_enrollment_vector)
+{
+    // TODO - carefull handling in MatchTwoVectors() may be required for vectors longer than 512.
+    static_assert((RSID_NUM_OF_RECOGNITION_FEATURES <= 512),
+                  "Vector length is higher than 512 - may need careful test and check, due to integer arithmetics and "
+                  "overflow risk!");
+
+    uint32_t nfeatures = static_cast<uint32_t>(RSID_NUM_OF_RECOGNITION_FEATURES);
+
+    bool is_valid = true;
+
+    if (check_enrollment_vector)
+    {
+        is_valid = ValidateVector(&faceprints.data.enrollmentDescriptor[0], nfeatures);
+    }
+    else
+    {
+        is_valid = ValidateVector(&faceprints.data.adaptiveDescriptorWithoutMask[0], nfeatures);
+    }
+
+    if (!is_valid)
+    {
+        LOG_ERROR(LOG_TAG, "Vector (Faceprints faceprint) validation failed!");
+    }
+
+    return is_valid;
+}
+
+bool Matcher::ValidateFaceprints(const MatchElement& faceprints)
+{
+    // TODO - carefull handling in MatchTwoVectors() may be required for vectors longer than 512.
+    static_assert((RSID_NUM_OF_RECOGNITION_FEATURES <= 512),
+                  "Vector length is higher than 512 - may need careful test and check, due to integer arithmetics and "
+                  "overflow risk!");
+
+    uint32_t nfeatures = static_cast<uint32_t>(RSID_NUM_OF_RECOGNITION_FEATURES);
+
+    bool is_valid = ValidateVector(&faceprints.data.featuresVector[0], nfeatures);
+
+    if (!is_valid)
+    {
+        LOG_ERROR(LOG_TAG, "Vector (MatchElement faceprint) validation failed!");
+    }
+
+    return is_valid;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints,
+                                                    const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                    MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    ExtendedMatchResult result =
+        MatchFaceprintsToArray(probe_faceprints, existing_faceprints_array, updated_faceprints, thresholds, pool);
+
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints,
+                                                    const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
+{
+    FaceprintsArray faceprints;
+    faceprints.first = existing_faceprints_array.empty() ? nullptr : &existing_faceprints_array[0].faceprints;
+    faceprints.stride = sizeof(UserFaceprints_t);
+    faceprints.count = existing_faceprints_array.size();
+    return MatchFaceprintsArray(probe_faceprints, faceprints, updated_faceprints, thresholds, pool);
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes,
+                                          const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const ThresholdsConfidenceEnum confidenceLevel, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    MatchFaceprintsBatchToArray(probes, existing_faceprints_array, results, updated_faceprints, thresholds, pool);
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes,
+                                          const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    FaceprintsArray faceprints;
+    faceprints.first = existing_faceprints_array.empty() ? nullptr : &existing_faceprints_array[0].faceprints;
+    faceprints.stride = sizeof(UserFaceprints_t);
+    faceprints.count = existing_faceprints_array.size();
+    MatchFaceprintsArrayBatch(probes, faceprints, results, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const Faceprints* existing_faceprints,
+                                                    size_t count, Faceprints& updated_faceprints,
+                                                    const ThresholdsConfidenceEnum confidenceLevel, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, existing_faceprints, count, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const Faceprints* existing_faceprints,
+                                                    size_t count, Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
+{
+    FaceprintsArray faceprints;
+    faceprints.first = existing_faceprints;
+    faceprints.count = (existing_faceprints != nullptr) ? count : 0;
+    return MatchFaceprintsArray(probe_faceprints, faceprints, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const GallerySnapshot& snapshot,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                    MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, snapshot, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const GallerySnapshot& snapshot,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
+{
+    FaceprintsArray faceprints;
+    faceprints.pointers = snapshot.AllFaceprints();
+    faceprints.count = snapshot.Size();
+    return MatchFaceprintsArray(probe_faceprints, faceprints, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsArray(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints,
+                                                  Faceprints& updated_faceprints, const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    if (faceprints.count == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
+        return result;
+    }
+
+    if (probe_faceprints.data.version != faceprints[0].data.version)
+    {
+        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
+        return result;
+    }
+
+    // Try to match the 2 faceprints, and raise should_update flag respecively.
+    // note that here we also set the active thresholds configurtion
+    // which is used for adaptive-learning w/wo mask.
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    FaceMatch(probe_faceprints, faceprints, result, probe_has_mask, pool);
+
+    size_t user_index = (size_t)result.userId;
+
+    // if no user matched, finish here and return.
+    if (user_index >= faceprints.count)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return result;
+    }
+
+    HandleMatchResult(probe_faceprints, faceprints[user_index], probe_has_mask, thresholds, result, updated_faceprints);
+
+    return result;
+}
+
+template <typename RowGallery>
+ExtendedMatchResult Matcher::MatchRowGallery(const MatchElement& probe_faceprints, const RowGallery& gallery,
+                                             Faceprints& updated_faceprints, const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    TagResult scoresResult;
+    if (!GetScores(probe_faceprints, gallery, scoresResult, probe_has_mask, pool))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    result.maxScore = scoresResult.score;
+    result.userId = scoresResult.idx;
+
+    size_t user_index = (size_t)result.userId;
+    if (user_index >= gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return result;
+    }
+
+    HandleMatchResult(probe_faceprints, gallery.GetFaceprints(user_index), probe_has_mask, thresholds, result, updated_faceprints);
+
+    return result;
+}
+
+template <typename RowGallery>
+void Matcher::MatchRowGalleryBatch(const std::vector<MatchElement>& probes, const RowGallery& gallery,
+                                   std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                   const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    const size_t num_probes = probes.size();
+    results.assign(num_probes, ExtendedMatchResult());
+    updated_faceprints.resize(num_probes);
+
+    if (gallery.Empty())
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return;
+    }
+
+    // valid probes, grouped by mask state since each group is matched against a different gallery row set.
+    std::vector<size_t> groups[2];
+    for (size_t i = 0; i < num_probes; i++)
+    {
+        if (!ValidateFaceprints(probes[i]))
+        {
+            LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation (probe %zu).", i);
+            continue;
+        }
+        if (probes[i].data.version != gallery.GetVersion())
+        {
+            LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions (probe %zu).", i);
+            continue;
+        }
+        feature_t probeFaceFlags = probes[i].data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask);
+        groups[probe_has_mask ? 1 : 0].push_back(i);
+    }
+
+    for (int mask_group = 0; mask_group < 2; mask_group++)
+    {
+        const auto& group = groups[mask_group];
+        const size_t group_size = group.size();
+        if (group_size == 0)
+        {
+            continue;
+        }
+        const bool probe_has_mask = (mask_group == 1);
+
+        std::vector<const feature_t*> probeVectors(group_size);
+        std::vector<uint32_t> probeNorms(group_size);
+        std::vector<short> probeNormMsbs(group_size);
+        for (size_t p = 0; p < group_size; p++)
+        {
+            probeVectors[p] = &probes[group[p]].data.featuresVector[0];
+            GetProbeNorm(probeVectors[p], probeNorms[p], probeNormMsbs[p]);
+        }
+
+        std::vector<TagResult> best(group_size);
+        GetBatchScores(probeVectors.data(), probeNorms.data(), probeNormMsbs.data(), group_size, gallery, best.data(), probe_has_mask,
+                       pool);
+
+        for (size_t p = 0; p < group_size; p++)
+        {
+            size_t i = group[p];
+            results[i].maxScore = best[p].score;
+            results[i].userId = best[p].idx;
+            HandleMatchResult(probes[i], gallery.GetFaceprints(static_cast<size_t>(best[p].idx)), probe_has_mask, thresholds, results[i],
+                              updated_faceprints[i]);
+        }
+    }
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                    MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, gallery, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
+{
+    return MatchRowGallery(probe_faceprints, gallery, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                    RecentMatches& recent, Faceprints& updated_faceprints,
+                                                    const ThresholdsConfidenceEnum confidenceLevel, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, gallery, recent, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                    RecentMatches& recent, Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    ExtendedMatchResult result;
+    TagResult candidate;
+    bool has_candidate = GetRecentCandidate(probe_faceprints, gallery, recent, thresholds, candidate);
+    bool early_accept = has_candidate && recent.EarlyAccept();
+    if (early_accept)
+    {
+        feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask);
+        result.maxScore = candidate.score;
+        result.userId = candidate.idx;
+        HandleMatchResult(probe_faceprints, gallery.GetFaceprints(static_cast<size_t>(candidate.idx)), probe_has_mask, thresholds, result,
+                          updated_faceprints);
+    }
+    else
+    {
+        result = MatchFaceprintsToArray(probe_faceprints, gallery, updated_faceprints, thresholds, pool);
+        if (has_candidate)
+        {
+            recent.RecordEarlyAcceptCandidate(result.userId == candidate.idx);
+        }
+    }
+    if (result.userId < 0)
+    {
+        return result;
+    }
+
+    const char* user_id = gallery.GetUserId(static_cast<size_t>(result.userId));
+    bool recent_hit = result.isSame && recent.Contains(user_id);
+    if (result.isSame)
+    {
+        recent.Touch(user_id);
+    }
+    double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    recent.RecordMatch(recent_hit, early_accept, elapsed_us);
+    return result;
+}
+
+bool Matcher::GetRecentCandidate(const MatchElement& probe_faceprints, const FaceprintGallery& gallery, const RecentMatches& recent,
+                                 const Thresholds& thresholds, TagResult& candidate)
+{
+    // invalid probes are left to the full scan, which reports them.
+    if (recent.Users().empty() || !IsInFeatureRange<RSID_NUM_OF_RECOGNITION_FEATURES>(&probe_faceprints.data.featuresVector[0]) ||
+        probe_faceprints.data.version != gallery.GetVersion())
+    {
+        return false;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask);
+
+    const feature_t* probeVector = &probe_faceprints.data.featuresVector[0];
+    uint32_t probeNorm;
+    short probeNormMsb;
+    GetProbeNorm(probeVector, probeNorm, probeNormMsb);
+
+    // same scores as the full scan (GetScoresInRange()), for the recent users only.
+    const uint32_t vec_length = static_cast<uint32_t>(FaceprintGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+    const feature_t* galeryVectors = gallery.Descriptors(probe_has_mask);
+    const uint32_t* galeryNorms = gallery.Norms(probe_has_mask);
+    const short* galeryNormMsbs = gallery.NormMsbs(probe_has_mask);
+
+    match_calc_t maxScore = -1;
+    int maxSubject = -1;
+    for (const auto& user_id : recent.Users())
+    {
+        int slot = gallery.Find(user_id.c_str());
+        if (slot < 0)
+        {
+            continue;
+        }
+        int32_t corr = kernels.dot(probeVector, galeryVectors + static_cast<size_t>(slot) * vec_length, vec_length);
+        match_calc_t matchScore = NormalizeCorrelation(corr, probeNorm, probeNormMsb, galeryNorms[slot], galeryNormMsbs[slot]);
+        if (matchScore > maxScore)
+        {
+            maxScore = matchScore;
+            maxSubject = slot;
+        }
+    }
+    if (maxSubject < 0)
+    {
+        return false;
+    }
+
+    const Faceprints& matched_faceprints = gallery.GetFaceprints(static_cast<size_t>(maxSubject));
+    AdaptiveThresholds adaptiveThresholds;
+    InitAdaptiveThresholds(thresholds, adaptiveThresholds);
+    HandleThresholdsConfiguration(probe_has_mask, matched_faceprints, adaptiveThresholds);
+    if (maxScore <= adaptiveThresholds.activeStrongThreshold + recent.EarlyAcceptMargin())
+    {
+        return false;
+    }
+
+    candidate.score = maxScore;
+    candidate.idx = maxSubject;
+    return true;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayTopK(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                        Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                        TagResult* top_k, size_t k, size_t& num_candidates, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArrayTopK(probe_faceprints, gallery, updated_faceprints, thresholds, top_k, k, num_candidates, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayTopK(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                        Faceprints& updated_faceprints, const Thresholds& thresholds, TagResult* top_k,
+                                                        size_t k, size_t& num_candidates, MatcherThreadPool* pool)
+{
+    num_candidates = 0;
+
+    // the best candidate is the single-best result, so nothing to collect means a plain scan.
+    if (top_k == nullptr || k == 0)
+    {
+        return MatchFaceprintsToArray(probe_faceprints, gallery, updated_faceprints, thresholds, pool);
+    }
+
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    if (!GetTopKScores(probe_faceprints, gallery, top_k, k, num_candidates, probe_has_mask, pool) || num_candidates == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetTopKScores() - please check.");
+        return result;
+    }
+
+    result.maxScore = top_k[0].score;
+    result.userId = top_k[0].idx;
+
+    HandleMatchResult(probe_faceprints, gallery.GetFaceprints(static_cast<size_t>(result.userId)), probe_has_mask, thresholds, result,
+                      updated_faceprints);
+
+    return result;
+}
+
+match_calc_t Matcher::ScoreMargin(const TagResult* top_k, size_t num_candidates)
+{
+    if (top_k == nullptr || num_candidates == 0)
+    {
+        return 0;
+    }
+    if (num_candidates == 1)
+    {
+        return top_k[0].score;
+    }
+    return static_cast<match_calc_t>(top_k[0].score - top_k[1].score);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayPrefiltered(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                              Faceprints& updated_faceprints,
+                                                              const ThresholdsConfidenceEnum confidenceLevel, size_t num_rescore,
+                                                              MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArrayPrefiltered(probe_faceprints, gallery, updated_faceprints, thresholds, num_rescore, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayPrefiltered(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                              Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                              size_t num_rescore, MatcherThreadPool* pool)
+{
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    std::vector<TagResult> candidates(std::max<size_t>(1, std::min(num_rescore, gallery.Size())));
+    size_t num_candidates = 0;
+    if (!GetPrefilterCandidates(probe_faceprints, gallery, candidates.data(), candidates.size(), num_candidates, probe_has_mask, pool))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetPrefilterCandidates() - please check.");
+        return result;
+    }
+
+    TagResult scoresResult;
+    RescoreCandidates(&probe_faceprints.data.featuresVector[0], gallery, candidates.data(), num_candidates, scoresResult,
+                      probe_has_mask);
+
+    result.maxScore = scoresResult.score;
+    result.userId = scoresResult.idx;
+
+    size_t user_index = (size_t)result.userId;
+    if (user_index >= gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return result;
+    }
+
+    HandleMatchResult(probe_faceprints, gallery.GetFaceprints(user_index), probe_has_mask, thresholds, result, updated_faceprints);
+
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const HnswIndex& index,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                    size_t ef)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, index, updated_faceprints, thresholds, ef);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const HnswIndex& index,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds, size_t ef)
+{
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    if (index.Empty())
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty index.");
+        return result;
+    }
+
+    if (probe_faceprints.data.version != index.GetVersion())
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return result;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    // the graph is over the no-mask vectors, so all ef candidates are rescored exactly (a masked probe may rank
+    // them differently against the with-mask vectors).
+    ef = (ef == 0) ? index.GetParams().ef_search : ef;
+    std::vector<TagResult> candidates(ef);
+    size_t num_candidates = index.Search(&probe_faceprints.data.featuresVector[0], candidates.data(), ef, ef);
+
+    TagResult scoresResult;
+    RescoreIndexCandidates(probe_faceprints, index, candidates.data(), num_candidates, scoresResult, probe_has_mask);
+
+    result.maxScore = scoresResult.score;
+    result.userId = scoresResult.idx;
+
+    if (result.userId < 0)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return result;
+    }
+
+    HandleMatchResult(probe_faceprints, index.GetFaceprints(static_cast<size_t>(result.userId)), probe_has_mask, thresholds, result,
+                      updated_faceprints);
+
+    return result;
+}
+
+PrefilterRecall Matcher::MeasurePrefilterRecall(const std::vector<MatchElement>& probes, const FaceprintGallery& gallery,
+                                                size_t num_rescore, MatcherThreadPool* pool)
+{
+    PrefilterRecall recall;
+
+    std::vector<TagResult> candidates(std::max<size_t>(1, std::min(num_rescore, gallery.Size())));
+    for (const auto& probe : probes)
+    {
+        if (!ValidateFaceprints(probe))
+        {
+            continue;
+        }
+
+        feature_t probeFaceFlags = probe.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask);
+
+        TagResult exactResult;
+        size_t num_candidates = 0;
+        if (!GetScores(probe, gallery, exactResult, probe_has_mask, pool) ||
+            !GetPrefilterCandidates(probe, gallery, candidates.data(), candidates.size(), num_candidates, probe_has_mask, pool))
+        {
+            continue;
+        }
+
+        recall.num_probes++;
+        for (size_t i = 0; i < num_candidates; i++)
+        {
+            if (candidates[i].idx == exactResult.idx)
+            {
+                recall.num_survived++;
+                break;
+            }
+        }
+    }
+
+    recall.recall = (recall.num_probes > 0) ? static_cast<float>(recall.num_survived) / static_cast<float>(recall.num_probes) : 0.0f;
+    LOG_INFO(LOG_TAG, "Prefilter recall with %zu rescored: %zu / %zu probes (%.4f)", num_rescore, recall.num_survived, recall.num_probes,
+             recall.recall);
+    return recall;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const PackedGallery& gallery,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                    MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, gallery, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const PackedGallery& gallery,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
+{
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    TagResult scoresResult;
+    if (!GetScores(probe_faceprints, gallery, scoresResult, probe_has_mask, pool))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    result.maxScore = scoresResult.score;
+    result.userId = scoresResult.idx;
+
+    size_t user_index = (size_t)result.userId;
+    if (user_index >= gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return result;
+    }
+
+    HandleMatchResult(probe_faceprints, gallery.GetFaceprints(user_index), probe_has_mask, thresholds, result, updated_faceprints);
+
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayQuantized(const MatchElement& probe_faceprints, const PackedGallery& gallery,
+                                                             Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                             size_t num_rescore, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArrayQuantized(probe_faceprints, gallery, updated_faceprints, thresholds, num_rescore, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayQuantized(const MatchElement& probe_faceprints, const PackedGallery& gallery,
+                                                             Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                             size_t num_rescore, MatcherThreadPool* pool)
+{
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    std::vector<TagResult> candidates(std::max<size_t>(1, std::min(num_rescore, gallery.Size())));
+    size_t num_candidates = 0;
+    if (!GetQuantizedCandidates(probe_faceprints, gallery, candidates.data(), candidates.size(), num_candidates, probe_has_mask, pool))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetQuantizedCandidates() - please check.");
+        return result;
+    }
+
+    TagResult scoresResult;
+    RescoreCandidates(&probe_faceprints.data.featuresVector[0], gallery, candidates.data(), num_candidates, scoresResult,
+                      probe_has_mask);
+
+    result.maxScore = scoresResult.score;
+    result.userId = scoresResult.idx;
+
+    size_t user_index = (size_t)result.userId;
+    if (user_index >= gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return result;
+    }
+
+    HandleMatchResult(probe_faceprints, gallery.GetFaceprints(user_index), probe_has_mask, thresholds, result, updated_faceprints);
+
+    return result;
+}
+
+PrefilterRecall Matcher::MeasurePrefilterRecall(const std::vector<MatchElement>& probes, const PackedGallery& gallery,
+                                                size_t num_rescore, MatcherThreadPool* pool)
+{
+    PrefilterRecall recall;
+
+    std::vector<TagResult> candidates(std::max<size_t>(1, std::min(num_rescore, gallery.Size())));
+    double total_error = 0;
+    for (const auto& probe : probes)
+    {
+        if (!ValidateFaceprints(probe))
+        {
+            continue;
+        }
+
+        feature_t probeFaceFlags = probe.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask);
+
+        TagResult exactResult;
+        size_t num_candidates = 0;
+        if (!GetScores(probe, gallery, exactResult, probe_has_mask, pool) ||
+            !GetQuantizedCandidates(probe, gallery, candidates.data(), candidates.size(), num_candidates, probe_has_mask, pool))
+        {
+            continue;
+        }
+
+        // int8 score of the exact best match.
+        int8_t probeVector[PackedGallery::RowLength];
+        uint32_t probeNorm;
+        short probeNormMsb;
+        GetQuantizedProbe(&probe.data.featuresVector[0], probeVector, probeNorm, probeNormMsb);
+        size_t best = static_cast<size_t>(exactResult.idx);
+        int32_t corr = MatcherKernels::Active().dot_int8(probeVector, gallery.QuantizedRow(best, probe_has_mask),
+                                                         static_cast<uint32_t>(PackedGallery::RowLength));
+        match_calc_t quantizedScore = NormalizeCorrelation(corr, probeNorm, probeNormMsb, gallery.QuantizedNorms(probe_has_mask)[best],
+                                                           gallery.QuantizedNormMsbs(probe_has_mask)[best]);
+        int error = quantizedScore - exactResult.score;
+        total_error += error;
+        if (std::abs(error) > std::abs(recall.max_score_error))
+        {
+            recall.max_score_error = error;
+        }
+
+        recall.num_probes++;
+        for (size_t i = 0; i < num_candidates; i++)
+        {
+            if (candidates[i].idx == exactResult.idx)
+            {
+                recall.num_survived++;
+                break;
+            }
+        }
+    }
+
+    if (recall.num_probes > 0)
+    {
+        recall.recall = static_cast<float>(recall.num_survived) / static_cast<float>(recall.num_probes);
+        recall.mean_score_error = static_cast<float>(total_error / static_cast<double>(recall.num_probes));
+    }
+    LOG_INFO(LOG_TAG, "Quantized recall with %zu rescored: %zu / %zu probes (%.4f), score error mean %.2f max %d", num_rescore,
+             recall.num_survived, recall.num_probes, recall.recall, recall.mean_score_error, recall.max_score_error);
+    return recall;
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const FaceprintGallery& gallery,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const ThresholdsConfidenceEnum confidenceLevel, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    MatchFaceprintsBatchToArray(probes, gallery, results, updated_faceprints, thresholds, pool);
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const FaceprintGallery& gallery,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    MatchRowGalleryBatch(probes, gallery, results, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const GalleryFile& file,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                    MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, file, updated_faceprints, thresholds, pool);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const GalleryFile& file,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
+{
+    std::vector<ExtendedMatchResult> results;
+    std::vector<Faceprints> updated;
+    MatchFaceprintsBatchToArray(std::vector<MatchElement>(1, probe_faceprints), file, results, updated, thresholds, pool);
+    if (results[0].should_update)
+    {
+        updated_faceprints = updated[0];
+    }
+    return results[0];
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const GalleryFile& file,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const ThresholdsConfidenceEnum confidenceLevel, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    MatchFaceprintsBatchToArray(probes, file, results, updated_faceprints, thresholds, pool);
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const GalleryFile& file,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    const size_t num_probes = probes.size();
+    results.assign(num_probes, ExtendedMatchResult());
+    updated_faceprints.resize(num_probes);
+
+    if (file.Size() == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
+        return;
+    }
+
+    // probes still matched, and the best match of each so far. the best faceprints are copied out of their chunk, which
+    // is gone by the end of the scan.
+    std::vector<char> active(num_probes, 0);
+    std::vector<char> probe_has_mask(num_probes, 0);
+    std::vector<TagResult> best(num_probes);
+    std::vector<Faceprints> best_faceprints(num_probes);
+    for (size_t i = 0; i < num_probes; i++)
+    {
+        if (!ValidateFaceprints(probes[i]))
+        {
+            LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation (probe %zu).", i);
+            continue;
+        }
+        feature_t probeFaceFlags = probes[i].data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        probe_has_mask[i] = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? 1 : 0;
+        active[i] = 1;
+    }
+
+    // chunks are merged in file order with a strict comparison, so ties resolve to the lowest index as in memory.
+    bool read_ok = file.Scan([&](const GalleryFile::Chunk& chunk) {
+        FaceprintsArray faceprints;
+        faceprints.first = chunk.faceprints;
+        faceprints.count = chunk.count;
+        for (size_t i = 0; i < num_probes; i++)
+        {
+            if (!active[i])
+            {
+                continue;
+            }
+            if (chunk.first == 0 && probes[i].data.version != faceprints[0].data.version)
+            {
+                LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
+                active[i] = 0;
+                continue;
+            }
+
+            TagResult chunk_result;
+            if (!GetScores(probes[i], faceprints, chunk_result, probe_has_mask[i] != 0, pool))
+            {
+                LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+                active[i] = 0;
+                continue;
+            }
+            if (chunk.first == 0 || chunk_result.score > best[i].score)
+            {
+                best[i].score = chunk_result.score;
+                best[i].idx = static_cast<int>(chunk.first) + chunk_result.idx;
+                best_faceprints[i] = faceprints[static_cast<size_t>(chunk_result.idx)];
+            }
+        }
+        return true;
+    });
+
+    if (!read_ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed reading the gallery file.");
+        return;
+    }
+
+    for (size_t i = 0; i < num_probes; i++)
+    {
+        if (!active[i])
+        {
+            continue;
+        }
+        results[i].maxScore = best[i].score;
+        results[i].userId = best[i].idx;
+        HandleMatchResult(probes[i], best_faceprints[i], probe_has_mask[i] != 0, thresholds, results[i], updated_faceprints[i]);
+    }
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const ShardedGallery& gallery,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    return MatchFaceprintsToArray(probe_faceprints, gallery, updated_faceprints, thresholds);
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const ShardedGallery& gallery,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return result;
+    }
+
+    if (gallery.Empty())
+    {
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return result;
+    }
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    const size_t num_shards = gallery.NumShards();
+    std::vector<TagResult> shard_results(num_shards);
+    std::vector<char> shard_success(num_shards, 0);
+    gallery.RunOnShards([&](size_t shard) {
+        const auto& shard_gallery = gallery.Shard(shard);
+        shard_success[shard] = shard_gallery.Empty() || GetScores(probe_faceprints, shard_gallery, shard_results[shard], probe_has_mask,
+                                                                  &gallery.ShardPool(shard));
+    });
+
+    // shards are merged in order with a strict comparison, so ties resolve to the lowest global index.
+    bool found = false;
+    TagResult scoresResult;
+    for (size_t shard = 0, offset = 0; shard < num_shards; offset += gallery.Shard(shard).Size(), shard++)
+    {
+        if (!shard_success[shard])
+        {
+            LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+            return result;
+        }
+        if (gallery.Shard(shard).Empty())
+        {
+            continue;
+        }
+        if (!found || shard_results[shard].score > scoresResult.score)
+        {
+            scoresResult.score = shard_results[shard].score;
+            scoresResult.idx = static_cast<int>(offset) + shard_results[shard].idx;
+            found = true;
+        }
+    }
+
+    result.maxScore = scoresResult.score;
+    result.userId = scoresResult.idx;
+
+    HandleMatchResult(probe_faceprints, gallery.GetFaceprints(static_cast<size_t>(result.userId)), probe_has_mask, thresholds, result,
+                      updated_faceprints);
+
+    return result;
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const ShardedGallery& gallery,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const ThresholdsConfidenceEnum confidenceLevel)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
 
-    return;
+    MatchFaceprintsBatchToArray(probes, gallery, results, updated_faceprints, thresholds);
 }
 
-bool Matcher::GetScores(const MatchElement& probe_faceprints, const std::vector<UserFaceprints_t>& existing_faceprints_array,
-                        TagResult& result, const bool& probe_has_mask)
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const ShardedGallery& gallery,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const Thresholds& thresholds)
 {
-    if (existing_faceprints_array.size() == 0)
+    const size_t num_probes = probes.size();
+    results.assign(num_probes, ExtendedMatchResult());
+    updated_faceprints.resize(num_probes);
+
+    if (gallery.Empty())
     {
-        LOG_ERROR(LOG_TAG, "Can't match with empty array.");
-        return false;
+        LOG_ERROR(LOG_TAG, "Can't match with empty gallery.");
+        return;
     }
 
-    result.score = 0;
-    result.idx = -1;
-
-    match_calc_t maxScore = -1; // must init to -1 so that maximum will be saved if matchScore is 0 !!!
-    match_calc_t matchScore = -1;
-    int numberOfSubjects = (int)existing_faceprints_array.size();
-    int maxSubject = -1;
-    uint32_t vec_length = RSID_NUM_OF_RECOGNITION_FEATURES;
-
-    const feature_t* probeVector = (feature_t*)(&(probe_faceprints.data.featuresVector[0]));
-    feature_t* galeryAdaptiveVector = nullptr;
-
-    for (int subjectIndex = 0; subjectIndex < numberOfSubjects; subjectIndex++)
+    // valid probes, grouped by mask state since each group is matched against a different gallery row set.
+    std::vector<size_t> groups[2];
+    for (size_t i = 0; i < num_probes; i++)
     {
-        matchScore = s_minPossibleScore;
-        auto& existing_faceprints = existing_faceprints_array[subjectIndex];
-
-        if (!ValidateFaceprints(existing_faceprints.faceprints))
+        if (!ValidateFaceprints(probes[i]))
         {
-            LOG_ERROR(LOG_TAG, "Invalid faceprints vector range");
-            return false;
+            LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation (probe %zu).", i);
+            continue;
         }
-
-        if (!IsSameVersion(probe_faceprints, existing_faceprints.faceprints))
+        if (probes[i].data.version != gallery.GetVersion())
         {
-            LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
-            return false;
+            LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions (probe %zu).", i);
+            continue;
         }
+        feature_t probeFaceFlags = probes[i].data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+        bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask);
+        groups[probe_has_mask ? 1 : 0].push_back(i);
+    }
 
-        // here we handle adaptive-learning for with/without mask vectors.
-        // choose the correct adaptiveVector.
-        if (!probe_has_mask)
+    const size_t num_shards = gallery.NumShards();
+    for (int mask_group = 0; mask_group < 2; mask_group++)
+    {
+        const auto& group = groups[mask_group];
+        const size_t group_size = group.size();
+        if (group_size == 0)
         {
-            galeryAdaptiveVector = (feature_t*)(&existing_faceprints.faceprints.data.adaptiveDescriptorWithoutMask[0]);
+            continue;
         }
-        else
+        const bool probe_has_mask = (mask_group == 1);
+
+        std::vector<const feature_t*> probeVectors(group_size);
+        std::vector<uint32_t> probeNorms(group_size);
+        std::vector<short> probeNormMsbs(group_size);
+        for (size_t p = 0; p < group_size; p++)
         {
-            // does the adaptive-withMask vector is valid ?
-            feature_t vec_flags = existing_faceprints.faceprints.data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
-            bool is_valid = (vec_flags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+            probeVectors[p] = &probes[group[p]].data.featuresVector[0];
+            GetProbeNorm(probeVectors[p], probeNorms[p], probeNormMsbs[p]);
+        }
 
-            if (is_valid)
+        std::vector<TagResult> shard_best(num_shards * group_size);
+        gallery.RunOnShards([&](size_t shard) {
+            const auto& shard_gallery = gallery.Shard(shard);
+            if (!shard_gallery.Empty())
             {
-                galeryAdaptiveVector = (feature_t*)(&existing_faceprints.faceprints.data.adaptiveDescriptorWithMask[0]);
+                GetBatchScores(probeVectors.data(), probeNorms.data(), probeNormMsbs.data(), group_size, shard_gallery,
+                               &shard_best[shard * group_size], probe_has_mask, &gallery.ShardPool(shard));
             }
-            else
+        });
+
+        for (size_t p = 0; p < group_size; p++)
+        {
+            // shards are merged in order with a strict comparison, so ties resolve to the lowest global index.
+            TagResult best;
+            bool found = false;
+            for (size_t shard = 0, offset = 0; shard < num_shards; offset += gallery.Shard(shard).Size(), shard++)
             {
-                galeryAdaptiveVector = (feature_t*)(&existing_faceprints.faceprints.data.adaptiveDescriptorWithoutMask[0]);
+                const TagResult& shard_result = shard_best[shard * group_size + p];
+                if (gallery.Shard(shard).Empty() || (found && shard_result.score <= best.score))
+                {
+                    continue;
+                }
+                best.score = shard_result.score;
+                best.idx = static_cast<int>(offset) + shard_result.idx;
+                found = true;
             }
-        }
-
-        MatchTwoVectors(probeVector, galeryAdaptiveVector, &matchScore, vec_length);
 
-        // save max found so far
-        if (matchScore > maxScore)
-        {
-            maxScore = matchScore;
-            maxSubject = static_cast<int>(subjectIndex);
+            size_t i = group[p];
+            results[i].maxScore = best.score;
+            results[i].userId = best.idx;
+            HandleMatchResult(probes[i], gallery.GetFaceprints(static_cast<size_t>(best.idx)), probe_has_mask, thresholds, results[i],
+                              updated_faceprints[i]);
         }
     }
+}
 
-    result.score = maxScore;
-    result.idx = maxSubject;
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const MappedGallery& gallery,
+                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                    MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
 
-    return true;
+    return MatchFaceprintsToArray(probe_faceprints, gallery, updated_faceprints, thresholds, pool);
 }
 
-void Matcher::FaceMatch(const MatchElement& probe_faceprints, const std::vector<UserFaceprints_t>& existing_faceprints_array,
-                        ExtendedMatchResult& result, const bool& probe_has_mask)
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints, const MappedGallery& gallery,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    MatcherThreadPool* pool)
 {
-    result.isSame = false;
-    result.maxScore = 0;
-    result.userId = -1;
-    result.should_update = false;
+    return MatchRowGallery(probe_faceprints, gallery, updated_faceprints, thresholds, pool);
+}
 
-    TagResult scoresResult;
-    // this function returns the index and info of the best score winner in the array.
-    bool isScoreSuccess = GetScores(probe_faceprints, existing_faceprints_array, scoresResult, probe_has_mask);
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const MappedGallery& gallery,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const ThresholdsConfidenceEnum confidenceLevel, MatcherThreadPool* pool)
+{
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
 
-    if (!isScoreSuccess)
+    MatchFaceprintsBatchToArray(probes, gallery, results, updated_faceprints, thresholds, pool);
+}
+
+void Matcher::MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const MappedGallery& gallery,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const Thresholds& thresholds, MatcherThreadPool* pool)
+{
+    MatchRowGalleryBatch(probes, gallery, results, updated_faceprints, thresholds, pool);
+}
+
+template <typename RowGallery>
+void Matcher::GetBatchScores(const feature_t* const* probeVectors, const uint32_t* probeNorms, const short* probeNormMsbs,
+                             size_t num_probes, const RowGallery& gallery, TagResult* results, const bool& probe_has_mask,
+                             MatcherThreadPool* pool)
+{
+    // each chunk of the gallery keeps its own best per probe. chunks are merged in order with a strict
+    // comparison, so ties resolve to the lowest index as in a serial scan.
+    const size_t count = gallery.Size();
+    size_t num_chunks = (pool != nullptr) ? pool->NumChunks(count) : 1;
+    if (num_chunks <= 1)
     {
-        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        GetBatchScoresInRange(probeVectors, probeNorms, probeNormMsbs, num_probes, gallery, 0, count, results, probe_has_mask);
         return;
     }
 
-    result.maxScore = scoresResult.score;
-    result.userId = scoresResult.idx;
+    std::vector<TagResult> chunk_results(num_chunks * num_probes);
+    pool->Run(num_chunks, [&](size_t chunk) {
+        size_t begin = count * chunk / num_chunks;
+        size_t end = count * (chunk + 1) / num_chunks;
+        GetBatchScoresInRange(probeVectors, probeNorms, probeNormMsbs, num_probes, gallery, begin, end, &chunk_results[chunk * num_probes],
+                              probe_has_mask);
+    });
 
-    // don't set yet - we must call HandleThresholdsConfiguration() first!
-    // result.isSame = (scoresResult.score > thresholds.activeStrongThreshold);
+    for (size_t p = 0; p < num_probes; p++)
+    {
+        results[p] = chunk_results[p];
+        for (size_t chunk = 1; chunk < num_chunks; chunk++)
+        {
+            const TagResult& chunk_result = chunk_results[chunk * num_probes + p];
+            if (chunk_result.score > results[p].score)
+            {
+                results[p] = chunk_result;
+            }
+        }
+    }
 }
 
-bool Matcher::ValidateFaceprints(const Faceprints& faceprints, bool check_enrollment_vector)
+void Matcher::GetPrecedingScores(const feature_t* const* vectors, const uint32_t* norms, const short* normMsbs, size_t count,
+                                 TagResult* results, MatcherThreadPool* pool)
 {
-    // TODO - carefull handling in MatchTwoVectors() may be required for vectors longer than 512.
-    static_assert((RSID_NUM_OF_RECOGNITION_FEATURES <= 512),
-                  "Vector length is higher than 512 - may need careful test and check, due to integer arithmetics and "
-                  "overflow risk!");
-
-    uint32_t nfeatures = static_cast<uint32_t>(RSID_NUM_OF_RECOGNITION_FEATURES);
-
-    bool is_valid = true;
+    const uint32_t vec_length = static_cast<uint32_t>(RSID_NUM_OF_RECOGNITION_FEATURES);
+    const auto& kernels = MatcherKernels::Active();
+
+    // vector i is scored against i vectors, so tasks take every num_tasks-th vector to get even work.
+    size_t num_pairs = count * (count - 1) / 2;
+    size_t num_tasks = (pool != nullptr && count > 1) ? std::min(pool->NumChunks(num_pairs), count) : 1;
+    auto score_task = [&](size_t task) {
+        for (size_t i = task; i < count; i += num_tasks)
+        {
+            results[i].score = -1;
+            results[i].idx = -1;
+            for (size_t j = 0; j < i; j++)
+            {
+                int32_t corr = kernels.dot(vectors[i], vectors[j], vec_length);
+                match_calc_t matchScore = NormalizeCorrelation(corr, norms[i], normMsbs[i], norms[j], normMsbs[j]);
+                if (matchScore > results[i].score)
+                {
+                    results[i].score = matchScore;
+                    results[i].idx = static_cast<int>(j);
+                }
+            }
+        }
+    };
 
-    if (check_enrollment_vector)
+    if (num_tasks > 1)
     {
-        is_valid = ValidateVector(&faceprints.data.enrollmentDescriptor[0], nfeatures);
+        pool->Run(num_tasks, score_task);
     }
     else
     {
-        is_valid = ValidateVector(&faceprints.data.adaptiveDescriptorWithoutMask[0], nfeatures);
+        score_task(0);
     }
+}
 
-    if (!is_valid)
+void Matcher::GetTileScores(const feature_t* rows1, const uint32_t* norms1, const short* normMsbs1, size_t count1, const feature_t* rows2,
+                            const uint32_t* norms2, const short* normMsbs2, size_t count2, bool same_tile, match_calc_t* scores)
+{
+    // rows of tile 1 are scored 4 at a time (dot4), so each row of tile 2 is loaded once per 4 rows.
+    const size_t probeBlock = 4;
+    const uint32_t vec_length = static_cast<uint32_t>(FaceprintGallery::RowLength);
+    const auto& kernels = MatcherKernels::Active();
+
+    for (size_t i0 = 0; i0 < count1; i0 += probeBlock)
     {
-        LOG_ERROR(LOG_TAG, "Vector (Faceprints faceprint) validation failed!");
-    }
+        size_t numBlockRows = std::min(probeBlock, count1 - i0);
+        const feature_t* blockRows[4];
+        for (size_t k = 0; k < probeBlock; k++)
+        {
+            blockRows[k] = rows1 + (i0 + std::min(k, numBlockRows - 1)) * vec_length;
+        }
 
-    return is_valid;
+        // on the diagonal tile only j > i is needed, which starts after the first row of the block.
+        for (size_t j = same_tile ? i0 + 1 : 0; j < count2; j++)
+        {
+            int32_t corrs[4];
+            kernels.dot4(rows2 + j * vec_length, blockRows, vec_length, corrs);
+            for (size_t k = 0; k < numBlockRows; k++)
+            {
+                size_t i = i0 + k;
+                scores[i * count2 + j] = NormalizeCorrelation(corrs[k], norms1[i], normMsbs1[i], norms2[j], normMsbs2[j]);
+            }
+        }
+    }
 }
 
-bool Matcher::ValidateFaceprints(const MatchElement& faceprints)
+SimilarityAudit Matcher::AuditGallery(const FaceprintGallery& gallery, const SimilarityAuditOptions& options,
+                                      const SimilarPairsCallback& on_pairs, const SimilarityAuditProgressCallback& on_progress,
+                                      MatcherThreadPool* pool)
 {
-    // TODO - carefull handling in MatchTwoVectors() may be required for vectors longer than 512.
-    static_assert((RSID_NUM_OF_RECOGNITION_FEATURES <= 512),
-                  "Vector length is higher than 512 - may need careful test and check, due to integer arithmetics and "
-                  "overflow risk!");
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+
+    SimilarityAudit audit;
+    const size_t count = gallery.Size();
+    audit.num_users = count;
+    audit.total_pairs = (count > 1) ? static_cast<uint64_t>(count) * (count - 1) / 2 : 0;
+    if (!options.enrollment && !options.adaptive)
+    {
+        LOG_ERROR(LOG_TAG, "Nothing to audit: neither enrollment nor adaptive descriptors selected.");
+        return audit;
+    }
 
-    uint32_t nfeatures = static_cast<uint32_t>(RSID_NUM_OF_RECOGNITION_FEATURES);
+    const size_t vec_length = FaceprintGallery::RowLength;
+    const size_t tile_rows = std::max<size_t>(options.tile_rows, 4);
+    const size_t num_tiles = (count + tile_rows - 1) / tile_rows;
+
+    // the adaptive rows and norms are the gallery's no-mask ones. enrollment norms are computed once, and the enrollment
+    // rows of each tile are gathered next to each other when the tile is scored.
+    const feature_t* adaptiveRows = gallery.Descriptors(false);
+    const uint32_t* adaptiveNorms = gallery.Norms(false);
+    const short* adaptiveNormMsbs = gallery.NormMsbs(false);
+    std::vector<uint32_t> enrollmentNorms;
+    std::vector<short> enrollmentNormMsbs;
+    if (options.enrollment)
+    {
+        enrollmentNorms.resize(count);
+        enrollmentNormMsbs.resize(count);
+        for (size_t slot = 0; slot < count; slot++)
+        {
+            GetProbeNorm(&gallery.GetFaceprints(slot).data.enrollmentDescriptor[0], enrollmentNorms[slot], enrollmentNormMsbs[slot]);
+        }
+    }
 
-    bool is_valid = ValidateVector(&faceprints.data.featuresVector[0], nfeatures);
+    struct TilePair
+    {
+        size_t tile1;
+        size_t tile2;
+        std::vector<SimilarPair> pairs;
+    };
+
+    auto score_tile_pair = [&](TilePair& task) {
+        const size_t begin1 = task.tile1 * tile_rows, begin2 = task.tile2 * tile_rows;
+        const size_t count1 = std::min(tile_rows, count - begin1), count2 = std::min(tile_rows, count - begin2);
+        const bool same_tile = (task.tile1 == task.tile2);
+
+        std::vector<match_calc_t> enrollmentScores, adaptiveScores;
+        if (options.enrollment)
+        {
+            const size_t row_bytes = vec_length * sizeof(feature_t);
+            std::vector<feature_t> rows((same_tile ? count1 : count1 + count2) * vec_length);
+            for (size_t i = 0; i < count1; i++)
+            {
+                ::memcpy(&rows[i * vec_length], gallery.GetFaceprints(begin1 + i).data.enrollmentDescriptor, row_bytes);
+            }
+            for (size_t j = 0; j < count2 && !same_tile; j++)
+            {
+                ::memcpy(&rows[(count1 + j) * vec_length], gallery.GetFaceprints(begin2 + j).data.enrollmentDescriptor, row_bytes);
+            }
+            const feature_t* rows2 = same_tile ? rows.data() : &rows[count1 * vec_length];
+            enrollmentScores.resize(count1 * count2);
+            GetTileScores(rows.data(), &enrollmentNorms[begin1], &enrollmentNormMsbs[begin1], count1, rows2, &enrollmentNorms[begin2],
+                          &enrollmentNormMsbs[begin2], count2, same_tile, enrollmentScores.data());
+        }
+        if (options.adaptive)
+        {
+            adaptiveScores.resize(count1 * count2);
+            GetTileScores(adaptiveRows + begin1 * vec_length, adaptiveNorms + begin1, adaptiveNormMsbs + begin1, count1,
+                          adaptiveRows + begin2 * vec_length, adaptiveNorms + begin2, adaptiveNormMsbs + begin2, count2, same_tile,
+                          adaptiveScores.data());
+        }
 
-    if (!is_valid)
+        for (size_t i = 0; i < count1; i++)
+        {
+            for (size_t j = same_tile ? i + 1 : 0; j < count2; j++)
+            {
+                match_calc_t enrollmentScore = options.enrollment ? enrollmentScores[i * count2 + j] : -1;
+                match_calc_t adaptiveScore = options.adaptive ? adaptiveScores[i * count2 + j] : -1;
+                if (enrollmentScore > options.threshold || adaptiveScore > options.threshold)
+                {
+                    SimilarPair pair;
+                    pair.slot1 = static_cast<uint32_t>(begin1 + i);
+                    pair.slot2 = static_cast<uint32_t>(begin2 + j);
+                    pair.enrollment_score = enrollmentScore;
+                    pair.adaptive_score = adaptiveScore;
+                    task.pairs.push_back(pair);
+                }
+            }
+        }
+    };
+
+    // tile pairs are scored in rounds of a few per thread, in upper triangular row order. pairs are passed on after
+    // each round, so only the pairs of a round are held.
+    const size_t round_size = 16 * ((pool != nullptr) ? pool->GetNumThreads() : 1);
+    std::vector<TilePair> round;
+    size_t next1 = 0, next2 = 0;
+    auto last_progress = start;
+    while (next1 < num_tiles)
     {
-        LOG_ERROR(LOG_TAG, "Vector (MatchElement faceprint) validation failed!");
+        round.clear();
+        while (round.size() < round_size && next1 < num_tiles)
+        {
+            round.push_back({next1, next2, {}});
+            if (++next2 == num_tiles)
+            {
+                next2 = ++next1;
+            }
+        }
+
+        auto score_task = [&](size_t task) { score_tile_pair(round[task]); };
+        if (pool != nullptr && round.size() > 1)
+        {
+            pool->Run(round.size(), score_task);
+        }
+        else
+        {
+            for (size_t task = 0; task < round.size(); task++)
+            {
+                score_task(task);
+            }
+        }
+
+        for (const auto& task : round)
+        {
+            uint64_t count1 = std::min(tile_rows, count - task.tile1 * tile_rows);
+            uint64_t count2 = std::min(tile_rows, count - task.tile2 * tile_rows);
+            audit.num_pairs += (task.tile1 == task.tile2) ? count1 * (count1 - 1) / 2 : count1 * count2;
+            audit.num_similar += task.pairs.size();
+            if (!task.pairs.empty() && on_pairs)
+            {
+                on_pairs(task.pairs.data(), task.pairs.size());
+            }
+        }
+
+        auto now = Clock::now();
+        audit.elapsed_seconds = std::chrono::duration<double>(now - start).count();
+        double pair_seconds = audit.elapsed_seconds / static_cast<double>(std::max<uint64_t>(audit.num_pairs, 1));
+        audit.remaining_seconds = pair_seconds * static_cast<double>(audit.total_pairs - audit.num_pairs);
+        bool done = (next1 >= num_tiles);
+        if (on_progress && !done && std::chrono::duration<double>(now - last_progress).count() >= options.progress_interval)
+        {
+            on_progress(audit);
+            last_progress = now;
+        }
     }
 
-    return is_valid;
+    audit.elapsed_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    audit.remaining_seconds = 0;
+    if (on_progress)
+    {
+        on_progress(audit);
+    }
+    LOG_INFO(LOG_TAG, "Audit of %zu users: %llu similar pairs of %llu in %.1f s", count, static_cast<unsigned long long>(audit.num_similar),
+             static_cast<unsigned long long>(audit.total_pairs), audit.elapsed_seconds);
+    return audit;
 }
 
-ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints,
-                                                    const std::vector<UserFaceprints_t>& existing_faceprints_array,
-                                                    Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel)
+void Matcher::FindDuplicates(const std::vector<Faceprints>& enrollments, const FaceprintGallery& gallery,
+                             std::vector<DuplicateCheckResult>& results, const ThresholdsConfidenceEnum confidenceLevel,
+                             MatcherThreadPool* pool)
 {
     Thresholds thresholds;
     SetToDefaultThresholds(thresholds, confidenceLevel);
 
-    ExtendedMatchResult result = MatchFaceprintsToArray(probe_faceprints, existing_faceprints_array, updated_faceprints, thresholds);
-
-    return result;
+    FindDuplicates(enrollments, gallery, results, thresholds.strongThreshold_pNMgNM, pool);
 }
 
-ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_faceprints,
-                                                    const std::vector<UserFaceprints_t>& existing_faceprints_array,
-                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+void Matcher::FindDuplicates(const std::vector<Faceprints>& enrollments, const FaceprintGallery& gallery,
+                             std::vector<DuplicateCheckResult>& results, match_calc_t threshold, MatcherThreadPool* pool)
 {
-    ExtendedMatchResult result;
+    results.assign(enrollments.size(), DuplicateCheckResult());
 
-    result.userId = -1;
-    result.maxScore = 0;
-
-    if (!ValidateFaceprints(probe_faceprints))
+    // valid enrollments. the batch must share a single version, the gallery's unless it is empty.
+    std::vector<size_t> valid;
+    int version = gallery.Empty() ? (enrollments.empty() ? RSID_FACEPRINTS_VERSION : enrollments[0].data.version) : gallery.GetVersion();
+    for (size_t i = 0; i < enrollments.size(); i++)
     {
-        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
-        return result;
+        if (!ValidateFaceprints(enrollments[i], true))
+        {
+            LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation (enrollment %zu).", i);
+            continue;
+        }
+        if (enrollments[i].data.version != version)
+        {
+            LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions (enrollment %zu).", i);
+            continue;
+        }
+        valid.push_back(i);
     }
 
-    if (existing_faceprints_array.size() == 0)
+    const size_t num_valid = valid.size();
+    if (num_valid == 0)
     {
-        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
-        return result;
+        return;
     }
 
-    if (probe_faceprints.data.version != existing_faceprints_array[0].faceprints.data.version)
+    std::vector<const feature_t*> vectors(num_valid);
+    std::vector<uint32_t> norms(num_valid);
+    std::vector<short> normMsbs(num_valid);
+    for (size_t p = 0; p < num_valid; p++)
     {
-        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
-        return result;
+        vectors[p] = &enrollments[valid[p]].data.enrollmentDescriptor[0];
+        GetProbeNorm(vectors[p], norms[p], normMsbs[p]);
     }
 
-    // Try to match the 2 faceprints, and raise should_update flag respecively.
-    // note that here we also set the active thresholds configurtion
-    // which is used for adaptive-learning w/wo mask.
-    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
-    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
-
-    FaceMatch(probe_faceprints, existing_faceprints_array, result, probe_has_mask);
-
-    size_t user_index = (size_t)result.userId;
+    // vs. the gallery: enrollments are no-mask, so they are matched against the no-mask rows, as a no-mask probe.
+    std::vector<TagResult> best(num_valid);
+    if (!gallery.Empty())
+    {
+        GetBatchScores(vectors.data(), norms.data(), normMsbs.data(), num_valid, gallery, best.data(), false, pool);
+        for (size_t p = 0; p < num_valid; p++)
+        {
+            results[valid[p]].gallery_slot = best[p].idx;
+            results[valid[p]].gallery_score = best[p].score;
+        }
+    }
 
-    // if no user matched, finish here and return.
-    if (user_index >= existing_faceprints_array.size())
+    // vs. each other.
+    GetPrecedingScores(vectors.data(), norms.data(), normMsbs.data(), num_valid, best.data(), pool);
+    size_t num_duplicates = 0;
+    for (size_t p = 0; p < num_valid; p++)
     {
-        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
-        return result;
+        auto& result = results[valid[p]];
+        if (best[p].idx >= 0)
+        {
+            result.batch_index = static_cast<int>(valid[static_cast<size_t>(best[p].idx)]);
+            result.batch_score = best[p].score;
+        }
+        result.is_duplicate = (result.gallery_score > threshold) || (result.batch_score > threshold);
+        num_duplicates += result.is_duplicate ? 1 : 0;
     }
 
+    LOG_DEBUG(LOG_TAG, "Duplicate check of %zu enrollments vs. %zu users: %zu duplicates", enrollments.size(), gallery.Size(),
+              num_duplicates);
+}
+
+void Matcher::HandleMatchResult(const MatchElement& probe_faceprints, const Faceprints& matched_faceprints, const bool& probe_has_mask,
+                                const Thresholds& thresholds, ExtendedMatchResult& result, Faceprints& updated_faceprints)
+{
     AdaptiveThresholds adaptiveThresholds;
     InitAdaptiveThresholds(thresholds, adaptiveThresholds);
 
     // here we handle with/without mask adaptive learning.
     // we choose the correct thresholds Configuration, based on the probe-vector and the (matched) gallery-vector.
-    HandleThresholdsConfiguration(probe_has_mask, existing_faceprints_array[user_index].faceprints, adaptiveThresholds);
+    HandleThresholdsConfiguration(probe_has_mask, matched_faceprints, adaptiveThresholds);
 
     // here correct active thresholds set correctly, so we can use them.
     result.isSame = (result.maxScore > adaptiveThresholds.activeStrongThreshold);
@@ -381,7 +2416,7 @@ ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_fa
 
     // Does the DB entry of the user is RGB type ?
     // bool isEnrolledTypeInDbIsRgb = (FaceprintsTypeEnum::RGB ==
-    // existing_faceprints_array[user_index].faceprints.data.featuresType);
+    // matched_faceprints.data.featuresType);
 
     // if should_update then we create an update vector such that:
     // (1) the current new vector is blended into the latest adaptive vector.
@@ -390,7 +2425,7 @@ ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_fa
     {
         // Init updated_faceprints to the faceprints already exists in the DB
         //
-        updated_faceprints = existing_faceprints_array[user_index].faceprints;
+        updated_faceprints = matched_faceprints;
 
         const uint32_t vec_length = RSID_NUM_OF_RECOGNITION_FEATURES;
         const feature_t* probeVector = &probe_faceprints.data.featuresVector[0];
@@ -454,15 +2489,11 @@ ExtendedMatchResult Matcher::MatchFaceprintsToArray(const MatchElement& probe_fa
               "activeThreshConfig: %d, confidenceLevel: %d.",
               result.maxScore, result.isSame, result.should_update, probe_has_mask, adaptiveThresholds.activeStrongThreshold,
               adaptiveThresholds.activeUpdateThreshold, adaptiveThresholds.activeConfig, adaptiveThresholds.thresholds.confidenceLevel);
-
-    return result;
 }
 
 bool Matcher::LimitAdaptiveVector(feature_t* adaptive_faceprints_vec, const feature_t* anchor_faceprints_vec,
                                   const AdaptiveThresholds& adaptiveThresholds, const uint32_t vec_length)
 {
-    bool success = true;
-
     if ((nullptr == anchor_faceprints_vec) || (nullptr == adaptive_faceprints_vec))
     {
         LOG_ERROR(LOG_TAG, "Null pointer detected : Skipping function.");
@@ -472,6 +2503,10 @@ bool Matcher::LimitAdaptiveVector(feature_t* adaptive_faceprints_vec, const feat
     // Explain - as long as the adaptive vector is "too far" from the anchor vector, we
     // want to update the adaptive vector with more samples of the anchor vector.
     // hence refreshing the adaptive to be more similar to the anchor vector.
+    //
+    // each iteration blends and updates the ncc sums in a single pass (see MatcherKernels::BlendSumsFn), which gives the
+    // same vectors and scores as BlendAverageVector() followed by MatchTwoVectors(). the anchor norm doesn't change.
+    // once a blend changes nothing, later ones wouldn't either, so we stop there instead of running to the limit.
 
     match_calc_t match_score = 0;
     MatchTwoVectors(adaptive_faceprints_vec, anchor_faceprints_vec, &match_score, vec_length);
@@ -480,67 +2515,64 @@ bool Matcher::LimitAdaptiveVector(feature_t* adaptive_faceprints_vec, const feat
     LOG_DEBUG(LOG_TAG, "----> match score (adaptive vs. anchor) = %d.", match_score);
 #endif
 
+    if (match_score >= adaptiveThresholds.activeIdenticalThreshold)
+    {
+        return true;
+    }
+
     // adding limit on number of iterations, e.g. if one vector is all zeros we'll get
     // deadlock here.
-    uint32_t cnt_iter = 0;
-
     uint32_t limit_num_iters = static_cast<uint32_t>(RSID_LIMIT_NUM_ITERS_NM);
     if (adaptiveThresholds.activeConfig != ThresholdsConfigEnum::ThresholdConfig_pNM_gNM)
     {
         limit_num_iters = static_cast<uint32_t>(RSID_LIMIT_NUM_ITERS_M);
     }
 
-    while ((match_score < adaptiveThresholds.activeIdenticalThreshold))
-    {
-#if (RSID_MATCHER_DEBUG_LOGS)
-        LOG_DEBUG(LOG_TAG, "----> adaptive vector is far from anchor vector. Doing update while() loop : count = %d. score = %d.", cnt_iter,
-                  match_score);
-#endif
+    // MatchTwoVectors() refuses vectors longer than 512 (score 0), so only the blends are left to do.
+    const bool can_score = (vec_length <= 512);
 
-        BlendAverageVector(adaptive_faceprints_vec, anchor_faceprints_vec, vec_length);
+    // the simd blend kernels need the validated feature range, which the anchor (e.g. the enrollment vector) isn't
+    // checked for on match. the scalar kernel is exact for any input.
+    const bool in_range = ValidateVector(adaptive_faceprints_vec, vec_length) && ValidateVector(anchor_faceprints_vec, vec_length);
+    const MatcherKernels::BlendSumsFn blend_sums =
+        in_range ? MatcherKernels::Active().blend_sums : MatcherKernels::Get(MatcherKernels::KernelIsa::Scalar)->blend_sums;
 
-        MatchTwoVectors(adaptive_faceprints_vec, anchor_faceprints_vec, &match_score, vec_length);
+    MatcherKernels::NccSums sums;
+    MatcherKernels::Active().ncc_sums(adaptive_faceprints_vec, anchor_faceprints_vec, vec_length, sums);
+    const uint32_t norm2 = (sums.norm2 == 0) ? 1 : sums.norm2;
+    const short norm2_msb = GetMsb(norm2);
 
-        cnt_iter++;
-        if (cnt_iter > limit_num_iters)
-        {
+    for (uint32_t cnt_iter = 1; cnt_iter <= limit_num_iters + 1; cnt_iter++)
+    {
 #if (RSID_MATCHER_DEBUG_LOGS)
-            LOG_DEBUG(LOG_TAG,
-                      "----> Update while() loop count reached the limit of %d iterations. Breaking the while() loop "
-                      "with score = %d.",
-                      cnt_iter, match_score);
+        LOG_DEBUG(LOG_TAG, "----> adaptive vector is far from anchor vector. Doing update while() loop : count = %d. score = %d.",
+                  cnt_iter - 1, match_score);
 #endif
 
-            success = false;
+        if (!blend_sums(adaptive_faceprints_vec, anchor_faceprints_vec, vec_length, sums))
+        {
+            // fixed point below the threshold: the remaining iterations can't change the vector or the score.
             break;
         }
-    }
-
-    return success;
-}
 
-static void ConvertFaceprintsToUserFaceprints(const Faceprints& faceprints, UserFaceprints_t& extended_faceprints)
-{
-    extended_faceprints.faceprints.data.version = faceprints.data.version;
-    extended_faceprints.faceprints.data.featuresType = faceprints.data.featuresType;
-    extended_faceprints.faceprints.data.flags = faceprints.data.flags;
+        if (can_score)
+        {
+            const uint32_t norm1 = (sums.norm1 == 0) ? 1 : sums.norm1;
+            match_score = NormalizeCorrelation(sums.corr, norm1, GetMsb(norm1), norm2, norm2_msb);
+        }
 
-    static_assert(sizeof(extended_faceprints.faceprints.data.adaptiveDescriptorWithoutMask) ==
-                      sizeof(faceprints.data.adaptiveDescriptorWithoutMask),
-                  "updated faceprints (with mask) sizes don't match");
-    ::memcpy(&extended_faceprints.faceprints.data.adaptiveDescriptorWithoutMask[0], &faceprints.data.adaptiveDescriptorWithoutMask[0],
-             sizeof(faceprints.data.adaptiveDescriptorWithoutMask));
+        if (match_score >= adaptiveThresholds.activeIdenticalThreshold)
+        {
+            return cnt_iter <= limit_num_iters;
+        }
+    }
 
-    static_assert(sizeof(extended_faceprints.faceprints.data.adaptiveDescriptorWithMask) ==
-                      sizeof(faceprints.data.adaptiveDescriptorWithMask),
-                  "updated faceprints (without) sizes don't match");
-    ::memcpy(&extended_faceprints.faceprints.data.adaptiveDescriptorWithMask[0], &faceprints.data.adaptiveDescriptorWithMask[0],
-             sizeof(faceprints.data.adaptiveDescriptorWithMask));
+#if (RSID_MATCHER_DEBUG_LOGS)
+    LOG_DEBUG(LOG_TAG, "----> Update while() loop count reached the limit of %d iterations. Breaking the while() loop with score = %d.",
+              limit_num_iters + 1, match_score);
+#endif
 
-    static_assert(sizeof(extended_faceprints.faceprints.data.enrollmentDescriptor) == sizeof(faceprints.data.enrollmentDescriptor),
-                  "enrollment faceprints sizes don't match");
-    ::memcpy(&extended_faceprints.faceprints.data.enrollmentDescriptor[0], &faceprints.data.enrollmentDescriptor[0],
-             sizeof(faceprints.data.enrollmentDescriptor));
+    return false;
 }
 
 MatchResultInternal Matcher::MatchFaceprints(const MatchElement& probe_faceprints, const Faceprints& existing_faceprints,
@@ -552,23 +2584,41 @@ MatchResultInternal Matcher::MatchFaceprints(const MatchElement& probe_faceprint
     matchResult.should_update = false;
     matchResult.score = 0;
 
-    /*
-    // No need to validate probe_faceprints here because its done during MatchFaceprintsToArray() below.
-    */
-
+    // match in place: no copy of the existing faceprints and no 1-element array, since host mode callers do this
+    // once per user in their db. same checks and result as MatchFaceprintsToArray() with a single entry.
     if (!ValidateFaceprints(existing_faceprints))
     {
         LOG_ERROR(LOG_TAG, "existing faceprints vector : failed range validation.");
         return matchResult;
     }
 
-    // init existing faceprints array
-    UserFaceprints_t existing_extended_faceprints;
-    ConvertFaceprintsToUserFaceprints(existing_faceprints, existing_extended_faceprints);
-    std::vector<UserFaceprints_t> existing_faceprints_array = {existing_extended_faceprints};
+    if (!ValidateFaceprints(probe_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return matchResult;
+    }
+
+    if (!IsSameVersion(probe_faceprints, existing_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
+        return matchResult;
+    }
+
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds, confidenceLevel);
+
+    feature_t probeFaceFlags = probe_faceprints.data.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool probe_has_mask = (probeFaceFlags == FaVectorFlagsEnum::VecFlagValidWithMask) ? true : false;
+
+    ExtendedMatchResult result;
+    match_calc_t matchScore = s_minPossibleScore;
+    MatchTwoVectors(&probe_faceprints.data.featuresVector[0], GetGalleryVector(existing_faceprints, probe_has_mask), &matchScore);
+    result.maxScore = matchScore;
+    result.userId = 0;
 
-    // match using shared code
-    ExtendedMatchResult result = MatchFaceprintsToArray(probe_faceprints, existing_faceprints_array, updated_faceprints, confidenceLevel);
+    // note: existing_faceprints may be the same object as updated_faceprints (e.g. host-mode sample).
+    // HandleMatchResult() reads the matched faceprints only before it writes the updated ones.
+    HandleMatchResult(probe_faceprints, existing_faceprints, probe_has_mask, thresholds, result, updated_faceprints);
 
 #if (RSID_MATCHER_DEBUG_LOGS)
     LOG_DEBUG(LOG_TAG, "Match score: %f, isSame: %d, shouldUpdate: %d", float(result.maxScore), result.isSame, result.should_update);
@@ -588,17 +2638,12 @@ MatchResultInternal Matcher::MatchFaceprints(const MatchElement& probe_faceprint
 //
 bool Matcher::ValidateVector(const feature_t* vec, const uint32_t vec_length)
 {
-    for (uint32_t i = 0; i < vec_length; i++)
+    // no early exit: valid vectors are scanned to the end anyway, and a branch-free loop vectorizes.
+    if (vec_length == RSID_NUM_OF_RECOGNITION_FEATURES)
     {
-        feature_t curr_feature = (feature_t)vec[i];
-
-        if (curr_feature > s_maxFeatureValue || curr_feature < s_minFeatureValue)
-        {
-            return false;
-        }
+        return IsInFeatureRange<RSID_NUM_OF_RECOGNITION_FEATURES>(vec);
     }
-
-    return true;
+    return OutOfRangeFeatures(vec, vec_length) == 0;
 }
 
 void Matcher::BlendAverageVector(feature_t* user_adaptive_faceprints, const feature_t* user_probe_faceprints, const uint32_t vec_length)
@@ -709,31 +2754,25 @@ void Matcher::MatchTwoVectors(const feature_t* T1, const feature_t* T2, match_ca
 
     uint32_t nfeatures = vec_length;
 
-    int32_t corr = 0;
-    int32_t min_corr = 0;
-    uint32_t ucorr = 0;
-    uint32_t norm1 = 0;
-    uint32_t norm2 = 0;
+    // correlation and norms are accumulated by the best simd kernel available (see MatcherKernels.h).
+    MatcherKernels::NccSums sums;
+    MatcherKernels::Active().ncc_sums(T1, T2, nfeatures, sums);
 
-    for (uint32_t i = 0; i < nfeatures; ++i)
-    {
-        int32_t t1 = static_cast<int32_t>(T1[i]);
-        int32_t t2 = static_cast<int32_t>(T2[i]);
+    // protect division by 0.
+    uint32_t norm1 = (sums.norm1 == 0) ? 1 : sums.norm1;
+    uint32_t norm2 = (sums.norm2 == 0) ? 1 : sums.norm2;
 
-        corr += t1 * t2;
-        norm1 += t1 * t1;
-        norm2 += t2 * t2;
-    }
+    *match_score = NormalizeCorrelation(sums.corr, norm1, GetMsb(norm1), norm2, GetMsb(norm2));
+}
 
-    // protect division by 0.
-    norm1 = (norm1 == 0) ? 1 : norm1;
-    norm2 = (norm2 == 0) ? 1 : norm2;
+match_calc_t Matcher::NormalizeCorrelation(int32_t corr, uint32_t norm1, short norm1_msb, uint32_t norm2, short norm2_msb)
+{
+    int32_t min_corr = 0;
+    uint32_t ucorr = 0;
 
     // negative correlation will be considered as 0 correlation.
     ucorr = static_cast<uint32_t>(std::max(corr, min_corr));
 
-    short norm1_msb = GetMsb(norm1);
-    short norm2_msb = GetMsb(norm2);
     short corr_msb = GetMsb(ucorr);
     int32_t min_shift = 0;
 
@@ -763,7 +2802,7 @@ void Matcher::MatchTwoVectors(const feature_t* T1, const feature_t* T2, match_ca
 
     // LOG_DEBUG(LOG_TAG, "ncc result: -----> grade = %u", grade);
 
-    *match_score = static_cast<match_calc_t>(grade);
+    return static_cast<match_calc_t>(grade);
 }
 
 } // namespace RealSenseID
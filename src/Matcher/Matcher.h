@@ -5,15 +5,83 @@
 #include "MatcherImplDefines.h"
 #include "RealSenseID/Faceprints.h"
 #include "RealSenseID/MatcherDefines.h"
+#include <functional>
 #include <vector>
 #include <stdint.h>
 
 namespace RealSenseID
 {
+class FaceprintGallery;
+class PackedGallery;
+class MatcherThreadPool;
+class MatcherTopK;
+class HnswIndex;
+class GallerySnapshot;
+class RecentMatches;
+class GalleryFile;
+class ShardedGallery;
+class MappedGallery;
 
 // using feature_t = short;
 using match_calc_t = short;
 
+// result of Matcher::MeasurePrefilterRecall().
+struct PrefilterRecall
+{
+    size_t num_probes = 0;   // valid probes measured
+    size_t num_survived = 0; // probes whose exact best match was among the rescored candidates
+    float recall = 0;        // num_survived / num_probes
+
+    // quantized PackedGallery only: stage one score minus exact score of each probe's exact best match.
+    float mean_score_error = 0;
+    int max_score_error = 0; // largest magnitude
+};
+
+// options of Matcher::AuditGallery().
+struct SimilarityAuditOptions
+{
+    match_calc_t threshold = RSID_STRONG_THRESHOLD_PNM_GNM_HIGH_CONFIDENCE_LEVEL; // pairs scoring above it are reported
+    bool enrollment = true;         // audit the enrollment descriptors
+    bool adaptive = true;           // audit the adaptive no-mask descriptors
+    size_t tile_rows = 256;         // users per tile: two tiles of 256 users (512KB) stay in cache while scored
+    double progress_interval = 1.0; // seconds between progress callbacks
+};
+
+// a pair of users reported by Matcher::AuditGallery(), slot1 < slot2.
+struct SimilarPair
+{
+    uint32_t slot1 = 0;
+    uint32_t slot2 = 0;
+    match_calc_t enrollment_score = -1; // -1 if not audited
+    match_calc_t adaptive_score = -1;
+};
+
+// progress and result of Matcher::AuditGallery().
+struct SimilarityAudit
+{
+    size_t num_users = 0;
+    uint64_t num_pairs = 0;     // user pairs scored so far, out of num_users * (num_users - 1) / 2
+    uint64_t total_pairs = 0;
+    uint64_t num_similar = 0;   // pairs reported so far
+    double elapsed_seconds = 0;
+    double remaining_seconds = 0; // estimate, from the rate so far
+};
+
+using SimilarPairsCallback = std::function<void(const SimilarPair* pairs, size_t count)>;
+using SimilarityAuditProgressCallback = std::function<void(const SimilarityAudit& progress)>;
+
+// result of Matcher::FindDuplicates() for one new enrollment.
+struct DuplicateCheckResult
+{
+    bool is_duplicate = false; // gallery_score or batch_score above the duplicate threshold
+
+    int gallery_slot = -1; // most similar gallery user, -1 if none (empty gallery or invalid enrollment)
+    match_calc_t gallery_score = -1;
+
+    int batch_index = -1; // most similar enrollment before this one in the batch, -1 if none
+    match_calc_t batch_score = -1;
+};
+
 class Matcher
 {
 public:
@@ -26,18 +94,258 @@ public:
     // match single vs. an array of faceprints. Used e.g. when matching user against a set of users in the database.
     // returns updated faceprints if update conditions fulfilled (indicated in result.should_update).
     // internal thresholds will be used.
+    // if a thread pool is given, the array scan is split across its threads (same result as the serial scan).
     static ExtendedMatchResult MatchFaceprintsToArray(
         const MatchElement& probe_faceprints, const std::vector<UserFaceprints_t>& existing_faceprints_array,
         Faceprints& updated_faceprints,
-        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High);
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
 
     // match single vs. an array of faceprints. Used e.g. when matching user against a set of users in the database.
     // returns updated faceprints if update conditions fulfilled (indicated in result.should_update).
     // thresholds provided by caller.
     static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints,
                                                       const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    // match a batch of probes vs. an array of faceprints: the array is scanned once (split across the pool, if any), in
+    // blocks that are scored against every probe while in cache. results[i] and updated_faceprints[i] are the same as
+    // MatchFaceprintsToArray() would return for probes[i]; invalid probes get a default result (userId = -1).
+    static void MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes,
+                                            const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                            std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                            const Thresholds& thresholds, MatcherThreadPool* pool = nullptr);
+
+    static void MatchFaceprintsBatchToArray(
+        const std::vector<MatchElement>& probes, const std::vector<UserFaceprints_t>& existing_faceprints_array,
+        std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    // match single vs. a contiguous array of count faceprints, in place: no copies and no heap allocation (unless a thread
+    // pool splits the scan). Same result as the std::vector overloads, result.userId is the array index.
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const Faceprints* existing_faceprints, size_t count, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const Faceprints* existing_faceprints,
+                                                      size_t count, Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    // match single vs. a ConcurrentGallery snapshot, without locks (see ConcurrentGallery). Same as the std::vector
+    // overloads, result.userId is the snapshot index - write adaptive updates back with ConcurrentGallery::Update().
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const GallerySnapshot& snapshot, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const GallerySnapshot& snapshot,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    // match single vs. a FaceprintGallery. Same as the std::vector overloads, but uses the gallery's precomputed
+    // descriptor layout and norms. result.userId is the gallery slot of the best match.
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const FaceprintGallery& gallery, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    // match single vs. a FaceprintGallery, with a set of recently matched users (see RecentMatches). the recent users are
+    // scored first: with early accept on, one that beats its strong threshold by the set's margin is returned without the
+    // full scan; with early accept off the full scan always runs, the result is the same as above, and the recent
+    // candidate is checked against it. matched users are moved to the front of the set, and the set's statistics (hit
+    // rate, early accepts, candidate misses, time saved) are updated.
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const FaceprintGallery& gallery, RecentMatches& recent, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                      RecentMatches& recent, Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    // match single vs. a FaceprintGallery, and also return the k best candidates (best first, gallery slot and score)
+    // in the caller's top_k array, e.g. to find look-alikes or close calls (see ScoreMargin()).
+    // candidates are kept in a fixed-size heap during the same scan. there is no allocation unless a thread pool splits the scan.
+    // the returned result and updated_faceprints are the same as MatchFaceprintsToArray(). num_candidates = min(k, gallery size).
+    static ExtendedMatchResult MatchFaceprintsToArrayTopK(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                          Faceprints& updated_faceprints, const ThresholdsConfidenceEnum confidenceLevel,
+                                                          TagResult* top_k, size_t k, size_t& num_candidates,
+                                                          MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArrayTopK(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                          Faceprints& updated_faceprints, const Thresholds& thresholds, TagResult* top_k,
+                                                          size_t k, size_t& num_candidates, MatcherThreadPool* pool = nullptr);
+
+    // score difference between the best and the second best candidates (the best score if there is a single candidate).
+    static match_calc_t ScoreMargin(const TagResult* top_k, size_t num_candidates);
+
+    // two-stage match single vs. a FaceprintGallery, for very large galleries.
+    // stage one ranks all entries by hamming distance between sign sketches (64 bytes per entry instead of 1KB),
+    // stage two rescores the num_rescore closest entries with the exact ncc of MatchTwoVectors() and applies the usual
+    // thresholds and adaptive update. the result is the same as MatchFaceprintsToArray() whenever the exact best match
+    // survives stage one, which is always the case if num_rescore >= gallery size (see MeasurePrefilterRecall()).
+    static ExtendedMatchResult MatchFaceprintsToArrayPrefiltered(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                                 Faceprints& updated_faceprints,
+                                                                 const ThresholdsConfidenceEnum confidenceLevel, size_t num_rescore,
+                                                                 MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArrayPrefiltered(const MatchElement& probe_faceprints, const FaceprintGallery& gallery,
+                                                                 Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                                 size_t num_rescore, MatcherThreadPool* pool = nullptr);
+
+    // how often the exact best match of the given probes survives the prefilter stage with num_rescore candidates.
+    // runs a full exact scan per probe - meant for tuning num_rescore on a given gallery, not for the match path.
+    static PrefilterRecall MeasurePrefilterRecall(const std::vector<MatchElement>& probes, const FaceprintGallery& gallery,
+                                                  size_t num_rescore, MatcherThreadPool* pool = nullptr);
+
+    // match single vs. a PackedGallery. Same result as the FaceprintGallery overloads: the packed rows are scored directly,
+    // with the exact scores of the unpacked faceprints. result.userId is the gallery slot of the best match.
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const PackedGallery& gallery, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const PackedGallery& gallery,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    // two-stage match single vs. a quantized PackedGallery.
+    // stage one ranks all entries by the ncc of their int8 rows with the int8 probe (512 bytes per entry), stage two
+    // rescores the num_rescore best on the packed rows and applies the usual thresholds and adaptive update, as
+    // MatchFaceprintsToArrayPrefiltered(). the result is the same as MatchFaceprintsToArray() whenever the exact best match
+    // survives stage one (see MeasurePrefilterRecall()).
+    static ExtendedMatchResult MatchFaceprintsToArrayQuantized(const MatchElement& probe_faceprints, const PackedGallery& gallery,
+                                                               Faceprints& updated_faceprints,
+                                                               const ThresholdsConfidenceEnum confidenceLevel, size_t num_rescore,
+                                                               MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArrayQuantized(const MatchElement& probe_faceprints, const PackedGallery& gallery,
+                                                               Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                               size_t num_rescore, MatcherThreadPool* pool = nullptr);
+
+    // same as above, for the int8 stage of MatchFaceprintsToArrayQuantized(). also measures the int8 score error.
+    static PrefilterRecall MeasurePrefilterRecall(const std::vector<MatchElement>& probes, const PackedGallery& gallery,
+                                                  size_t num_rescore, MatcherThreadPool* pool = nullptr);
+
+    // match single vs. an HnswIndex, for very large galleries. the index returns ef approximate candidates, which are
+    // rescored with the exact ncc (vs. the with-mask adaptive vector for masked probes, as GetScores()) before the
+    // calibrated thresholds and adaptive update are applied. result.userId is the index node of the best match.
+    // ef = 0 uses the index's ef_search.
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const HnswIndex& index, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High, size_t ef = 0);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const HnswIndex& index,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds, size_t ef = 0);
+
+    // match a batch of probes vs. a FaceprintGallery, e.g. probes that arrive together from several devices.
+    // the gallery is scanned once, in blocks that are scored against every probe while in cache.
+    // results[i] and updated_faceprints[i] are the same as MatchFaceprintsToArray() would return for probes[i].
+    // invalid probes (range or version) get a default result (userId = -1).
+    static void MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const FaceprintGallery& gallery,
+                                            std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                            const Thresholds& thresholds, MatcherThreadPool* pool = nullptr);
+
+    static void MatchFaceprintsBatchToArray(
+        const std::vector<MatchElement>& probes, const FaceprintGallery& gallery, std::vector<ExtendedMatchResult>& results,
+        std::vector<Faceprints>& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    // match single / a batch of probes vs. a GalleryFile, streamed from the file in chunks (see GalleryFile::Scan()) so
+    // the gallery never has to fit in memory. each chunk is scored against every probe (on the pool, if any) while the
+    // next one is read, so a batch costs a single pass over the file.
+    // results are the same as MatchFaceprintsToArray() of the same faceprints in memory, in file order: userId is the
+    // record index (see GalleryFile::ReadRecord() for its user id). a read error fails every probe (userId = -1).
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const GalleryFile& file, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const GalleryFile& file,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    static void MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const GalleryFile& file,
+                                            std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                            const Thresholds& thresholds, MatcherThreadPool* pool = nullptr);
+
+    static void MatchFaceprintsBatchToArray(
+        const std::vector<MatchElement>& probes, const GalleryFile& file, std::vector<ExtendedMatchResult>& results,
+        std::vector<Faceprints>& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    // match single / a batch of probes vs. a ShardedGallery: every shard is scanned at once by its own node local threads
+    // (instead of a pool), and the best results of the shards are merged. results are the same as the FaceprintGallery
+    // overloads for a gallery of the shards' users in shard order: userId is the global index (see ShardedGallery).
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const ShardedGallery& gallery, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const ShardedGallery& gallery,
                                                       Faceprints& updated_faceprints, const Thresholds& thresholds);
 
+    static void MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const ShardedGallery& gallery,
+                                            std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                            const Thresholds& thresholds);
+
+    static void MatchFaceprintsBatchToArray(
+        const std::vector<MatchElement>& probes, const ShardedGallery& gallery, std::vector<ExtendedMatchResult>& results,
+        std::vector<Faceprints>& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High);
+
+    // match single / a batch of probes vs. a MappedGallery, scored in place in the file mapping. results are the same as
+    // the FaceprintGallery overloads for the gallery the file was written from: userId is the slot.
+    static ExtendedMatchResult MatchFaceprintsToArray(
+        const MatchElement& probe_faceprints, const MappedGallery& gallery, Faceprints& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints, const MappedGallery& gallery,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      MatcherThreadPool* pool = nullptr);
+
+    static void MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes, const MappedGallery& gallery,
+                                            std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                            const Thresholds& thresholds, MatcherThreadPool* pool = nullptr);
+
+    static void MatchFaceprintsBatchToArray(
+        const std::vector<MatchElement>& probes, const MappedGallery& gallery, std::vector<ExtendedMatchResult>& results,
+        std::vector<Faceprints>& updated_faceprints,
+        const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+        MatcherThreadPool* pool = nullptr);
+
+    // enrollment time duplicate identity check of a batch of new enrollments (e.g. a bulk enroll), so the same person is
+    // not enrolled under two ids. the enrollment descriptor of each new faceprints is matched against the no-mask rows of
+    // the whole gallery in a single batched scan (as MatchFaceprintsBatchToArray()), and against the enrollments before it
+    // in the batch. results[i].is_duplicate is set if either best score is above threshold - the caller decides whether to
+    // reject or only flag it. invalid enrollments (range or version) get a default result.
+    // the confidence level overload uses the no-mask strong threshold: a duplicate would authenticate as the other user.
+    static void FindDuplicates(const std::vector<Faceprints>& enrollments, const FaceprintGallery& gallery,
+                               std::vector<DuplicateCheckResult>& results, match_calc_t threshold, MatcherThreadPool* pool = nullptr);
+
+    static void FindDuplicates(const std::vector<Faceprints>& enrollments, const FaceprintGallery& gallery,
+                               std::vector<DuplicateCheckResult>& results,
+                               const ThresholdsConfidenceEnum confidenceLevel = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High,
+                               MatcherThreadPool* pool = nullptr);
+
+    // gallery wide N x N similarity audit: every pair of users whose enrollment or adaptive no-mask descriptors score
+    // above options.threshold (the MatchTwoVectors() score). the upper triangle of the similarity matrix is scored in
+    // tiles of options.tile_rows x options.tile_rows users, split across the pool (if any), and never stored: the pairs
+    // found are passed to on_pairs in batches, in tile order, from the calling thread. on_progress (if set) is called
+    // every options.progress_interval seconds and at the end. returns the totals.
+    static SimilarityAudit AuditGallery(const FaceprintGallery& gallery, const SimilarityAuditOptions& options,
+                                        const SimilarPairsCallback& on_pairs,
+                                        const SimilarityAuditProgressCallback& on_progress = SimilarityAuditProgressCallback(),
+                                        MatcherThreadPool* pool = nullptr);
 
     // checks the faceprints vector coordinates are in valid range [-1023,+1023].
     // if check_enrollment_vector=false it validates the adaptive faceprints, otherwise it validates the enrollment
@@ -49,7 +357,13 @@ public:
     static void MatchTwoVectors(const feature_t* T1, const feature_t* T2, match_calc_t* match_score,
                                 const uint32_t vec_length = RSID_NUM_OF_RECOGNITION_FEATURES);
 
-private:
+    // integer ncc from the correlation and the (non zero) squared norms of two vectors and their msb.
+    static match_calc_t NormalizeCorrelation(int32_t corr, uint32_t norm1, short norm1_msb, uint32_t norm2, short norm2_msb);
+
+    static short GetMsb(const uint32_t ux);
+
+    // adaptive update steps (see HandleMatchResult()): blend the new vector into the adaptive one, then blend the anchor
+    // vector in until the adaptive vector is close enough to it.
     static void BlendAverageVector(feature_t* user_adaptive_faceprints, const feature_t* user_probe_faceprints,
                                    const uint32_t vec_length = RSID_NUM_OF_RECOGNITION_FEATURES);
 
@@ -57,17 +371,152 @@ private:
                                     const AdaptiveThresholds& adaptiveThresholds,
                                     const uint32_t vec_length = RSID_NUM_OF_RECOGNITION_FEATURES);
 
+private:
+    // entries of a 1:N scan: faceprints stride bytes apart (an array of Faceprints, or the faceprints of UserFaceprints_t),
+    // or an array of pointers to faceprints (e.g. a GallerySnapshot).
+    struct FaceprintsArray
+    {
+        const Faceprints* first = nullptr;
+        size_t stride = sizeof(Faceprints);
+        const Faceprints* const* pointers = nullptr;
+        size_t count = 0;
+
+        const Faceprints& operator[](size_t i) const
+        {
+            if (pointers != nullptr)
+            {
+                return *pointers[i];
+            }
+            return *reinterpret_cast<const Faceprints*>(reinterpret_cast<const char*>(first) + i * stride);
+        }
+    };
+
 
     static void HandleThresholdsConfiguration(const bool& probe_has_mask, const Faceprints& existing_faceprints,
                                               AdaptiveThresholds& adaptiveThresholds);
 
-    static short GetMsb(const uint32_t ux);
+    // shared 1:N match of the vector, array and snapshot overloads.
+    static ExtendedMatchResult MatchFaceprintsArray(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds, MatcherThreadPool* pool);
+
+    // shared batch match of the vector overloads.
+    static void MatchFaceprintsArrayBatch(const std::vector<MatchElement>& probes, const FaceprintsArray& faceprints,
+                                          std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                          const Thresholds& thresholds, MatcherThreadPool* pool);
+
+    // shared 1:N match of the row gallery overloads. a row gallery is any gallery with the row accessors of
+    // FaceprintGallery (FaceprintGallery, MappedGallery).
+    template <typename RowGallery>
+    static ExtendedMatchResult MatchRowGallery(const MatchElement& probe_faceprints, const RowGallery& gallery,
+                                               Faceprints& updated_faceprints, const Thresholds& thresholds, MatcherThreadPool* pool);
+
+    template <typename RowGallery>
+    static void MatchRowGalleryBatch(const std::vector<MatchElement>& probes, const RowGallery& gallery,
+                                     std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                     const Thresholds& thresholds, MatcherThreadPool* pool);
+
+    static void FaceMatch(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, ExtendedMatchResult& result,
+                          const bool& probe_has_mask, MatcherThreadPool* pool);
+
+    // squared norm of a probe (0 replaced by 1) and its msb.
+    static void GetProbeNorm(const feature_t* probeVector, uint32_t& probeNorm, short& probeNormMsb);
+
+    // int8 probe of a quantized PackedGallery match (see PackedGallery::Quantize()), its squared norm and msb.
+    static void GetQuantizedProbe(const feature_t* probeVector, int8_t* quantizedVector, uint32_t& probeNorm, short& probeNormMsb);
+
+    static bool GetScores(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, TagResult& result,
+                          const bool& probe_has_mask, MatcherThreadPool* pool = nullptr);
+
+    template <typename RowGallery>
+    static bool GetScores(const MatchElement& probe_faceprints, const RowGallery& gallery, TagResult& result, const bool& probe_has_mask,
+                          MatcherThreadPool* pool = nullptr);
+
+    // best score (lowest index on ties) of the entries [begin, end).
+    static bool GetScoresInRange(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, size_t begin, size_t end,
+                                 TagResult& result, const bool& probe_has_mask);
+
+    // specialized for the probe mask state and vector length, so the entry loop has no mask or length branches.
+    template <bool ProbeHasMask, uint32_t VecLength>
+    static bool GetScoresInRange(const MatchElement& probe_faceprints, const FaceprintsArray& faceprints, size_t begin, size_t end,
+                                 TagResult& result);
+
+    template <typename RowGallery>
+    static void GetScoresInRange(const feature_t* probeVector, uint32_t probeNorm, short probeNormMsb, const RowGallery& gallery,
+                                 size_t begin, size_t end, TagResult& result, const bool& probe_has_mask);
+
+    // early accept candidate of a RecentMatches match: the best scoring recent user (most recent on ties), if it beats its
+    // active strong threshold by the set's margin. false if none does, or the probe can't be matched.
+    static bool GetRecentCandidate(const MatchElement& probe_faceprints, const FaceprintGallery& gallery, const RecentMatches& recent,
+                                   const Thresholds& thresholds, TagResult& candidate);
+
+    static bool GetTopKScores(const MatchElement& probe_faceprints, const FaceprintGallery& gallery, TagResult* top_k, size_t k,
+                              size_t& num_candidates, const bool& probe_has_mask, MatcherThreadPool* pool);
+
+    static void GetTopKScoresInRange(const feature_t* probeVector, uint32_t probeNorm, short probeNormMsb, const FaceprintGallery& gallery,
+                                     size_t begin, size_t end, MatcherTopK& top_k, const bool& probe_has_mask);
+
+    // the num_rescore entries closest to the probe by sign sketch, best first.
+    static bool GetPrefilterCandidates(const MatchElement& probe_faceprints, const FaceprintGallery& gallery, TagResult* candidates,
+                                       size_t num_rescore, size_t& num_candidates, const bool& probe_has_mask, MatcherThreadPool* pool);
+
+    static void GetSketchScoresInRange(const uint64_t* probeSketch, const FaceprintGallery& gallery, size_t begin, size_t end,
+                                       MatcherTopK& top_k, const bool& probe_has_mask);
+
+    // exact best score (lowest index on ties) of the given candidates.
+    static void RescoreCandidates(const feature_t* probeVector, const FaceprintGallery& gallery, const TagResult* candidates,
+                                  size_t num_candidates, TagResult& result, const bool& probe_has_mask);
+
+    static bool GetScores(const MatchElement& probe_faceprints, const PackedGallery& gallery, TagResult& result,
+                          const bool& probe_has_mask, MatcherThreadPool* pool = nullptr);
+
+    static void GetScoresInRange(const feature_t* probeVector, uint32_t probeNorm, short probeNormMsb, const PackedGallery& gallery,
+                                 size_t begin, size_t end, TagResult& result, const bool& probe_has_mask);
+
+    // the num_rescore entries with the best int8 scores, best first.
+    static bool GetQuantizedCandidates(const MatchElement& probe_faceprints, const PackedGallery& gallery, TagResult* candidates,
+                                       size_t num_rescore, size_t& num_candidates, const bool& probe_has_mask, MatcherThreadPool* pool);
+
+    static void GetQuantizedScoresInRange(const int8_t* probeVector, uint32_t probeNorm, short probeNormMsb, const PackedGallery& gallery,
+                                          size_t begin, size_t end, MatcherTopK& top_k, const bool& probe_has_mask);
+
+    static void RescoreCandidates(const feature_t* probeVector, const PackedGallery& gallery, const TagResult* candidates,
+                                  size_t num_candidates, TagResult& result, const bool& probe_has_mask);
+
+    // exact best score (lowest node on ties) of the given index candidates.
+    static void RescoreIndexCandidates(const MatchElement& probe_faceprints, const HnswIndex& index, const TagResult* candidates,
+                                       size_t num_candidates, TagResult& result, const bool& probe_has_mask);
+
+    // the adaptive vector a probe is matched against: with-mask if the probe has a mask and it is valid, no-mask otherwise.
+    static const feature_t* GetGalleryVector(const Faceprints& faceprints, const bool& probe_has_mask);
+
+    template <bool ProbeHasMask>
+    static const feature_t* GetGalleryVector(const Faceprints& faceprints);
+
+    // best score of each probe (lowest index on ties) vs. the gallery entries [begin, end).
+    template <typename RowGallery>
+    static void GetBatchScoresInRange(const feature_t* const* probeVectors, const uint32_t* probeNorms, const short* probeNormMsbs,
+                                      size_t num_probes, const RowGallery& gallery, size_t begin, size_t end, TagResult* results,
+                                      const bool& probe_has_mask);
+
+    // best score of each probe (lowest index on ties) vs. the whole gallery, split across the pool (if any).
+    template <typename RowGallery>
+    static void GetBatchScores(const feature_t* const* probeVectors, const uint32_t* probeNorms, const short* probeNormMsbs,
+                               size_t num_probes, const RowGallery& gallery, TagResult* results, const bool& probe_has_mask,
+                               MatcherThreadPool* pool);
+
+    // best score of each vector (lowest index on ties) vs. the vectors before it, split across the pool (if any).
+    static void GetPrecedingScores(const feature_t* const* vectors, const uint32_t* norms, const short* normMsbs, size_t count,
+                                   TagResult* results, MatcherThreadPool* pool);
 
-    static void FaceMatch(const MatchElement& probe_faceprints, const std::vector<UserFaceprints_t>& existing_faceprints_array,
-                          ExtendedMatchResult& result, const bool& probe_has_mask);
+    // scores of count1 contiguous rows vs. count2 contiguous rows into scores, count1 x count2 row major.
+    // if same_tile (rows1 == rows2), only the upper triangle is meaningful.
+    static void GetTileScores(const feature_t* rows1, const uint32_t* norms1, const short* normMsbs1, size_t count1,
+                              const feature_t* rows2, const uint32_t* norms2, const short* normMsbs2, size_t count2, bool same_tile,
+                              match_calc_t* scores);
 
-    static bool GetScores(const MatchElement& probe_faceprints, const std::vector<UserFaceprints_t>& existing_faceprints_array,
-                          TagResult& result, const bool& probe_has_mask);
+    // set isSame/should_update of a result by the active thresholds of the matched user, and apply adaptive update.
+    static void HandleMatchResult(const MatchElement& probe_faceprints, const Faceprints& matched_faceprints, const bool& probe_has_mask,
+                                  const Thresholds& thresholds, ExtendedMatchResult& result, Faceprints& updated_faceprints);
 
     static bool ValidateVector(const feature_t* T1, const uint32_t vec_length = RSID_NUM_OF_RECOGNITION_FEATURES);
 
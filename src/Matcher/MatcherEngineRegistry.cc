@@ -0,0 +1,205 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/MatcherEngine.h"
+#include "Matcher.h"
+#include "MatcherThreadPool.h"
+#include "Logger.h"
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <utility>
+
+#ifndef RSID_MATCHER_ENGINE_DEFAULT
+#define RSID_MATCHER_ENGINE_DEFAULT "reference"
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherEngineRegistry";
+
+namespace
+{
+// the static Matcher. a threaded engine splits the 1:N and batch scans across a pool of all cores.
+class StaticMatcherEngine : public IMatcherEngine
+{
+public:
+    StaticMatcherEngine(const char* name, bool threaded) : _name(name), _pool(threaded ? new MatcherThreadPool() : nullptr)
+    {
+    }
+
+    const char* Name() const override
+    {
+        return _name;
+    }
+
+    MatchResultInternal MatchFaceprints(const MatchElement& probe_faceprints, const Faceprints& existing_faceprints,
+                                        Faceprints& updated_faceprints, ThresholdsConfidenceEnum confidenceLevel) override
+    {
+        return Matcher::MatchFaceprints(probe_faceprints, existing_faceprints, updated_faceprints, confidenceLevel);
+    }
+
+    ExtendedMatchResult MatchFaceprintsToArray(const MatchElement& probe_faceprints,
+                                               const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                               Faceprints& updated_faceprints, ThresholdsConfidenceEnum confidenceLevel) override
+    {
+        return Matcher::MatchFaceprintsToArray(probe_faceprints, existing_faceprints_array, updated_faceprints, confidenceLevel,
+                                               _pool.get());
+    }
+
+    void MatchFaceprintsBatchToArray(const std::vector<MatchElement>& probes,
+                                     const std::vector<UserFaceprints_t>& existing_faceprints_array,
+                                     std::vector<ExtendedMatchResult>& results, std::vector<Faceprints>& updated_faceprints,
+                                     ThresholdsConfidenceEnum confidenceLevel) override
+    {
+        Matcher::MatchFaceprintsBatchToArray(probes, existing_faceprints_array, results, updated_faceprints, confidenceLevel, _pool.get());
+    }
+
+    void BlendAverageVector(feature_t* user_adaptive_faceprints, const feature_t* user_probe_faceprints) override
+    {
+        Matcher::BlendAverageVector(user_adaptive_faceprints, user_probe_faceprints);
+    }
+
+    bool LimitAdaptiveVector(feature_t* adaptive_faceprints_vec, const feature_t* anchor_faceprints_vec,
+                             const AdaptiveThresholds& adaptiveThresholds) override
+    {
+        return Matcher::LimitAdaptiveVector(adaptive_faceprints_vec, anchor_faceprints_vec, adaptiveThresholds);
+    }
+
+private:
+    const char* _name;
+    std::unique_ptr<MatcherThreadPool> _pool;
+};
+
+struct Entry
+{
+    std::string name;
+    MatcherEngineRegistry::Factory factory;
+    std::unique_ptr<IMatcherEngine> engine;
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<Entry> entries;
+    std::atomic<IMatcherEngine*> active {nullptr};
+
+    Registry()
+    {
+        const char* reference = MatcherEngineRegistry::ReferenceEngine;
+        entries.push_back({reference, [=] { return std::unique_ptr<IMatcherEngine>(new StaticMatcherEngine(reference, false)); }, nullptr});
+        entries.push_back({"threaded", [] { return std::unique_ptr<IMatcherEngine>(new StaticMatcherEngine("threaded", true)); }, nullptr});
+    }
+
+    // the engine of name, created on first use. nullptr if not registered. mutex must be held.
+    IMatcherEngine* Get(const std::string& name)
+    {
+        for (auto& entry : entries)
+        {
+            if (entry.name != name)
+            {
+                continue;
+            }
+            if (!entry.engine)
+            {
+                entry.engine = entry.factory();
+            }
+            return entry.engine.get();
+        }
+        return nullptr;
+    }
+};
+
+Registry& GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+} // namespace
+
+bool MatcherEngineRegistry::Register(const char* name, Factory factory)
+{
+    if (name == nullptr || !factory)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid matcher engine registration");
+        return false;
+    }
+
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& entry : registry.entries)
+    {
+        if (entry.name == name)
+        {
+            LOG_ERROR(LOG_TAG, "Matcher engine \"%s\" already registered", name);
+            return false;
+        }
+    }
+    registry.entries.push_back({name, std::move(factory), nullptr});
+    return true;
+}
+
+std::vector<std::string> MatcherEngineRegistry::Names()
+{
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<std::string> names;
+    for (const auto& entry : registry.entries)
+    {
+        names.push_back(entry.name);
+    }
+    return names;
+}
+
+IMatcherEngine* MatcherEngineRegistry::Get(const char* name)
+{
+    if (name == nullptr)
+    {
+        return nullptr;
+    }
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return registry.Get(name);
+}
+
+bool MatcherEngineRegistry::SetActive(const char* name)
+{
+    auto* engine = Get(name);
+    if (engine == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown matcher engine \"%s\"", name ? name : "");
+        return false;
+    }
+    GetRegistry().active = engine;
+    LOG_INFO(LOG_TAG, "Using matcher engine \"%s\"", engine->Name());
+    return true;
+}
+
+IMatcherEngine& MatcherEngineRegistry::Active()
+{
+    auto& registry = GetRegistry();
+    IMatcherEngine* engine = registry.active.load(std::memory_order_acquire);
+    if (engine != nullptr)
+    {
+        return *engine;
+    }
+
+    // first use: environment, then build default.
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    engine = registry.active.load(std::memory_order_acquire);
+    if (engine == nullptr)
+    {
+        const char* env = std::getenv(EnvironmentVariable);
+        std::string name = (env != nullptr && *env != '\0') ? env : RSID_MATCHER_ENGINE_DEFAULT;
+        engine = registry.Get(name);
+        if (engine == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Unknown matcher engine \"%s\", using \"%s\"", name.c_str(), ReferenceEngine);
+            engine = registry.Get(ReferenceEngine);
+        }
+        LOG_INFO(LOG_TAG, "Using matcher engine \"%s\"", engine->Name());
+        registry.active.store(engine, std::memory_order_release);
+    }
+    return *engine;
+}
+} // namespace RealSenseID
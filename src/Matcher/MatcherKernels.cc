@@ -0,0 +1,274 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherKernels.h"
+#include "Logger.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RSID_MATCHER_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+static const char* LOG_TAG = "MatcherKernels";
+
+void NccSumsScalar(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums)
+{
+    int32_t corr = 0;
+    uint32_t norm1 = 0;
+    uint32_t norm2 = 0;
+
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        int32_t t1 = static_cast<int32_t>(T1[i]);
+        int32_t t2 = static_cast<int32_t>(T2[i]);
+
+        corr += t1 * t2;
+        norm1 += t1 * t1;
+        norm2 += t2 * t2;
+    }
+
+    sums.corr = corr;
+    sums.norm1 = norm1;
+    sums.norm2 = norm2;
+}
+
+int32_t DotScalar(const feature_t* T1, const feature_t* T2, uint32_t vec_length)
+{
+    int32_t corr = 0;
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        corr += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr;
+}
+
+void Dot4Scalar(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs)
+{
+    int32_t corr[4] = {};
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        int32_t t1 = static_cast<int32_t>(T1[i]);
+        for (int k = 0; k < 4; k++)
+        {
+            corr[k] += t1 * static_cast<int32_t>(T2[k][i]);
+        }
+    }
+    for (int k = 0; k < 4; k++)
+    {
+        corrs[k] = corr[k];
+    }
+}
+
+uint32_t HammingScalar(const uint64_t* S1, const uint64_t* S2, uint32_t num_words)
+{
+    uint32_t distance = 0;
+    for (uint32_t i = 0; i < num_words; ++i)
+    {
+        // swar popcount
+        uint64_t x = S1[i] ^ S2[i];
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        distance += static_cast<uint32_t>((x * 0x0101010101010101ULL) >> 56);
+    }
+    return distance;
+}
+
+bool BlendSumsScalar(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums)
+{
+    // round((30 * x + a) / 31) == x - round((x - a) / 31) exactly, there are no ties since 31 is odd.
+    // the change of each feature updates the sums: corr by -r * a, norm1 by new^2 - old^2 = -r * (old + new).
+    uint32_t corr_change = 0;
+    uint32_t norm1_change = 0;
+    int32_t changed = 0;
+
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        int32_t x = static_cast<int32_t>(adaptive[i]);
+        int32_t a = static_cast<int32_t>(anchor[i]);
+        int32_t d = x - a;
+        int32_t r = ((d < 0 ? -d : d) + 15) / 31;
+        r = (d < 0) ? -r : r;
+        int32_t new_x = x - r;
+
+        corr_change -= static_cast<uint32_t>(r) * static_cast<uint32_t>(a);
+        norm1_change -= static_cast<uint32_t>(r) * static_cast<uint32_t>(x + new_x);
+        changed |= r;
+        adaptive[i] = static_cast<feature_t>(new_x);
+    }
+
+    sums.corr = static_cast<int32_t>(static_cast<uint32_t>(sums.corr) + corr_change);
+    sums.norm1 += norm1_change;
+    return changed != 0;
+}
+
+int32_t DotPackedScalar(const feature_t* T1, const uint8_t* packed, uint32_t vec_length)
+{
+    int32_t corr = 0;
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        corr += static_cast<int32_t>(T1[i]) * PackedFeature(packed, vec_length, i);
+    }
+    return corr;
+}
+
+int32_t DotInt8Scalar(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    int32_t corr = 0;
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        corr += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr;
+}
+
+#ifdef RSID_MATCHER_X86
+static void CpuId(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; i++)
+    {
+        regs[i] = static_cast<uint32_t>(info[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// XCR0 - which register states the os saves on context switch.
+static uint64_t XGetBv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static bool IsaSupported(KernelIsa isa)
+{
+    uint32_t regs[4] = {};
+    CpuId(0, 0, regs);
+    const uint32_t max_leaf = regs[0];
+
+    CpuId(1, 0, regs);
+    const uint32_t ecx1 = regs[2];
+    const bool has_sse41 = (ecx1 >> 19) & 1;
+    const bool has_popcnt = (ecx1 >> 23) & 1;
+    const bool has_osxsave = (ecx1 >> 27) & 1;
+    const bool has_avx = (ecx1 >> 28) & 1;
+
+    uint32_t ebx7 = 0;
+    if (max_leaf >= 7)
+    {
+        CpuId(7, 0, regs);
+        ebx7 = regs[1];
+    }
+    const bool has_avx2 = (ebx7 >> 5) & 1;
+    const bool has_avx512f = (ebx7 >> 16) & 1;
+    const bool has_avx512bw = (ebx7 >> 30) & 1;
+
+    // os must save the ymm (and for avx512 also opmask/zmm) registers.
+    const uint64_t xcr0 = (has_osxsave && has_avx) ? XGetBv() : 0;
+    const bool os_ymm = (xcr0 & 0x6) == 0x6;
+    const bool os_zmm = (xcr0 & 0xE6) == 0xE6;
+
+    switch (isa)
+    {
+    case KernelIsa::Sse41:
+        return has_sse41;
+    case KernelIsa::Avx2:
+        return has_avx2 && has_popcnt && os_ymm;
+    case KernelIsa::Avx512:
+        return has_avx512f && has_avx512bw && has_popcnt && os_zmm;
+    default:
+        return false;
+    }
+}
+#else
+static bool IsaSupported(KernelIsa isa)
+{
+    // neon is mandatory on aarch64
+    return isa == KernelIsa::Neon;
+}
+#endif // RSID_MATCHER_X86
+
+// all kernels compiled in, from worst to best.
+static const KernelTable s_kernels[] = {
+    {KernelIsa::Scalar, "scalar", NccSumsScalar, DotScalar, Dot4Scalar, HammingScalar, BlendSumsScalar, DotPackedScalar, DotInt8Scalar},
+#ifdef RSID_MATCHER_SSE41
+    {KernelIsa::Sse41, "sse4.1", NccSumsSse41, DotSse41, Dot4Sse41, HammingScalar, BlendSumsSse41, DotPackedSse41, DotInt8Sse41},
+#endif
+#ifdef RSID_MATCHER_AVX2
+    {KernelIsa::Avx2, "avx2", NccSumsAvx2, DotAvx2, Dot4Avx2, HammingAvx2, BlendSumsAvx2, DotPackedAvx2, DotInt8Avx2},
+#endif
+#ifdef RSID_MATCHER_AVX512
+    {KernelIsa::Avx512, "avx512bw", NccSumsAvx512, DotAvx512, Dot4Avx512, HammingAvx512, BlendSumsAvx512, DotPackedAvx512, DotInt8Avx512},
+#endif
+#ifdef RSID_MATCHER_NEON
+    {KernelIsa::Neon, "neon", NccSumsNeon, DotNeon, Dot4Neon, HammingNeon, BlendSumsScalar, DotPackedScalar, DotInt8Scalar},
+#endif
+};
+
+static std::atomic<const KernelTable*> s_active {nullptr};
+
+const KernelTable* Get(KernelIsa isa)
+{
+    for (const auto& kernel : s_kernels)
+    {
+        if (kernel.isa == isa)
+        {
+            return (isa == KernelIsa::Scalar || IsaSupported(isa)) ? &kernel : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+const KernelTable& Active()
+{
+    const KernelTable* active = s_active.load(std::memory_order_acquire);
+    if (active != nullptr)
+    {
+        return *active;
+    }
+
+    // pick the last (best) supported kernel. concurrent first calls pick the same one.
+    active = &s_kernels[0];
+    for (const auto& kernel : s_kernels)
+    {
+        if (Get(kernel.isa) != nullptr)
+        {
+            active = &kernel;
+        }
+    }
+    s_active.store(active, std::memory_order_release);
+    LOG_DEBUG(LOG_TAG, "Using %s matcher kernels", active->name);
+    return *active;
+}
+
+bool Select(KernelIsa isa)
+{
+    const KernelTable* kernel = Get(isa);
+    if (kernel == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Matcher kernels isa %d not available", static_cast<int>(isa));
+        return false;
+    }
+    s_active.store(kernel, std::memory_order_release);
+    return true;
+}
+} // namespace MatcherKernels
+} // namespace RealSenseID
@@ -0,0 +1,144 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/FaceprintsDefines.h"
+#include <stdint.h>
+
+// Matcher kernels - the integer accumulation at the heart of MatchTwoVectors().
+//
+// Each kernel computes the raw sums needed by the integer ncc:
+//      corr = sum(T1[i] * T2[i]), norm1 = sum(T1[i]^2), norm2 = sum(T2[i]^2)
+// or just the correlation (dot), when the norms are known in advance (e.g. FaceprintGallery).
+// dot4 is the register-blocked form used by batch matching: one gallery row against 4 probes, each row chunk is
+// loaded once and multiplied with all 4 probes.
+// hamming is the bit distance of two sign sketches (see FaceprintGallery), using the cpu popcount where available.
+// blend_sums is one adaptive vector blend step (see Matcher::LimitAdaptiveVector()), updating corr and norm1 of the
+// (adaptive, anchor) sums with the change of each feature instead of recomputing them.
+// dot_packed and dot_int8 score the compact rows of PackedGallery without unpacking them to memory: dot_packed is the
+// exact dot of a probe with an 11-bit packed row, dot_int8 the dot of two int8 quantized vectors.
+// Integer sums are exact regardless of accumulation order, so all kernels give bit-identical results to the scalar
+// reference (given the validated feature range [-1023,+1023] and vector length <= 512, see MatchTwoVectors()).
+//
+// The best kernel supported by the running cpu is chosen once at runtime.
+
+// enable an instruction set for a single function, so no special compiler flags are needed for the kernel sources.
+// msvc allows all intrinsics without special flags.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define RSID_KERNEL_TARGET(isa)
+#else
+#define RSID_KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+enum class KernelIsa
+{
+    Scalar = 0,
+    Sse41,
+    Avx2,
+    Avx512,
+    Neon,
+    NumKernelIsas
+};
+
+struct NccSums
+{
+    int32_t corr = 0;
+    uint32_t norm1 = 0;
+    uint32_t norm2 = 0;
+};
+
+using NccSumsFn = void (*)(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums);
+using DotFn = int32_t (*)(const feature_t* T1, const feature_t* T2, uint32_t vec_length);
+using Dot4Fn = void (*)(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs);
+using HammingFn = uint32_t (*)(const uint64_t* S1, const uint64_t* S2, uint32_t num_words);
+// blend anchor into adaptive (same as Matcher::BlendAverageVector()) and update sums.corr and sums.norm1.
+// returns false if no feature changed. the scalar kernel is exact for any input, the simd ones need the validated range.
+using BlendSumsFn = bool (*)(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums);
+
+// packed row of vec_length features (a multiple of 8), lossless for the validated range: u = feature + PackedOffset
+// takes 11 bits, stored as vec_length low bytes followed by 3 bit planes of vec_length / 8 bytes (bit i % 8 of byte
+// i / 8 of plane k is bit 8 + k of u). the planes let simd kernels expand 8 to 32 features at a time.
+static constexpr int32_t PackedOffset = 1023;
+
+constexpr uint32_t PackedRowBytes(uint32_t vec_length)
+{
+    return vec_length + 3 * (vec_length / 8);
+}
+
+inline int32_t PackedFeature(const uint8_t* packed, uint32_t vec_length, uint32_t i)
+{
+    const uint8_t* planes = packed + vec_length;
+    const uint32_t plane_bytes = vec_length / 8;
+    const uint32_t byte = i / 8;
+    const uint32_t bit = i % 8;
+    int32_t u = packed[i];
+    u |= ((planes[byte] >> bit) & 1) << 8;
+    u |= ((planes[plane_bytes + byte] >> bit) & 1) << 9;
+    u |= ((planes[2 * plane_bytes + byte] >> bit) & 1) << 10;
+    return u - PackedOffset;
+}
+
+using DotPackedFn = int32_t (*)(const feature_t* T1, const uint8_t* packed, uint32_t vec_length);
+using DotInt8Fn = int32_t (*)(const int8_t* T1, const int8_t* T2, uint32_t vec_length);
+
+struct KernelTable
+{
+    KernelIsa isa;
+    const char* name;
+    NccSumsFn ncc_sums;
+    DotFn dot;
+    Dot4Fn dot4;
+    HammingFn hamming;
+    BlendSumsFn blend_sums;
+    DotPackedFn dot_packed;
+    DotInt8Fn dot_int8;
+};
+
+// kernel table in use (best supported by the cpu, unless changed with Select()).
+const KernelTable& Active();
+
+// kernel table for the given isa, or nullptr if it was not compiled in or is not supported by the cpu.
+const KernelTable* Get(KernelIsa isa);
+
+// force the given isa (e.g. for benchmarks). returns false if it is not available.
+bool Select(KernelIsa isa);
+
+// isa specific implementations. only the ones enabled at build time (RSID_MATCHER_<ISA>) are linked.
+void NccSumsScalar(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums);
+int32_t DotScalar(const feature_t* T1, const feature_t* T2, uint32_t vec_length);
+void Dot4Scalar(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs);
+uint32_t HammingScalar(const uint64_t* S1, const uint64_t* S2, uint32_t num_words);
+bool BlendSumsScalar(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums);
+int32_t DotPackedScalar(const feature_t* T1, const uint8_t* packed, uint32_t vec_length);
+int32_t DotInt8Scalar(const int8_t* T1, const int8_t* T2, uint32_t vec_length);
+void NccSumsSse41(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums);
+int32_t DotSse41(const feature_t* T1, const feature_t* T2, uint32_t vec_length);
+void Dot4Sse41(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs);
+bool BlendSumsSse41(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums);
+int32_t DotPackedSse41(const feature_t* T1, const uint8_t* packed, uint32_t vec_length);
+int32_t DotInt8Sse41(const int8_t* T1, const int8_t* T2, uint32_t vec_length);
+void NccSumsAvx2(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums);
+int32_t DotAvx2(const feature_t* T1, const feature_t* T2, uint32_t vec_length);
+void Dot4Avx2(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs);
+uint32_t HammingAvx2(const uint64_t* S1, const uint64_t* S2, uint32_t num_words);
+bool BlendSumsAvx2(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums);
+int32_t DotPackedAvx2(const feature_t* T1, const uint8_t* packed, uint32_t vec_length);
+int32_t DotInt8Avx2(const int8_t* T1, const int8_t* T2, uint32_t vec_length);
+void NccSumsAvx512(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums);
+int32_t DotAvx512(const feature_t* T1, const feature_t* T2, uint32_t vec_length);
+void Dot4Avx512(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs);
+uint32_t HammingAvx512(const uint64_t* S1, const uint64_t* S2, uint32_t num_words);
+bool BlendSumsAvx512(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums);
+int32_t DotPackedAvx512(const feature_t* T1, const uint8_t* packed, uint32_t vec_length);
+int32_t DotInt8Avx512(const int8_t* T1, const int8_t* T2, uint32_t vec_length);
+void NccSumsNeon(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums);
+int32_t DotNeon(const feature_t* T1, const feature_t* T2, uint32_t vec_length);
+void Dot4Neon(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs);
+uint32_t HammingNeon(const uint64_t* S1, const uint64_t* S2, uint32_t num_words);
+} // namespace MatcherKernels
+} // namespace RealSenseID
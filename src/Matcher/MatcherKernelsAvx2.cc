@@ -0,0 +1,222 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// avx2 kernels. called only if the cpu supports it (see MatcherKernels.cc).
+
+#include "MatcherKernels.h"
+#include <immintrin.h>
+#include <string.h>
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+RSID_KERNEL_TARGET("popcnt") static inline uint64_t PopCount64(uint64_t x)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return static_cast<uint64_t>(_mm_popcnt_u64(x));
+#else
+    return static_cast<uint64_t>(_mm_popcnt_u32(static_cast<uint32_t>(x))) + _mm_popcnt_u32(static_cast<uint32_t>(x >> 32));
+#endif
+}
+
+RSID_KERNEL_TARGET("avx2") static inline int32_t HorizontalSum(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+RSID_KERNEL_TARGET("avx2") void NccSumsAvx2(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums)
+{
+    // 16 features per step. madd multiplies int16 pairs and adds adjacent products into int32 lanes.
+    __m256i corr = _mm256_setzero_si256();
+    __m256i norm1 = _mm256_setzero_si256();
+    __m256i norm2 = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i t1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i));
+        __m256i t2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i));
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(t1, t2));
+        norm1 = _mm256_add_epi32(norm1, _mm256_madd_epi16(t1, t1));
+        norm2 = _mm256_add_epi32(norm2, _mm256_madd_epi16(t2, t2));
+    }
+
+    int32_t corr_sum = HorizontalSum(corr);
+    uint32_t norm1_sum = static_cast<uint32_t>(HorizontalSum(norm1));
+    uint32_t norm2_sum = static_cast<uint32_t>(HorizontalSum(norm2));
+
+    for (; i < vec_length; ++i)
+    {
+        int32_t t1 = static_cast<int32_t>(T1[i]);
+        int32_t t2 = static_cast<int32_t>(T2[i]);
+        corr_sum += t1 * t2;
+        norm1_sum += t1 * t1;
+        norm2_sum += t2 * t2;
+    }
+
+    sums.corr = corr_sum;
+    sums.norm1 = norm1_sum;
+    sums.norm2 = norm2_sum;
+}
+
+RSID_KERNEL_TARGET("avx2") int32_t DotAvx2(const feature_t* T1, const feature_t* T2, uint32_t vec_length)
+{
+    // 32 features per step, two accumulators to hide the add latency.
+    __m256i corr = _mm256_setzero_si256();
+    __m256i corr_b = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 32 <= vec_length; i += 32)
+    {
+        __m256i t1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i));
+        __m256i t2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i));
+        __m256i t1_b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i + 16));
+        __m256i t2_b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i + 16));
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(t1, t2));
+        corr_b = _mm256_add_epi32(corr_b, _mm256_madd_epi16(t1_b, t2_b));
+    }
+
+    int32_t corr_sum = HorizontalSum(_mm256_add_epi32(corr, corr_b));
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr_sum;
+}
+
+RSID_KERNEL_TARGET("avx2") void Dot4Avx2(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs)
+{
+    __m256i corr[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i t1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i));
+        for (int k = 0; k < 4; k++)
+        {
+            __m256i t2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2[k] + i));
+            corr[k] = _mm256_add_epi32(corr[k], _mm256_madd_epi16(t1, t2));
+        }
+    }
+
+    for (int k = 0; k < 4; k++)
+    {
+        int32_t corr_sum = HorizontalSum(corr[k]);
+        for (uint32_t j = i; j < vec_length; ++j)
+        {
+            corr_sum += static_cast<int32_t>(T1[j]) * static_cast<int32_t>(T2[k][j]);
+        }
+        corrs[k] = corr_sum;
+    }
+}
+
+RSID_KERNEL_TARGET("avx2,popcnt") uint32_t HammingAvx2(const uint64_t* S1, const uint64_t* S2, uint32_t num_words)
+{
+    // scalar popcnt on 64-bit words, 2 independent sums.
+    uint64_t distance_a = 0;
+    uint64_t distance_b = 0;
+    uint32_t i = 0;
+    for (; i + 2 <= num_words; i += 2)
+    {
+        distance_a += PopCount64(S1[i] ^ S2[i]);
+        distance_b += PopCount64(S1[i + 1] ^ S2[i + 1]);
+    }
+    for (; i < num_words; ++i)
+    {
+        distance_a += PopCount64(S1[i] ^ S2[i]);
+    }
+    return static_cast<uint32_t>(distance_a + distance_b);
+}
+
+RSID_KERNEL_TARGET("avx2") bool BlendSumsAvx2(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums)
+{
+    // 16 features per step, see BlendSumsSse41().
+    const __m256i round_half = _mm256_set1_epi16(15);
+    const __m256i div31 = _mm256_set1_epi16(2115);
+    __m256i corr = _mm256_setzero_si256();
+    __m256i norm1 = _mm256_setzero_si256();
+    __m256i changed = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(adaptive + i));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(anchor + i));
+        __m256i d = _mm256_sub_epi16(x, a);
+        __m256i r = _mm256_sign_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(_mm256_abs_epi16(d), round_half), div31), d);
+        __m256i new_x = _mm256_sub_epi16(x, r);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(adaptive + i), new_x);
+
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(r, a));
+        norm1 = _mm256_add_epi32(norm1, _mm256_madd_epi16(r, _mm256_add_epi16(x, new_x)));
+        changed = _mm256_or_si256(changed, r);
+    }
+
+    sums.corr = static_cast<int32_t>(static_cast<uint32_t>(sums.corr) - static_cast<uint32_t>(HorizontalSum(corr)));
+    sums.norm1 -= static_cast<uint32_t>(HorizontalSum(norm1));
+    bool any_changed = !_mm256_testz_si256(changed, changed);
+
+    if (i < vec_length)
+    {
+        any_changed |= BlendSumsScalar(adaptive + i, anchor + i, vec_length - i, sums);
+    }
+    return any_changed;
+}
+
+RSID_KERNEL_TARGET("avx2") int32_t DotPackedAvx2(const feature_t* T1, const uint8_t* packed, uint32_t vec_length)
+{
+    // 16 features per step: a 16 bit word of each bit plane, broadcast and tested against the lane's bit.
+    const uint8_t* planes = packed + vec_length;
+    const uint32_t plane_bytes = vec_length / 8;
+    const __m256i lane_bits = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, -32768);
+    const __m256i offset = _mm256_set1_epi16(PackedOffset);
+    __m256i corr = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i u = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + i)));
+        for (int k = 0; k < 3; k++)
+        {
+            uint16_t word;
+            memcpy(&word, planes + k * plane_bytes + i / 8, sizeof(word));
+            __m256i bits = _mm256_and_si256(_mm256_set1_epi16(static_cast<short>(word)), lane_bits);
+            __m256i high = _mm256_set1_epi16(static_cast<short>(256 << k));
+            u = _mm256_add_epi16(u, _mm256_and_si256(_mm256_cmpeq_epi16(bits, lane_bits), high));
+        }
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i));
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(v, _mm256_sub_epi16(u, offset)));
+    }
+
+    int32_t corr_sum = HorizontalSum(corr);
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * PackedFeature(packed, vec_length, i);
+    }
+    return corr_sum;
+}
+
+RSID_KERNEL_TARGET("avx2") int32_t DotInt8Avx2(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    __m256i corr = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i v1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i)));
+        __m256i v2 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i)));
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(v1, v2));
+    }
+
+    int32_t corr_sum = HorizontalSum(corr);
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr_sum;
+}
+} // namespace MatcherKernels
+} // namespace RealSenseID
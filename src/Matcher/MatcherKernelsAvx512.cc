@@ -0,0 +1,215 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// avx512f/avx512bw kernels. called only if the cpu supports it (see MatcherKernels.cc).
+
+#include "MatcherKernels.h"
+#include <immintrin.h>
+#include <string.h>
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+RSID_KERNEL_TARGET("popcnt") static inline uint64_t PopCount64(uint64_t x)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return static_cast<uint64_t>(_mm_popcnt_u64(x));
+#else
+    return static_cast<uint64_t>(_mm_popcnt_u32(static_cast<uint32_t>(x))) + _mm_popcnt_u32(static_cast<uint32_t>(x >> 32));
+#endif
+}
+
+RSID_KERNEL_TARGET("avx512f,avx512bw") void NccSumsAvx512(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums)
+{
+    // 32 features per step. madd multiplies int16 pairs and adds adjacent products into int32 lanes.
+    __m512i corr = _mm512_setzero_si512();
+    __m512i norm1 = _mm512_setzero_si512();
+    __m512i norm2 = _mm512_setzero_si512();
+
+    uint32_t i = 0;
+    for (; i + 32 <= vec_length; i += 32)
+    {
+        __m512i t1 = _mm512_loadu_si512(reinterpret_cast<const void*>(T1 + i));
+        __m512i t2 = _mm512_loadu_si512(reinterpret_cast<const void*>(T2 + i));
+        corr = _mm512_add_epi32(corr, _mm512_madd_epi16(t1, t2));
+        norm1 = _mm512_add_epi32(norm1, _mm512_madd_epi16(t1, t1));
+        norm2 = _mm512_add_epi32(norm2, _mm512_madd_epi16(t2, t2));
+    }
+
+    int32_t corr_sum = _mm512_reduce_add_epi32(corr);
+    uint32_t norm1_sum = static_cast<uint32_t>(_mm512_reduce_add_epi32(norm1));
+    uint32_t norm2_sum = static_cast<uint32_t>(_mm512_reduce_add_epi32(norm2));
+
+    for (; i < vec_length; ++i)
+    {
+        int32_t t1 = static_cast<int32_t>(T1[i]);
+        int32_t t2 = static_cast<int32_t>(T2[i]);
+        corr_sum += t1 * t2;
+        norm1_sum += t1 * t1;
+        norm2_sum += t2 * t2;
+    }
+
+    sums.corr = corr_sum;
+    sums.norm1 = norm1_sum;
+    sums.norm2 = norm2_sum;
+}
+
+RSID_KERNEL_TARGET("avx512f,avx512bw") int32_t DotAvx512(const feature_t* T1, const feature_t* T2, uint32_t vec_length)
+{
+    // 64 features per step, two accumulators to hide the add latency.
+    __m512i corr = _mm512_setzero_si512();
+    __m512i corr_b = _mm512_setzero_si512();
+
+    uint32_t i = 0;
+    for (; i + 64 <= vec_length; i += 64)
+    {
+        __m512i t1 = _mm512_loadu_si512(reinterpret_cast<const void*>(T1 + i));
+        __m512i t2 = _mm512_loadu_si512(reinterpret_cast<const void*>(T2 + i));
+        __m512i t1_b = _mm512_loadu_si512(reinterpret_cast<const void*>(T1 + i + 32));
+        __m512i t2_b = _mm512_loadu_si512(reinterpret_cast<const void*>(T2 + i + 32));
+        corr = _mm512_add_epi32(corr, _mm512_madd_epi16(t1, t2));
+        corr_b = _mm512_add_epi32(corr_b, _mm512_madd_epi16(t1_b, t2_b));
+    }
+
+    int32_t corr_sum = _mm512_reduce_add_epi32(_mm512_add_epi32(corr, corr_b));
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr_sum;
+}
+
+RSID_KERNEL_TARGET("avx512f,avx512bw")
+void Dot4Avx512(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs)
+{
+    __m512i corr[4] = {_mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512()};
+
+    uint32_t i = 0;
+    for (; i + 32 <= vec_length; i += 32)
+    {
+        __m512i t1 = _mm512_loadu_si512(reinterpret_cast<const void*>(T1 + i));
+        for (int k = 0; k < 4; k++)
+        {
+            __m512i t2 = _mm512_loadu_si512(reinterpret_cast<const void*>(T2[k] + i));
+            corr[k] = _mm512_add_epi32(corr[k], _mm512_madd_epi16(t1, t2));
+        }
+    }
+
+    for (int k = 0; k < 4; k++)
+    {
+        int32_t corr_sum = _mm512_reduce_add_epi32(corr[k]);
+        for (uint32_t j = i; j < vec_length; ++j)
+        {
+            corr_sum += static_cast<int32_t>(T1[j]) * static_cast<int32_t>(T2[k][j]);
+        }
+        corrs[k] = corr_sum;
+    }
+}
+
+RSID_KERNEL_TARGET("avx512f,avx512bw,popcnt") uint32_t HammingAvx512(const uint64_t* S1, const uint64_t* S2, uint32_t num_words)
+{
+    // scalar popcnt on 64-bit words, 2 independent sums.
+    uint64_t distance_a = 0;
+    uint64_t distance_b = 0;
+    uint32_t i = 0;
+    for (; i + 2 <= num_words; i += 2)
+    {
+        distance_a += PopCount64(S1[i] ^ S2[i]);
+        distance_b += PopCount64(S1[i + 1] ^ S2[i + 1]);
+    }
+    for (; i < num_words; ++i)
+    {
+        distance_a += PopCount64(S1[i] ^ S2[i]);
+    }
+    return static_cast<uint32_t>(distance_a + distance_b);
+}
+
+RSID_KERNEL_TARGET("avx512f,avx512bw") bool BlendSumsAvx512(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length,
+                                                             NccSums& sums)
+{
+    // 32 features per step, see BlendSumsSse41(). no sign instruction, so r is negated under the mask of negative d.
+    const __m512i round_half = _mm512_set1_epi16(15);
+    const __m512i div31 = _mm512_set1_epi16(2115);
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i corr = _mm512_setzero_si512();
+    __m512i norm1 = _mm512_setzero_si512();
+    __m512i changed = _mm512_setzero_si512();
+
+    uint32_t i = 0;
+    for (; i + 32 <= vec_length; i += 32)
+    {
+        __m512i x = _mm512_loadu_si512(reinterpret_cast<const void*>(adaptive + i));
+        __m512i a = _mm512_loadu_si512(reinterpret_cast<const void*>(anchor + i));
+        __m512i d = _mm512_sub_epi16(x, a);
+        __m512i r = _mm512_mulhi_epu16(_mm512_add_epi16(_mm512_abs_epi16(d), round_half), div31);
+        r = _mm512_mask_sub_epi16(r, _mm512_movepi16_mask(d), zero, r);
+        __m512i new_x = _mm512_sub_epi16(x, r);
+        _mm512_storeu_si512(reinterpret_cast<void*>(adaptive + i), new_x);
+
+        corr = _mm512_add_epi32(corr, _mm512_madd_epi16(r, a));
+        norm1 = _mm512_add_epi32(norm1, _mm512_madd_epi16(r, _mm512_add_epi16(x, new_x)));
+        changed = _mm512_or_si512(changed, r);
+    }
+
+    sums.corr = static_cast<int32_t>(static_cast<uint32_t>(sums.corr) - static_cast<uint32_t>(_mm512_reduce_add_epi32(corr)));
+    sums.norm1 -= static_cast<uint32_t>(_mm512_reduce_add_epi32(norm1));
+    bool any_changed = _mm512_test_epi16_mask(changed, changed) != 0;
+
+    if (i < vec_length)
+    {
+        any_changed |= BlendSumsScalar(adaptive + i, anchor + i, vec_length - i, sums);
+    }
+    return any_changed;
+}
+
+RSID_KERNEL_TARGET("avx512f,avx512bw") int32_t DotPackedAvx512(const feature_t* T1, const uint8_t* packed, uint32_t vec_length)
+{
+    // 32 features per step: a 32 bit word of each bit plane is directly the lane mask of its bit.
+    const uint8_t* planes = packed + vec_length;
+    const uint32_t plane_bytes = vec_length / 8;
+    const __m512i offset = _mm512_set1_epi16(PackedOffset);
+    __m512i corr = _mm512_setzero_si512();
+
+    uint32_t i = 0;
+    for (; i + 32 <= vec_length; i += 32)
+    {
+        __m512i u = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(packed + i)));
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t word;
+            memcpy(&word, planes + k * plane_bytes + i / 8, sizeof(word));
+            u = _mm512_mask_add_epi16(u, static_cast<__mmask32>(word), u, _mm512_set1_epi16(static_cast<short>(256 << k)));
+        }
+        __m512i v = _mm512_loadu_si512(reinterpret_cast<const void*>(T1 + i));
+        corr = _mm512_add_epi32(corr, _mm512_madd_epi16(v, _mm512_sub_epi16(u, offset)));
+    }
+
+    int32_t corr_sum = _mm512_reduce_add_epi32(corr);
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * PackedFeature(packed, vec_length, i);
+    }
+    return corr_sum;
+}
+
+RSID_KERNEL_TARGET("avx512f,avx512bw") int32_t DotInt8Avx512(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    __m512i corr = _mm512_setzero_si512();
+    uint32_t i = 0;
+    for (; i + 32 <= vec_length; i += 32)
+    {
+        __m512i v1 = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i)));
+        __m512i v2 = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i)));
+        corr = _mm512_add_epi32(corr, _mm512_madd_epi16(v1, v2));
+    }
+
+    int32_t corr_sum = _mm512_reduce_add_epi32(corr);
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr_sum;
+}
+} // namespace MatcherKernels
+} // namespace RealSenseID
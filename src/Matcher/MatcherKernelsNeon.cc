@@ -0,0 +1,122 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// aarch64 neon kernels (neon is always available on aarch64).
+
+#include "MatcherKernels.h"
+#include <arm_neon.h>
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+void NccSumsNeon(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums)
+{
+    // 8 features per step, widening multiply-accumulate of int16 into int32 lanes.
+    int32x4_t corr = vdupq_n_s32(0);
+    int32x4_t norm1 = vdupq_n_s32(0);
+    int32x4_t norm2 = vdupq_n_s32(0);
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        int16x8_t t1 = vld1q_s16(T1 + i);
+        int16x8_t t2 = vld1q_s16(T2 + i);
+        corr = vmlal_s16(corr, vget_low_s16(t1), vget_low_s16(t2));
+        corr = vmlal_high_s16(corr, t1, t2);
+        norm1 = vmlal_s16(norm1, vget_low_s16(t1), vget_low_s16(t1));
+        norm1 = vmlal_high_s16(norm1, t1, t1);
+        norm2 = vmlal_s16(norm2, vget_low_s16(t2), vget_low_s16(t2));
+        norm2 = vmlal_high_s16(norm2, t2, t2);
+    }
+
+    int32_t corr_sum = vaddvq_s32(corr);
+    uint32_t norm1_sum = static_cast<uint32_t>(vaddvq_s32(norm1));
+    uint32_t norm2_sum = static_cast<uint32_t>(vaddvq_s32(norm2));
+
+    for (; i < vec_length; ++i)
+    {
+        int32_t t1 = static_cast<int32_t>(T1[i]);
+        int32_t t2 = static_cast<int32_t>(T2[i]);
+        corr_sum += t1 * t2;
+        norm1_sum += t1 * t1;
+        norm2_sum += t2 * t2;
+    }
+
+    sums.corr = corr_sum;
+    sums.norm1 = norm1_sum;
+    sums.norm2 = norm2_sum;
+}
+
+int32_t DotNeon(const feature_t* T1, const feature_t* T2, uint32_t vec_length)
+{
+    // 16 features per step, two accumulators to hide the multiply-accumulate latency.
+    int32x4_t corr = vdupq_n_s32(0);
+    int32x4_t corr_b = vdupq_n_s32(0);
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        int16x8_t t1 = vld1q_s16(T1 + i);
+        int16x8_t t2 = vld1q_s16(T2 + i);
+        int16x8_t t1_b = vld1q_s16(T1 + i + 8);
+        int16x8_t t2_b = vld1q_s16(T2 + i + 8);
+        corr = vmlal_s16(corr, vget_low_s16(t1), vget_low_s16(t2));
+        corr = vmlal_high_s16(corr, t1, t2);
+        corr_b = vmlal_s16(corr_b, vget_low_s16(t1_b), vget_low_s16(t2_b));
+        corr_b = vmlal_high_s16(corr_b, t1_b, t2_b);
+    }
+
+    int32_t corr_sum = vaddvq_s32(vaddq_s32(corr, corr_b));
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr_sum;
+}
+
+void Dot4Neon(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs)
+{
+    int32x4_t corr[4] = {vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0)};
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        int16x8_t t1 = vld1q_s16(T1 + i);
+        for (int k = 0; k < 4; k++)
+        {
+            int16x8_t t2 = vld1q_s16(T2[k] + i);
+            corr[k] = vmlal_s16(corr[k], vget_low_s16(t1), vget_low_s16(t2));
+            corr[k] = vmlal_high_s16(corr[k], t1, t2);
+        }
+    }
+
+    for (int k = 0; k < 4; k++)
+    {
+        int32_t corr_sum = vaddvq_s32(corr[k]);
+        for (uint32_t j = i; j < vec_length; ++j)
+        {
+            corr_sum += static_cast<int32_t>(T1[j]) * static_cast<int32_t>(T2[k][j]);
+        }
+        corrs[k] = corr_sum;
+    }
+}
+
+uint32_t HammingNeon(const uint64_t* S1, const uint64_t* S2, uint32_t num_words)
+{
+    // per-byte popcount (cnt), summed per 128 bits.
+    uint32_t distance = 0;
+    uint32_t i = 0;
+    for (; i + 2 <= num_words; i += 2)
+    {
+        uint8x16_t x = veorq_u8(vreinterpretq_u8_u64(vld1q_u64(S1 + i)), vreinterpretq_u8_u64(vld1q_u64(S2 + i)));
+        distance += vaddvq_u8(vcntq_u8(x));
+    }
+    for (; i < num_words; ++i)
+    {
+        distance += vaddv_u8(vcnt_u8(vcreate_u8(S1[i] ^ S2[i])));
+    }
+    return distance;
+}
+} // namespace MatcherKernels
+} // namespace RealSenseID
@@ -0,0 +1,191 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// sse4.1 kernels. called only if the cpu supports it (see MatcherKernels.cc).
+
+#include "MatcherKernels.h"
+#include <smmintrin.h>
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+RSID_KERNEL_TARGET("sse4.1") static inline int32_t HorizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+RSID_KERNEL_TARGET("sse4.1") void NccSumsSse41(const feature_t* T1, const feature_t* T2, uint32_t vec_length, NccSums& sums)
+{
+    // 8 features per step. madd multiplies int16 pairs and adds adjacent products into int32 lanes.
+    __m128i corr = _mm_setzero_si128();
+    __m128i norm1 = _mm_setzero_si128();
+    __m128i norm2 = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i));
+        __m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(t1, t2));
+        norm1 = _mm_add_epi32(norm1, _mm_madd_epi16(t1, t1));
+        norm2 = _mm_add_epi32(norm2, _mm_madd_epi16(t2, t2));
+    }
+
+    int32_t corr_sum = HorizontalSum(corr);
+    uint32_t norm1_sum = static_cast<uint32_t>(HorizontalSum(norm1));
+    uint32_t norm2_sum = static_cast<uint32_t>(HorizontalSum(norm2));
+
+    for (; i < vec_length; ++i)
+    {
+        int32_t t1 = static_cast<int32_t>(T1[i]);
+        int32_t t2 = static_cast<int32_t>(T2[i]);
+        corr_sum += t1 * t2;
+        norm1_sum += t1 * t1;
+        norm2_sum += t2 * t2;
+    }
+
+    sums.corr = corr_sum;
+    sums.norm1 = norm1_sum;
+    sums.norm2 = norm2_sum;
+}
+
+RSID_KERNEL_TARGET("sse4.1") int32_t DotSse41(const feature_t* T1, const feature_t* T2, uint32_t vec_length)
+{
+    // 16 features per step, two accumulators to hide the add latency.
+    __m128i corr = _mm_setzero_si128();
+    __m128i corr_b = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i));
+        __m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i));
+        __m128i t1_b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i + 8));
+        __m128i t2_b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i + 8));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(t1, t2));
+        corr_b = _mm_add_epi32(corr_b, _mm_madd_epi16(t1_b, t2_b));
+    }
+
+    int32_t corr_sum = HorizontalSum(_mm_add_epi32(corr, corr_b));
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr_sum;
+}
+
+RSID_KERNEL_TARGET("sse4.1") void Dot4Sse41(const feature_t* T1, const feature_t* const* T2, uint32_t vec_length, int32_t* corrs)
+{
+    __m128i corr[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i));
+        for (int k = 0; k < 4; k++)
+        {
+            __m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2[k] + i));
+            corr[k] = _mm_add_epi32(corr[k], _mm_madd_epi16(t1, t2));
+        }
+    }
+
+    for (int k = 0; k < 4; k++)
+    {
+        int32_t corr_sum = HorizontalSum(corr[k]);
+        for (uint32_t j = i; j < vec_length; ++j)
+        {
+            corr_sum += static_cast<int32_t>(T1[j]) * static_cast<int32_t>(T2[k][j]);
+        }
+        corrs[k] = corr_sum;
+    }
+}
+
+RSID_KERNEL_TARGET("sse4.1") bool BlendSumsSse41(feature_t* adaptive, const feature_t* anchor, uint32_t vec_length, NccSums& sums)
+{
+    // 8 features per step, same math as BlendSumsScalar() on int16 lanes. in the validated range x - a and x + new_x fit
+    // int16, and round(|d| / 31) = ((|d| + 15) * 2115) >> 16 exactly (up to |d| = 2246).
+    const __m128i round_half = _mm_set1_epi16(15);
+    const __m128i div31 = _mm_set1_epi16(2115);
+    __m128i corr = _mm_setzero_si128();
+    __m128i norm1 = _mm_setzero_si128();
+    __m128i changed = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(adaptive + i));
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(anchor + i));
+        __m128i d = _mm_sub_epi16(x, a);
+        __m128i r = _mm_sign_epi16(_mm_mulhi_epu16(_mm_add_epi16(_mm_abs_epi16(d), round_half), div31), d);
+        __m128i new_x = _mm_sub_epi16(x, r);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(adaptive + i), new_x);
+
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(r, a));
+        norm1 = _mm_add_epi32(norm1, _mm_madd_epi16(r, _mm_add_epi16(x, new_x)));
+        changed = _mm_or_si128(changed, r);
+    }
+
+    sums.corr = static_cast<int32_t>(static_cast<uint32_t>(sums.corr) - static_cast<uint32_t>(HorizontalSum(corr)));
+    sums.norm1 -= static_cast<uint32_t>(HorizontalSum(norm1));
+    bool any_changed = !_mm_testz_si128(changed, changed);
+
+    if (i < vec_length)
+    {
+        any_changed |= BlendSumsScalar(adaptive + i, anchor + i, vec_length - i, sums);
+    }
+    return any_changed;
+}
+
+RSID_KERNEL_TARGET("sse4.1") int32_t DotPackedSse41(const feature_t* T1, const uint8_t* packed, uint32_t vec_length)
+{
+    // 8 features per step: one byte of each bit plane, broadcast and tested against the lane's bit.
+    const uint8_t* planes = packed + vec_length;
+    const uint32_t plane_bytes = vec_length / 8;
+    const __m128i lane_bits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m128i offset = _mm_set1_epi16(PackedOffset);
+    __m128i corr = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i u = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(packed + i)));
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i bits = _mm_and_si128(_mm_set1_epi16(planes[k * plane_bytes + i / 8]), lane_bits);
+            u = _mm_add_epi16(u, _mm_and_si128(_mm_cmpeq_epi16(bits, lane_bits), _mm_set1_epi16(static_cast<short>(256 << k))));
+        }
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(v, _mm_sub_epi16(u, offset)));
+    }
+
+    int32_t corr_sum = HorizontalSum(corr);
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * PackedFeature(packed, vec_length, i);
+    }
+    return corr_sum;
+}
+
+RSID_KERNEL_TARGET("sse4.1") int32_t DotInt8Sse41(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    __m128i corr = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i v1 = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(T1 + i)));
+        __m128i v2 = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(T2 + i)));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(v1, v2));
+    }
+
+    int32_t corr_sum = HorizontalSum(corr);
+    for (; i < vec_length; ++i)
+    {
+        corr_sum += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr_sum;
+}
+} // namespace MatcherKernels
+} // namespace RealSenseID
@@ -0,0 +1,160 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherThreadPool.h"
+#include "NumaTopology.h"
+#include <algorithm>
+
+namespace RealSenseID
+{
+MatcherThreadPool::MatcherThreadPool(unsigned int num_threads, size_t min_chunk_size)
+{
+    SetMinChunkSize(min_chunk_size);
+    SetNumThreads(num_threads);
+}
+
+MatcherThreadPool::~MatcherThreadPool()
+{
+    std::lock_guard<std::mutex> run_lock(_run_mutex);
+    StopWorkers();
+}
+
+void MatcherThreadPool::SetNumThreads(unsigned int num_threads)
+{
+    if (num_threads == 0)
+    {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::lock_guard<std::mutex> run_lock(_run_mutex);
+    StopWorkers();
+    StartWorkers(num_threads);
+}
+
+unsigned int MatcherThreadPool::GetNumThreads() const
+{
+    return _num_threads;
+}
+
+bool MatcherThreadPool::SetAffinity(const std::vector<int>& cpus)
+{
+    std::lock_guard<std::mutex> run_lock(_run_mutex);
+    _cpus = cpus;
+    bool pinned = true;
+    for (auto& worker : _workers)
+    {
+        pinned = (_cpus.empty() || NumaTopology::PinThread(worker, _cpus)) && pinned;
+    }
+    return pinned;
+}
+
+void MatcherThreadPool::SetMinChunkSize(size_t min_chunk_size)
+{
+    _min_chunk_size = std::max<size_t>(1, min_chunk_size);
+}
+
+size_t MatcherThreadPool::GetMinChunkSize() const
+{
+    return _min_chunk_size;
+}
+
+size_t MatcherThreadPool::NumChunks(size_t count) const
+{
+    size_t num_chunks = count / _min_chunk_size;
+    return std::max<size_t>(1, std::min<size_t>(num_chunks, _num_threads));
+}
+
+void MatcherThreadPool::Run(size_t num_tasks, const std::function<void(size_t)>& task)
+{
+    std::lock_guard<std::mutex> run_lock(_run_mutex);
+
+    if (_workers.empty() || num_tasks <= 1)
+    {
+        for (size_t i = 0; i < num_tasks; i++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _num_tasks = num_tasks;
+        _next_task = 0;
+        _pending_workers = _workers.size();
+        _generation++;
+    }
+    _wake_cv.notify_all();
+
+    // the calling thread works too
+    RunTasks();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done_cv.wait(lock, [this] { return _pending_workers == 0; });
+    _task = nullptr;
+}
+
+void MatcherThreadPool::StartWorkers(unsigned int num_threads)
+{
+    _stop = false;
+    _num_threads = num_threads;
+    // workers start from the current generation, so they don't miss a Run() that starts before they wait.
+    uint64_t generation = _generation;
+    for (unsigned int i = 1; i < num_threads; i++)
+    {
+        _workers.emplace_back([this, generation] { WorkerLoop(generation); });
+        if (!_cpus.empty())
+        {
+            NumaTopology::PinThread(_workers.back(), _cpus);
+        }
+    }
+}
+
+void MatcherThreadPool::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake_cv.notify_all();
+    for (auto& worker : _workers)
+    {
+        worker.join();
+    }
+    _workers.clear();
+}
+
+void MatcherThreadPool::WorkerLoop(uint64_t seen_generation)
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake_cv.wait(lock, [&] { return _stop || _generation != seen_generation; });
+            if (_stop)
+            {
+                return;
+            }
+            seen_generation = _generation;
+        }
+
+        RunTasks();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_pending_workers == 0)
+        {
+            _done_cv.notify_one();
+        }
+    }
+}
+
+void MatcherThreadPool::RunTasks()
+{
+    size_t i;
+    while ((i = _next_task.fetch_add(1)) < _num_tasks)
+    {
+        (*_task)(i);
+    }
+}
+} // namespace RealSenseID
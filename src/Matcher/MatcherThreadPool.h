@@ -0,0 +1,72 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// Fixed set of worker threads used to split 1:N gallery scans (see Matcher::MatchFaceprintsToArray()).
+//
+// The calling thread takes part in the work, so a pool of N threads runs N-1 workers.
+// A scan of count entries is split to chunks of at least min_chunk_size entries (one per thread at most), so small
+// galleries stay on the calling thread.
+// Run() calls from several threads are serialized.
+class MatcherThreadPool
+{
+public:
+    static constexpr size_t DefaultMinChunkSize = 4096;
+
+    // num_threads = 0 means std::thread::hardware_concurrency().
+    explicit MatcherThreadPool(unsigned int num_threads = 0, size_t min_chunk_size = DefaultMinChunkSize);
+    ~MatcherThreadPool();
+
+    MatcherThreadPool(const MatcherThreadPool&) = delete;
+    MatcherThreadPool& operator=(const MatcherThreadPool&) = delete;
+
+    void SetNumThreads(unsigned int num_threads);
+    unsigned int GetNumThreads() const;
+
+    // pin the worker threads (current and future) to the given cpus, e.g. of a NUMA node (see NumaTopology). the calling
+    // thread of Run() is not pinned. an empty list unpins future workers only. returns false if pinning failed.
+    bool SetAffinity(const std::vector<int>& cpus);
+
+    void SetMinChunkSize(size_t min_chunk_size);
+    size_t GetMinChunkSize() const;
+
+    // number of chunks a scan of count entries should be split to.
+    size_t NumChunks(size_t count) const;
+
+    // run task(0) .. task(num_tasks - 1) on the pool threads and wait for all of them to finish.
+    void Run(size_t num_tasks, const std::function<void(size_t)>& task);
+
+private:
+    void StartWorkers(unsigned int num_threads);
+    void StopWorkers();
+    void WorkerLoop(uint64_t seen_generation);
+    void RunTasks();
+
+    std::vector<std::thread> _workers;
+    std::vector<int> _cpus;
+    std::atomic<unsigned int> _num_threads {1};
+    std::atomic<size_t> _min_chunk_size {DefaultMinChunkSize};
+
+    std::mutex _run_mutex; // serializes Run() and SetNumThreads()
+    std::mutex _mutex;
+    std::condition_variable _wake_cv;
+    std::condition_variable _done_cv;
+    const std::function<void(size_t)>* _task = nullptr;
+    size_t _num_tasks = 0;
+    std::atomic<size_t> _next_task {0};
+    size_t _pending_workers = 0;
+    uint64_t _generation = 0;
+    bool _stop = false;
+};
+} // namespace RealSenseID
@@ -0,0 +1,84 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/MatcherDefines.h"
+#include <algorithm>
+#include <stddef.h>
+
+namespace RealSenseID
+{
+// Fixed-size heap of the K best scores of a 1:N scan (see Matcher::MatchFaceprintsToArrayTopK()).
+//
+// Works on caller provided storage of capacity entries and never allocates.
+// Candidates are ordered by score (higher first), then by index (lower first), the same tie rule as the single-best
+// scan, so the best candidate is always the single-best result and the final set does not depend on scan order.
+class MatcherTopK
+{
+public:
+    MatcherTopK(TagResult* storage, size_t capacity) : _data(storage), _capacity(capacity)
+    {
+    }
+
+    // quick reject for the scan loop (entries are scanned by increasing index, so an equal score never gets in).
+    bool Accepts(match_calc_t score) const
+    {
+        return _size < _capacity || score > _data[0].score;
+    }
+
+    void Push(match_calc_t score, int idx)
+    {
+        if (_capacity == 0)
+        {
+            return;
+        }
+
+        TagResult candidate;
+        candidate.idx = idx;
+        candidate.score = score;
+
+        // the heap top is the worst candidate kept so far.
+        if (_size < _capacity)
+        {
+            _data[_size++] = candidate;
+            std::push_heap(_data, _data + _size, IsBetter);
+        }
+        else if (IsBetter(candidate, _data[0]))
+        {
+            std::pop_heap(_data, _data + _size, IsBetter);
+            _data[_size - 1] = candidate;
+            std::push_heap(_data, _data + _size, IsBetter);
+        }
+    }
+
+    void Merge(const MatcherTopK& other)
+    {
+        for (size_t i = 0; i < other._size; i++)
+        {
+            Push(other._data[i].score, other._data[i].idx);
+        }
+    }
+
+    // sort the kept candidates best first. no more Push() after this.
+    void Sort()
+    {
+        std::sort_heap(_data, _data + _size, IsBetter);
+    }
+
+    size_t Size() const
+    {
+        return _size;
+    }
+
+    static bool IsBetter(const TagResult& a, const TagResult& b)
+    {
+        return a.score > b.score || (a.score == b.score && a.idx < b.idx);
+    }
+
+private:
+    TagResult* _data;
+    size_t _capacity;
+    size_t _size = 0;
+};
+} // namespace RealSenseID
@@ -0,0 +1,114 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "NumaTopology.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// thread affinity on linux, except android (bionic has no pthread_setaffinity_np).
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace RealSenseID
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+static bool SetAffinity(pthread_t thread, const std::vector<int>& cpus)
+{
+    if (cpus.empty())
+    {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return ::pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+#endif
+
+std::vector<std::vector<int>> NumaTopology::NodeCpus()
+{
+    std::vector<std::vector<int>> nodes;
+#if defined(__linux__)
+    // node ids may have gaps (e.g. offline nodes), so look a bit past the first missing one.
+    for (int node = 0, missing = 0; missing < 8; node++)
+    {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string text;
+        if (!file || !std::getline(file, text))
+        {
+            missing++;
+            continue;
+        }
+        auto cpus = ParseCpuList(text);
+        if (!cpus.empty())
+        {
+            nodes.push_back(cpus);
+        }
+    }
+#endif
+    if (nodes.empty())
+    {
+        unsigned int num_cpus = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<int> cpus(num_cpus);
+        for (unsigned int cpu = 0; cpu < num_cpus; cpu++)
+        {
+            cpus[cpu] = static_cast<int>(cpu);
+        }
+        nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+std::vector<int> NumaTopology::ParseCpuList(const std::string& text)
+{
+    std::vector<int> cpus;
+    std::istringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        int first = 0, last = 0;
+        char dash = 0;
+        std::istringstream range_stream(range);
+        if (!(range_stream >> first))
+        {
+            continue;
+        }
+        last = (range_stream >> dash >> last && dash == '-') ? last : first;
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+bool NumaTopology::PinCurrentThread(const std::vector<int>& cpus)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    return SetAffinity(::pthread_self(), cpus);
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+bool NumaTopology::PinThread(std::thread& thread, const std::vector<int>& cpus)
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    return SetAffinity(thread.native_handle(), cpus);
+#else
+    (void)thread;
+    (void)cpus;
+    return false;
+#endif
+}
+} // namespace RealSenseID
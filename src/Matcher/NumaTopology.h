@@ -0,0 +1,28 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RealSenseID
+{
+// NUMA nodes of the host and thread pinning, for node local gallery shards (see ShardedGallery).
+// Read on Linux from /sys/devices/system/node. Elsewhere, or on hosts without NUMA, there is a single node with all cpus,
+// and pinning is not supported (nor on Android).
+class NumaTopology
+{
+public:
+    // cpus of each node, in node order. never empty.
+    static std::vector<std::vector<int>> NodeCpus();
+
+    // parse a kernel cpu list, e.g. "0-3,8-11".
+    static std::vector<int> ParseCpuList(const std::string& text);
+
+    // restrict a thread to the given cpus. returns false if not supported or failed.
+    static bool PinCurrentThread(const std::vector<int>& cpus);
+    static bool PinThread(std::thread& thread, const std::vector<int>& cpus);
+};
+} // namespace RealSenseID
@@ -0,0 +1,445 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "PackedGallery.h"
+#include "Matcher.h"
+#include "Logger.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "PackedGallery";
+
+static_assert(PackedGallery::RowLength % 8 == 0, "packed rows need whole bytes of each bit plane");
+static_assert(PackedGallery::RowBytes % AlignedBuffer<uint8_t>::Alignment == 0, "packed rows must keep the 64-byte alignment");
+static_assert(RSID_MAX_FEATURE_VALUE + MatcherKernels::PackedOffset < 2048 && RSID_MIN_FEATURE_VALUE + MatcherKernels::PackedOffset >= 0,
+              "valid features must fit 11 bits");
+
+static bool IsPackable(const feature_t* descriptor)
+{
+    int out_of_range = 0;
+    for (size_t i = 0; i < PackedGallery::RowLength; i++)
+    {
+        out_of_range |= (descriptor[i] > RSID_MAX_FEATURE_VALUE) | (descriptor[i] < RSID_MIN_FEATURE_VALUE);
+    }
+    return out_of_range == 0;
+}
+
+static bool IsAllZero(const feature_t* descriptor)
+{
+    int any = 0;
+    for (size_t i = 0; i < PackedGallery::RowLength; i++)
+    {
+        any |= descriptor[i];
+    }
+    return any == 0;
+}
+
+PackedGallery::PackedGallery(bool quantized) : _quantized(quantized)
+{
+}
+
+bool PackedGallery::Set(const char* user_id, const Faceprints& faceprints)
+{
+    if (user_id == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Null user id");
+        return false;
+    }
+
+    const auto& data = faceprints.data;
+    if (!IsPackable(&data.adaptiveDescriptorWithoutMask[0]) || !IsPackable(&data.adaptiveDescriptorWithMask[0]) ||
+        !IsPackable(&data.enrollmentDescriptor[0]))
+    {
+        LOG_ERROR(LOG_TAG, "Invalid faceprints vector range");
+        return false;
+    }
+
+    auto it = _slots.find(user_id);
+    bool is_only_entry = Empty() || (Size() == 1 && it != _slots.end());
+    if (!is_only_entry && data.version != _version)
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+    _version = data.version;
+
+    if (it != _slots.end())
+    {
+        WriteSlot(it->second, faceprints);
+        return true;
+    }
+
+    size_t slot = Size();
+    Reserve(slot + 1);
+    _meta.emplace_back();
+    _user_ids.emplace_back(user_id);
+    _mask_row.push_back(-1);
+    _matched_mask_row.push_back(-1);
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set].push_back(0);
+        _norm_msbs[row_set].push_back(0);
+        if (_quantized)
+        {
+            _quantized_norms[row_set].push_back(0);
+            _quantized_norm_msbs[row_set].push_back(0);
+        }
+    }
+    WriteSlot(slot, faceprints);
+    _slots[_user_ids.back()] = slot;
+    return true;
+}
+
+bool PackedGallery::Remove(const char* user_id)
+{
+    auto it = (user_id != nullptr) ? _slots.find(user_id) : _slots.end();
+    if (it == _slots.end())
+    {
+        return false;
+    }
+
+    // swap with last, so removal is O(1)
+    size_t slot = it->second;
+    size_t last = Size() - 1;
+    _slots.erase(it);
+    RemoveMaskRow(slot);
+    if (slot != last)
+    {
+        MoveSlot(last, slot);
+        _slots[_user_ids[slot]] = slot;
+    }
+
+    _meta.pop_back();
+    _user_ids.pop_back();
+    _mask_row.pop_back();
+    _matched_mask_row.pop_back();
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set].pop_back();
+        _norm_msbs[row_set].pop_back();
+        if (_quantized)
+        {
+            _quantized_norms[row_set].pop_back();
+            _quantized_norm_msbs[row_set].pop_back();
+        }
+    }
+    return true;
+}
+
+void PackedGallery::Clear()
+{
+    _meta.clear();
+    _user_ids.clear();
+    _slots.clear();
+    _mask_row.clear();
+    _matched_mask_row.clear();
+    _mask_owner.clear();
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set].clear();
+        _norm_msbs[row_set].clear();
+        _quantized_norms[row_set].clear();
+        _quantized_norm_msbs[row_set].clear();
+    }
+}
+
+void PackedGallery::Reserve(size_t count)
+{
+    size_t capacity = _rows.Capacity() / RowBytes;
+    if (count <= capacity)
+    {
+        return;
+    }
+    capacity = std::max(count, capacity * 2);
+    _rows.Reserve(capacity * RowBytes);
+    _enrollment.Reserve(capacity * RowBytes);
+    if (_quantized)
+    {
+        _quantized_rows.Reserve(capacity * RowLength);
+    }
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set].reserve(capacity);
+        _norm_msbs[row_set].reserve(capacity);
+        if (_quantized)
+        {
+            _quantized_norms[row_set].reserve(capacity);
+            _quantized_norm_msbs[row_set].reserve(capacity);
+        }
+    }
+    _meta.reserve(capacity);
+    _user_ids.reserve(capacity);
+    _mask_row.reserve(capacity);
+    _matched_mask_row.reserve(capacity);
+}
+
+size_t PackedGallery::Size() const
+{
+    return _meta.size();
+}
+
+bool PackedGallery::Empty() const
+{
+    return _meta.empty();
+}
+
+bool PackedGallery::IsQuantized() const
+{
+    return _quantized;
+}
+
+int PackedGallery::Find(const char* user_id) const
+{
+    auto it = (user_id != nullptr) ? _slots.find(user_id) : _slots.end();
+    return (it != _slots.end()) ? static_cast<int>(it->second) : -1;
+}
+
+const char* PackedGallery::GetUserId(size_t slot) const
+{
+    return _user_ids[slot].c_str();
+}
+
+Faceprints PackedGallery::GetFaceprints(size_t slot) const
+{
+    Faceprints faceprints;
+    auto& data = faceprints.data;
+    const SlotMeta& meta = _meta[slot];
+    ::memcpy(data.reserved, meta.reserved, sizeof(data.reserved));
+    data.version = _version;
+    data.featuresType = meta.featuresType;
+    data.flags = meta.flags;
+
+    // the with-mask vector is all zero if it has no row (the constructor's value).
+    Unpack(_rows.Data() + slot * RowBytes, &data.adaptiveDescriptorWithoutMask[0]);
+    if (_mask_row[slot] >= 0)
+    {
+        Unpack(_mask_rows.Data() + _mask_row[slot] * RowBytes, &data.adaptiveDescriptorWithMask[0]);
+    }
+    Unpack(_enrollment.Data() + slot * RowBytes, &data.enrollmentDescriptor[0]);
+
+    const size_t tail_bytes = sizeof(meta.tails[0]);
+    ::memcpy(&data.adaptiveDescriptorWithoutMask[RowLength], meta.tails[0], tail_bytes);
+    ::memcpy(&data.adaptiveDescriptorWithMask[RowLength], meta.tails[1], tail_bytes);
+    ::memcpy(&data.enrollmentDescriptor[RowLength], meta.tails[2], tail_bytes);
+    return faceprints;
+}
+
+int PackedGallery::GetVersion() const
+{
+    return _version;
+}
+
+size_t PackedGallery::MemoryBytes() const
+{
+    size_t bytes = _rows.Capacity() + _enrollment.Capacity() + _mask_rows.Capacity() + _quantized_rows.Capacity() +
+                   _quantized_mask_rows.Capacity();
+    bytes += (_mask_row.capacity() + _matched_mask_row.capacity()) * sizeof(int) + _mask_owner.capacity() * sizeof(uint32_t);
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        bytes += (_norms[row_set].capacity() + _quantized_norms[row_set].capacity()) * sizeof(uint32_t);
+        bytes += (_norm_msbs[row_set].capacity() + _quantized_norm_msbs[row_set].capacity()) * sizeof(short);
+    }
+    bytes += _meta.capacity() * sizeof(SlotMeta);
+    return bytes;
+}
+
+void PackedGallery::Pack(const feature_t* descriptor, uint8_t* packed)
+{
+    const size_t plane_bytes = RowLength / 8;
+    uint8_t* planes = packed + RowLength;
+    ::memset(planes, 0, 3 * plane_bytes);
+    for (size_t i = 0; i < RowLength; i++)
+    {
+        uint32_t u = static_cast<uint32_t>(descriptor[i] + MatcherKernels::PackedOffset);
+        packed[i] = static_cast<uint8_t>(u);
+        for (size_t k = 0; k < 3; k++)
+        {
+            planes[k * plane_bytes + i / 8] |= static_cast<uint8_t>(((u >> (8 + k)) & 1) << (i % 8));
+        }
+    }
+}
+
+void PackedGallery::Unpack(const uint8_t* packed, feature_t* descriptor)
+{
+    const uint32_t vec_length = static_cast<uint32_t>(RowLength);
+    for (uint32_t i = 0; i < vec_length; i++)
+    {
+        descriptor[i] = static_cast<feature_t>(MatcherKernels::PackedFeature(packed, vec_length, i));
+    }
+}
+
+void PackedGallery::Quantize(const feature_t* descriptor, int8_t* quantized)
+{
+    int32_t max_abs = 0;
+    for (size_t i = 0; i < RowLength; i++)
+    {
+        max_abs = std::max(max_abs, std::abs(static_cast<int32_t>(descriptor[i])));
+    }
+
+    // round(x * 127 / max_abs), half away from zero, in integers so every platform quantizes the same way.
+    for (size_t i = 0; i < RowLength; i++)
+    {
+        int32_t x = descriptor[i];
+        int32_t q = 0;
+        if (max_abs > 0)
+        {
+            int32_t scaled = std::abs(x) * 2 * 127 + max_abs;
+            q = (scaled / (2 * max_abs)) * ((x < 0) ? -1 : 1);
+        }
+        quantized[i] = static_cast<int8_t>(q);
+    }
+}
+
+void PackedGallery::WriteSlot(size_t slot, const Faceprints& faceprints)
+{
+    const auto& data = faceprints.data;
+    SlotMeta& meta = _meta[slot];
+    ::memcpy(meta.reserved, data.reserved, sizeof(meta.reserved));
+    meta.featuresType = data.featuresType;
+    meta.flags = data.flags;
+    const size_t tail_bytes = sizeof(meta.tails[0]);
+    ::memcpy(meta.tails[0], &data.adaptiveDescriptorWithoutMask[RowLength], tail_bytes);
+    ::memcpy(meta.tails[1], &data.adaptiveDescriptorWithMask[RowLength], tail_bytes);
+    ::memcpy(meta.tails[2], &data.enrollmentDescriptor[RowLength], tail_bytes);
+
+    Pack(&data.adaptiveDescriptorWithoutMask[0], _rows.Data() + slot * RowBytes);
+    Pack(&data.enrollmentDescriptor[0], _enrollment.Data() + slot * RowBytes);
+    if (_quantized)
+    {
+        Quantize(&data.adaptiveDescriptorWithoutMask[0], _quantized_rows.Data() + slot * RowLength);
+    }
+
+    // same row selection as GetScores(): the with-mask vector if valid, otherwise the no-mask one.
+    feature_t vec_flags = data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS];
+    bool mask_is_valid = (vec_flags == FaVectorFlagsEnum::VecFlagValidWithMask);
+    if (mask_is_valid || !IsAllZero(&data.adaptiveDescriptorWithMask[0]))
+    {
+        WriteMaskRow(slot, &data.adaptiveDescriptorWithMask[0]);
+    }
+    else
+    {
+        RemoveMaskRow(slot);
+    }
+    _matched_mask_row[slot] = mask_is_valid ? _mask_row[slot] : -1;
+
+    WriteNorms(0, slot, &data.adaptiveDescriptorWithoutMask[0]);
+    WriteNorms(1, slot, mask_is_valid ? &data.adaptiveDescriptorWithMask[0] : &data.adaptiveDescriptorWithoutMask[0]);
+}
+
+void PackedGallery::WriteMaskRow(size_t slot, const feature_t* descriptor)
+{
+    if (_mask_row[slot] < 0)
+    {
+        ReserveMaskRows(_mask_owner.size() + 1);
+        _mask_row[slot] = static_cast<int>(_mask_owner.size());
+        _mask_owner.push_back(static_cast<uint32_t>(slot));
+    }
+
+    size_t row = static_cast<size_t>(_mask_row[slot]);
+    Pack(descriptor, _mask_rows.Data() + row * RowBytes);
+    if (_quantized)
+    {
+        Quantize(descriptor, _quantized_mask_rows.Data() + row * RowLength);
+    }
+}
+
+void PackedGallery::RemoveMaskRow(size_t slot)
+{
+    if (_mask_row[slot] < 0)
+    {
+        return;
+    }
+
+    // swap with last, as for slots
+    size_t row = static_cast<size_t>(_mask_row[slot]);
+    size_t last = _mask_owner.size() - 1;
+    if (row != last)
+    {
+        ::memcpy(_mask_rows.Data() + row * RowBytes, _mask_rows.Data() + last * RowBytes, RowBytes);
+        if (_quantized)
+        {
+            ::memcpy(_quantized_mask_rows.Data() + row * RowLength, _quantized_mask_rows.Data() + last * RowLength, RowLength);
+        }
+        size_t owner = _mask_owner[last];
+        _mask_owner[row] = static_cast<uint32_t>(owner);
+        _mask_row[owner] = static_cast<int>(row);
+        if (_matched_mask_row[owner] >= 0)
+        {
+            _matched_mask_row[owner] = static_cast<int>(row);
+        }
+    }
+    _mask_owner.pop_back();
+    _mask_row[slot] = -1;
+    _matched_mask_row[slot] = -1;
+}
+
+void PackedGallery::WriteNorms(int row_set, size_t slot, const feature_t* descriptor)
+{
+    // same norm handling as MatchTwoVectors() : protect division by 0.
+    const uint32_t vec_length = static_cast<uint32_t>(RowLength);
+    const auto& kernels = MatcherKernels::Active();
+    uint32_t norm = static_cast<uint32_t>(kernels.dot(descriptor, descriptor, vec_length));
+    norm = (norm == 0) ? 1 : norm;
+    _norms[row_set][slot] = norm;
+    _norm_msbs[row_set][slot] = Matcher::GetMsb(norm);
+
+    if (_quantized)
+    {
+        const int8_t* quantized = QuantizedRow(slot, row_set == 1);
+        uint32_t quantized_norm = static_cast<uint32_t>(kernels.dot_int8(quantized, quantized, vec_length));
+        quantized_norm = (quantized_norm == 0) ? 1 : quantized_norm;
+        _quantized_norms[row_set][slot] = quantized_norm;
+        _quantized_norm_msbs[row_set][slot] = Matcher::GetMsb(quantized_norm);
+    }
+}
+
+void PackedGallery::MoveSlot(size_t from, size_t to)
+{
+    _meta[to] = _meta[from];
+    _user_ids[to] = std::move(_user_ids[from]);
+    ::memcpy(_rows.Data() + to * RowBytes, _rows.Data() + from * RowBytes, RowBytes);
+    ::memcpy(_enrollment.Data() + to * RowBytes, _enrollment.Data() + from * RowBytes, RowBytes);
+    if (_quantized)
+    {
+        ::memcpy(_quantized_rows.Data() + to * RowLength, _quantized_rows.Data() + from * RowLength, RowLength);
+    }
+
+    // the mask row stays in place, only its owner changes.
+    _mask_row[to] = _mask_row[from];
+    _matched_mask_row[to] = _matched_mask_row[from];
+    if (_mask_row[to] >= 0)
+    {
+        _mask_owner[static_cast<size_t>(_mask_row[to])] = static_cast<uint32_t>(to);
+    }
+
+    for (int row_set = 0; row_set < 2; row_set++)
+    {
+        _norms[row_set][to] = _norms[row_set][from];
+        _norm_msbs[row_set][to] = _norm_msbs[row_set][from];
+        if (_quantized)
+        {
+            _quantized_norms[row_set][to] = _quantized_norms[row_set][from];
+            _quantized_norm_msbs[row_set][to] = _quantized_norm_msbs[row_set][from];
+        }
+    }
+}
+
+void PackedGallery::ReserveMaskRows(size_t count)
+{
+    size_t capacity = _mask_rows.Capacity() / RowBytes;
+    if (count <= capacity)
+    {
+        return;
+    }
+    capacity = std::max(count, capacity * 2);
+    _mask_rows.Reserve(capacity * RowBytes);
+    if (_quantized)
+    {
+        _quantized_mask_rows.Reserve(capacity * RowLength);
+    }
+    _mask_owner.reserve(capacity);
+}
+} // namespace RealSenseID
@@ -0,0 +1,155 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "AlignedBuffer.h"
+#include "MatcherKernels.h"
+#include "RealSenseID/Faceprints.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// Compact host side gallery for very large 1:N galleries (see Matcher::MatchFaceprintsToArray()).
+//
+// Faceprints are kept packed instead of as 16-bit features (see MatcherKernels::PackedRowBytes()): features are in
+// [-1023, 1023], so 11 bits per feature are lossless. Per user this keeps:
+//  * the adaptive no-mask and the enrollment vectors, packed (704 bytes each instead of 1030).
+//  * the adaptive with-mask vector (deprecated) only if it is in use - valid, or not all zero. most users have none.
+//  * the squared norm and its msb of the rows scanned for probes without and with mask, computed once at Set() time.
+//  * the remaining faceprints fields, so GetFaceprints() returns exactly the faceprints that were set.
+// The matcher scores the packed rows directly (MatcherKernels dot_packed), with the same scores as the unpacked ones.
+//
+// A quantized gallery also keeps an int8 copy of the scanned rows (512 bytes per row), for a fast approximate first
+// pass rescored on the packed rows (see Matcher::MatchFaceprintsToArrayQuantized()). Each row is scaled to use the
+// full int8 range. The scale itself is not kept: ncc is scale invariant, so only the rounding error is left.
+//
+// Unlike FaceprintGallery, all three vectors must be in the valid feature range (they are packed), and Set() rejects
+// faceprints otherwise. Removal moves the last entry into the removed slot, so slots are stable only until the next
+// Remove(). Not thread safe.
+class PackedGallery
+{
+public:
+    static constexpr size_t RowLength = RSID_NUM_OF_RECOGNITION_FEATURES;
+    static constexpr size_t RowBytes = MatcherKernels::PackedRowBytes(static_cast<uint32_t>(RowLength));
+
+    explicit PackedGallery(bool quantized = false);
+    PackedGallery(const PackedGallery&) = delete;
+    PackedGallery& operator=(const PackedGallery&) = delete;
+
+    // insert a new user, or replace the faceprints of an existing user (e.g. after adaptive update).
+    // returns false if a vector is out of range or the faceprints version differs from the gallery's.
+    bool Set(const char* user_id, const Faceprints& faceprints);
+
+    // returns false if user was not found.
+    bool Remove(const char* user_id);
+
+    void Clear();
+    void Reserve(size_t count);
+
+    size_t Size() const;
+    bool Empty() const;
+    bool IsQuantized() const;
+
+    // slot of the given user, or -1 if not found.
+    int Find(const char* user_id) const;
+
+    const char* GetUserId(size_t slot) const;
+
+    // the faceprints of a slot, unpacked.
+    Faceprints GetFaceprints(size_t slot) const;
+
+    // faceprints version shared by all entries.
+    int GetVersion() const;
+
+    // heap bytes held by the gallery rows and per user data (not counting the user id index).
+    size_t MemoryBytes() const;
+
+    // packed row scanned for a probe with/without mask at slot, RowBytes bytes.
+    const uint8_t* Row(size_t slot, bool probe_has_mask) const
+    {
+        int mask_row = probe_has_mask ? _matched_mask_row[slot] : -1;
+        return (mask_row >= 0) ? _mask_rows.Data() + mask_row * RowBytes : _rows.Data() + slot * RowBytes;
+    }
+
+    const uint32_t* Norms(bool probe_has_mask) const
+    {
+        return _norms[probe_has_mask ? 1 : 0].data();
+    }
+
+    const short* NormMsbs(bool probe_has_mask) const
+    {
+        return _norm_msbs[probe_has_mask ? 1 : 0].data();
+    }
+
+    // int8 row scanned for a probe with/without mask at slot, RowLength bytes. quantized galleries only.
+    const int8_t* QuantizedRow(size_t slot, bool probe_has_mask) const
+    {
+        int mask_row = probe_has_mask ? _matched_mask_row[slot] : -1;
+        return (mask_row >= 0) ? _quantized_mask_rows.Data() + mask_row * RowLength : _quantized_rows.Data() + slot * RowLength;
+    }
+
+    const uint32_t* QuantizedNorms(bool probe_has_mask) const
+    {
+        return _quantized_norms[probe_has_mask ? 1 : 0].data();
+    }
+
+    const short* QuantizedNormMsbs(bool probe_has_mask) const
+    {
+        return _quantized_norm_msbs[probe_has_mask ? 1 : 0].data();
+    }
+
+    // a vector of RowLength features in the valid range to a packed row of RowBytes bytes, and back.
+    static void Pack(const feature_t* descriptor, uint8_t* packed);
+    static void Unpack(const uint8_t* packed, feature_t* descriptor);
+
+    // a vector of RowLength features to int8, scaled so the largest magnitude maps to 127.
+    static void Quantize(const feature_t* descriptor, int8_t* quantized);
+
+private:
+    // faceprints fields kept aside of the packed rows: the header and the features past RowLength of each vector.
+    struct SlotMeta
+    {
+        int reserved[5];
+        int featuresType;
+        int flags;
+        feature_t tails[3][RSID_FEATURES_VECTOR_ALLOC_SIZE - RowLength];
+    };
+
+    void WriteSlot(size_t slot, const Faceprints& faceprints);
+    void WriteMaskRow(size_t slot, const feature_t* descriptor);
+    void RemoveMaskRow(size_t slot);
+    void WriteNorms(int row_set, size_t slot, const feature_t* descriptor);
+    void MoveSlot(size_t from, size_t to);
+    void ReserveMaskRows(size_t count);
+
+    bool _quantized;
+
+    // dense per slot rows.
+    AlignedBuffer<uint8_t> _rows;       // adaptive no-mask
+    AlignedBuffer<uint8_t> _enrollment; // enrollment
+    AlignedBuffer<int8_t> _quantized_rows;
+
+    // sparse with-mask rows. _mask_row[slot] is the row of a slot (-1 if none), _mask_owner[row] its slot.
+    // _matched_mask_row[slot] is the same row if it is valid (scanned for masked probes), -1 otherwise.
+    AlignedBuffer<uint8_t> _mask_rows;
+    AlignedBuffer<int8_t> _quantized_mask_rows;
+    std::vector<int> _mask_row;
+    std::vector<int> _matched_mask_row;
+    std::vector<uint32_t> _mask_owner;
+
+    // row sets, indexed by probe_has_mask.
+    std::vector<uint32_t> _norms[2];
+    std::vector<short> _norm_msbs[2];
+    std::vector<uint32_t> _quantized_norms[2];
+    std::vector<short> _quantized_norm_msbs[2];
+
+    std::vector<SlotMeta> _meta;
+    std::vector<std::string> _user_ids;
+    std::unordered_map<std::string, size_t> _slots;
+    int _version = RSID_FACEPRINTS_VERSION;
+};
+} // namespace RealSenseID
@@ -0,0 +1,120 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RecentMatches.h"
+#include <algorithm>
+
+namespace RealSenseID
+{
+RecentMatches::RecentMatches(size_t capacity, bool early_accept, match_calc_t early_accept_margin) :
+    _capacity(std::max<size_t>(capacity, 1)), _early_accept(early_accept), _early_accept_margin(early_accept_margin)
+{
+    _users.reserve(_capacity);
+}
+
+size_t RecentMatches::Capacity() const
+{
+    return _capacity;
+}
+
+bool RecentMatches::EarlyAccept() const
+{
+    return _early_accept;
+}
+
+match_calc_t RecentMatches::EarlyAcceptMargin() const
+{
+    return _early_accept_margin;
+}
+
+const std::vector<std::string>& RecentMatches::Users() const
+{
+    return _users;
+}
+
+bool RecentMatches::Contains(const char* user_id) const
+{
+    return std::find(_users.begin(), _users.end(), user_id) != _users.end();
+}
+
+void RecentMatches::Touch(const char* user_id)
+{
+    auto it = std::find(_users.begin(), _users.end(), user_id);
+    if (it == _users.end())
+    {
+        if (_users.size() == _capacity)
+        {
+            _users.pop_back();
+        }
+        _users.insert(_users.begin(), user_id);
+        return;
+    }
+    std::rotate(_users.begin(), it, it + 1);
+}
+
+void RecentMatches::Clear()
+{
+    _users.clear();
+}
+
+void RecentMatches::RecordMatch(bool recent_hit, bool early_accept, double elapsed_us)
+{
+    _num_matches++;
+    _num_recent_hits += recent_hit ? 1 : 0;
+    if (early_accept)
+    {
+        _num_early_accepts++;
+        _early_accept_us += elapsed_us;
+    }
+    else
+    {
+        _full_scan_us += elapsed_us;
+    }
+}
+
+void RecentMatches::RecordEarlyAcceptCandidate(bool same_as_full_scan)
+{
+    _num_early_accept_candidates++;
+    _num_early_accept_misses += same_as_full_scan ? 0 : 1;
+}
+
+RecentMatchStats RecentMatches::GetStats() const
+{
+    RecentMatchStats stats;
+    stats.num_matches = _num_matches;
+    stats.num_recent_hits = _num_recent_hits;
+    stats.num_early_accepts = _num_early_accepts;
+    stats.num_early_accept_candidates = _num_early_accept_candidates;
+    stats.num_early_accept_misses = _num_early_accept_misses;
+    if (_num_matches > 0)
+    {
+        stats.hit_rate = static_cast<float>(_num_recent_hits) / static_cast<float>(_num_matches);
+    }
+
+    uint64_t num_full_scans = _num_matches - _num_early_accepts;
+    if (num_full_scans > 0)
+    {
+        stats.mean_full_scan_us = _full_scan_us / static_cast<double>(num_full_scans);
+    }
+    if (_num_early_accepts > 0)
+    {
+        stats.mean_early_accept_us = _early_accept_us / static_cast<double>(_num_early_accepts);
+    }
+    if (num_full_scans > 0 && _num_early_accepts > 0)
+    {
+        stats.saved_us = static_cast<double>(_num_early_accepts) * (stats.mean_full_scan_us - stats.mean_early_accept_us);
+    }
+    return stats;
+}
+
+void RecentMatches::ResetStats()
+{
+    _num_matches = 0;
+    _num_recent_hits = 0;
+    _num_early_accepts = 0;
+    _num_early_accept_candidates = 0;
+    _num_early_accept_misses = 0;
+    _full_scan_us = 0;
+    _early_accept_us = 0;
+}
+} // namespace RealSenseID
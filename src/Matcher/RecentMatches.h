@@ -0,0 +1,85 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/MatcherDefines.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// statistics of the matches made with a RecentMatches set.
+struct RecentMatchStats
+{
+    uint64_t num_matches = 0;       // matches made with the set
+    uint64_t num_recent_hits = 0;   // matched users (isSame) that were in the set
+    uint64_t num_early_accepts = 0; // matches accepted from the set without the full scan
+    float hit_rate = 0;             // num_recent_hits / num_matches
+
+    // with early accept off: matches where a recent user beat the margin (would have been accepted early), and those of
+    // them where the full scan returned another user (the early accept would have been wrong).
+    uint64_t num_early_accept_candidates = 0;
+    uint64_t num_early_accept_misses = 0;
+
+    double mean_full_scan_us = 0;    // mean time of the matches that ran the full scan
+    double mean_early_accept_us = 0; // mean time of the early accepted matches
+    double saved_us = 0;             // estimate: num_early_accepts * (mean_full_scan_us - mean_early_accept_us)
+};
+
+// Small set of the most recently matched users of a FaceprintGallery, for galleries where the same few people match
+// again and again within minutes (e.g. a door running an authentication loop).
+// See Matcher::MatchFaceprintsToArray() with a RecentMatches set. The recent users are always scored first, and the best
+// of them is an early accept candidate if it beats its strong threshold by at least early_accept_margin:
+//  * with early accept off, every match also runs the usual full scan - same result as without the set. the set tracks
+//    how often the match was one of the recent users (the hit rate), and checks each candidate against the full scan,
+//    to tune the margin before turning early accept on.
+//  * with early accept on, a candidate is accepted without the full scan. a better scoring user outside the set is then
+//    not looked at, so the margin trades accuracy for latency.
+// Users are kept by id, so gallery slot changes (Remove()) don't matter, and ids no longer in the gallery are skipped.
+// The least recently matched user is evicted when the set is full.
+// Not thread safe, use a set per matching thread.
+class RecentMatches
+{
+public:
+    static constexpr size_t DefaultCapacity = 16;
+
+    explicit RecentMatches(size_t capacity = DefaultCapacity, bool early_accept = false, match_calc_t early_accept_margin = 0);
+
+    size_t Capacity() const;
+    bool EarlyAccept() const;
+    match_calc_t EarlyAcceptMargin() const;
+
+    // user ids, most recent first.
+    const std::vector<std::string>& Users() const;
+
+    bool Contains(const char* user_id) const;
+
+    // move a matched user to the front, evicting the least recent one if full.
+    void Touch(const char* user_id);
+
+    void Clear();
+
+    // called by the matcher after each match, and for each early accept candidate that was checked by the full scan.
+    void RecordMatch(bool recent_hit, bool early_accept, double elapsed_us);
+    void RecordEarlyAcceptCandidate(bool same_as_full_scan);
+
+    RecentMatchStats GetStats() const;
+    void ResetStats();
+
+private:
+    size_t _capacity;
+    bool _early_accept;
+    match_calc_t _early_accept_margin;
+    std::vector<std::string> _users;
+
+    uint64_t _num_matches = 0;
+    uint64_t _num_recent_hits = 0;
+    uint64_t _num_early_accepts = 0;
+    uint64_t _num_early_accept_candidates = 0;
+    uint64_t _num_early_accept_misses = 0;
+    double _full_scan_us = 0;
+    double _early_accept_us = 0;
+};
+} // namespace RealSenseID
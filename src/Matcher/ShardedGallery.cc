@@ -0,0 +1,328 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "ShardedGallery.h"
+#include "NumaTopology.h"
+#include "Logger.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "ShardedGallery";
+
+ShardedGallery::ShardedGallery(const ShardedGalleryOptions& options)
+{
+    auto nodes = NumaTopology::NodeCpus();
+    size_t num_shards = (options.num_shards > 0) ? options.num_shards : nodes.size();
+    _pinned = options.pin_threads;
+    for (size_t shard = 0; shard < num_shards; shard++)
+    {
+        std::unique_ptr<ShardData> data(new ShardData());
+        data->node = static_cast<int>(shard % nodes.size());
+        const auto& cpus = nodes[data->node];
+        data->gallery.SetHugePages(options.huge_pages);
+
+        unsigned int threads = (options.threads_per_shard > 0) ? options.threads_per_shard : static_cast<unsigned int>(cpus.size());
+        data->pool.reset(new MatcherThreadPool(threads));
+        if (options.pin_threads)
+        {
+            _pinned = data->pool->SetAffinity(cpus) && _pinned;
+        }
+        _shards.push_back(std::move(data));
+    }
+
+    // node threads start from the current generation, so they don't miss a RunOnShards() that starts before they wait.
+    for (size_t shard = 0; shard < num_shards; shard++)
+    {
+        auto& data = *_shards[shard];
+        data.thread = std::thread([this, shard] { ShardLoop(shard, 0); });
+        if (options.pin_threads)
+        {
+            _pinned = NumaTopology::PinThread(data.thread, nodes[data.node]) && _pinned;
+        }
+    }
+
+    if (options.pin_threads && !_pinned)
+    {
+        LOG_ERROR(LOG_TAG, "Failed pinning shard threads to their nodes");
+    }
+}
+
+ShardedGallery::~ShardedGallery()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake_cv.notify_all();
+    for (auto& shard : _shards)
+    {
+        shard->thread.join();
+    }
+}
+
+void ShardedGallery::ShardLoop(size_t shard, uint64_t seen_generation) const
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake_cv.wait(lock, [&] { return _stop || _generation != seen_generation; });
+            if (_stop)
+            {
+                return;
+            }
+            seen_generation = _generation;
+        }
+
+        (*_task)(shard);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_pending_shards == 0)
+        {
+            _done_cv.notify_one();
+        }
+    }
+}
+
+void ShardedGallery::RunOnShards(const std::function<void(size_t)>& task) const
+{
+    std::lock_guard<std::mutex> run_lock(_run_mutex);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _pending_shards = _shards.size();
+        _generation++;
+    }
+    _wake_cv.notify_all();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done_cv.wait(lock, [this] { return _pending_shards == 0; });
+    _task = nullptr;
+}
+
+int ShardedGallery::FindShard(const char* user_id) const
+{
+    for (size_t shard = 0; shard < _shards.size(); shard++)
+    {
+        if (_shards[shard]->gallery.Find(user_id) >= 0)
+        {
+            return static_cast<int>(shard);
+        }
+    }
+    return -1;
+}
+
+size_t ShardedGallery::SmallestShard() const
+{
+    size_t smallest = 0;
+    for (size_t shard = 1; shard < _shards.size(); shard++)
+    {
+        if (_shards[shard]->gallery.Size() < _shards[smallest]->gallery.Size())
+        {
+            smallest = shard;
+        }
+    }
+    return smallest;
+}
+
+bool ShardedGallery::Set(const char* user_id, const Faceprints& faceprints)
+{
+    if (user_id == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Null user id");
+        return false;
+    }
+
+    // same version rule as FaceprintGallery, across all shards.
+    int shard = FindShard(user_id);
+    bool is_only_entry = Empty() || (Size() == 1 && shard >= 0);
+    if (!is_only_entry && faceprints.data.version != GetVersion())
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+
+    size_t target = (shard >= 0) ? static_cast<size_t>(shard) : SmallestShard();
+    bool is_set = false;
+    RunOnShards([&](size_t index) {
+        if (index == target)
+        {
+            is_set = _shards[index]->gallery.Set(user_id, faceprints);
+        }
+    });
+    return is_set;
+}
+
+size_t ShardedGallery::Set(const std::vector<std::string>& user_ids, const std::vector<Faceprints>& faceprints)
+{
+    const size_t count = std::min(user_ids.size(), faceprints.size());
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // assign the users on this thread (so ids repeated in the batch go to one shard), then load every shard at once.
+    int version = Empty() ? faceprints[0].data.version : GetVersion();
+    std::vector<std::vector<size_t>> assigned(_shards.size());
+    std::vector<size_t> sizes(_shards.size());
+    for (size_t shard = 0; shard < _shards.size(); shard++)
+    {
+        sizes[shard] = _shards[shard]->gallery.Size();
+    }
+    std::unordered_map<std::string, int> batch_shards;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (faceprints[i].data.version != version)
+        {
+            LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+            continue;
+        }
+        auto batch_it = batch_shards.find(user_ids[i]);
+        int shard = (batch_it != batch_shards.end()) ? batch_it->second : FindShard(user_ids[i].c_str());
+        if (shard < 0)
+        {
+            shard = static_cast<int>(std::min_element(sizes.begin(), sizes.end()) - sizes.begin());
+            sizes[shard]++;
+        }
+        batch_shards[user_ids[i]] = shard;
+        assigned[shard].push_back(i);
+    }
+
+    std::vector<size_t> num_set(_shards.size(), 0);
+    RunOnShards([&](size_t shard) {
+        auto& gallery = _shards[shard]->gallery;
+        gallery.Reserve(gallery.Size() + assigned[shard].size());
+        for (size_t i : assigned[shard])
+        {
+            num_set[shard] += gallery.Set(user_ids[i].c_str(), faceprints[i]) ? 1 : 0;
+        }
+    });
+
+    size_t total = 0;
+    for (size_t n : num_set)
+    {
+        total += n;
+    }
+    return total;
+}
+
+bool ShardedGallery::Remove(const char* user_id)
+{
+    int shard = FindShard(user_id);
+    return shard >= 0 && _shards[shard]->gallery.Remove(user_id);
+}
+
+void ShardedGallery::Clear()
+{
+    for (auto& shard : _shards)
+    {
+        shard->gallery.Clear();
+    }
+}
+
+size_t ShardedGallery::Size() const
+{
+    size_t size = 0;
+    for (const auto& shard : _shards)
+    {
+        size += shard->gallery.Size();
+    }
+    return size;
+}
+
+bool ShardedGallery::Empty() const
+{
+    return Size() == 0;
+}
+
+int ShardedGallery::Find(const char* user_id) const
+{
+    size_t offset = 0;
+    for (const auto& shard : _shards)
+    {
+        int slot = shard->gallery.Find(user_id);
+        if (slot >= 0)
+        {
+            return static_cast<int>(offset) + slot;
+        }
+        offset += shard->gallery.Size();
+    }
+    return -1;
+}
+
+const char* ShardedGallery::GetUserId(size_t index) const
+{
+    for (const auto& shard : _shards)
+    {
+        if (index < shard->gallery.Size())
+        {
+            return shard->gallery.GetUserId(index);
+        }
+        index -= shard->gallery.Size();
+    }
+    return nullptr;
+}
+
+const Faceprints& ShardedGallery::GetFaceprints(size_t index) const
+{
+    for (const auto& shard : _shards)
+    {
+        if (index < shard->gallery.Size())
+        {
+            return shard->gallery.GetFaceprints(index);
+        }
+        index -= shard->gallery.Size();
+    }
+    throw std::out_of_range("ShardedGallery index out of range");
+}
+
+int ShardedGallery::GetVersion() const
+{
+    for (const auto& shard : _shards)
+    {
+        if (!shard->gallery.Empty())
+        {
+            return shard->gallery.GetVersion();
+        }
+    }
+    return RSID_FACEPRINTS_VERSION;
+}
+
+size_t ShardedGallery::NumShards() const
+{
+    return _shards.size();
+}
+
+const FaceprintGallery& ShardedGallery::Shard(size_t shard) const
+{
+    return _shards[shard]->gallery;
+}
+
+MatcherThreadPool& ShardedGallery::ShardPool(size_t shard) const
+{
+    return *_shards[shard]->pool;
+}
+
+int ShardedGallery::ShardNode(size_t shard) const
+{
+    return _shards[shard]->node;
+}
+
+size_t ShardedGallery::ShardOffset(size_t shard) const
+{
+    size_t offset = 0;
+    for (size_t s = 0; s < shard && s < _shards.size(); s++)
+    {
+        offset += _shards[s]->gallery.Size();
+    }
+    return offset;
+}
+
+bool ShardedGallery::IsPinned() const
+{
+    return _pinned;
+}
+} // namespace RealSenseID
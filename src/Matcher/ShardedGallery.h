@@ -0,0 +1,111 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "FaceprintGallery.h"
+#include "MatcherThreadPool.h"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+struct ShardedGalleryOptions
+{
+    size_t num_shards = 0;              // 0: one shard per NUMA node. more shards than nodes are spread round robin
+    unsigned int threads_per_shard = 0; // 0: the cpus of the shard's node
+    bool pin_threads = true;            // pin each shard's threads to its node's cpus (Linux only)
+    bool huge_pages = false;            // descriptor rows on transparent huge pages (see AlignedBuffer)
+};
+
+// Gallery split into FaceprintGallery shards, one per NUMA node, for multi-socket hosts where a gallery allocated by
+// one thread lives on one node and the scans of the other socket run at remote memory bandwidth
+// (see Matcher::MatchFaceprintsToArray()).
+//
+// Each shard has a node thread and a MatcherThreadPool, pinned to the cpus of its node (see NumaTopology). Users are set
+// from the node thread of their shard, so the shard's rows are first touched - and so allocated by the kernel - on its
+// node. A scan runs every shard at once on its own threads over its node local rows, and the best results of the shards
+// are merged.
+//
+// New users go to the smallest shard. Users are addressed by a global index: the shards' slots, concatenated in shard
+// order. Like FaceprintGallery, indexes are stable only until the next Remove(), all entries share a single faceprints
+// version, and the gallery is not thread safe - except RunOnShards() (so matching), which is serialized.
+class ShardedGallery
+{
+public:
+    explicit ShardedGallery(const ShardedGalleryOptions& options = ShardedGalleryOptions());
+    ~ShardedGallery();
+    ShardedGallery(const ShardedGallery&) = delete;
+    ShardedGallery& operator=(const ShardedGallery&) = delete;
+
+    // insert a new user, or replace the faceprints of an existing user (e.g. after adaptive update).
+    // returns false if the faceprints failed validation or their version differs from the gallery's.
+    bool Set(const char* user_id, const Faceprints& faceprints);
+
+    // bulk Set(), with every shard loading its users at once. returns the number of users set.
+    size_t Set(const std::vector<std::string>& user_ids, const std::vector<Faceprints>& faceprints);
+
+    // returns false if user was not found.
+    bool Remove(const char* user_id);
+
+    void Clear();
+
+    size_t Size() const;
+    bool Empty() const;
+
+    // global index of the given user, or -1 if not found.
+    int Find(const char* user_id) const;
+
+    const char* GetUserId(size_t index) const;
+    const Faceprints& GetFaceprints(size_t index) const;
+
+    // faceprints version shared by all entries.
+    int GetVersion() const;
+
+    size_t NumShards() const;
+    const FaceprintGallery& Shard(size_t shard) const;
+    MatcherThreadPool& ShardPool(size_t shard) const;
+    int ShardNode(size_t shard) const;
+
+    // global index of the first slot of shard.
+    size_t ShardOffset(size_t shard) const;
+
+    // true if the shard threads are pinned to their nodes (asked for, supported and succeeded).
+    bool IsPinned() const;
+
+    // run task(shard) for every shard at once, each on its shard's node thread, and wait for all of them to finish.
+    // calls from several threads are serialized.
+    void RunOnShards(const std::function<void(size_t)>& task) const;
+
+private:
+    struct ShardData
+    {
+        FaceprintGallery gallery;
+        std::unique_ptr<MatcherThreadPool> pool;
+        std::thread thread;
+        int node = 0;
+    };
+
+    void ShardLoop(size_t shard, uint64_t seen_generation) const;
+    int FindShard(const char* user_id) const;
+    size_t SmallestShard() const;
+
+    std::vector<std::unique_ptr<ShardData>> _shards;
+    bool _pinned = true;
+
+    mutable std::mutex _run_mutex; // serializes RunOnShards()
+    mutable std::mutex _mutex;
+    mutable std::condition_variable _wake_cv;
+    mutable std::condition_variable _done_cv;
+    mutable const std::function<void(size_t)>* _task = nullptr;
+    mutable size_t _pending_shards = 0;
+    mutable uint64_t _generation = 0;
+    bool _stop = false;
+};
+} // namespace RealSenseID
@@ -0,0 +1,182 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Binary protocol of rsid-match-server, over a Unix domain stream socket.
+//
+// Every request and response is a frame: a FrameHeader followed by payload_size bytes of payload. Client and server run
+// on the same host, so all fields are in host byte order and the faceprints travel as their in-memory structs
+// (ExtractedFaceprintsElement, DBFaceprintsElement).
+//
+// Requests may be pipelined on a connection. Each response echoes the request's type and request_id, with the status
+// and the time the request spent in the server. Responses of one connection come back in request order.
+//
+//  request    payload                                  response payload
+//  Enroll     EnrollRequest                            -
+//  Set        SetRequest                               -
+//  Match      ExtractedFaceprintsElement (the probe)   MatchResponse
+//  Remove     UserId                                   -
+//  BulkLoad   uint32_t count, count x SetRequest       uint32_t users loaded (invalid and duplicate users are skipped)
+//  Stats      -                                        StatsResponse
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace RealSenseID
+{
+namespace MatchProtocol
+{
+static constexpr uint32_t Magic = 0x31444952; // "RID1"
+
+// largest payload accepted, so a corrupt header can't make the peer allocate gigabytes. bulk loads are split to fit.
+static constexpr uint32_t MaxPayloadSize = 64u << 20;
+
+static constexpr size_t UserIdSize = RSID_MAX_USER_ID_LENGTH_IN_DB + 1; // null padded
+
+enum class RequestType : uint16_t
+{
+    Enroll = 1, // new user from the faceprints extracted at enrollment (as samples/cpp/host-mode.cc)
+    Set,        // insert or replace a user with full db faceprints
+    Match,
+    Remove,
+    BulkLoad,
+    Stats,
+};
+
+enum class Status : uint16_t
+{
+    Ok = 0,
+    NotFound,          // Remove of an unknown user
+    InvalidFaceprints, // failed range or version validation
+    NoMatch,           // Match against an empty gallery, or of an invalid probe
+    BadRequest,        // unknown type or malformed payload
+    Duplicate,         // new user matches another user (server run with --reject-duplicates)
+    StorageError,      // the change was made but failed to be logged (server run with --wal): it may be lost on a crash
+};
+
+#pragma pack(push, 1)
+struct FrameHeader
+{
+    uint32_t magic = Magic;
+    uint16_t type = 0;
+    uint16_t status = 0;       // responses only
+    uint32_t request_id = 0;   // chosen by the client, echoed in the response
+    uint32_t payload_size = 0;
+    uint32_t server_us = 0;    // responses only: time from receiving the request to sending the response
+};
+
+struct UserId
+{
+    char id[UserIdSize] = {};
+};
+
+struct EnrollRequest
+{
+    UserId user;
+    ExtractedFaceprintsElement faceprints;
+};
+
+struct SetRequest
+{
+    UserId user;
+    DBFaceprintsElement faceprints;
+};
+
+struct MatchResponse
+{
+    UserId user;         // best match, empty if none
+    int16_t score = 0;
+    uint8_t is_same = 0;
+    uint8_t updated = 0; // the user's adaptive faceprints were updated by this match
+};
+
+struct StatsResponse
+{
+    uint64_t num_users = 0;
+    uint64_t num_requests = 0;
+    uint64_t num_matches = 0;
+    uint64_t num_match_batches = 0;
+    uint32_t match_p50_us = 0; // of the matches since the previous Stats request, within 3%
+    uint32_t match_p99_us = 0;
+};
+#pragma pack(pop)
+
+inline void SetUserId(UserId& user, const char* id)
+{
+    ::memset(user.id, 0, sizeof(user.id));
+    ::strncpy(user.id, id, sizeof(user.id) - 1);
+}
+
+// user id of a received frame, which may not be null terminated.
+inline std::string GetUserId(const UserId& user)
+{
+    return std::string(user.id, ::strnlen(user.id, sizeof(user.id)));
+}
+
+// false on error or end of stream.
+inline bool ReadAll(int fd, void* buffer, size_t size)
+{
+    char* data = static_cast<char*>(buffer);
+    while (size > 0)
+    {
+        ssize_t n = ::read(fd, data, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool WriteAll(int fd, const void* buffer, size_t size)
+{
+    const char* data = static_cast<const char*>(buffer);
+    while (size > 0)
+    {
+        // a peer that is gone is an error here, as the server and client ignore SIGPIPE.
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// reads one frame. false on error, end of stream or an invalid header.
+inline bool ReadFrame(int fd, FrameHeader& header, std::vector<char>& payload)
+{
+    if (!ReadAll(fd, &header, sizeof(header)) || header.magic != Magic || header.payload_size > MaxPayloadSize)
+    {
+        return false;
+    }
+    payload.resize(header.payload_size);
+    return header.payload_size == 0 || ReadAll(fd, payload.data(), payload.size());
+}
+
+inline bool WriteFrame(int fd, FrameHeader header, const void* payload, size_t payload_size)
+{
+    header.magic = Magic;
+    header.payload_size = static_cast<uint32_t>(payload_size);
+    return WriteAll(fd, &header, sizeof(header)) && (payload_size == 0 || WriteAll(fd, payload, payload_size));
+}
+} // namespace MatchProtocol
+} // namespace RealSenseID
@@ -0,0 +1,482 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Load generator for rsid-match-server: bulk loads a synthetic gallery, checks every request type once, then runs
+// concurrent clients that send pipelined match requests and reports throughput, latency and match accuracy.
+// Usage: rsid-match-loadgen [options], see print_usage().
+// Exits with an error if a request fails or a probe of an enrolled user does not match that user.
+
+#include "MatchProtocol.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace RealSenseID;
+using namespace RealSenseID::MatchProtocol;
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint32_t BulkLoadChunk = 8192; // users per BulkLoad request, well below MaxPayloadSize
+
+struct Args
+{
+    std::string socket_path = "/tmp/rsid-match.sock";
+    size_t users = 10000;
+    unsigned int clients = 4;
+    size_t requests = 5000; // per client
+    size_t pipeline = 4;    // requests in flight per client
+    bool load = true;
+    uint64_t seed = 1;
+};
+
+// xorshift64*, as in rsid-matcher-bench.
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : _state(seed * 0x9E3779B97F4A7C15ull + 1)
+    {
+    }
+
+    uint64_t Next()
+    {
+        _state ^= _state >> 12;
+        _state ^= _state << 25;
+        _state ^= _state >> 27;
+        return _state * 0x2545F4914F6CDD1Dull;
+    }
+
+    // uniform in [min, max]
+    int Range(int min, int max)
+    {
+        return min + static_cast<int>((Next() >> 32) % static_cast<uint64_t>(max - min + 1));
+    }
+
+private:
+    uint64_t _state;
+};
+
+static void random_vector(Random& rnd, feature_t* vec)
+{
+    for (size_t i = 0; i < RSID_NUM_OF_RECOGNITION_FEATURES; i++)
+    {
+        vec[i] = static_cast<feature_t>(rnd.Range(-1023, 1023));
+    }
+}
+
+// src plus uniform noise in [-amplitude, amplitude], clamped to the valid range.
+static void noisy_vector(Random& rnd, const feature_t* src, int amplitude, feature_t* vec)
+{
+    for (size_t i = 0; i < RSID_NUM_OF_RECOGNITION_FEATURES; i++)
+    {
+        int value = src[i] + rnd.Range(-amplitude, amplitude);
+        vec[i] = static_cast<feature_t>(std::max(-1023, std::min(1023, value)));
+    }
+}
+
+// the enrollment vector of a synthetic user depends only on the seed and the user index, so clients can make probes of
+// a gallery loaded by an earlier run.
+static void user_vector(uint64_t seed, size_t user, feature_t* vec)
+{
+    Random rnd(seed * 1000003 + user);
+    random_vector(rnd, vec);
+}
+
+static std::string user_name(size_t user)
+{
+    return "user" + std::to_string(user);
+}
+
+class Client
+{
+public:
+    explicit Client(const std::string& path)
+    {
+        sockaddr_un addr {};
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            throw std::invalid_argument("socket path too long: " + path);
+        }
+        _fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (_fd < 0 || ::connect(_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            if (_fd >= 0)
+            {
+                ::close(_fd);
+            }
+            throw std::runtime_error("failed connecting to " + path + ": " + std::strerror(errno));
+        }
+    }
+
+    ~Client()
+    {
+        ::close(_fd);
+    }
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    void Send(RequestType type, uint32_t request_id, const void* payload, size_t payload_size)
+    {
+        FrameHeader header;
+        header.type = static_cast<uint16_t>(type);
+        header.request_id = request_id;
+        if (!WriteFrame(_fd, header, payload, payload_size))
+        {
+            throw std::runtime_error("connection lost");
+        }
+    }
+
+    void Receive(FrameHeader& header, std::vector<char>& payload)
+    {
+        if (!ReadFrame(_fd, header, payload))
+        {
+            throw std::runtime_error("connection lost");
+        }
+    }
+
+    // a request and its response.
+    Status Call(RequestType type, const void* payload, size_t payload_size, std::vector<char>& response)
+    {
+        Send(type, ++_last_id, payload, payload_size);
+        FrameHeader header;
+        Receive(header, response);
+        if (header.request_id != _last_id || header.type != static_cast<uint16_t>(type))
+        {
+            throw std::runtime_error("unexpected response");
+        }
+        return static_cast<Status>(header.status);
+    }
+
+private:
+    int _fd = -1;
+    uint32_t _last_id = 0;
+};
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string("check failed: ") + what);
+    }
+}
+
+static void bulk_load(const Args& args)
+{
+    Client client(args.socket_path);
+    std::vector<char> payload, response;
+    auto start = Clock::now();
+    for (size_t first = 0; first < args.users; first += BulkLoadChunk)
+    {
+        uint32_t count = static_cast<uint32_t>(std::min<size_t>(BulkLoadChunk, args.users - first));
+        payload.assign(sizeof(count) + count * sizeof(SetRequest), 0);
+        ::memcpy(payload.data(), &count, sizeof(count));
+        SetRequest record;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            auto& data = record.faceprints;
+            data = DBFaceprintsElement();
+            user_vector(args.seed, first + i, data.enrollmentDescriptor);
+            ::memcpy(data.adaptiveDescriptorWithoutMask, data.enrollmentDescriptor, sizeof(data.enrollmentDescriptor));
+            data.adaptiveDescriptorWithoutMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithoutMask;
+            SetUserId(record.user, user_name(first + i).c_str());
+            ::memcpy(payload.data() + sizeof(count) + i * sizeof(SetRequest), &record, sizeof(record));
+        }
+        expect(client.Call(RequestType::BulkLoad, payload.data(), payload.size(), response) == Status::Ok, "bulk load");
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::printf("Bulk loaded %zu users in %.2f s\n", args.users, seconds);
+}
+
+// every request type once, on a user outside the synthetic gallery.
+static void check_requests(const Args& args)
+{
+    Client client(args.socket_path);
+    std::vector<char> response;
+    Random rnd(args.seed + 1);
+
+    EnrollRequest enroll;
+    SetUserId(enroll.user, "loadgen-check");
+    random_vector(rnd, enroll.faceprints.featuresVector);
+    enroll.faceprints.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithoutMask;
+    expect(client.Call(RequestType::Enroll, &enroll, sizeof(enroll), response) == Status::Ok, "enroll");
+
+    ExtractedFaceprintsElement probe;
+    noisy_vector(rnd, enroll.faceprints.featuresVector, 100, probe.featuresVector);
+    probe.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithoutMask;
+    expect(client.Call(RequestType::Match, &probe, sizeof(probe), response) == Status::Ok, "match");
+    MatchResponse match;
+    ::memcpy(&match, response.data(), sizeof(match));
+    expect(GetUserId(match.user) == "loadgen-check" && match.is_same, "match of the enrolled user");
+
+    // a second enrollment of the same person: rejected if the server runs with --reject-duplicates.
+    EnrollRequest duplicate;
+    SetUserId(duplicate.user, "loadgen-check-duplicate");
+    noisy_vector(rnd, enroll.faceprints.featuresVector, 100, duplicate.faceprints.featuresVector);
+    duplicate.faceprints.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithoutMask;
+    Status status = client.Call(RequestType::Enroll, &duplicate, sizeof(duplicate), response);
+    expect(status == Status::Ok || status == Status::Duplicate, "enroll of a duplicate");
+    bool rejects_duplicates = (status == Status::Duplicate);
+    if (!rejects_duplicates)
+    {
+        expect(client.Call(RequestType::Remove, &duplicate.user, sizeof(duplicate.user), response) == Status::Ok, "remove duplicate");
+    }
+
+    SetRequest set;
+    set.user = enroll.user;
+    set.faceprints.adaptiveDescriptorWithoutMask[0] = 2000; // out of range
+    expect(client.Call(RequestType::Set, &set, sizeof(set), response) == Status::InvalidFaceprints, "set of invalid faceprints");
+
+    expect(client.Call(RequestType::Remove, &enroll.user, sizeof(enroll.user), response) == Status::Ok, "remove");
+    expect(client.Call(RequestType::Remove, &enroll.user, sizeof(enroll.user), response) == Status::NotFound, "remove of a removed user");
+    expect(client.Call(RequestType::Stats, nullptr, 0, response) == Status::Ok, "stats");
+    std::printf("Checked all request types (duplicates %s)\n", rejects_duplicates ? "rejected" : "accepted");
+}
+
+struct ClientResult
+{
+    std::vector<double> latency_us; // send to receive
+    std::vector<uint32_t> server_us;
+    size_t genuine = 0;
+    size_t genuine_matched = 0;
+    size_t impostors = 0;
+    size_t impostors_accepted = 0;
+};
+
+// pipelined match requests: keeps args.pipeline requests in flight. half of the probes are of gallery users.
+static void run_client(const Args& args, unsigned int client_index, ClientResult& result)
+{
+    struct InFlight
+    {
+        Clock::time_point sent;
+        long long user; // -1 for an impostor
+    };
+
+    Client client(args.socket_path);
+    Random rnd(args.seed * 7919 + client_index);
+    std::deque<InFlight> in_flight;
+    ExtractedFaceprintsElement probe;
+    feature_t enrolled[RSID_FEATURES_VECTOR_ALLOC_SIZE];
+    std::vector<char> payload;
+    size_t sent = 0;
+
+    auto send_one = [&]() {
+        long long user = -1;
+        if (rnd.Range(0, 1) == 0)
+        {
+            user = static_cast<long long>(rnd.Next() % args.users);
+            user_vector(args.seed, static_cast<size_t>(user), enrolled);
+            noisy_vector(rnd, enrolled, 200, probe.featuresVector);
+        }
+        else
+        {
+            random_vector(rnd, probe.featuresVector);
+        }
+        probe.featuresVector[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithoutMask;
+        in_flight.push_back({Clock::now(), user});
+        client.Send(RequestType::Match, static_cast<uint32_t>(++sent), &probe, sizeof(probe));
+    };
+
+    while (sent < args.requests && in_flight.size() < args.pipeline)
+    {
+        send_one();
+    }
+    while (!in_flight.empty())
+    {
+        FrameHeader header;
+        client.Receive(header, payload);
+        auto received = Clock::now();
+        InFlight request = in_flight.front();
+        in_flight.pop_front();
+        if (sent < args.requests)
+        {
+            send_one();
+        }
+
+        expect(payload.size() == sizeof(MatchResponse), "match response");
+        MatchResponse match;
+        ::memcpy(&match, payload.data(), sizeof(match));
+        result.latency_us.push_back(std::chrono::duration<double, std::micro>(received - request.sent).count());
+        result.server_us.push_back(header.server_us);
+        if (request.user >= 0)
+        {
+            result.genuine++;
+            bool matched = header.status == static_cast<uint16_t>(Status::Ok) && match.is_same &&
+                           GetUserId(match.user) == user_name(static_cast<size_t>(request.user));
+            result.genuine_matched += matched ? 1 : 0;
+        }
+        else
+        {
+            result.impostors++;
+            result.impostors_accepted += match.is_same ? 1 : 0;
+        }
+    }
+}
+
+template <typename T>
+static double percentile(std::vector<T>& values, int p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return static_cast<double>(values[(values.size() - 1) * static_cast<size_t>(p) / 100]);
+}
+
+static bool run_load(const Args& args)
+{
+    std::vector<ClientResult> results(args.clients);
+    std::vector<std::thread> threads;
+    std::mutex error_mutex;
+    std::string error;
+    auto start = Clock::now();
+    for (unsigned int c = 0; c < args.clients; c++)
+    {
+        threads.emplace_back([&, c] {
+            try
+            {
+                run_client(args, c, results[c]);
+            }
+            catch (const std::exception& ex)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                error = ex.what();
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+
+    ClientResult total;
+    for (auto& result : results)
+    {
+        total.latency_us.insert(total.latency_us.end(), result.latency_us.begin(), result.latency_us.end());
+        total.server_us.insert(total.server_us.end(), result.server_us.begin(), result.server_us.end());
+        total.genuine += result.genuine;
+        total.genuine_matched += result.genuine_matched;
+        total.impostors += result.impostors;
+        total.impostors_accepted += result.impostors_accepted;
+    }
+
+    Client client(args.socket_path);
+    std::vector<char> response;
+    expect(client.Call(RequestType::Stats, nullptr, 0, response) == Status::Ok && response.size() == sizeof(StatsResponse), "stats");
+    StatsResponse stats;
+    ::memcpy(&stats, response.data(), sizeof(stats));
+
+    size_t num_requests = total.latency_us.size();
+    std::printf("Matched %zu requests from %u clients (pipeline %zu) in %.2f s: %.0f requests/s\n", num_requests, args.clients,
+                args.pipeline, seconds, static_cast<double>(num_requests) / seconds);
+    std::printf("Client latency us: p50 %.0f, p99 %.0f, max %.0f\n", percentile(total.latency_us, 50), percentile(total.latency_us, 99),
+                percentile(total.latency_us, 100));
+    std::printf("Server latency us: p50 %.0f, p99 %.0f\n", percentile(total.server_us, 50), percentile(total.server_us, 99));
+    std::printf("Server: %llu users, %llu matches in %llu batches (%.1f per batch)\n", static_cast<unsigned long long>(stats.num_users),
+                static_cast<unsigned long long>(stats.num_matches), static_cast<unsigned long long>(stats.num_match_batches),
+                stats.num_match_batches ? static_cast<double>(stats.num_matches) / static_cast<double>(stats.num_match_batches) : 0.0);
+    std::printf("Genuine probes matched: %zu / %zu, impostors accepted: %zu / %zu\n", total.genuine_matched, total.genuine,
+                total.impostors_accepted, total.impostors);
+    return total.genuine_matched == total.genuine;
+}
+
+static void print_usage()
+{
+    std::cout << "Usage: rsid-match-loadgen [options]\n"
+              << "  --socket PATH     server socket (default /tmp/rsid-match.sock).\n"
+              << "  --users N         synthetic gallery size (default 10000).\n"
+              << "  --clients N       concurrent client connections (default 4).\n"
+              << "  --requests N      match requests per client (default 5000).\n"
+              << "  --pipeline N      match requests in flight per client (default 4).\n"
+              << "  --no-load         don't bulk load: the server already has the gallery of the same --users and --seed.\n"
+              << "  --seed N          synthetic data seed (default 1).\n";
+}
+
+static Args config_from_argv(int argc, char* argv[])
+{
+    Args args;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            print_usage();
+            std::exit(0);
+        }
+        if (arg == "--no-load")
+        {
+            args.load = false;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            print_usage();
+            std::exit(1);
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--socket")
+            args.socket_path = value;
+        else if (arg == "--users")
+            args.users = std::max<size_t>(1, std::stoul(value));
+        else if (arg == "--clients")
+            args.clients = static_cast<unsigned int>(std::max(1ul, std::stoul(value)));
+        else if (arg == "--requests")
+            args.requests = std::stoul(value);
+        else if (arg == "--pipeline")
+            args.pipeline = std::max<size_t>(1, std::stoul(value));
+        else if (arg == "--seed")
+            args.seed = std::stoull(value);
+        else
+        {
+            print_usage();
+            std::exit(1);
+        }
+    }
+    return args;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        auto args = config_from_argv(argc, argv);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        if (args.load)
+        {
+            bulk_load(args);
+        }
+        check_requests(args);
+        if (!run_load(args))
+        {
+            std::cerr << "Some genuine probes did not match their user" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception occurred: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,1461 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Host mode matching daemon: owns a warm FaceprintGallery and serves enroll, match, remove and bulk load requests of
+// many devices and processes over a Unix domain socket (see MatchProtocol.h).
+// Usage: rsid-match-server [options], see print_usage().
+//
+// Threads:
+//  * an acceptor, and a reader per connection that parses frames into a single request queue.
+//  * one worker that owns the gallery and serves the queue in arrival order. queued match requests that follow each
+//    other are matched as a batch (Matcher::MatchFaceprintsBatchToArray()), so under load the gallery is scanned once
+//    per batch instead of once per request. adaptive updates are written back to the gallery after the batch: all
+//    probes of a batch see the gallery as of the batch start.
+// The gallery is loaded from the --db file at start and saved back on SIGINT/SIGTERM.
+// With --wal, every change is also logged next to the db file (GalleryLog), so a crash loses none: the log is replayed
+// at start and folded into the db file in the background. Enroll, set, remove and bulk load responses are held until
+// their changes are on the storage device (one fsync for all the changes queued together). Adaptive updates are logged
+// without waiting, so matching never waits for the storage device.
+// With --reject-duplicates, new users whose enrollment vector matches another user (in the gallery, or earlier in the
+// same bulk load) are rejected (Matcher::FindDuplicates()).
+
+#include "MatchProtocol.h"
+#include "Matcher.h"
+#include "FaceprintGallery.h"
+#include "GalleryFile.h"
+#include "GalleryLog.h"
+#include "MappedGallery.h"
+#include "MatcherThreadPool.h"
+#include "RealSenseID/Logging.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace RealSenseID;
+using namespace RealSenseID::MatchProtocol;
+using Clock = std::chrono::steady_clock;
+
+struct Args
+{
+    std::string socket_path = "/tmp/rsid-match.sock";
+    std::string db_path;
+    unsigned int threads = 1;
+    size_t max_batch = 64;
+    ThresholdsConfidenceEnum confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+    bool reject_duplicates = false;
+    bool wal = false;
+    uint64_t wal_compact_bytes = GalleryLogOptions().compact_bytes;
+};
+
+// closed when the reader and all queued requests of the connection are done with it.
+class Connection
+{
+public:
+    explicit Connection(int fd) : _fd(fd)
+    {
+    }
+
+    ~Connection()
+    {
+        ::close(_fd);
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    int Fd() const
+    {
+        return _fd;
+    }
+
+    // written by the worker only. a failed write drops the responses that follow, the reader sees the disconnect.
+    void Respond(const FrameHeader& header, const void* payload, size_t payload_size)
+    {
+        if (!_broken && !WriteFrame(_fd, header, payload, payload_size))
+        {
+            _broken = true;
+        }
+    }
+
+private:
+    int _fd;
+    bool _broken = false;
+};
+
+struct Request
+{
+    std::shared_ptr<Connection> connection;
+    FrameHeader header;
+    std::vector<char> payload;
+    Clock::time_point received;
+};
+
+class RequestQueue
+{
+public:
+    void Push(Request&& request)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _requests.push_back(std::move(request));
+        }
+        _cv.notify_one();
+    }
+
+    // waits for requests and takes all of them. false once closed and empty.
+    bool TakeAll(std::deque<Request>& requests)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&] { return !_requests.empty() || _closed; });
+        requests.swap(_requests);
+        return !requests.empty();
+    }
+
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+        }
+        _cv.notify_all();
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<Request> _requests;
+    bool _closed = false;
+};
+
+// match latencies in fixed buckets, so the memory doesn't grow with the matches between two Stats requests: exact below
+// 32us, then 32 buckets per power of two (a percentile is the lower bound of its bucket, within 3%).
+class LatencyHistogram
+{
+public:
+    void Add(uint32_t us)
+    {
+        _buckets[Bucket(us)]++;
+        _count++;
+    }
+
+    // 0 if empty.
+    uint32_t Percentile(uint64_t percent) const
+    {
+        if (_count == 0)
+        {
+            return 0;
+        }
+        const uint64_t rank = (_count - 1) * percent / 100;
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < NumBuckets; bucket++)
+        {
+            seen += _buckets[bucket];
+            if (seen > rank)
+            {
+                return LowerBound(bucket);
+            }
+        }
+        return LowerBound(NumBuckets - 1);
+    }
+
+    void Clear()
+    {
+        _buckets.fill(0);
+        _count = 0;
+    }
+
+private:
+    static constexpr uint32_t SubBuckets = 32;
+    static constexpr size_t NumBuckets = SubBuckets * 28; // up to 2^32 us
+
+    // bucket b >= 32 holds [(32 + b % 32) << shift, (33 + b % 32) << shift), shift = b / 32 - 1.
+    static size_t Bucket(uint32_t us)
+    {
+        if (us < SubBuckets)
+        {
+            return us;
+        }
+        uint32_t shift = 0;
+        while ((us >> shift) >= 2 * SubBuckets)
+        {
+            shift++;
+        }
+        return SubBuckets * (shift + 1) + (us >> shift) - SubBuckets;
+    }
+
+    static uint32_t LowerBound(size_t bucket)
+    {
+        if (bucket < SubBuckets)
+        {
+            return static_cast<uint32_t>(bucket);
+        }
+        const auto shift = static_cast<uint32_t>(bucket / SubBuckets - 1);
+        return static_cast<uint32_t>(SubBuckets + bucket % SubBuckets) << shift;
+    }
+
+    std::array<uint64_t, NumBuckets> _buckets {};
+    uint64_t _count = 0;
+};
+
+class MatchServer
+{
+public:
+    explicit MatchServer(const Args& args) : _args(args)
+    {
+        if (args.threads > 1)
+        {
+            _pool.reset(new MatcherThreadPool(args.threads));
+        }
+    }
+
+    void LoadDb();
+    void SaveDb();
+
+    void Start(int listen_fd);
+    void Stop();
+
+private:
+    void AcceptLoop();
+    void ReadLoop(std::shared_ptr<Connection> connection);
+    void WorkLoop();
+
+    void Serve(Request& request);
+    void ServeMatches(std::vector<Request*>& matches);
+    void Respond(Request& request, Status status, const void* payload = nullptr, size_t payload_size = 0);
+    void Send(Request& request, Status status, const void* payload, size_t payload_size);
+
+    // wait for the logged changes, then send the responses held for them.
+    void FlushDeferred();
+
+    // log a change made to the gallery. its response (and the ones after it) are held until it is durable.
+    void LogSet(const std::string& user_id, const Faceprints& faceprints);
+    void LogRemove(const std::string& user_id);
+
+    Status Enroll(const Request& request);
+    Status Set(const Request& request);
+    Status Remove(const Request& request);
+    Status BulkLoad(const Request& request, uint32_t& num_loaded);
+    StatsResponse Stats();
+
+    // per user: a new user (not in the gallery) that is a duplicate of another one. all false unless --reject-duplicates.
+    std::vector<char> FindDuplicates(const std::vector<std::string>& users, const std::vector<Faceprints>& faceprints);
+
+    Args _args;
+    int _listen_fd = -1;
+    RequestQueue _queue;
+    std::thread _acceptor;
+    std::thread _worker;
+
+    // readers that finished are joined by the acceptor, on the next connection.
+    std::mutex _connections_mutex;
+    std::vector<std::shared_ptr<Connection>> _connections;
+    std::map<std::thread::id, std::thread> _readers;
+    std::vector<std::thread::id> _finished_readers;
+
+    // owned by the worker (and main before Start() / after Stop()).
+    FaceprintGallery _gallery;
+    std::unique_ptr<MatcherThreadPool> _pool;
+    uint64_t _num_requests = 0;
+    uint64_t _num_matches = 0;
+    uint64_t _num_match_batches = 0;
+    LatencyHistogram _match_us; // since the last Stats request
+
+    // with --wal. responses are held while a logged change before them is not durable, so they keep request order.
+    struct DeferredResponse
+    {
+        Request* request;
+        Status status;
+        std::vector<char> payload;
+    };
+    std::unique_ptr<GalleryLog> _log;
+    uint64_t _unsynced_sequence = 0;
+    std::vector<DeferredResponse> _deferred;
+};
+
+// false if there is no db file. throws if the file is invalid.
+// db file: a GalleryFile.
+static bool load_db(const std::string& path, FaceprintGallery& gallery)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    GalleryFile::Header header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && header.magic == GalleryFile::Magic;
+    size_t num_loaded = 0;
+    if (ok)
+    {
+        gallery.Reserve(header.count);
+        GalleryFile::Record record;
+        Faceprints faceprints;
+        for (uint32_t i = 0; i < header.count && std::fread(&record, sizeof(record), 1, file) == 1; i++)
+        {
+            ::memcpy(&faceprints.data, &record.faceprints, sizeof(faceprints.data));
+            num_loaded += gallery.Set(GalleryFile::GetUserId(record).c_str(), faceprints) ? 1 : 0;
+        }
+    }
+    std::fclose(file);
+
+    if (!ok || num_loaded != header.count)
+    {
+        throw std::runtime_error("failed loading " + path);
+    }
+    return true;
+}
+
+static void save_db(const std::string& path, const FaceprintGallery& gallery)
+{
+    if (!GalleryFile::Write(path.c_str(), gallery))
+    {
+        throw std::runtime_error("failed writing " + path);
+    }
+}
+
+void MatchServer::LoadDb()
+{
+    if (_args.db_path.empty())
+    {
+        return;
+    }
+    if (!load_db(_args.db_path, _gallery))
+    {
+        std::cout << "No db at " << _args.db_path << ", starting with an empty gallery" << std::endl;
+    }
+    else
+    {
+        std::cout << "Loaded " << _gallery.Size() << " users from " << _args.db_path << std::endl;
+    }
+    if (!_args.wal)
+    {
+        return;
+    }
+
+    GalleryLogReplayStats replay;
+    if (!GalleryLog::Replay(_args.db_path.c_str(), _gallery, &replay))
+    {
+        throw std::runtime_error("failed replaying the log of " + _args.db_path);
+    }
+    if (replay.segments > 0)
+    {
+        std::cout << "Replayed " << replay.records << " changes from " << replay.segments << " log segments, " << _gallery.Size()
+                  << " users" << std::endl;
+    }
+    GalleryLogOptions options;
+    options.compact_bytes = _args.wal_compact_bytes;
+    _log.reset(new GalleryLog(options));
+    if (!_log->Open(_args.db_path.c_str(), replay.last_sequence + 1))
+    {
+        throw std::runtime_error("failed opening the log of " + _args.db_path);
+    }
+}
+
+void MatchServer::SaveDb()
+{
+    if (_args.db_path.empty())
+    {
+        return;
+    }
+    if (_log)
+    {
+        _log->Close();
+        auto stats = _log->Stats();
+        std::cout << "Logged " << stats.records << " changes in " << stats.commits << " commits, " << stats.compactions << " compactions"
+                  << std::endl;
+    }
+    save_db(_args.db_path, _gallery);
+    std::cout << "Saved " << _gallery.Size() << " users to " << _args.db_path << std::endl;
+
+    // the db file has every logged change now.
+    if (_log && !GalleryLog::RemoveSegments(_args.db_path.c_str()))
+    {
+        std::cerr << "Failed removing the log of " << _args.db_path << std::endl;
+    }
+}
+
+void MatchServer::Start(int listen_fd)
+{
+    _listen_fd = listen_fd;
+    _worker = std::thread([this] { WorkLoop(); });
+    _acceptor = std::thread([this] { AcceptLoop(); });
+}
+
+void MatchServer::Stop()
+{
+    // no new connections, then wake the readers with end of stream. queued requests are still served.
+    ::shutdown(_listen_fd, SHUT_RDWR);
+    _acceptor.join();
+    {
+        std::lock_guard<std::mutex> lock(_connections_mutex);
+        for (const auto& connection : _connections)
+        {
+            ::shutdown(connection->Fd(), SHUT_RD);
+        }
+    }
+    for (auto& reader : _readers)
+    {
+        reader.second.join();
+    }
+    _readers.clear();
+    _finished_readers.clear();
+
+    _queue.Close();
+    _worker.join();
+
+    std::cout << "Served " << _num_requests << " requests, " << _num_matches << " matches in " << _num_match_batches << " batches"
+              << std::endl;
+}
+
+void MatchServer::AcceptLoop()
+{
+    while (true)
+    {
+        int fd = ::accept(_listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            return; // listening socket shut down
+        }
+
+        std::vector<std::thread> finished;
+        {
+            auto connection = std::make_shared<Connection>(fd);
+            std::lock_guard<std::mutex> lock(_connections_mutex);
+            _connections.push_back(connection);
+            std::thread reader([this, connection] { ReadLoop(connection); });
+            auto id = reader.get_id();
+            _readers[id] = std::move(reader);
+
+            for (auto finished_id : _finished_readers)
+            {
+                finished.push_back(std::move(_readers[finished_id]));
+                _readers.erase(finished_id);
+            }
+            _finished_readers.clear();
+        }
+
+        // outside the lock, which they take last before returning.
+        for (auto& reader : finished)
+        {
+            reader.join();
+        }
+    }
+}
+
+void MatchServer::ReadLoop(std::shared_ptr<Connection> connection)
+{
+    while (true)
+    {
+        Request request;
+        if (!ReadFrame(connection->Fd(), request.header, request.payload))
+        {
+            break;
+        }
+        request.received = Clock::now();
+        request.connection = connection;
+        _queue.Push(std::move(request));
+    }
+
+    // queued requests keep the connection open until they are answered.
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    _connections.erase(std::remove(_connections.begin(), _connections.end(), connection), _connections.end());
+    _finished_readers.push_back(std::this_thread::get_id());
+}
+
+void MatchServer::WorkLoop()
+{
+    std::deque<Request> requests;
+    std::vector<Request*> matches;
+    while (_queue.TakeAll(requests))
+    {
+        // consecutive match requests are batched, other requests are barriers so every request sees the changes of
+        // the ones before it.
+        for (auto& request : requests)
+        {
+            if (static_cast<RequestType>(request.header.type) == RequestType::Match)
+            {
+                matches.push_back(&request);
+                if (matches.size() < _args.max_batch)
+                {
+                    continue;
+                }
+            }
+            ServeMatches(matches);
+            if (static_cast<RequestType>(request.header.type) != RequestType::Match)
+            {
+                Serve(request);
+            }
+        }
+        ServeMatches(matches);
+        FlushDeferred();
+        _num_requests += requests.size();
+        requests.clear();
+    }
+}
+
+void MatchServer::Serve(Request& request)
+{
+    switch (static_cast<RequestType>(request.header.type))
+    {
+    case RequestType::Enroll:
+        Respond(request, Enroll(request));
+        break;
+    case RequestType::Set:
+        Respond(request, Set(request));
+        break;
+    case RequestType::Remove:
+        Respond(request, Remove(request));
+        break;
+    case RequestType::BulkLoad: {
+        uint32_t num_loaded = 0;
+        Status status = BulkLoad(request, num_loaded);
+        Respond(request, status, &num_loaded, sizeof(num_loaded));
+        break;
+    }
+    case RequestType::Stats: {
+        StatsResponse stats = Stats();
+        Respond(request, Status::Ok, &stats, sizeof(stats));
+        break;
+    }
+    default:
+        Respond(request, Status::BadRequest);
+        break;
+    }
+}
+
+void MatchServer::ServeMatches(std::vector<Request*>& matches)
+{
+    if (matches.empty())
+    {
+        return;
+    }
+    FlushDeferred();
+
+    std::vector<MatchElement> probes(matches.size());
+    std::vector<bool> well_formed(matches.size());
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        well_formed[i] = (matches[i]->payload.size() == sizeof(ExtractedFaceprintsElement));
+        if (well_formed[i])
+        {
+            // plain data with a user-defined copy constructor (not trivially copyable): copy the wire bytes as is.
+            ::memcpy(static_cast<void*>(&probes[i].data), matches[i]->payload.data(), sizeof(ExtractedFaceprintsElement));
+        }
+        else
+        {
+            probes[i].data.version = -1; // skipped by the matcher as a version mismatch
+        }
+    }
+
+    std::vector<ExtendedMatchResult> results(matches.size());
+    std::vector<Faceprints> updated_faceprints;
+    if (!_gallery.Empty())
+    {
+        Matcher::MatchFaceprintsBatchToArray(probes, _gallery, results, updated_faceprints, _args.confidence, _pool.get());
+    }
+    _num_matches += matches.size();
+    _num_match_batches++;
+
+    // responses first, with the user ids of the slots as they were during the match. then the adaptive updates.
+    std::vector<std::string> updated_users;
+    std::vector<size_t> updates;
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        MatchResponse response;
+        const auto& result = results[i];
+        bool matched = result.userId >= 0 && static_cast<size_t>(result.userId) < _gallery.Size();
+        if (matched)
+        {
+            SetUserId(response.user, _gallery.GetUserId(static_cast<size_t>(result.userId)));
+            response.score = result.maxScore;
+            response.is_same = result.isSame ? 1 : 0;
+            response.updated = result.should_update ? 1 : 0;
+            if (result.should_update)
+            {
+                updated_users.push_back(GetUserId(response.user));
+                updates.push_back(i);
+            }
+        }
+
+        Status status = !well_formed[i] ? Status::BadRequest : (matched ? Status::Ok : Status::NoMatch);
+        Respond(*matches[i], status, &response, sizeof(response));
+        _match_us.Add(matches[i]->header.server_us);
+    }
+
+    // logged without waiting: no response depends on them.
+    Faceprints previous;
+    for (size_t u = 0; u < updates.size(); u++)
+    {
+        const auto& user_id = updated_users[u];
+        int slot = _log ? _gallery.Find(user_id.c_str()) : -1;
+        if (slot >= 0)
+        {
+            previous = _gallery.GetFaceprints(static_cast<size_t>(slot));
+        }
+        if (_gallery.Set(user_id.c_str(), updated_faceprints[updates[u]]) && slot >= 0)
+        {
+            _log->AppendUpdate(user_id.c_str(), previous, updated_faceprints[updates[u]]);
+        }
+    }
+    matches.clear();
+}
+
+void MatchServer::Respond(Request& request, Status status, const void* payload, size_t payload_size)
+{
+    if (_unsynced_sequence > 0 || !_deferred.empty())
+    {
+        const char* bytes = static_cast<const char*>(payload);
+        _deferred.push_back({&request, status, std::vector<char>(bytes, bytes + payload_size)});
+        return;
+    }
+    Send(request, status, payload, payload_size);
+}
+
+void MatchServer::FlushDeferred()
+{
+    if (_deferred.empty())
+    {
+        return;
+    }
+
+    bool durable = _log->Sync(_unsynced_sequence);
+    _unsynced_sequence = 0;
+    for (auto& deferred : _deferred)
+    {
+        auto type = static_cast<RequestType>(deferred.request->header.type);
+        bool is_change =
+            type == RequestType::Enroll || type == RequestType::Set || type == RequestType::Remove || type == RequestType::BulkLoad;
+        Status status = (!durable && is_change && deferred.status == Status::Ok) ? Status::StorageError : deferred.status;
+        Send(*deferred.request, status, deferred.payload.data(), deferred.payload.size());
+    }
+    _deferred.clear();
+}
+
+void MatchServer::LogSet(const std::string& user_id, const Faceprints& faceprints)
+{
+    if (_log)
+    {
+        // a failed log returns 0, which still holds the response for Sync() to report the failure.
+        _unsynced_sequence = std::max<uint64_t>({_unsynced_sequence, _log->AppendSet(user_id.c_str(), faceprints), 1});
+    }
+}
+
+void MatchServer::LogRemove(const std::string& user_id)
+{
+    if (_log)
+    {
+        _unsynced_sequence = std::max<uint64_t>({_unsynced_sequence, _log->AppendRemove(user_id.c_str()), 1});
+    }
+}
+
+void MatchServer::Send(Request& request, Status status, const void* payload, size_t payload_size)
+{
+    request.header.status = static_cast<uint16_t>(status);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - request.received).count();
+    request.header.server_us = static_cast<uint32_t>(std::min<int64_t>(elapsed, UINT32_MAX));
+    request.connection->Respond(request.header, payload, payload_size);
+}
+
+Status MatchServer::Enroll(const Request& request)
+{
+    if (request.payload.size() != sizeof(EnrollRequest))
+    {
+        return Status::BadRequest;
+    }
+    EnrollRequest enroll;
+    // plain data, but ExtractedFaceprintsElement has a user-defined copy constructor: copy the wire bytes as is.
+    ::memcpy(static_cast<void*>(&enroll), request.payload.data(), sizeof(enroll));
+
+    // same as samples/cpp/host-mode.cc: both adaptive no-mask and enrollment vectors start from the extracted one,
+    // and the with-mask vector is not set yet.
+    Faceprints faceprints;
+    auto& data = faceprints.data;
+    data.version = enroll.faceprints.version;
+    data.flags = enroll.faceprints.flags;
+    data.featuresType = enroll.faceprints.featuresType;
+    static_assert(sizeof(data.adaptiveDescriptorWithoutMask) == sizeof(enroll.faceprints.featuresVector), "faceprints sizes differ");
+    static_assert(sizeof(data.enrollmentDescriptor) == sizeof(enroll.faceprints.featuresVector), "faceprints sizes differ");
+    ::memcpy(data.adaptiveDescriptorWithoutMask, enroll.faceprints.featuresVector, sizeof(data.adaptiveDescriptorWithoutMask));
+    ::memcpy(data.enrollmentDescriptor, enroll.faceprints.featuresVector, sizeof(data.enrollmentDescriptor));
+    data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = FaVectorFlagsEnum::VecFlagNotSet;
+
+    std::string user_id = GetUserId(enroll.user);
+    if (FindDuplicates({user_id}, {faceprints})[0])
+    {
+        return Status::Duplicate;
+    }
+    if (!_gallery.Set(user_id.c_str(), faceprints))
+    {
+        return Status::InvalidFaceprints;
+    }
+    LogSet(user_id, faceprints);
+    return Status::Ok;
+}
+
+Status MatchServer::Set(const Request& request)
+{
+    if (request.payload.size() != sizeof(SetRequest))
+    {
+        return Status::BadRequest;
+    }
+    SetRequest set;
+    ::memcpy(&set, request.payload.data(), sizeof(set));
+    Faceprints faceprints;
+    faceprints.data = set.faceprints;
+    std::string user_id = GetUserId(set.user);
+    if (FindDuplicates({user_id}, {faceprints})[0])
+    {
+        return Status::Duplicate;
+    }
+    if (!_gallery.Set(user_id.c_str(), faceprints))
+    {
+        return Status::InvalidFaceprints;
+    }
+    LogSet(user_id, faceprints);
+    return Status::Ok;
+}
+
+Status MatchServer::Remove(const Request& request)
+{
+    if (request.payload.size() != sizeof(UserId))
+    {
+        return Status::BadRequest;
+    }
+    UserId user;
+    ::memcpy(&user, request.payload.data(), sizeof(user));
+    std::string user_id = GetUserId(user);
+    if (!_gallery.Remove(user_id.c_str()))
+    {
+        return Status::NotFound;
+    }
+    LogRemove(user_id);
+    return Status::Ok;
+}
+
+Status MatchServer::BulkLoad(const Request& request, uint32_t& num_loaded)
+{
+    uint32_t count = 0;
+    if (request.payload.size() < sizeof(count))
+    {
+        return Status::BadRequest;
+    }
+    ::memcpy(&count, request.payload.data(), sizeof(count));
+    if (request.payload.size() != sizeof(count) + static_cast<size_t>(count) * sizeof(SetRequest))
+    {
+        return Status::BadRequest;
+    }
+
+    std::vector<std::string> users(count);
+    std::vector<Faceprints> faceprints(count);
+    const char* record = request.payload.data() + sizeof(count);
+    SetRequest set;
+    for (uint32_t i = 0; i < count; i++, record += sizeof(SetRequest))
+    {
+        ::memcpy(&set, record, sizeof(set));
+        users[i] = GetUserId(set.user);
+        faceprints[i].data = set.faceprints;
+    }
+
+    // users that fail validation or are duplicates are skipped, the rest are loaded.
+    auto duplicates = FindDuplicates(users, faceprints);
+    size_t num_duplicates = 0;
+    _gallery.Reserve(_gallery.Size() + count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (duplicates[i])
+        {
+            num_duplicates++;
+            continue;
+        }
+        if (_gallery.Set(users[i].c_str(), faceprints[i]))
+        {
+            LogSet(users[i], faceprints[i]);
+            num_loaded++;
+        }
+    }
+    if (num_loaded == count)
+    {
+        return Status::Ok;
+    }
+    return (num_loaded + num_duplicates == count) ? Status::Duplicate : Status::InvalidFaceprints;
+}
+
+StatsResponse MatchServer::Stats()
+{
+    StatsResponse stats;
+    stats.num_users = _gallery.Size();
+    stats.num_requests = _num_requests;
+    stats.num_matches = _num_matches;
+    stats.num_match_batches = _num_match_batches;
+    stats.match_p50_us = _match_us.Percentile(50);
+    stats.match_p99_us = _match_us.Percentile(99);
+    _match_us.Clear();
+    return stats;
+}
+
+std::vector<char> MatchServer::FindDuplicates(const std::vector<std::string>& users, const std::vector<Faceprints>& faceprints)
+{
+    std::vector<char> duplicates(users.size(), 0);
+    if (!_args.reject_duplicates)
+    {
+        return duplicates;
+    }
+
+    // existing users are replaced, not enrolled, and would match their own gallery entry.
+    std::vector<size_t> new_users;
+    std::vector<Faceprints> enrollments;
+    for (size_t i = 0; i < users.size(); i++)
+    {
+        if (_gallery.Find(users[i].c_str()) < 0)
+        {
+            new_users.push_back(i);
+            enrollments.push_back(faceprints[i]);
+        }
+    }
+
+    std::vector<DuplicateCheckResult> results;
+    Matcher::FindDuplicates(enrollments, _gallery, results, _args.confidence, _pool.get());
+    for (size_t i = 0; i < new_users.size(); i++)
+    {
+        duplicates[new_users[i]] = results[i].is_duplicate ? 1 : 0;
+    }
+    return duplicates;
+}
+
+static int listen_on(const std::string& path)
+{
+    sockaddr_un addr {};
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        throw std::invalid_argument("socket path too long: " + path);
+    }
+
+    // a socket left over from a previous run is replaced, any other file is not.
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        ::unlink(path.c_str());
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed creating socket");
+    }
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("failed listening on " + path + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+static void print_usage()
+{
+    std::cout << "Usage: rsid-match-server [options]\n"
+              << "       rsid-match-server audit [audit options]   (see rsid-match-server audit --help)\n"
+              << "       rsid-match-server convert [convert options]   (see rsid-match-server convert --help)\n"
+              << "  --socket PATH     unix socket to listen on (default /tmp/rsid-match.sock).\n"
+              << "  --db FILE         gallery file, loaded at start and saved on SIGINT/SIGTERM (default: none).\n"
+              << "  --threads N       matcher threads (default 1).\n"
+              << "  --max-batch N     most match requests matched together (default 64).\n"
+              << "  --confidence L    high, medium or low thresholds (default high).\n"
+              << "  --reject-duplicates\n"
+              << "                    reject new users that match another user, by the strong threshold of --confidence.\n"
+              << "  --wal             log every change to the --db file's log (FILE.wal.N), replayed at start, so a crash\n"
+              << "                    loses no change. changes are acknowledged once logged to the storage device.\n"
+              << "  --wal-compact-mb N\n"
+              << "                    fold the log into the --db file in the background every N MB of log (default 64, 0: never).\n";
+}
+
+static Args config_from_argv(int argc, char* argv[])
+{
+    Args args;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            print_usage();
+            std::exit(0);
+        }
+        if (arg == "--reject-duplicates")
+        {
+            args.reject_duplicates = true;
+            continue;
+        }
+        if (arg == "--wal")
+        {
+            args.wal = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            print_usage();
+            std::exit(1);
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--socket")
+            args.socket_path = value;
+        else if (arg == "--db")
+            args.db_path = value;
+        else if (arg == "--threads")
+            args.threads = static_cast<unsigned int>(std::max(1ul, std::stoul(value)));
+        else if (arg == "--max-batch")
+            args.max_batch = std::max<size_t>(1, std::stoul(value));
+        else if (arg == "--wal-compact-mb")
+            args.wal_compact_bytes = static_cast<uint64_t>(std::stoull(value)) << 20;
+        else if (arg == "--confidence" && value == "high")
+            args.confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+        else if (arg == "--confidence" && value == "medium")
+            args.confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_Medium;
+        else if (arg == "--confidence" && value == "low")
+            args.confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_Low;
+        else
+        {
+            print_usage();
+            std::exit(1);
+        }
+    }
+    if (args.wal && args.db_path.empty())
+    {
+        std::cerr << "--wal needs a --db file" << std::endl;
+        std::exit(1);
+    }
+    return args;
+}
+
+struct AuditArgs
+{
+    std::string db_path;
+    std::string out_path; // stdout if empty
+    unsigned int threads = 0;
+    SimilarityAuditOptions options;
+};
+
+static void print_audit_usage()
+{
+    std::cout << "Usage: rsid-match-server audit --db FILE [options]\n"
+              << "Lists every pair of users of the db whose enrollment or adaptive descriptors score above the threshold,\n"
+              << "as csv: user1,user2,enrollment score,adaptive score.\n"
+              << "  --db FILE         gallery file to audit.\n"
+              << "  --out FILE        csv output (default stdout).\n"
+              << "  --threshold N     report pairs scoring above N (default " << SimilarityAuditOptions().threshold << ").\n"
+              << "  --descriptors D   enrollment, adaptive or both (default both).\n"
+              << "  --threads N       audit threads (default: all cores).\n"
+              << "  --tile N          users per tile (default " << SimilarityAuditOptions().tile_rows << ").\n";
+}
+
+static AuditArgs audit_from_argv(int argc, char* argv[])
+{
+    AuditArgs args;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            print_audit_usage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc)
+        {
+            print_audit_usage();
+            std::exit(1);
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--db")
+            args.db_path = value;
+        else if (arg == "--out")
+            args.out_path = value;
+        else if (arg == "--threshold")
+            args.options.threshold = static_cast<match_calc_t>(std::stoi(value));
+        else if (arg == "--descriptors" && (value == "enrollment" || value == "adaptive" || value == "both"))
+        {
+            args.options.enrollment = (value != "adaptive");
+            args.options.adaptive = (value != "enrollment");
+        }
+        else if (arg == "--threads")
+            args.threads = static_cast<unsigned int>(std::stoul(value));
+        else if (arg == "--tile")
+            args.options.tile_rows = std::stoul(value);
+        else
+        {
+            print_audit_usage();
+            std::exit(1);
+        }
+    }
+    if (args.db_path.empty())
+    {
+        print_audit_usage();
+        std::exit(1);
+    }
+    return args;
+}
+
+static std::string format_duration(double seconds)
+{
+    long long s = static_cast<long long>(seconds);
+    char text[32];
+    std::snprintf(text, sizeof(text), "%lld:%02lld:%02lld", s / 3600, (s / 60) % 60, s % 60);
+    return text;
+}
+
+// the audit subcommand: similar pairs of the db users to a csv, with progress on stderr.
+static int run_audit(const AuditArgs& args)
+{
+    FaceprintGallery gallery;
+    if (!load_db(args.db_path, gallery))
+    {
+        throw std::runtime_error("no db at " + args.db_path);
+    }
+
+    FILE* out = args.out_path.empty() ? stdout : std::fopen(args.out_path.c_str(), "w");
+    if (out == nullptr)
+    {
+        throw std::runtime_error("failed creating " + args.out_path);
+    }
+    std::fprintf(out, "user1,user2,enrollment_score,adaptive_score\n");
+
+    MatcherThreadPool pool(args.threads);
+    std::cerr << "Auditing " << gallery.Size() << " users from " << args.db_path << " with " << pool.GetNumThreads() << " threads"
+              << std::endl;
+    auto on_pairs = [&](const SimilarPair* pairs, size_t count) {
+        for (size_t i = 0; i < count; i++)
+        {
+            std::fprintf(out, "%s,%s,%d,%d\n", gallery.GetUserId(pairs[i].slot1), gallery.GetUserId(pairs[i].slot2),
+                         pairs[i].enrollment_score, pairs[i].adaptive_score);
+        }
+    };
+    auto on_progress = [](const SimilarityAudit& progress) {
+        double total = static_cast<double>(std::max<uint64_t>(progress.total_pairs, 1));
+        double percent = progress.total_pairs ? 100.0 * static_cast<double>(progress.num_pairs) / total : 100.0;
+        std::fprintf(stderr, "\r%6.2f%% of %llu pairs, %llu similar, elapsed %s, remaining %s ", percent,
+                     static_cast<unsigned long long>(progress.total_pairs), static_cast<unsigned long long>(progress.num_similar),
+                     format_duration(progress.elapsed_seconds).c_str(), format_duration(progress.remaining_seconds).c_str());
+    };
+    auto audit = Matcher::AuditGallery(gallery, args.options, on_pairs, on_progress, &pool);
+    std::fprintf(stderr, "\n");
+
+    bool ok = !std::ferror(out);
+    ok = ((out == stdout) ? std::fflush(out) == 0 : std::fclose(out) == 0) && ok;
+    if (!ok)
+    {
+        throw std::runtime_error("failed writing the audit output");
+    }
+    std::cerr << "Found " << audit.num_similar << " similar pairs" << std::endl;
+    return 0;
+}
+
+struct ConvertArgs
+{
+    std::string in_path;
+    std::string out_path;
+    bool to_mapped = true; // else to a db file
+    bool verify = false;
+};
+
+static void print_convert_usage()
+{
+    std::cout << "Usage: rsid-match-server convert --in FILE --out FILE [options]\n"
+              << "Converts a gallery between the db format, the rsid-viewer json db and the memory mapped format (see\n"
+              << "MappedGallery). The input format is detected from its content.\n"
+              << "  --in FILE         db, viewer json or mapped gallery file.\n"
+              << "  --out FILE        output file, replaced if it exists.\n"
+              << "  --to F            mapped or db (default mapped).\n"
+              << "  --verify          check the checksums of a mapped input, and of the mapped output once written.\n";
+}
+
+static ConvertArgs convert_from_argv(int argc, char* argv[])
+{
+    ConvertArgs args;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            print_convert_usage();
+            std::exit(0);
+        }
+        if (arg == "--verify")
+        {
+            args.verify = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            print_convert_usage();
+            std::exit(1);
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--in")
+            args.in_path = value;
+        else if (arg == "--out")
+            args.out_path = value;
+        else if (arg == "--to" && (value == "mapped" || value == "db"))
+            args.to_mapped = (value == "mapped");
+        else
+        {
+            print_convert_usage();
+            std::exit(1);
+        }
+    }
+    if (args.in_path.empty() || args.out_path.empty())
+    {
+        print_convert_usage();
+        std::exit(1);
+    }
+    return args;
+}
+
+// reader of the rsid-viewer json db (see DatabaseSerializer.cs):
+// {"db":[{"userID":"...","faceprints":{"version":N,"featuresType":N,"flags":N,"reserved":[...],
+//   "adaptiveDescriptorWithoutMask":[...],"adaptiveDescriptorWithMask":[...],"enrollmentDescriptor":[...]}},...],"version":N}
+// keys may come in any order, unknown keys are skipped. throws on malformed input.
+class ViewerJsonReader
+{
+public:
+    explicit ViewerJsonReader(std::string text) : _text(std::move(text))
+    {
+    }
+
+    void Read(FaceprintGallery& gallery)
+    {
+        ReadObject([&](const std::string& key) {
+            if (key != "db")
+            {
+                SkipValue();
+                return;
+            }
+            ReadArray([&] {
+                std::string user_id;
+                Faceprints faceprints;
+                ReadObject([&](const std::string& user_key) {
+                    if (user_key == "userID")
+                        user_id = ReadString();
+                    else if (user_key == "faceprints")
+                        ReadFaceprints(faceprints.data);
+                    else
+                        SkipValue();
+                });
+                if (!gallery.Set(user_id.c_str(), faceprints))
+                {
+                    throw std::runtime_error("invalid faceprints of user " + user_id);
+                }
+            });
+        });
+    }
+
+private:
+    void ReadFaceprints(DBFaceprintsElement& data)
+    {
+        ReadObject([&](const std::string& key) {
+            if (key == "version")
+                data.version = static_cast<int>(ReadNumber());
+            else if (key == "featuresType")
+                data.featuresType = static_cast<int>(ReadNumber());
+            else if (key == "flags")
+                data.flags = static_cast<int>(ReadNumber());
+            else if (key == "reserved")
+                ReadNumbers(data.reserved, sizeof(data.reserved) / sizeof(data.reserved[0]));
+            else if (key == "adaptiveDescriptorWithoutMask")
+                ReadNumbers(data.adaptiveDescriptorWithoutMask, RSID_FEATURES_VECTOR_ALLOC_SIZE);
+            else if (key == "adaptiveDescriptorWithMask")
+                ReadNumbers(data.adaptiveDescriptorWithMask, RSID_FEATURES_VECTOR_ALLOC_SIZE);
+            else if (key == "enrollmentDescriptor")
+                ReadNumbers(data.enrollmentDescriptor, RSID_FEATURES_VECTOR_ALLOC_SIZE);
+            else
+                SkipValue();
+        });
+    }
+
+    template <typename T>
+    void ReadNumbers(T* values, size_t count)
+    {
+        size_t i = 0;
+        ReadArray([&] {
+            long long value = ReadNumber();
+            if (i >= count)
+            {
+                throw std::runtime_error("json array too long");
+            }
+            values[i++] = static_cast<T>(value);
+        });
+    }
+
+    template <typename OnKey>
+    void ReadObject(OnKey on_key)
+    {
+        Expect('{');
+        if (Peek() == '}')
+        {
+            _pos++;
+            return;
+        }
+        do
+        {
+            std::string key = ReadString();
+            Expect(':');
+            on_key(key);
+        } while (Accept(','));
+        Expect('}');
+    }
+
+    template <typename OnItem>
+    void ReadArray(OnItem on_item)
+    {
+        Expect('[');
+        if (Peek() == ']')
+        {
+            _pos++;
+            return;
+        }
+        do
+        {
+            on_item();
+        } while (Accept(','));
+        Expect(']');
+    }
+
+    std::string ReadString()
+    {
+        Expect('"');
+        std::string value;
+        while (_pos < _text.size() && _text[_pos] != '"')
+        {
+            char c = _text[_pos++];
+            if (c == '\\' && _pos < _text.size())
+            {
+                // user ids are ascii: \uXXXX keeps the low byte, other escapes the escaped char.
+                c = _text[_pos++];
+                if (c == 'u' && _pos + 4 <= _text.size())
+                {
+                    c = static_cast<char>(std::stoi(_text.substr(_pos, 4), nullptr, 16));
+                    _pos += 4;
+                }
+            }
+            value += c;
+        }
+        Expect('"');
+        return value;
+    }
+
+    long long ReadNumber()
+    {
+        Peek();
+        size_t length = 0;
+        long long value = std::stoll(_text.substr(_pos, 32), &length);
+        _pos += length;
+        return value;
+    }
+
+    void SkipValue()
+    {
+        char c = Peek();
+        if (c == '{')
+            ReadObject([&](const std::string&) { SkipValue(); });
+        else if (c == '[')
+            ReadArray([&] { SkipValue(); });
+        else if (c == '"')
+            ReadString();
+        else
+        {
+            while (_pos < _text.size() && std::strchr(",}] \t\r\n", _text[_pos]) == nullptr)
+            {
+                _pos++;
+            }
+        }
+    }
+
+    char Peek()
+    {
+        while (_pos < _text.size() && std::strchr(" \t\r\n", _text[_pos]) != nullptr)
+        {
+            _pos++;
+        }
+        if (_pos >= _text.size())
+        {
+            throw std::runtime_error("unexpected end of json");
+        }
+        return _text[_pos];
+    }
+
+    bool Accept(char c)
+    {
+        if (Peek() != c)
+        {
+            return false;
+        }
+        _pos++;
+        return true;
+    }
+
+    void Expect(char c)
+    {
+        if (!Accept(c))
+        {
+            throw std::runtime_error(std::string("expected '") + c + "' at offset " + std::to_string(_pos) + " of the json");
+        }
+    }
+
+    std::string _text;
+    size_t _pos = 0;
+};
+
+// load a gallery of any convertible format: a mapped gallery, a db file or a viewer json db.
+static void load_any(const ConvertArgs& args, FaceprintGallery& gallery)
+{
+    std::ifstream file(args.in_path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("failed opening " + args.in_path);
+    }
+    uint32_t magic = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+
+    if (file && magic == MappedGallery::Magic)
+    {
+        MappedGallery mapped;
+        if (!mapped.Open(args.in_path.c_str(), args.verify))
+        {
+            throw std::runtime_error("failed loading " + args.in_path);
+        }
+        gallery.Reserve(mapped.Size());
+        for (size_t slot = 0; slot < mapped.Size(); slot++)
+        {
+            if (!gallery.Set(mapped.GetUserId(slot), mapped.GetFaceprints(slot)))
+            {
+                throw std::runtime_error("invalid faceprints of user " + std::string(mapped.GetUserId(slot)));
+            }
+        }
+        return;
+    }
+    if (file && magic == GalleryFile::Magic)
+    {
+        load_db(args.in_path, gallery);
+        return;
+    }
+
+    file.clear();
+    file.seekg(0);
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    // the viewer may write a utf-8 bom before the json.
+    size_t begin = text.find_first_not_of(" \t\r\n\xEF\xBB\xBF");
+    if (begin == std::string::npos || text[begin] != '{')
+    {
+        throw std::runtime_error("unknown gallery format: " + args.in_path);
+    }
+    text.erase(0, begin);
+    ViewerJsonReader(std::move(text)).Read(gallery);
+}
+
+// the convert subcommand: a gallery to the mapped or db format.
+static int run_convert(const ConvertArgs& args)
+{
+    auto start = Clock::now();
+    FaceprintGallery gallery;
+    load_any(args, gallery);
+    double load_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    if (args.to_mapped)
+    {
+        if (!MappedGallery::Write(args.out_path.c_str(), gallery))
+        {
+            throw std::runtime_error("failed writing " + args.out_path);
+        }
+        MappedGallery mapped;
+        if (args.verify && !mapped.Open(args.out_path.c_str(), true))
+        {
+            throw std::runtime_error("failed verifying " + args.out_path);
+        }
+    }
+    else
+    {
+        save_db(args.out_path, gallery);
+    }
+    double write_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << "Converted " << gallery.Size() << " users from " << args.in_path << " to " << args.out_path << " (load "
+              << load_seconds << " s, write " << write_seconds << " s)" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        if (argc > 1 && std::string(argv[1]) == "audit")
+        {
+            RealSenseID::SetLogCallback([](LogLevel, const char* msg) { std::cerr << msg << std::endl; }, LogLevel::Error, false);
+            return run_audit(audit_from_argv(argc, argv));
+        }
+        if (argc > 1 && std::string(argv[1]) == "convert")
+        {
+            RealSenseID::SetLogCallback([](LogLevel, const char* msg) { std::cerr << msg << std::endl; }, LogLevel::Error, false);
+            return run_convert(convert_from_argv(argc, argv));
+        }
+
+        auto args = config_from_argv(argc, argv);
+
+        // errors only: the matcher logs every match.
+        RealSenseID::SetLogCallback([](LogLevel, const char* msg) { std::cerr << msg << std::endl; }, LogLevel::Error, false);
+
+        // shutdown signals are taken by sigwait() below, so every thread started from here on blocks them.
+        std::signal(SIGPIPE, SIG_IGN);
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        MatchServer server(args);
+        server.LoadDb();
+
+        int listen_fd = listen_on(args.socket_path);
+        server.Start(listen_fd);
+        std::cout << "Listening on " << args.socket_path << std::endl;
+
+        int signal = 0;
+        sigwait(&signals, &signal);
+        std::cout << "Shutting down" << std::endl;
+        server.Stop();
+        ::close(listen_fd);
+        ::unlink(args.socket_path.c_str());
+        server.SaveDb();
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception occurred: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,1808 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Host matcher micro benchmarks on synthetic faceprints (no device needed).
+// Usage: rsid-matcher-bench [options], see print_usage().
+//
+// Each benchmark is calibrated to batches of at least BatchTime, run for at least --min-time, and reports the mean
+// (ns/op), the median and 99th percentile of the per batch time per op, gallery entries matched per second and
+// descriptor bytes scanned per second.
+// Results go to stdout as a table, and optionally to a json file with one result per line (stable order and formatting,
+// so result files of two builds can be diffed).
+//
+// Build with -DRSID_DEBUG_CONSOLE=OFF for meaningful numbers: the debug console log of every match costs more than
+// most of the benchmarked functions.
+
+#include "Matcher.h"
+#include "MatcherKernels.h"
+#include "FaceprintGallery.h"
+#include "ConcurrentGallery.h"
+#include "PackedGallery.h"
+#include "MatcherThreadPool.h"
+#include "RealSenseID/MatcherEngine.h"
+#include "GalleryFile.h"
+#include "MappedGallery.h"
+#include "GalleryLog.h"
+#include "ShardedGallery.h"
+#include "NumaTopology.h"
+#include "RealSenseID/Logging.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace RealSenseID;
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t NumProbes = 64;
+static constexpr double BatchTime = 20e-6; // seconds
+static constexpr size_t DescriptorBytes = RSID_NUM_OF_RECOGNITION_FEATURES * sizeof(feature_t); // bytes of one vector
+static constexpr size_t QuantizedRescore = 16; // candidates rescored after the int8 pass
+
+struct Args
+{
+    std::vector<size_t> sizes {1, 10, 100, 1000, 10000, 100000, 1000000};
+    size_t max_gallery_size = 100000; // FaceprintGallery/ConcurrentGallery/PackedGallery keep their own copy of the faceprints
+    unsigned int threads = 1;
+    std::string kernel;
+    std::string filter;
+    std::string json_path;
+    std::string gallery_file; // GalleryFile benchmarks run only if set
+    std::string mapped_file;  // MappedGallery benchmarks run only if set
+    std::string log_file;     // GalleryLog benchmarks and crash check run only if set
+    size_t shards = 0;        // ShardedGallery shards, 0: one per NUMA node
+    double min_time = 0.5;
+    uint64_t seed = 1;
+};
+
+struct BenchResult
+{
+    std::string name;
+    std::string variant;
+    size_t gallery_size = 0;
+    uint64_t ops = 0;
+    double ns_per_op = 0;
+    double p50_ns = 0;
+    double p99_ns = 0;
+    double matches_per_sec = 0;
+    double bytes_per_sec = 0;
+};
+
+// xorshift64*, fast enough to generate a 1M users gallery in a few seconds.
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : _state(seed * 0x9E3779B97F4A7C15ull + 1)
+    {
+    }
+
+    uint64_t Next()
+    {
+        _state ^= _state >> 12;
+        _state ^= _state << 25;
+        _state ^= _state >> 27;
+        return _state * 0x2545F4914F6CDD1Dull;
+    }
+
+    // uniform in [min, max]
+    int Range(int min, int max)
+    {
+        return min + static_cast<int>((Next() >> 32) % static_cast<uint64_t>(max - min + 1));
+    }
+
+private:
+    uint64_t _state;
+};
+
+static void random_vector(Random& rnd, feature_t* vec)
+{
+    for (size_t i = 0; i < RSID_NUM_OF_RECOGNITION_FEATURES; i++)
+    {
+        vec[i] = static_cast<feature_t>(rnd.Range(RSID_MIN_FEATURE_VALUE, RSID_MAX_FEATURE_VALUE));
+    }
+}
+
+// src plus uniform noise in [-amplitude, amplitude], clamped to the valid range.
+static void noisy_vector(Random& rnd, const feature_t* src, int amplitude, feature_t* vec)
+{
+    for (size_t i = 0; i < RSID_NUM_OF_RECOGNITION_FEATURES; i++)
+    {
+        int value = src[i] + rnd.Range(-amplitude, amplitude);
+        vec[i] = static_cast<feature_t>(std::max(RSID_MIN_FEATURE_VALUE, std::min(RSID_MAX_FEATURE_VALUE, value)));
+    }
+}
+
+// valid faceprints: random enrollment vector, adaptive no-mask vector close to it, and a with-mask adaptive vector
+// for a third of the users.
+static void make_faceprints(Random& rnd, Faceprints& faceprints)
+{
+    auto& data = faceprints.data;
+    random_vector(rnd, data.enrollmentDescriptor);
+    data.enrollmentDescriptor[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithoutMask;
+    noisy_vector(rnd, data.enrollmentDescriptor, 200, data.adaptiveDescriptorWithoutMask);
+    data.adaptiveDescriptorWithoutMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithoutMask;
+    if (rnd.Range(0, 2) == 0)
+    {
+        noisy_vector(rnd, data.enrollmentDescriptor, 500, data.adaptiveDescriptorWithMask);
+        data.adaptiveDescriptorWithMask[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = VecFlagValidWithMask;
+    }
+}
+
+// probes of gallery users at several noise levels, and unknown faces. half of them with mask.
+static std::vector<MatchElement> make_probes(Random& rnd, const std::vector<Faceprints>& gallery, size_t gallery_size)
+{
+    std::vector<MatchElement> probes(NumProbes);
+    for (size_t i = 0; i < NumProbes; i++)
+    {
+        auto& features = probes[i].data.featuresVector;
+        int mode = static_cast<int>(i % 4);
+        if (mode == 0)
+        {
+            random_vector(rnd, features);
+        }
+        else
+        {
+            size_t user = static_cast<size_t>(rnd.Next() % gallery_size);
+            noisy_vector(rnd, gallery[user].data.enrollmentDescriptor, mode * 200, features);
+        }
+        features[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = ((i / 4) % 2 == 0) ? VecFlagValidWithoutMask : VecFlagValidWithMask;
+    }
+    return probes;
+}
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// op(i) is called with a running op index (e.g. to cycle through probes).
+template <typename Op>
+static BenchResult run_bench(const Args& args, const char* name, const std::string& variant, size_t gallery_size,
+                             double matches_per_op, double bytes_per_op, Op&& op)
+{
+    uint64_t op_index = 0;
+    auto run_batch = [&](uint64_t batch) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < batch; i++)
+        {
+            op(op_index++);
+        }
+        return seconds_since(start);
+    };
+
+    // calibrate the batch size (this doubles as warm up)
+    uint64_t batch = 1;
+    while (run_batch(batch) < BatchTime && batch < (1u << 24))
+    {
+        batch *= 2;
+    }
+
+    // at least 20 batches, unless that takes more than 10 times min_time (the 1M scans).
+    std::vector<double> samples; // seconds per op
+    double total_time = 0;
+    auto start = Clock::now();
+    while (true)
+    {
+        double elapsed = seconds_since(start);
+        bool enough_samples = samples.size() >= 20 || (samples.size() >= 3 && elapsed >= 10 * args.min_time);
+        if (elapsed >= args.min_time && enough_samples)
+        {
+            break;
+        }
+        double batch_time = run_batch(batch);
+        total_time += batch_time;
+        samples.push_back(batch_time / static_cast<double>(batch));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.name = name;
+    result.variant = variant;
+    result.gallery_size = gallery_size;
+    result.ops = batch * samples.size();
+    double sec_per_op = total_time / static_cast<double>(result.ops);
+    result.ns_per_op = sec_per_op * 1e9;
+    result.p50_ns = samples[(samples.size() - 1) / 2] * 1e9;
+    result.p99_ns = samples[(samples.size() - 1) * 99 / 100] * 1e9;
+    result.matches_per_sec = matches_per_op / sec_per_op;
+    result.bytes_per_sec = bytes_per_op / sec_per_op;
+    return result;
+}
+
+static void print_header()
+{
+    std::printf("%-24s %-16s %9s %14s %14s %14s %14s %12s\n", "benchmark", "variant", "size", "ns/op", "p50 ns", "p99 ns",
+                "matches/s", "MB/s");
+}
+
+static void print_result(const BenchResult& r)
+{
+    std::printf("%-24s %-16s %9zu %14.1f %14.1f %14.1f %14.4g %12.1f\n", r.name.c_str(), r.variant.c_str(), r.gallery_size, r.ns_per_op,
+                r.p50_ns, r.p99_ns, r.matches_per_sec, r.bytes_per_sec / 1e6);
+    std::fflush(stdout);
+}
+
+static void write_json(const Args& args, const char* kernel, const std::vector<BenchResult>& results)
+{
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"kernel\": \"" << kernel << "\",\n";
+    json << "  \"threads\": " << args.threads << ",\n";
+    json << "  \"seed\": " << args.seed << ",\n";
+    json << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto& r = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"variant\": \"%s\", \"gallery_size\": %zu, \"ops\": %llu, \"ns_per_op\": %.1f, "
+                      "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"matches_per_sec\": %.1f, \"bytes_per_sec\": %.1f}%s\n",
+                      r.name.c_str(), r.variant.c_str(), r.gallery_size, static_cast<unsigned long long>(r.ops), r.ns_per_op, r.p50_ns,
+                      r.p99_ns, r.matches_per_sec, r.bytes_per_sec, (i + 1 < results.size()) ? "," : "");
+        json << line;
+    }
+    json << "  ]\n}\n";
+
+    if (args.json_path == "-")
+    {
+        std::cout << json.str();
+        return;
+    }
+    std::ofstream file(args.json_path, std::ios::binary);
+    file << json.str();
+    if (!file)
+    {
+        throw std::runtime_error("failed writing " + args.json_path);
+    }
+}
+
+static void print_usage()
+{
+    std::cout << "Usage: rsid-matcher-bench [options]\n"
+              << "  --sizes N,N,..    gallery sizes of the 1:N benchmarks (default 1,10,100,1000,10000,100000,1000000).\n"
+              << "                    1M users take about 3GB.\n"
+              << "  --max-gallery N   largest size of the FaceprintGallery/ConcurrentGallery/PackedGallery variants, which\n"
+              << "                    copy the faceprints (default 100000).\n"
+              << "  --threads N       also run the 1:N benchmarks on a thread pool of N threads (default 1: serial only).\n"
+              << "  --kernel NAME     force a matcher kernel (scalar, sse4.1, avx2, avx512bw, neon). default: best available.\n"
+              << "  --filter TEXT     only run benchmarks whose name contains TEXT.\n"
+              << "  --min-time SEC    minimum run time of each benchmark (default 0.5).\n"
+              << "  --seed N          synthetic data seed (default 1).\n"
+              << "  --json FILE       also write the results as json to FILE ('-' for stdout).\n"
+              << "  --shards N        ShardedGallery shards (default 0: one per NUMA node).\n"
+              << "  --gallery-file F  also benchmark 1:N matching of a gallery streamed from file F (see GalleryFile), which is\n"
+              << "                    written for each gallery size and removed at the end. put it on the storage device to\n"
+              << "                    measure (1M users take about 3GB).\n"
+              << "  --mapped-file F   also benchmark loading and matching a memory mapped gallery file F (see MappedGallery),\n"
+              << "                    written (with F.db, the same gallery as a GalleryFile) for each gallery size up to\n"
+              << "                    --max-gallery and removed at the end.\n"
+              << "  --log-file F      also benchmark the write-ahead log of gallery changes (see GalleryLog) with F as the base\n"
+              << "                    file, and check its recovery from processes killed while logging. put it on the\n"
+              << "                    storage device to measure. F and its log segments are removed at the end.\n";
+}
+
+static std::vector<size_t> parse_sizes(const std::string& text)
+{
+    std::vector<size_t> sizes;
+    std::istringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        size_t size = std::stoul(item);
+        if (size == 0)
+        {
+            throw std::invalid_argument("gallery size must be positive");
+        }
+        sizes.push_back(size);
+    }
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    if (sizes.empty())
+    {
+        throw std::invalid_argument("no gallery sizes given");
+    }
+    return sizes;
+}
+
+static Args config_from_argv(int argc, char* argv[])
+{
+    Args args;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            print_usage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc)
+        {
+            print_usage();
+            std::exit(1);
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--sizes")
+            args.sizes = parse_sizes(value);
+        else if (arg == "--max-gallery")
+            args.max_gallery_size = std::stoul(value);
+        else if (arg == "--threads")
+            args.threads = static_cast<unsigned int>(std::max(1ul, std::stoul(value)));
+        else if (arg == "--kernel")
+            args.kernel = value;
+        else if (arg == "--filter")
+            args.filter = value;
+        else if (arg == "--min-time")
+            args.min_time = std::stod(value);
+        else if (arg == "--seed")
+            args.seed = std::stoull(value);
+        else if (arg == "--json")
+            args.json_path = value;
+        else if (arg == "--shards")
+            args.shards = std::stoul(value);
+        else if (arg == "--gallery-file")
+            args.gallery_file = value;
+        else if (arg == "--mapped-file")
+            args.mapped_file = value;
+        else if (arg == "--log-file")
+            args.log_file = value;
+        else
+        {
+            print_usage();
+            std::exit(1);
+        }
+    }
+    return args;
+}
+
+static void log_to_cerr(LogLevel, const char* msg)
+{
+    std::cerr << msg << std::endl;
+}
+
+static void select_kernel(const std::string& name)
+{
+    for (int isa = 0; isa < static_cast<int>(MatcherKernels::KernelIsa::NumKernelIsas); isa++)
+    {
+        const auto* table = MatcherKernels::Get(static_cast<MatcherKernels::KernelIsa>(isa));
+        if (table != nullptr && name == table->name)
+        {
+            MatcherKernels::Select(table->isa);
+            return;
+        }
+    }
+    throw std::invalid_argument("kernel not available: " + name);
+}
+
+class BenchRunner
+{
+public:
+    explicit BenchRunner(const Args& args) : _args(args)
+    {
+    }
+
+    bool Enabled(const char* name) const
+    {
+        return _args.filter.empty() || std::string(name).find(_args.filter) != std::string::npos;
+    }
+
+    template <typename Op>
+    void Run(const char* name, const std::string& variant, size_t gallery_size, double matches_per_op, double bytes_per_op, Op&& op)
+    {
+        _results.push_back(run_bench(_args, name, variant, gallery_size, matches_per_op, bytes_per_op, std::forward<Op>(op)));
+        print_result(_results.back());
+    }
+
+    const std::vector<BenchResult>& Results() const
+    {
+        return _results;
+    }
+
+private:
+    const Args& _args;
+    std::vector<BenchResult> _results;
+};
+
+// single vector functions and 1:1 match.
+static void bench_vectors(BenchRunner& runner, const std::vector<Faceprints>& gallery, const std::vector<MatchElement>& probes)
+{
+    const size_t num_users = std::min(gallery.size(), NumProbes);
+    auto probe_vector = [&](uint64_t i) { return probes[i % NumProbes].data.featuresVector; };
+    auto user = [&](uint64_t i) -> const Faceprints& { return gallery[i % num_users]; };
+
+    if (runner.Enabled("MatchTwoVectors"))
+    {
+        // every available kernel, then back to the one selected for the run.
+        const auto& active = MatcherKernels::Active();
+        for (int isa = 0; isa < static_cast<int>(MatcherKernels::KernelIsa::NumKernelIsas); isa++)
+        {
+            const auto* table = MatcherKernels::Get(static_cast<MatcherKernels::KernelIsa>(isa));
+            if (table == nullptr)
+            {
+                continue;
+            }
+            MatcherKernels::Select(table->isa);
+            match_calc_t score = 0;
+            runner.Run("MatchTwoVectors", table->name, 1, 1, 2 * DescriptorBytes,
+                       [&](uint64_t i) { Matcher::MatchTwoVectors(probe_vector(i), user(i).data.adaptiveDescriptorWithoutMask, &score); });
+        }
+        MatcherKernels::Select(active.isa);
+    }
+
+    if (runner.Enabled("ValidateFaceprints"))
+    {
+        volatile bool valid = false;
+        runner.Run("ValidateFaceprints", "adaptive", 1, 0, 2 * DescriptorBytes,
+                   [&](uint64_t i) { valid = Matcher::ValidateFaceprints(user(i)); });
+        runner.Run("ValidateFaceprints", "probe", 1, 0, DescriptorBytes,
+                   [&](uint64_t i) { valid = Matcher::ValidateFaceprints(probes[i % NumProbes]); });
+        (void)valid;
+    }
+
+    if (runner.Enabled("BlendAverageVector"))
+    {
+        // keeps blending probes into the same vector, which stays in the valid range.
+        Faceprints adaptive = user(0);
+        runner.Run("BlendAverageVector", "", 1, 0, 2 * DescriptorBytes, [&](uint64_t i) {
+            Matcher::BlendAverageVector(adaptive.data.adaptiveDescriptorWithoutMask, probe_vector(i));
+        });
+    }
+
+    if (runner.Enabled("LimitAdaptiveVector"))
+    {
+        // opening the first with-mask adaptive vector: the probe is pulled towards the no-mask adaptive (anchor) vector
+        // until they are identical enough, which takes most iterations. each op restores the probe first.
+        AdaptiveThresholds thresholds {};
+        thresholds.activeConfig = ThresholdsConfigEnum::ThresholdConfig_pM_gNM;
+        thresholds.activeIdenticalThreshold = RSID_IDENTICAL_THRESHOLD_GM_GNM_HIGH_CONFIDENCE_LEVEL;
+        feature_t adaptive[RSID_FEATURES_VECTOR_ALLOC_SIZE];
+        volatile bool ok = false;
+        runner.Run("LimitAdaptiveVector", "first_with_mask", 1, 0, 0, [&](uint64_t i) {
+            ::memcpy(adaptive, probe_vector(i), sizeof(adaptive));
+            ok = Matcher::LimitAdaptiveVector(adaptive, user(i).data.adaptiveDescriptorWithoutMask, thresholds);
+        });
+        (void)ok;
+    }
+
+    if (runner.Enabled("MatchFaceprints"))
+    {
+        Faceprints updated;
+        runner.Run("MatchFaceprints", "1:1", 1, 1, DescriptorBytes, [&](uint64_t i) {
+            Matcher::MatchFaceprints(probes[i % NumProbes], user(i), updated, ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High);
+        });
+    }
+}
+
+// 1:N match of every gallery size, for each gallery layout (and serial vs. thread pool).
+static void bench_match_to_array(BenchRunner& runner, const Args& args, const std::vector<Faceprints>& gallery,
+                                 const std::vector<MatchElement>& probes)
+{
+    const char* name = "MatchFaceprintsToArray";
+    if (!runner.Enabled(name))
+    {
+        return;
+    }
+
+    std::unique_ptr<MatcherThreadPool> pool;
+    if (args.threads > 1)
+    {
+        pool.reset(new MatcherThreadPool(args.threads));
+    }
+
+    Faceprints updated;
+    const auto confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+    for (size_t size : args.sizes)
+    {
+        const double bytes = static_cast<double>(size * DescriptorBytes);
+        runner.Run(name, "array", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], gallery.data(), size, updated, confidence);
+        });
+        if (pool)
+        {
+            runner.Run(name, "array_pool", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+                Matcher::MatchFaceprintsToArray(probes[i % NumProbes], gallery.data(), size, updated, confidence, pool.get());
+            });
+        }
+
+        if (size > args.max_gallery_size)
+        {
+            continue;
+        }
+
+        FaceprintGallery faceprint_gallery;
+        ConcurrentGallery concurrent_gallery;
+        faceprint_gallery.Reserve(size);
+        for (size_t user = 0; user < size; user++)
+        {
+            std::string user_id = "user" + std::to_string(user);
+            faceprint_gallery.Set(user_id.c_str(), gallery[user]);
+            concurrent_gallery.Set(user_id.c_str(), gallery[user]);
+        }
+
+        runner.Run(name, "gallery", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], faceprint_gallery, updated, confidence);
+        });
+        if (pool)
+        {
+            runner.Run(name, "gallery_pool", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+                Matcher::MatchFaceprintsToArray(probes[i % NumProbes], faceprint_gallery, updated, confidence, pool.get());
+            });
+        }
+
+        // a snapshot per op, as a concurrent reader would take.
+        runner.Run(name, "snapshot", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            auto snapshot = concurrent_gallery.Acquire();
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], snapshot, updated, confidence);
+        });
+
+        PackedGallery packed_gallery(true);
+        packed_gallery.Reserve(size);
+        for (size_t user = 0; user < size; user++)
+        {
+            packed_gallery.Set(faceprint_gallery.GetUserId(user), gallery[user]);
+        }
+
+        const double packed_bytes = static_cast<double>(size * PackedGallery::RowBytes);
+        runner.Run(name, "packed", size, static_cast<double>(size), packed_bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], packed_gallery, updated, confidence);
+        });
+        const double quantized_bytes = static_cast<double>(size * PackedGallery::RowLength);
+        runner.Run(name, "quantized", size, static_cast<double>(size), quantized_bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArrayQuantized(probes[i % NumProbes], packed_gallery, updated, confidence, QuantizedRescore);
+        });
+        if (pool)
+        {
+            runner.Run(name, "packed_pool", size, static_cast<double>(size), packed_bytes, [&](uint64_t i) {
+                Matcher::MatchFaceprintsToArray(probes[i % NumProbes], packed_gallery, updated, confidence, pool.get());
+            });
+            runner.Run(name, "quantized_pool", size, static_cast<double>(size), quantized_bytes, [&](uint64_t i) {
+                Matcher::MatchFaceprintsToArrayQuantized(probes[i % NumProbes], packed_gallery, updated, confidence, QuantizedRescore,
+                                                         pool.get());
+            });
+        }
+    }
+}
+
+// kernel inputs: a vector T1 and 4 vectors T2 (the dot4 rows, T2[0] is the ncc/dot/hamming/int8 pair of T1 and T2[1]
+// is packed for dot_packed).
+struct KernelCase
+{
+    feature_t t1[RSID_NUM_OF_RECOGNITION_FEATURES];
+    feature_t t2[4][RSID_NUM_OF_RECOGNITION_FEATURES];
+};
+
+// feature(vec, i) gives feature i of T1 (vec 0) and of each T2 (vec 1..4).
+template <typename Feature>
+static KernelCase make_kernel_case(Feature feature)
+{
+    KernelCase c;
+    for (size_t i = 0; i < RSID_NUM_OF_RECOGNITION_FEATURES; i++)
+    {
+        c.t1[i] = static_cast<feature_t>(feature(0, i));
+        for (size_t row = 0; row < 4; row++)
+        {
+            c.t2[row][i] = static_cast<feature_t>(feature(row + 1, i));
+        }
+    }
+    return c;
+}
+
+static std::vector<KernelCase> make_kernel_cases(Random& rnd)
+{
+    const int min = RSID_MIN_FEATURE_VALUE, max = RSID_MAX_FEATURE_VALUE;
+    std::vector<KernelCase> cases;
+    for (int i = 0; i < 8; i++)
+    {
+        cases.push_back(make_kernel_case([&](size_t, size_t) { return rnd.Range(min, max); }));
+    }
+    // the range limits, where the products and sums are the largest
+    cases.push_back(make_kernel_case([&](size_t, size_t) { return max; }));
+    cases.push_back(make_kernel_case([&](size_t, size_t) { return min; }));
+    cases.push_back(make_kernel_case([&](size_t vec, size_t) { return vec == 0 ? max : min; }));
+    cases.push_back(make_kernel_case([&](size_t vec, size_t i) { return (vec + i) % 2 == 0 ? max : min; }));
+    cases.push_back(make_kernel_case([&](size_t, size_t) { return rnd.Range(0, 1) == 0 ? max : min; }));
+    // zero vectors
+    cases.push_back(make_kernel_case([&](size_t, size_t) { return 0; }));
+    cases.push_back(make_kernel_case([&](size_t vec, size_t) { return vec == 0 ? 0 : rnd.Range(min, max); }));
+    cases.push_back(make_kernel_case([&](size_t vec, size_t) { return vec == 0 ? rnd.Range(min, max) : 0; }));
+    return cases;
+}
+
+// packed row of the first vec_length features (see MatcherKernels::PackedRowBytes()).
+static std::vector<uint8_t> pack_row(const feature_t* vec, uint32_t vec_length)
+{
+    std::vector<uint8_t> packed(MatcherKernels::PackedRowBytes(vec_length), 0);
+    uint8_t* planes = packed.data() + vec_length;
+    const uint32_t plane_bytes = vec_length / 8;
+    for (uint32_t i = 0; i < vec_length; i++)
+    {
+        const auto u = static_cast<uint32_t>(vec[i] + MatcherKernels::PackedOffset);
+        packed[i] = static_cast<uint8_t>(u & 0xff);
+        for (uint32_t plane = 0; plane < 3; plane++)
+        {
+            planes[plane * plane_bytes + i / 8] |= static_cast<uint8_t>(((u >> (8 + plane)) & 1) << (i % 8));
+        }
+    }
+    return packed;
+}
+
+// int8 quantization of a feature, rounding down so that the range limits map to -128 and +127.
+static int8_t quantize_feature(feature_t x)
+{
+    return static_cast<int8_t>(x < 0 ? -((-x + 7) / 8) : x / 8);
+}
+
+// conformance of every available kernel isa with the scalar kernels: random, range limits and zero vectors, of every
+// length from 1 to 512 (odd lengths exercise the simd tails; dot_packed needs multiples of 8, hamming the whole words of
+// the vector bytes).
+// returns false if any kernel differs.
+static bool check_matcher_kernels(BenchRunner& runner, const Args& args)
+{
+    if (!runner.Enabled("MatcherKernels"))
+    {
+        return true;
+    }
+
+    Random rnd(args.seed);
+    const auto cases = make_kernel_cases(rnd);
+    const auto* scalar = MatcherKernels::Get(MatcherKernels::KernelIsa::Scalar);
+    std::printf("\n%-12s %12s %12s %12s %12s %12s %12s\n", "kernel", "ncc_sums", "dot", "dot4", "hamming", "dot_packed", "dot_int8");
+    bool all_identical = true;
+    for (int isa = 0; isa < static_cast<int>(MatcherKernels::KernelIsa::NumKernelIsas); isa++)
+    {
+        const auto* table = MatcherKernels::Get(static_cast<MatcherKernels::KernelIsa>(isa));
+        if (table == nullptr || table == scalar)
+        {
+            continue;
+        }
+
+        enum
+        {
+            Ncc,
+            Dot,
+            Dot4,
+            Hamming,
+            Packed,
+            Int8,
+            NumKernels
+        };
+        size_t num_identical[NumKernels] = {}, total[NumKernels] = {};
+        auto count = [&](int kernel, bool identical) {
+            num_identical[kernel] += identical ? 1 : 0;
+            total[kernel]++;
+        };
+        for (const auto& c : cases)
+        {
+            const feature_t* rows[4] = {c.t2[0], c.t2[1], c.t2[2], c.t2[3]};
+            uint64_t s1[DescriptorBytes / sizeof(uint64_t)], s2[DescriptorBytes / sizeof(uint64_t)];
+            ::memcpy(s1, c.t1, sizeof(s1));
+            ::memcpy(s2, c.t2[0], sizeof(s2));
+            int8_t q1[RSID_NUM_OF_RECOGNITION_FEATURES], q2[RSID_NUM_OF_RECOGNITION_FEATURES];
+            for (size_t i = 0; i < RSID_NUM_OF_RECOGNITION_FEATURES; i++)
+            {
+                q1[i] = quantize_feature(c.t1[i]);
+                q2[i] = quantize_feature(c.t2[0][i]);
+            }
+
+            for (uint32_t len = 1; len <= RSID_NUM_OF_RECOGNITION_FEATURES; len++)
+            {
+                MatcherKernels::NccSums expected_sums, sums;
+                scalar->ncc_sums(c.t1, c.t2[0], len, expected_sums);
+                table->ncc_sums(c.t1, c.t2[0], len, sums);
+                count(Ncc, expected_sums.corr == sums.corr && expected_sums.norm1 == sums.norm1 && expected_sums.norm2 == sums.norm2);
+
+                count(Dot, scalar->dot(c.t1, c.t2[0], len) == table->dot(c.t1, c.t2[0], len));
+
+                int32_t expected_corrs[4], corrs[4];
+                scalar->dot4(c.t1, rows, len, expected_corrs);
+                table->dot4(c.t1, rows, len, corrs);
+                count(Dot4, ::memcmp(expected_corrs, corrs, sizeof(corrs)) == 0);
+
+                const uint32_t num_words = len * static_cast<uint32_t>(sizeof(feature_t)) / static_cast<uint32_t>(sizeof(uint64_t));
+                if (num_words > 0 && len % (sizeof(uint64_t) / sizeof(feature_t)) == 0)
+                {
+                    count(Hamming, scalar->hamming(s1, s2, num_words) == table->hamming(s1, s2, num_words));
+                }
+
+                if (len % 8 == 0)
+                {
+                    auto packed = pack_row(c.t2[1], len);
+                    count(Packed, scalar->dot_packed(c.t1, packed.data(), len) == table->dot_packed(c.t1, packed.data(), len));
+                }
+
+                count(Int8, scalar->dot_int8(q1, q2, len) == table->dot_int8(q1, q2, len));
+            }
+        }
+
+        auto ratio = [&](int kernel) { return std::to_string(num_identical[kernel]) + "/" + std::to_string(total[kernel]); };
+        for (int kernel = 0; kernel < NumKernels; kernel++)
+        {
+            all_identical &= num_identical[kernel] == total[kernel];
+        }
+        std::printf("%-12s %12s %12s %12s %12s %12s %12s\n", table->name, ratio(Ncc).c_str(), ratio(Dot).c_str(), ratio(Dot4).c_str(),
+                    ratio(Hamming).c_str(), ratio(Packed).c_str(), ratio(Int8).c_str());
+    }
+    std::fflush(stdout);
+    return all_identical;
+}
+
+// verbatim copies of Matcher::BlendAverageVector() and of the Matcher::LimitAdaptiveVector() loop before the single
+// pass blend (see MatcherKernels::BlendSumsFn): the reference of check_adaptive_update().
+static void reference_blend(feature_t* user_adaptive_faceprints, const feature_t* user_probe_faceprints, const uint32_t vec_length)
+{
+    int history_weight = RSID_UPDATE_GALLERY_HISTORY_WEIGHT;
+    int round_value = (history_weight + 1);
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        int32_t v = static_cast<int32_t>(user_adaptive_faceprints[i]);
+        v *= 2 * history_weight;
+        v += 2 * (int)(user_probe_faceprints[i]);
+        v = (v >= 0) ? (v + round_value) : (v - round_value);
+        v /= (2 * round_value);
+
+        user_adaptive_faceprints[i] = static_cast<short>(v);
+    }
+}
+
+static bool reference_limit(feature_t* adaptive_faceprints_vec, const feature_t* anchor_faceprints_vec,
+                            const AdaptiveThresholds& adaptiveThresholds, const uint32_t vec_length)
+{
+    bool success = true;
+
+    match_calc_t match_score = 0;
+    Matcher::MatchTwoVectors(adaptive_faceprints_vec, anchor_faceprints_vec, &match_score, vec_length);
+
+    uint32_t cnt_iter = 0;
+
+    uint32_t limit_num_iters = static_cast<uint32_t>(RSID_LIMIT_NUM_ITERS_NM);
+    if (adaptiveThresholds.activeConfig != ThresholdsConfigEnum::ThresholdConfig_pNM_gNM)
+    {
+        limit_num_iters = static_cast<uint32_t>(RSID_LIMIT_NUM_ITERS_M);
+    }
+
+    while ((match_score < adaptiveThresholds.activeIdenticalThreshold))
+    {
+        reference_blend(adaptive_faceprints_vec, anchor_faceprints_vec, vec_length);
+
+        Matcher::MatchTwoVectors(adaptive_faceprints_vec, anchor_faceprints_vec, &match_score, vec_length);
+
+        cnt_iter++;
+        if (cnt_iter > limit_num_iters)
+        {
+            success = false;
+            break;
+        }
+    }
+
+    return success;
+}
+
+static constexpr size_t AdaptiveUpdateCases = 20000;
+static constexpr int OutOfRangeFeatureValue = 2047; // out of the validated range, without overflowing the int32 ncc sums
+
+struct AdaptiveCase
+{
+    feature_t adaptive[RSID_FEATURES_VECTOR_ALLOC_SIZE];
+    feature_t anchor[RSID_FEATURES_VECTOR_ALLOC_SIZE];
+    uint32_t vec_length;
+    AdaptiveThresholds thresholds;
+};
+
+// random feature of the given kind: 0 in range, 1 a range limit, 2 zero, 3 out of range.
+static int adaptive_feature(Random& rnd, int kind)
+{
+    switch (kind)
+    {
+    case 0:
+        return rnd.Range(RSID_MIN_FEATURE_VALUE, RSID_MAX_FEATURE_VALUE);
+    case 1:
+        return rnd.Range(0, 1) == 0 ? RSID_MIN_FEATURE_VALUE : RSID_MAX_FEATURE_VALUE;
+    case 2:
+        return 0;
+    default:
+        return rnd.Range(-OutOfRangeFeatureValue, OutOfRangeFeatureValue);
+    }
+}
+
+// anchor of any kind (see adaptive_feature()), and an adaptive vector close to it (few blends), negated (many blends,
+// up to the limit) or of any kind. lengths up to the alloc size (over 512 the score stays 0), thresholds from
+// immediately met to unreachable, and the mask (400 iterations) and no-mask (100 iterations) limits.
+static AdaptiveCase make_adaptive_case(Random& rnd)
+{
+    AdaptiveCase c;
+    c.vec_length = static_cast<uint32_t>(rnd.Range(1, RSID_FEATURES_VECTOR_ALLOC_SIZE));
+    c.thresholds = AdaptiveThresholds {};
+    c.thresholds.activeConfig = static_cast<ThresholdsConfigEnum>(rnd.Range(0, ThresholdsConfigEnum::NumThresholdConfigs - 1));
+    c.thresholds.activeIdenticalThreshold =
+        static_cast<short>(rnd.Range(0, 1) == 0 ? RSID_IDENTICAL_THRESHOLD_GM_GNM_HIGH_CONFIDENCE_LEVEL : rnd.Range(0, 4200));
+
+    const int anchor_kind = rnd.Range(0, 3);
+    const int adaptive_kind = rnd.Range(0, 5);
+    const int amplitude = rnd.Range(1, 400);
+    for (size_t i = 0; i < RSID_FEATURES_VECTOR_ALLOC_SIZE; i++)
+    {
+        const int anchor = adaptive_feature(rnd, anchor_kind);
+        int adaptive = 0;
+        if (adaptive_kind == 4)
+        {
+            adaptive = std::max(-OutOfRangeFeatureValue, std::min(OutOfRangeFeatureValue, anchor + rnd.Range(-amplitude, amplitude)));
+        }
+        else if (adaptive_kind == 5)
+        {
+            adaptive = -anchor;
+        }
+        else
+        {
+            adaptive = adaptive_feature(rnd, adaptive_kind);
+        }
+        c.anchor[i] = static_cast<feature_t>(anchor);
+        c.adaptive[i] = static_cast<feature_t>(adaptive);
+    }
+    return c;
+}
+
+static bool in_feature_range(const feature_t* vec, uint32_t vec_length)
+{
+    return std::all_of(vec, vec + vec_length, [](feature_t x) { return x >= RSID_MIN_FEATURE_VALUE && x <= RSID_MAX_FEATURE_VALUE; });
+}
+
+// the single pass adaptive update of every available kernel isa vs. the old loop (see reference_limit()) on random
+// cases: the final vectors and results of Matcher::LimitAdaptiveVector() must be identical, and a blend_sums step must
+// give the vector and the sums of a reference blend (the simd kernels only in the validated range, as in
+// LimitAdaptiveVector()).
+// returns false if any isa differs.
+static bool check_adaptive_update(BenchRunner& runner, const Args& args)
+{
+    if (!runner.Enabled("AdaptiveUpdate"))
+    {
+        return true;
+    }
+
+    Random rnd(args.seed);
+    std::vector<AdaptiveCase> cases;
+    for (size_t i = 0; i < AdaptiveUpdateCases; i++)
+    {
+        cases.push_back(make_adaptive_case(rnd));
+    }
+
+    // the scores of vectors over 512 features are refused with an error log, on every iteration.
+    RealSenseID::SetLogCallback(log_to_cerr, LogLevel::Off, false);
+
+    // the reference scores with the scalar kernels.
+    const auto active = MatcherKernels::Active().isa;
+    const auto* scalar = MatcherKernels::Get(MatcherKernels::KernelIsa::Scalar);
+    MatcherKernels::Select(MatcherKernels::KernelIsa::Scalar);
+    std::vector<AdaptiveCase> expected = cases;
+    std::vector<bool> expected_ok;
+    for (auto& c : expected)
+    {
+        expected_ok.push_back(reference_limit(c.adaptive, c.anchor, c.thresholds, c.vec_length));
+    }
+
+    std::printf("\n%-12s %12s %12s\n", "kernel", "blend_sums", "limit");
+    bool all_identical = true;
+    for (int isa = 0; isa < static_cast<int>(MatcherKernels::KernelIsa::NumKernelIsas); isa++)
+    {
+        const auto* table = MatcherKernels::Get(static_cast<MatcherKernels::KernelIsa>(isa));
+        if (table == nullptr)
+        {
+            continue;
+        }
+        MatcherKernels::Select(table->isa);
+
+        size_t num_blend = 0, total_blend = 0, num_limit = 0;
+        for (size_t i = 0; i < cases.size(); i++)
+        {
+            const auto& c = cases[i];
+            const size_t bytes = c.vec_length * sizeof(feature_t);
+            if (table == scalar || (in_feature_range(c.adaptive, c.vec_length) && in_feature_range(c.anchor, c.vec_length)))
+            {
+                feature_t expected_blend[RSID_FEATURES_VECTOR_ALLOC_SIZE], blend[RSID_FEATURES_VECTOR_ALLOC_SIZE];
+                ::memcpy(expected_blend, c.adaptive, bytes);
+                ::memcpy(blend, c.adaptive, bytes);
+                reference_blend(expected_blend, c.anchor, c.vec_length);
+                MatcherKernels::NccSums expected_sums, sums;
+                scalar->ncc_sums(expected_blend, c.anchor, c.vec_length, expected_sums);
+                scalar->ncc_sums(c.adaptive, c.anchor, c.vec_length, sums);
+                const bool expected_changed = ::memcmp(expected_blend, c.adaptive, bytes) != 0;
+                const bool changed = table->blend_sums(blend, c.anchor, c.vec_length, sums);
+                num_blend += (changed == expected_changed && ::memcmp(expected_blend, blend, bytes) == 0 &&
+                              expected_sums.corr == sums.corr && expected_sums.norm1 == sums.norm1)
+                                 ? 1
+                                 : 0;
+                total_blend++;
+            }
+
+            AdaptiveCase result = c;
+            const bool ok = Matcher::LimitAdaptiveVector(result.adaptive, result.anchor, result.thresholds, result.vec_length);
+            num_limit += (ok == expected_ok[i] && ::memcmp(result.adaptive, expected[i].adaptive, sizeof(result.adaptive)) == 0) ? 1 : 0;
+        }
+
+        all_identical &= num_blend == total_blend && num_limit == cases.size();
+        std::string blend_ratio = std::to_string(num_blend) + "/" + std::to_string(total_blend);
+        std::string limit_ratio = std::to_string(num_limit) + "/" + std::to_string(cases.size());
+        std::printf("%-12s %12s %12s\n", table->name, blend_ratio.c_str(), limit_ratio.c_str());
+    }
+    MatcherKernels::Select(active);
+    RealSenseID::SetLogCallback(log_to_cerr, LogLevel::Error, false);
+    std::fflush(stdout);
+    return all_identical;
+}
+
+// byte compare of the faceprints fields. DBFaceprintsElement is not packed, so its tail padding (not copied by an
+// assignment) is left out.
+static bool same_faceprints(const Faceprints& a, const Faceprints& b)
+{
+    const size_t size = offsetof(DBFaceprintsElement, enrollmentDescriptor) + sizeof(a.data.enrollmentDescriptor);
+    return ::memcmp(&a.data, &b.data, size) == 0;
+}
+
+// accuracy of the PackedGallery encodings vs. FaceprintGallery on the benchmark probes: the packed scan must give the
+// same results, the int8 pass is measured (recall of the exact best match and int8 score error).
+// returns false if the packed results differ.
+static bool check_packed_gallery(BenchRunner& runner, const Args& args, const std::vector<Faceprints>& gallery,
+                                 const std::vector<MatchElement>& probes)
+{
+    if (!runner.Enabled("PackedGallery"))
+    {
+        return true;
+    }
+
+    std::printf("\n%-9s %10s %10s %12s %12s %10s %10s %10s\n", "size", "bytes/user", "int8 b/u", "lossless", "recall@1",
+                "recall@16", "err mean", "err max");
+    bool all_identical = true;
+    const auto confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+    for (size_t size : args.sizes)
+    {
+        if (size > args.max_gallery_size)
+        {
+            continue;
+        }
+
+        FaceprintGallery faceprint_gallery;
+        PackedGallery packed_gallery, quantized_gallery(true);
+        for (size_t user = 0; user < size; user++)
+        {
+            std::string user_id = "user" + std::to_string(user);
+            faceprint_gallery.Set(user_id.c_str(), gallery[user]);
+            packed_gallery.Set(user_id.c_str(), gallery[user]);
+            quantized_gallery.Set(user_id.c_str(), gallery[user]);
+        }
+
+        size_t num_identical = 0;
+        for (const auto& probe : probes)
+        {
+            Faceprints expected_updated, packed_updated;
+            auto expected = Matcher::MatchFaceprintsToArray(probe, faceprint_gallery, expected_updated, confidence);
+            auto packed = Matcher::MatchFaceprintsToArray(probe, packed_gallery, packed_updated, confidence);
+            bool identical = expected.userId == packed.userId && expected.maxScore == packed.maxScore &&
+                             expected.isSame == packed.isSame && expected.should_update == packed.should_update &&
+                             (!expected.should_update || same_faceprints(expected_updated, packed_updated));
+            num_identical += identical ? 1 : 0;
+        }
+        all_identical &= (num_identical == probes.size());
+
+        auto recall_1 = Matcher::MeasurePrefilterRecall(probes, quantized_gallery, 1);
+        auto recall_rescore = Matcher::MeasurePrefilterRecall(probes, quantized_gallery, QuantizedRescore);
+        std::string lossless = std::to_string(num_identical) + "/" + std::to_string(probes.size());
+        std::printf("%-9zu %10zu %10zu %12s %12.4f %10.4f %10.1f %10d\n", size, packed_gallery.MemoryBytes() / size,
+                    quantized_gallery.MemoryBytes() / size, lossless.c_str(), recall_1.recall, recall_rescore.recall,
+                    recall_rescore.mean_score_error, recall_rescore.max_score_error);
+    }
+    std::fflush(stdout);
+    return all_identical;
+}
+
+static bool same_result(const ExtendedMatchResult& a, const Faceprints& a_updated, const ExtendedMatchResult& b,
+                        const Faceprints& b_updated)
+{
+    return a.userId == b.userId && a.maxScore == b.maxScore && a.isSame == b.isSame && a.should_update == b.should_update &&
+           (!a.should_update || same_faceprints(a_updated, b_updated));
+}
+
+// conformance of every registered matcher engine with the "reference" engine on the benchmark probes: 1:1, 1:N, batch
+// and the adaptive update steps must give identical results.
+// returns false if any engine differs.
+static bool check_matcher_engines(BenchRunner& runner, const Args& args, const std::vector<Faceprints>& gallery,
+                                  const std::vector<MatchElement>& probes)
+{
+    if (!runner.Enabled("MatcherEngine"))
+    {
+        return true;
+    }
+
+    auto* reference = MatcherEngineRegistry::Get(MatcherEngineRegistry::ReferenceEngine);
+    std::printf("\n%-12s %-9s %10s %10s %10s %10s %10s\n", "engine", "size", "1:1", "1:N", "batch", "blend", "limit");
+    bool all_identical = true;
+    const auto confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+    AdaptiveThresholds thresholds {};
+    thresholds.activeConfig = ThresholdsConfigEnum::ThresholdConfig_pM_gNM;
+    thresholds.activeIdenticalThreshold = RSID_IDENTICAL_THRESHOLD_GM_GNM_HIGH_CONFIDENCE_LEVEL;
+    for (size_t size : args.sizes)
+    {
+        if (size > args.max_gallery_size)
+        {
+            continue;
+        }
+
+        std::vector<UserFaceprints_t> users(size);
+        for (size_t user = 0; user < size; user++)
+        {
+            std::snprintf(users[user].user_id, sizeof(users[user].user_id), "user%zu", user);
+            users[user].faceprints = gallery[user];
+        }
+
+        // the batch of every engine (the reference too) must give the single probe results of the reference.
+        std::vector<ExtendedMatchResult> expected_batch(probes.size());
+        std::vector<Faceprints> expected_batch_updated(probes.size());
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            expected_batch[i] = reference->MatchFaceprintsToArray(probes[i], users, expected_batch_updated[i], confidence);
+        }
+
+        for (const auto& name : MatcherEngineRegistry::Names())
+        {
+            auto* engine = MatcherEngineRegistry::Get(name.c_str());
+            size_t num_1_1 = 0, num_1_n = 0, num_batch = 0, num_blend = 0, num_limit = 0;
+            for (size_t i = 0; i < probes.size(); i++)
+            {
+                const auto& probe = probes[i];
+                const auto& user = gallery[i % size];
+                Faceprints expected_updated, updated;
+
+                auto expected = reference->MatchFaceprints(probe, user, expected_updated, confidence);
+                auto result = engine->MatchFaceprints(probe, user, updated, confidence);
+                num_1_1 += (expected.success == result.success && expected.should_update == result.should_update &&
+                            expected.score == result.score &&
+                            (!expected.should_update || same_faceprints(expected_updated, updated)))
+                               ? 1
+                               : 0;
+
+                auto expected_array = reference->MatchFaceprintsToArray(probe, users, expected_updated, confidence);
+                auto result_array = engine->MatchFaceprintsToArray(probe, users, updated, confidence);
+                num_1_n += same_result(expected_array, expected_updated, result_array, updated) ? 1 : 0;
+
+                Faceprints expected_blend = user, blend = user;
+                reference->BlendAverageVector(expected_blend.data.adaptiveDescriptorWithoutMask, probe.data.featuresVector);
+                engine->BlendAverageVector(blend.data.adaptiveDescriptorWithoutMask, probe.data.featuresVector);
+                num_blend += same_faceprints(expected_blend, blend) ? 1 : 0;
+
+                feature_t expected_limit[RSID_FEATURES_VECTOR_ALLOC_SIZE], limit[RSID_FEATURES_VECTOR_ALLOC_SIZE];
+                ::memcpy(expected_limit, probe.data.featuresVector, sizeof(expected_limit));
+                ::memcpy(limit, probe.data.featuresVector, sizeof(limit));
+                bool expected_ok = reference->LimitAdaptiveVector(expected_limit, user.data.adaptiveDescriptorWithoutMask, thresholds);
+                bool ok = engine->LimitAdaptiveVector(limit, user.data.adaptiveDescriptorWithoutMask, thresholds);
+                num_limit += (expected_ok == ok && ::memcmp(expected_limit, limit, sizeof(limit)) == 0) ? 1 : 0;
+            }
+
+            std::vector<ExtendedMatchResult> batch;
+            std::vector<Faceprints> batch_updated;
+            engine->MatchFaceprintsBatchToArray(probes, users, batch, batch_updated, confidence);
+            for (size_t i = 0; i < probes.size() && i < batch.size() && i < batch_updated.size(); i++)
+            {
+                num_batch += same_result(expected_batch[i], expected_batch_updated[i], batch[i], batch_updated[i]) ? 1 : 0;
+            }
+
+            const size_t total = probes.size();
+            all_identical &= num_1_1 == total && num_1_n == total && num_batch == total && num_blend == total && num_limit == total;
+            auto ratio = [&](size_t n) { return std::to_string(n) + "/" + std::to_string(total); };
+            std::printf("%-12s %-9zu %10s %10s %10s %10s %10s\n", name.c_str(), size, ratio(num_1_1).c_str(), ratio(num_1_n).c_str(),
+                        ratio(num_batch).c_str(), ratio(num_blend).c_str(), ratio(num_limit).c_str());
+        }
+    }
+    std::fflush(stdout);
+    return all_identical;
+}
+
+// 1:N match of every gallery size vs. a GalleryFile streamed from --gallery-file: raw scan and match throughput with the
+// file in the page cache ("cached") and read from the storage device ("device", pages dropped as they are scanned), and
+// a batch of all probes in a single pass. the results must be the same as the in-memory array scan.
+// returns false if they differ.
+static bool bench_gallery_file(BenchRunner& runner, const Args& args, const std::vector<Faceprints>& gallery,
+                               const std::vector<MatchElement>& probes)
+{
+    if (args.gallery_file.empty() || !runner.Enabled("GalleryFile"))
+    {
+        return true;
+    }
+
+    std::unique_ptr<MatcherThreadPool> pool;
+    if (args.threads > 1)
+    {
+        pool.reset(new MatcherThreadPool(args.threads));
+    }
+
+    struct Accuracy
+    {
+        size_t size;
+        uint64_t file_bytes;
+        double device_read_bytes_per_sec;
+        size_t num_identical;
+        size_t num_batch_identical;
+    };
+    std::vector<Accuracy> accuracy;
+    const char* path = args.gallery_file.c_str();
+    const auto confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+    for (size_t size : args.sizes)
+    {
+        GalleryFileWriter writer;
+        bool written = writer.Open(path);
+        for (size_t user = 0; written && user < size; user++)
+        {
+            written = writer.Append(("user" + std::to_string(user)).c_str(), gallery[user]);
+        }
+        if (!writer.Close() || !written)
+        {
+            throw std::runtime_error("failed writing " + args.gallery_file);
+        }
+
+        GalleryFile cached_file, device_file(GalleryFile::DefaultChunkRecords, true);
+        if (!cached_file.Open(path) || !device_file.Open(path))
+        {
+            throw std::runtime_error("failed opening " + args.gallery_file);
+        }
+        const double bytes = static_cast<double>(cached_file.FileBytes());
+        auto no_op = [](const GalleryFile::Chunk&) { return true; };
+
+        Faceprints updated;
+        runner.Run("GalleryFileScan", "cached", size, 0, bytes, [&](uint64_t) { cached_file.Scan(no_op); });
+        runner.Run("GalleryFileMatch", "cached", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], cached_file, updated, confidence, pool.get());
+        });
+
+        device_file.DropCache();
+        runner.Run("GalleryFileScan", "device", size, 0, bytes, [&](uint64_t) { device_file.Scan(no_op); });
+        runner.Run("GalleryFileMatch", "device", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], device_file, updated, confidence, pool.get());
+        });
+
+        std::vector<ExtendedMatchResult> batch;
+        std::vector<Faceprints> batch_updated;
+        runner.Run("GalleryFileMatch", "batch64_device", size, static_cast<double>(NumProbes * size), bytes, [&](uint64_t) {
+            Matcher::MatchFaceprintsBatchToArray(probes, device_file, batch, batch_updated, confidence, pool.get());
+        });
+
+        GalleryFileScanStats stats;
+        device_file.DropCache();
+        device_file.Scan(no_op, &stats);
+
+        Accuracy row {size, cached_file.FileBytes(), static_cast<double>(stats.bytes_read) / stats.elapsed_seconds, 0, 0};
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            Faceprints expected_updated, file_updated;
+            auto expected = Matcher::MatchFaceprintsToArray(probes[i], gallery.data(), size, expected_updated, confidence);
+            auto result = Matcher::MatchFaceprintsToArray(probes[i], cached_file, file_updated, confidence);
+            row.num_identical += same_result(expected, expected_updated, result, file_updated) ? 1 : 0;
+            row.num_batch_identical += same_result(expected, expected_updated, batch[i], batch_updated[i]) ? 1 : 0;
+        }
+        accuracy.push_back(row);
+    }
+    std::remove(path);
+
+    bool all_identical = true;
+    std::printf("\n%-9s %12s %14s %12s %12s\n", "size", "file MB", "device MB/s", "identical", "batch");
+    for (const auto& row : accuracy)
+    {
+        all_identical &= row.num_identical == probes.size() && row.num_batch_identical == probes.size();
+        std::string identical = std::to_string(row.num_identical) + "/" + std::to_string(probes.size());
+        std::string batch_identical = std::to_string(row.num_batch_identical) + "/" + std::to_string(probes.size());
+        std::printf("%-9zu %12.1f %14.1f %12s %12s\n", row.size, static_cast<double>(row.file_bytes) / 1e6,
+                    row.device_read_bytes_per_sec / 1e6, identical.c_str(), batch_identical.c_str());
+    }
+    std::fflush(stdout);
+    return all_identical;
+}
+
+// 1:N match of a ShardedGallery (node local shards and pinned threads) vs. a FaceprintGallery allocated by this thread
+// and scanned by an unpinned pool of the same number of threads, single and batched. on a multi-socket host the
+// baseline runs at remote memory bandwidth on half of the threads. the sharded results must be the same as the
+// baseline's. returns false if they differ.
+static bool bench_sharded_gallery(BenchRunner& runner, const Args& args, const std::vector<Faceprints>& gallery,
+                                  const std::vector<MatchElement>& probes)
+{
+    const char* name = "ShardedGallery";
+    if (!runner.Enabled(name))
+    {
+        return true;
+    }
+
+    ShardedGalleryOptions options;
+    options.num_shards = args.shards;
+    ShardedGalleryOptions huge_options = options;
+    huge_options.huge_pages = true;
+    ShardedGallery sharded(options), sharded_huge(huge_options);
+    unsigned int num_threads = 0;
+    for (size_t shard = 0; shard < sharded.NumShards(); shard++)
+    {
+        num_threads += sharded.ShardPool(shard).GetNumThreads();
+    }
+    MatcherThreadPool pool(num_threads);
+
+    struct Accuracy
+    {
+        size_t size;
+        size_t num_identical;
+        size_t num_batch_identical;
+    };
+    std::vector<Accuracy> accuracy;
+    const auto confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+    for (size_t size : args.sizes)
+    {
+        if (size > args.max_gallery_size)
+        {
+            continue;
+        }
+
+        std::vector<std::string> user_ids(size);
+        for (size_t user = 0; user < size; user++)
+        {
+            user_ids[user] = "user" + std::to_string(user);
+        }
+        std::vector<Faceprints> faceprints(gallery.begin(), gallery.begin() + size);
+        sharded.Clear();
+        sharded_huge.Clear();
+        sharded.Set(user_ids, faceprints);
+        sharded_huge.Set(user_ids, faceprints);
+
+        // the baseline holds the users in shard order, so its slots are the sharded global indexes.
+        FaceprintGallery baseline;
+        baseline.Reserve(size);
+        for (size_t index = 0; index < size; index++)
+        {
+            baseline.Set(sharded.GetUserId(index), sharded.GetFaceprints(index));
+        }
+
+        Faceprints updated;
+        const double bytes = static_cast<double>(size * DescriptorBytes);
+        runner.Run(name, "baseline_pool", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], baseline, updated, confidence, &pool);
+        });
+        runner.Run(name, "sharded", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], sharded, updated, confidence);
+        });
+        runner.Run(name, "sharded_huge", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], sharded_huge, updated, confidence);
+        });
+
+        std::vector<ExtendedMatchResult> expected_batch, batch;
+        std::vector<Faceprints> expected_batch_updated, batch_updated;
+        const double batch_matches = static_cast<double>(NumProbes * size);
+        runner.Run(name, "baseline_batch64", size, batch_matches, bytes, [&](uint64_t) {
+            Matcher::MatchFaceprintsBatchToArray(probes, baseline, expected_batch, expected_batch_updated, confidence, &pool);
+        });
+        runner.Run(name, "sharded_batch64", size, batch_matches, bytes, [&](uint64_t) {
+            Matcher::MatchFaceprintsBatchToArray(probes, sharded, batch, batch_updated, confidence);
+        });
+
+        Accuracy row {size, 0, 0};
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            Faceprints expected_updated, sharded_updated;
+            auto expected = Matcher::MatchFaceprintsToArray(probes[i], baseline, expected_updated, confidence);
+            auto result = Matcher::MatchFaceprintsToArray(probes[i], sharded, sharded_updated, confidence);
+            row.num_identical += same_result(expected, expected_updated, result, sharded_updated) ? 1 : 0;
+            row.num_batch_identical += same_result(expected_batch[i], expected_batch_updated[i], batch[i], batch_updated[i]) ? 1 : 0;
+        }
+        accuracy.push_back(row);
+    }
+
+    bool all_identical = true;
+    std::printf("\nNUMA nodes: %zu, shards: %zu, threads: %u, pinned: %s\n", NumaTopology::NodeCpus().size(), sharded.NumShards(),
+                num_threads, sharded.IsPinned() ? "yes" : "no");
+    std::printf("%-9s %12s %12s\n", "size", "identical", "batch");
+    for (const auto& row : accuracy)
+    {
+        all_identical &= row.num_identical == probes.size() && row.num_batch_identical == probes.size();
+        std::string identical = std::to_string(row.num_identical) + "/" + std::to_string(probes.size());
+        std::string batch_identical = std::to_string(row.num_batch_identical) + "/" + std::to_string(probes.size());
+        std::printf("%-9zu %12s %12s\n", row.size, identical.c_str(), batch_identical.c_str());
+    }
+    std::fflush(stdout);
+    return all_identical;
+}
+
+// restart cost of a gallery: loading a GalleryFile into a FaceprintGallery (as rsid-match-server does) vs. mapping a
+// MappedGallery, with and without checking its checksums, and the time to the first match after a restart. then 1:N
+// match of the mapping vs. the FaceprintGallery it was written from, whose results it must match. returns false if
+// they differ.
+static bool bench_mapped_gallery(BenchRunner& runner, const Args& args, const std::vector<Faceprints>& gallery,
+                                 const std::vector<MatchElement>& probes)
+{
+    const char* name = "MappedGallery";
+    if (args.mapped_file.empty() || !runner.Enabled(name))
+    {
+        return true;
+    }
+
+    std::unique_ptr<MatcherThreadPool> pool;
+    if (args.threads > 1)
+    {
+        pool.reset(new MatcherThreadPool(args.threads));
+    }
+
+    struct Accuracy
+    {
+        size_t size;
+        uint64_t file_bytes;
+        size_t num_found;
+        size_t num_identical;
+        size_t num_batch_identical;
+    };
+    std::vector<Accuracy> accuracy;
+    const std::string db_path = args.mapped_file + ".db";
+    const char* path = args.mapped_file.c_str();
+    const auto confidence = ThresholdsConfidenceEnum::ThresholdsConfidenceLevel_High;
+    for (size_t size : args.sizes)
+    {
+        if (size > args.max_gallery_size)
+        {
+            continue;
+        }
+
+        FaceprintGallery faceprint_gallery;
+        faceprint_gallery.Reserve(size);
+        for (size_t user = 0; user < size; user++)
+        {
+            faceprint_gallery.Set(("user" + std::to_string(user)).c_str(), gallery[user]);
+        }
+        if (!MappedGallery::Write(path, faceprint_gallery) || !GalleryFile::Write(db_path.c_str(), faceprint_gallery))
+        {
+            throw std::runtime_error("failed writing " + args.mapped_file);
+        }
+
+        MappedGallery mapped;
+        GalleryFile db_file;
+        if (!mapped.Open(path) || !db_file.Open(db_path.c_str()))
+        {
+            throw std::runtime_error("failed opening " + args.mapped_file);
+        }
+        const double mapped_bytes = static_cast<double>(mapped.FileBytes());
+
+        Faceprints updated;
+        runner.Run("MappedGalleryLoad", "db_to_gallery", size, 0, static_cast<double>(db_file.FileBytes()), [&](uint64_t) {
+            FaceprintGallery loaded;
+            loaded.Reserve(size);
+            db_file.Scan([&](const GalleryFile::Chunk& chunk) {
+                for (size_t i = 0; i < chunk.count; i++)
+                {
+                    loaded.Set(GalleryFile::GetUserId(chunk.records[i]).c_str(), chunk.faceprints[i]);
+                }
+                return true;
+            });
+        });
+        runner.Run("MappedGalleryLoad", "mapped_open", size, 0, mapped_bytes, [&](uint64_t) {
+            MappedGallery reopened;
+            reopened.Open(path);
+        });
+        runner.Run("MappedGalleryLoad", "mapped_verify", size, 0, mapped_bytes, [&](uint64_t) {
+            MappedGallery reopened;
+            reopened.Open(path, true);
+        });
+        runner.Run("MappedGalleryLoad", "mapped_1st_match", size, static_cast<double>(size), mapped_bytes, [&](uint64_t i) {
+            MappedGallery reopened;
+            reopened.Open(path);
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], reopened, updated, confidence, pool.get());
+        });
+
+        const double bytes = static_cast<double>(size * DescriptorBytes);
+        runner.Run(name, "gallery", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], faceprint_gallery, updated, confidence, pool.get());
+        });
+        runner.Run(name, "mapped", size, static_cast<double>(size), bytes, [&](uint64_t i) {
+            Matcher::MatchFaceprintsToArray(probes[i % NumProbes], mapped, updated, confidence, pool.get());
+        });
+
+        std::vector<ExtendedMatchResult> batch;
+        std::vector<Faceprints> batch_updated;
+        runner.Run(name, "mapped_batch64", size, static_cast<double>(NumProbes * size), bytes, [&](uint64_t) {
+            Matcher::MatchFaceprintsBatchToArray(probes, mapped, batch, batch_updated, confidence, pool.get());
+        });
+
+        Accuracy row {size, mapped.FileBytes(), 0, 0, 0};
+        for (size_t slot = 0; slot < size; slot++)
+        {
+            row.num_found += (mapped.Find(faceprint_gallery.GetUserId(slot)) == static_cast<int>(slot)) ? 1 : 0;
+        }
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            Faceprints expected_updated, mapped_updated;
+            auto expected = Matcher::MatchFaceprintsToArray(probes[i], faceprint_gallery, expected_updated, confidence);
+            auto result = Matcher::MatchFaceprintsToArray(probes[i], mapped, mapped_updated, confidence);
+            row.num_identical += same_result(expected, expected_updated, result, mapped_updated) ? 1 : 0;
+            row.num_batch_identical += same_result(expected, expected_updated, batch[i], batch_updated[i]) ? 1 : 0;
+        }
+        accuracy.push_back(row);
+    }
+    std::remove(path);
+    std::remove(db_path.c_str());
+
+    bool all_identical = true;
+    std::printf("\n%-9s %12s %12s %12s %12s\n", "size", "file MB", "found", "identical", "batch");
+    for (const auto& row : accuracy)
+    {
+        all_identical &= row.num_found == row.size && row.num_identical == probes.size() && row.num_batch_identical == probes.size();
+        std::string found = std::to_string(row.num_found) + "/" + std::to_string(row.size);
+        std::string identical = std::to_string(row.num_identical) + "/" + std::to_string(probes.size());
+        std::string batch_identical = std::to_string(row.num_batch_identical) + "/" + std::to_string(probes.size());
+        std::printf("%-9zu %12.1f %12s %12s %12s\n", row.size, static_cast<double>(row.file_bytes) / 1e6, found.c_str(), identical.c_str(),
+                    batch_identical.c_str());
+    }
+    std::fflush(stdout);
+    return all_identical;
+}
+
+// gallery of a GalleryFile, empty if there is no file.
+static void load_gallery_file(const std::string& path, FaceprintGallery& gallery)
+{
+    gallery.Clear();
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return;
+    }
+    std::fclose(file);
+
+    GalleryFile gallery_file;
+    bool ok = gallery_file.Open(path.c_str()) && gallery_file.Scan([&](const GalleryFile::Chunk& chunk) {
+        for (size_t i = 0; i < chunk.count; i++)
+        {
+            gallery.Set(GalleryFile::GetUserId(chunk.records[i]).c_str(), chunk.faceprints[i]);
+        }
+        return true;
+    });
+    if (!ok)
+    {
+        throw std::runtime_error("failed reading " + path);
+    }
+}
+
+static void remove_log_files(const std::string& base_path)
+{
+    GalleryLog::RemoveSegments(base_path.c_str());
+    std::remove(base_path.c_str());
+    std::remove((base_path + ".compact").c_str());
+}
+
+// change number sequence of the crash check: a Set, a Remove or an adaptive update (of a single descriptor) of one of
+// LogCrashUsers users, the same for every process. the change is applied to gallery, with the new faceprints in
+// faceprints and, for an update, the faceprints it replaced in previous.
+static constexpr size_t LogCrashUsers = 64;
+
+enum class LogChange
+{
+    Set,
+    Remove,
+    Update
+};
+
+static LogChange apply_log_change(uint64_t seed, uint64_t sequence, FaceprintGallery& gallery, std::string& user_id, Faceprints& faceprints,
+                                   Faceprints& previous)
+{
+    Random rnd(seed * 1000003 + sequence);
+    user_id = "user" + std::to_string(rnd.Next() % LogCrashUsers);
+    int kind = rnd.Range(0, 9);
+    int slot = gallery.Find(user_id.c_str());
+    if (kind == 0)
+    {
+        gallery.Remove(user_id.c_str());
+        return LogChange::Remove;
+    }
+    if (kind <= 3 || slot < 0)
+    {
+        faceprints = Faceprints();
+        make_faceprints(rnd, faceprints);
+        gallery.Set(user_id.c_str(), faceprints);
+        return LogChange::Set;
+    }
+
+    previous = gallery.GetFaceprints(static_cast<size_t>(slot));
+    faceprints = previous;
+    auto& data = faceprints.data;
+    bool with_mask = rnd.Range(0, 1) == 1;
+    feature_t* adaptive = with_mask ? data.adaptiveDescriptorWithMask : data.adaptiveDescriptorWithoutMask;
+    noisy_vector(rnd, data.enrollmentDescriptor, 300, adaptive);
+    adaptive[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = with_mask ? VecFlagValidWithMask : VecFlagValidWithoutMask;
+    gallery.Set(user_id.c_str(), faceprints);
+    return LogChange::Update;
+}
+
+#ifndef _WIN32
+// the process killed by the crash check: recovers the gallery of base_path, then logs the change sequence from where
+// the log ends, syncing every few changes and reporting every synced sequence number on report_fd, until killed.
+static void run_log_child(const std::string& base_path, uint64_t seed, int report_fd)
+{
+    FaceprintGallery gallery;
+    load_gallery_file(base_path, gallery);
+    GalleryLogReplayStats replay;
+    GalleryLogOptions options;
+    options.compact_bytes = 256u << 10; // compactions every few hundred changes, so some are killed too
+    GalleryLog log(options);
+    if (!GalleryLog::Replay(base_path.c_str(), gallery, &replay) || !log.Open(base_path.c_str(), replay.last_sequence + 1))
+    {
+        ::_exit(2);
+    }
+
+    Random rnd(seed + replay.last_sequence);
+    std::string user_id;
+    Faceprints previous, faceprints;
+    for (uint64_t sequence = replay.last_sequence + 1;; sequence++)
+    {
+        uint64_t logged = 0;
+        switch (apply_log_change(seed, sequence, gallery, user_id, faceprints, previous))
+        {
+        case LogChange::Set:
+            logged = log.AppendSet(user_id.c_str(), faceprints);
+            break;
+        case LogChange::Remove:
+            logged = log.AppendRemove(user_id.c_str());
+            break;
+        case LogChange::Update:
+            logged = log.AppendUpdate(user_id.c_str(), previous, faceprints);
+            break;
+        }
+        if (logged != sequence)
+        {
+            ::_exit(3);
+        }
+        if (rnd.Range(0, 7) == 0)
+        {
+            if (!log.Sync(sequence) || ::write(report_fd, &sequence, sizeof(sequence)) != static_cast<ssize_t>(sizeof(sequence)))
+            {
+                ::_exit(4);
+            }
+        }
+    }
+}
+#endif
+
+// write-ahead log of gallery changes: append cost (what the match path pays per adaptive update), a synchronous fsync
+// per change vs. one per 64 changes (group commit), and a crash check: processes logging changes are killed (SIGKILL)
+// at random times, some of them during a compaction, and the recovered gallery must hold every change they synced and
+// equal the change sequence replayed up to the last recovered change. on some rounds the log tail is also cut, as by a
+// torn write. returns false if a recovery differs.
+static bool bench_gallery_log(BenchRunner& runner, const Args& args, const std::vector<Faceprints>& gallery)
+{
+    if (args.log_file.empty() || !runner.Enabled("GalleryLog"))
+    {
+        return true;
+    }
+
+    const std::string& base_path = args.log_file;
+    remove_log_files(base_path);
+    {
+        const size_t num_users = std::min<size_t>(gallery.size(), 1000);
+        GalleryLogOptions options;
+        options.compact_bytes = 0;
+        GalleryLog log(options);
+        if (!log.Open(base_path.c_str()))
+        {
+            throw std::runtime_error("failed opening the log of " + base_path);
+        }
+
+        // an adaptive update: a single descriptor record.
+        Random rnd(args.seed);
+        Faceprints updated = gallery[0];
+        noisy_vector(rnd, gallery[0].data.enrollmentDescriptor, 300, updated.data.adaptiveDescriptorWithoutMask);
+        const double record_bytes = sizeof(GalleryLog::RecordHeader) + sizeof(GalleryLog::VectorPayload);
+        auto user_id = [&](uint64_t i) { return "user" + std::to_string(i % num_users); };
+        runner.Run("GalleryLog", "append_update", num_users, 1, record_bytes,
+                   [&](uint64_t i) { log.AppendUpdate(user_id(i).c_str(), gallery[0], updated); });
+        runner.Run("GalleryLog", "sync_each", num_users, 1, record_bytes,
+                   [&](uint64_t i) { log.Sync(log.AppendUpdate(user_id(i).c_str(), gallery[0], updated)); });
+        runner.Run("GalleryLog", "sync_64", num_users, 64, 64 * record_bytes, [&](uint64_t i) {
+            uint64_t sequence = 0;
+            for (uint64_t j = 0; j < 64; j++)
+            {
+                sequence = log.AppendUpdate(user_id(i * 64 + j).c_str(), gallery[0], updated);
+            }
+            log.Sync(sequence);
+        });
+        log.Close();
+    }
+    remove_log_files(base_path);
+
+#ifdef _WIN32
+    std::printf("\nGalleryLog crash check: not supported on Windows\n");
+    return true;
+#else
+    const int rounds = 16;
+    Random rnd(args.seed);
+    size_t num_durable = 0, num_consistent = 0, num_torn = 0;
+    uint64_t last_sequence = 0;
+    bool child_failed = false;
+    for (int round = 0; round < rounds; round++)
+    {
+        int report[2];
+        if (::pipe(report) != 0)
+        {
+            throw std::runtime_error("failed creating a pipe");
+        }
+        std::fflush(stdout);
+        pid_t pid = ::fork();
+        if (pid < 0)
+        {
+            throw std::runtime_error("failed forking the logging process");
+        }
+        if (pid == 0)
+        {
+            ::close(report[0]);
+            run_log_child(base_path, args.seed, report[1]);
+            ::_exit(1);
+        }
+
+        ::close(report[1]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(rnd.Range(20, 200)));
+        ::kill(pid, SIGKILL);
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        child_failed |= !(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+
+        uint64_t durable = 0, sequence = 0;
+        while (::read(report[0], &sequence, sizeof(sequence)) == static_cast<ssize_t>(sizeof(sequence)))
+        {
+            durable = std::max(durable, sequence);
+        }
+        ::close(report[0]);
+
+        // every fourth round, cut the end of the newest segment (keeping its header), as a torn write would.
+        bool torn = false;
+        auto segments = GalleryLog::SegmentIndexes(base_path.c_str());
+        if (round % 4 == 3 && !segments.empty())
+        {
+            std::string path = GalleryLog::SegmentPath(base_path.c_str(), segments.back());
+            struct stat st;
+            const off_t min_size = sizeof(GalleryLog::SegmentHeader);
+            if (::stat(path.c_str(), &st) == 0 && st.st_size > min_size)
+            {
+                off_t size = std::max<off_t>(min_size, st.st_size - rnd.Range(1, 4000));
+                torn = ::truncate(path.c_str(), size) == 0;
+            }
+        }
+
+        FaceprintGallery recovered, expected;
+        load_gallery_file(base_path, recovered);
+        GalleryLogReplayStats replay;
+        if (!GalleryLog::Replay(base_path.c_str(), recovered, &replay))
+        {
+            throw std::runtime_error("failed replaying the log of " + base_path);
+        }
+        std::string user_id;
+        Faceprints faceprints, previous;
+        for (uint64_t n = 1; n <= replay.last_sequence; n++)
+        {
+            apply_log_change(args.seed, n, expected, user_id, faceprints, previous);
+        }
+        bool consistent = recovered.Size() == expected.Size();
+        for (size_t slot = 0; consistent && slot < expected.Size(); slot++)
+        {
+            int recovered_slot = recovered.Find(expected.GetUserId(slot));
+            consistent = recovered_slot >= 0 &&
+                         same_faceprints(recovered.GetFaceprints(static_cast<size_t>(recovered_slot)), expected.GetFaceprints(slot));
+        }
+        num_consistent += consistent ? 1 : 0;
+        num_durable += (torn || replay.last_sequence >= durable) ? 1 : 0;
+        num_torn += torn ? 1 : 0;
+        last_sequence = replay.last_sequence;
+    }
+    remove_log_files(base_path);
+
+    std::printf("\n%-9s %12s %12s %12s %12s\n", "rounds", "changes", "torn", "durable", "consistent");
+    std::string durable = std::to_string(num_durable) + "/" + std::to_string(rounds);
+    std::string consistent = std::to_string(num_consistent) + "/" + std::to_string(rounds);
+    std::printf("%-9d %12llu %12zu %12s %12s\n", rounds, static_cast<unsigned long long>(last_sequence), num_torn, durable.c_str(),
+                consistent.c_str());
+    std::fflush(stdout);
+    return !child_failed && num_durable == static_cast<size_t>(rounds) && num_consistent == static_cast<size_t>(rounds);
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        auto args = config_from_argv(argc, argv);
+
+        // errors only: the matcher logs every match.
+        RealSenseID::SetLogCallback(log_to_cerr, LogLevel::Error, false);
+
+        if (!args.kernel.empty())
+        {
+            select_kernel(args.kernel);
+        }
+
+        const size_t max_size = args.sizes.back();
+        std::cout << "Generating " << max_size << " synthetic users (seed " << args.seed << ")..." << std::endl;
+        Random rnd(args.seed);
+        std::vector<Faceprints> gallery(max_size);
+        for (auto& faceprints : gallery)
+        {
+            make_faceprints(rnd, faceprints);
+        }
+        auto probes = make_probes(rnd, gallery, max_size);
+
+        const char* kernel = MatcherKernels::Active().name;
+        std::cout << "Kernel: " << kernel << ", threads: " << args.threads << std::endl << std::endl;
+        print_header();
+
+        BenchRunner runner(args);
+        bench_vectors(runner, gallery, probes);
+        bench_match_to_array(runner, args, gallery, probes);
+        bool kernels_ok = check_matcher_kernels(runner, args);
+        bool adaptive_ok = check_adaptive_update(runner, args);
+        bool packed_ok = check_packed_gallery(runner, args, gallery, probes);
+        bool engines_ok = check_matcher_engines(runner, args, gallery, probes);
+        bool gallery_file_ok = bench_gallery_file(runner, args, gallery, probes);
+        bool sharded_ok = bench_sharded_gallery(runner, args, gallery, probes);
+        bool mapped_ok = bench_mapped_gallery(runner, args, gallery, probes);
+        bool log_ok = bench_gallery_log(runner, args, gallery);
+
+        if (!args.json_path.empty())
+        {
+            write_json(args, kernel, runner.Results());
+        }
+        if (!kernels_ok)
+        {
+            std::cerr << "Matcher kernel results differ from the scalar kernels" << std::endl;
+            return 1;
+        }
+        if (!adaptive_ok)
+        {
+            std::cerr << "Adaptive update results differ from the reference loop" << std::endl;
+            return 1;
+        }
+        if (!packed_ok)
+        {
+            std::cerr << "PackedGallery results differ from FaceprintGallery" << std::endl;
+            return 1;
+        }
+        if (!engines_ok)
+        {
+            std::cerr << "Matcher engine results differ from the reference engine" << std::endl;
+            return 1;
+        }
+        if (!gallery_file_ok)
+        {
+            std::cerr << "GalleryFile results differ from the in-memory scan" << std::endl;
+            return 1;
+        }
+        if (!sharded_ok)
+        {
+            std::cerr << "ShardedGallery results differ from FaceprintGallery" << std::endl;
+            return 1;
+        }
+        if (!mapped_ok)
+        {
+            std::cerr << "MappedGallery results differ from FaceprintGallery" << std::endl;
+            return 1;
+        }
+        if (!log_ok)
+        {
+            std::cerr << "GalleryLog recovery differs from the logged changes" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception occurred: " << ex.what() << std::endl;
+        return 1;
+    }
+}
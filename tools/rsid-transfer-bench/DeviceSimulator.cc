@@ -0,0 +1,458 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "DeviceSimulator.h"
+#include "PacketSender.h"
+#include "SerialConnection.h"
+#include "RealSenseID/Status.h"
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace RealSenseID
+{
+using namespace PacketManager;
+
+static constexpr size_t WriteChunk = 64; // bytes written to the terminal at once, at the link rate
+static constexpr int PollMillis = 50;
+
+// the master side of the terminal as a SerialConnection, so the simulator parses the host's packets with PacketSender.
+class PtyConnection : public SerialConnection
+{
+public:
+    PtyConnection(int fd, const std::atomic<bool>& stop) : _fd(fd), _stop(stop)
+    {
+    }
+
+    SerialStatus SendBytes(const char*, size_t) override
+    {
+        return SerialStatus::SendFailed; // replies are written by the writer thread
+    }
+
+    // all n_bytes, or RecvTimeout if the host sends nothing for a second
+    SerialStatus RecvBytes(char* buffer, size_t n_bytes) override
+    {
+        size_t received = 0;
+        auto idle_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (received < n_bytes)
+        {
+            if (_stop || std::chrono::steady_clock::now() > idle_deadline)
+            {
+                return SerialStatus::RecvTimeout;
+            }
+            pollfd pfd {_fd, POLLIN, 0};
+            if (::poll(&pfd, 1, PollMillis) <= 0)
+            {
+                continue;
+            }
+            auto n = ::read(_fd, buffer + received, n_bytes - received);
+            if (n > 0)
+            {
+                received += static_cast<size_t>(n);
+                _received_bytes += static_cast<size_t>(n);
+                idle_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            }
+        }
+        return SerialStatus::Ok;
+    }
+
+    size_t ReceivedBytes() const
+    {
+        return _received_bytes;
+    }
+
+private:
+    int _fd;
+    const std::atomic<bool>& _stop;
+    size_t _received_bytes = 0;
+};
+
+// collects the bytes PacketSender sends
+class BufferConnection : public SerialConnection
+{
+public:
+    SerialStatus SendBytes(const char* buffer, size_t n_bytes) override
+    {
+        bytes.insert(bytes.end(), buffer, buffer + n_bytes);
+        return SerialStatus::Ok;
+    }
+
+    SerialStatus RecvBytes(char*, size_t) override
+    {
+        return SerialStatus::RecvFailed;
+    }
+
+    std::vector<char> bytes;
+};
+
+DeviceSimulator::DeviceSimulator(const DeviceSimulatorOptions& options) : _options(options)
+{
+}
+
+DeviceSimulator::~DeviceSimulator()
+{
+    Stop();
+}
+
+bool DeviceSimulator::Start()
+{
+    _master = ::posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (_master < 0 || ::grantpt(_master) != 0 || ::unlockpt(_master) != 0)
+    {
+        Stop();
+        return false;
+    }
+    const char* name = ::ptsname(_master);
+    _slave = name != nullptr ? ::open(name, O_RDWR | O_NOCTTY) : -1;
+    if (_slave < 0)
+    {
+        Stop();
+        return false;
+    }
+    _port = name;
+
+    // raw terminal: no echo, no line discipline
+    termios options;
+    ::tcgetattr(_slave, &options);
+    ::cfmakeraw(&options);
+    ::tcsetattr(_slave, TCSANOW, &options);
+
+    _stop = false;
+    _stats = DeviceSimulatorStats();
+    _rx_free = _device_free = Clock::now();
+    _reader = std::thread(&DeviceSimulator::ReadLoop, this);
+    _writer = std::thread(&DeviceSimulator::WriteLoop, this);
+    return true;
+}
+
+void DeviceSimulator::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _reply_cv.notify_all();
+    if (_reader.joinable())
+    {
+        _reader.join();
+    }
+    if (_writer.joinable())
+    {
+        _writer.join();
+    }
+    _replies.clear();
+    if (_slave >= 0)
+    {
+        ::close(_slave);
+        _slave = -1;
+    }
+    if (_master >= 0)
+    {
+        ::close(_master);
+        _master = -1;
+    }
+}
+
+const char* DeviceSimulator::Port() const
+{
+    return _port.c_str();
+}
+
+void DeviceSimulator::SetUsers(std::vector<SimulatedUser> users)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _saved_users = users;
+    _users = std::move(users);
+}
+
+std::vector<SimulatedUser> DeviceSimulator::Users() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _users;
+}
+
+std::vector<SimulatedUser> DeviceSimulator::SavedUsers() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _saved_users;
+}
+
+void DeviceSimulator::CorruptFeaturesReply(unsigned int index)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _corrupt_features.push_back(index);
+}
+
+void DeviceSimulator::CorruptSetReply(const std::string& user_id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _corrupt_set.push_back(user_id);
+}
+
+void DeviceSimulator::RejectUser(const std::string& user_id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _rejected.push_back(user_id);
+}
+
+void DeviceSimulator::ClearFaults()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _corrupt_features.clear();
+    _corrupt_set.clear();
+    _rejected.clear();
+}
+
+DeviceSimulatorStats DeviceSimulator::Stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+DeviceSimulator::Clock::duration DeviceSimulator::WireTime(size_t bytes) const
+{
+    if (_options.baudrate == 0)
+    {
+        return Clock::duration::zero();
+    }
+    // 10 bits per byte: start, 8 data bits, stop
+    auto nanos = static_cast<double>(bytes) * 10 * 1e9 / _options.baudrate;
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(static_cast<int64_t>(nanos)));
+}
+
+void DeviceSimulator::ReadLoop()
+{
+    PtyConnection connection(_master, _stop);
+    PacketSender sender(&connection);
+    SerialPacket request;
+    while (!_stop)
+    {
+        // wait for the host, so PacketSender doesn't time out (and log it) while the link is idle
+        pollfd pfd {_master, POLLIN, 0};
+        if (::poll(&pfd, 1, PollMillis) <= 0)
+        {
+            continue;
+        }
+        auto first_byte = Clock::now();
+        auto received_before = connection.ReceivedBytes();
+        if (sender.Recv(request) != SerialStatus::Ok)
+        {
+            continue;
+        }
+        auto request_bytes = connection.ReceivedBytes() - received_before;
+
+        // the request is in once all its bytes went over the wire, and is handled after the requests before it
+        _rx_free = (std::max)(_rx_free, first_byte) + WireTime(request_bytes);
+        _device_free = (std::max)(_rx_free, _device_free) + _options.turnaround;
+        if (request.header.id == MsgId::SaveDatabase)
+        {
+            _device_free += _options.save_time;
+        }
+        auto reply = HandleRequest(request, request_bytes);
+        if (!reply.empty())
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _replies.push_back(Reply {std::move(reply), _device_free});
+        }
+        _reply_cv.notify_one();
+    }
+}
+
+void DeviceSimulator::WriteLoop()
+{
+    auto tx_free = Clock::now();
+    while (true)
+    {
+        Reply reply;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _reply_cv.wait(lock, [this] { return _stop || !_replies.empty(); });
+            if (_stop)
+            {
+                return;
+            }
+            reply = std::move(_replies.front());
+            _replies.pop_front();
+        }
+
+        // each chunk reaches the host once its last byte went over the wire
+        auto start = (std::max)(reply.ready, tx_free);
+        size_t written = 0;
+        while (written < reply.bytes.size() && !_stop)
+        {
+            auto chunk = (std::min)(WriteChunk, reply.bytes.size() - written);
+            std::this_thread::sleep_until(start + WireTime(written + chunk));
+            size_t chunk_written = 0;
+            while (chunk_written < chunk && !_stop)
+            {
+                pollfd pfd {_master, POLLOUT, 0};
+                if (::poll(&pfd, 1, PollMillis) <= 0)
+                {
+                    continue;
+                }
+                auto n = ::write(_master, reply.bytes.data() + written + chunk_written, chunk - chunk_written);
+                if (n > 0)
+                {
+                    chunk_written += static_cast<size_t>(n);
+                }
+            }
+            written += chunk_written;
+        }
+        tx_free = (std::max)(start + WireTime(reply.bytes.size()), Clock::now());
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.tx_bytes += written;
+    }
+}
+
+std::vector<char> DeviceSimulator::Frame(SerialPacket& reply)
+{
+    // replies of a session are numbered from 1, after the StartSession reply
+    if (reply.header.id != MsgId::StartSession)
+    {
+        reply.payload.sequence_number = ++_sequence_number;
+    }
+    BufferConnection buffer;
+    PacketSender sender(&buffer);
+    if (sender.Send(reply) != SerialStatus::Ok)
+    {
+        return {};
+    }
+    return std::move(buffer.bytes);
+}
+
+std::vector<char> DeviceSimulator::HandleRequest(const SerialPacket& request, size_t request_bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.requests++;
+    _stats.rx_bytes += request_bytes;
+
+    const char* data = request.payload.message.data_msg.data;
+    switch (request.header.id)
+    {
+    case MsgId::StartSession: {
+        _sequence_number = 0;
+        DataPacket reply {MsgId::StartSession};
+        return Frame(reply);
+    }
+
+    case MsgId::GetNumberOfUsers: {
+        auto n_users = static_cast<uint32_t>(_users.size());
+        DataPacket reply {MsgId::GetNumberOfUsers, reinterpret_cast<char*>(&n_users), sizeof(n_users)};
+        return Frame(reply);
+    }
+
+    case MsgId::GetUserIds: {
+        // request: first index and max count. reply: count, then the zero delimited ids
+        unsigned int settings[2];
+        ::memcpy(settings, data, sizeof(settings));
+        std::vector<char> ids(sizeof(unsigned int));
+        unsigned int count = 0;
+        for (size_t i = settings[0]; i < _users.size() && count < settings[1]; i++, count++)
+        {
+            const auto& user_id = _users[i].user_id;
+            ids.insert(ids.end(), user_id.c_str(), user_id.c_str() + user_id.size() + 1);
+        }
+        ::memcpy(ids.data(), &count, sizeof(count));
+        DataPacket reply {MsgId::GetUserIds, ids.data(), ids.size()};
+        return Frame(reply);
+    }
+
+    case MsgId::GetUserFeatures: {
+        uint16_t index = 0;
+        ::memcpy(&index, data, sizeof(index));
+        if (index >= _users.size())
+        {
+            FaPacket reply {MsgId::Reply, nullptr, static_cast<char>(Status::Error)};
+            return Frame(reply);
+        }
+        DataPacket reply {MsgId::GetUserFeatures, reinterpret_cast<char*>(&_users[index].faceprints), sizeof(DBFaceprintsElement)};
+        auto bytes = Frame(reply);
+        auto corrupt = std::find(_corrupt_features.begin(), _corrupt_features.end(), index);
+        if (corrupt != _corrupt_features.end() && !bytes.empty())
+        {
+            // a faceprints byte, so the host still reads the whole packet and fails its crc
+            _corrupt_features.erase(corrupt);
+            _stats.corrupted_replies++;
+            bytes[sizeof(reply.header) + sizeof(reply.payload.sequence_number)] ^= 0x5A;
+        }
+        return bytes;
+    }
+
+    case MsgId::SetUserFeatures:
+        return SetUserFeatures(data);
+
+    case MsgId::RemoveUser: {
+        char user_id[MaxUserIdSize + 1];
+        ::memcpy(user_id, request.payload.message.fa_msg.user_id, sizeof(user_id));
+        user_id[MaxUserIdSize] = '\0';
+        auto user = std::find_if(_users.begin(), _users.end(), [&](const SimulatedUser& u) { return u.user_id == user_id; });
+        auto status = user != _users.end() ? Status::Ok : Status::Error;
+        if (user != _users.end())
+        {
+            _users.erase(user);
+        }
+        FaPacket reply {MsgId::Reply, nullptr, static_cast<char>(status)};
+        return Frame(reply);
+    }
+
+    case MsgId::RemoveAllUsers: {
+        _users.clear();
+        FaPacket reply {MsgId::Reply, nullptr, static_cast<char>(Status::Ok)};
+        return Frame(reply);
+    }
+
+    case MsgId::SaveDatabase: {
+        _saved_users = _users;
+        _stats.saves++;
+        FaPacket reply {MsgId::Reply, nullptr, static_cast<char>(Status::Ok)};
+        return Frame(reply);
+    }
+
+    default: {
+        FaPacket reply {MsgId::Reply, nullptr, static_cast<char>(Status::Error)};
+        return Frame(reply);
+    }
+    }
+}
+
+// insert or update a user. request: the user id (MaxUserIdSize + 1 bytes), then the faceprints. called locked.
+std::vector<char> DeviceSimulator::SetUserFeatures(const char* data)
+{
+    char user_id[MaxUserIdSize + 1];
+    ::memcpy(user_id, data, sizeof(user_id));
+    user_id[MaxUserIdSize] = '\0';
+
+    auto status = Status::Ok;
+    if (user_id[0] == '\0' || std::find(_rejected.begin(), _rejected.end(), user_id) != _rejected.end())
+    {
+        status = Status::Error;
+    }
+    else
+    {
+        auto user = std::find_if(_users.begin(), _users.end(), [&](const SimulatedUser& u) { return u.user_id == user_id; });
+        if (user == _users.end())
+        {
+            _users.push_back(SimulatedUser {user_id, DBFaceprintsElement()});
+            user = _users.end() - 1;
+        }
+        ::memcpy(&user->faceprints, data + sizeof(user_id), sizeof(DBFaceprintsElement));
+    }
+
+    FaPacket reply {MsgId::Reply, nullptr, static_cast<char>(status)};
+    auto bytes = Frame(reply);
+    auto corrupt = std::find(_corrupt_set.begin(), _corrupt_set.end(), user_id);
+    if (corrupt != _corrupt_set.end() && !bytes.empty())
+    {
+        _corrupt_set.erase(corrupt);
+        _stats.corrupted_replies++;
+        bytes[sizeof(reply.header) + sizeof(reply.payload.sequence_number)] ^= 0x5A;
+    }
+    return bytes;
+}
+} // namespace RealSenseID
@@ -0,0 +1,129 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include "SerialPacket.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+struct DeviceSimulatorOptions
+{
+    unsigned int baudrate = 115200;             // of both directions of the simulated link (8N1). 0: unlimited
+    std::chrono::microseconds turnaround {2000}; // device time to handle a request, once it has arrived
+    std::chrono::microseconds save_time {200000}; // added to the turnaround of SaveDatabase: the DB is written to flash
+};
+
+struct SimulatedUser
+{
+    std::string user_id;
+    DBFaceprintsElement faceprints;
+};
+
+// counters since DeviceSimulator::Start().
+struct DeviceSimulatorStats
+{
+    uint64_t requests = 0;
+    uint64_t rx_bytes = 0; // from the host
+    uint64_t tx_bytes = 0; // to the host
+    uint64_t corrupted_replies = 0;
+    uint64_t saves = 0;
+};
+
+// Simulated device on a pseudo terminal, for running the host's transfers of the device's DB end to end without a
+// device: connect a FaceAuthenticator to Port().
+//
+// The simulator speaks the non-secure packet protocol (framing, crc and session sequence numbers as in PacketSender)
+// and serves the DB requests - StartSession, GetNumberOfUsers, GetUserIds, GetUserFeatures, SetUserFeatures,
+// RemoveUser, RemoveAllUsers and SaveDatabase - from an in-memory user list. Changes are made to the live DB, and copied
+// to the saved DB (as in the device's flash) by SaveDatabase.
+// The serial link is modelled: every packet takes its bytes' transmission time at the given baudrate in its direction,
+// the device handles one request at a time, and replies are written to the terminal at the link rate, so the host sees
+// the latency and the throughput of a real device on a serial port.
+//
+// Linux only (posix pseudo terminals, and the host side is LinuxSerial).
+class DeviceSimulator
+{
+public:
+    explicit DeviceSimulator(const DeviceSimulatorOptions& options = DeviceSimulatorOptions());
+    ~DeviceSimulator();
+    DeviceSimulator(const DeviceSimulator&) = delete;
+    DeviceSimulator& operator=(const DeviceSimulator&) = delete;
+
+    // open the pseudo terminal and start serving. returns false if the terminal can't be opened.
+    bool Start();
+    void Stop();
+
+    // serial port of the simulated device.
+    const char* Port() const;
+
+    // set both the live and the saved DB.
+    void SetUsers(std::vector<SimulatedUser> users);
+    std::vector<SimulatedUser> Users() const;
+    std::vector<SimulatedUser> SavedUsers() const;
+
+    // corrupt a byte of the reply to the next GetUserFeatures request of user index, as by noise on the link.
+    void CorruptFeaturesReply(unsigned int index);
+
+    // corrupt a byte of the acknowledgement of the next SetUserFeatures request of user_id (the user is set).
+    void CorruptSetReply(const std::string& user_id);
+
+    // reject the SetUserFeatures requests of user_id with Status::Error.
+    void RejectUser(const std::string& user_id);
+
+    // forget the faults of CorruptFeaturesReply(), CorruptSetReply() and RejectUser().
+    void ClearFaults();
+
+    DeviceSimulatorStats Stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Reply
+    {
+        std::vector<char> bytes;
+        Clock::time_point ready; // handled by the device
+    };
+
+    void ReadLoop();
+    void WriteLoop();
+    // the framed reply to request, or nothing if it gets no reply
+    std::vector<char> HandleRequest(const PacketManager::SerialPacket& request, size_t request_bytes);
+    std::vector<char> Frame(PacketManager::SerialPacket& reply);
+    std::vector<char> SetUserFeatures(const char* data);
+    Clock::duration WireTime(size_t bytes) const;
+
+    DeviceSimulatorOptions _options;
+    int _master = -1;
+    int _slave = -1; // kept open, so the terminal stays up while the host reconnects
+    std::string _port;
+    std::thread _reader;
+    std::thread _writer;
+
+    // link model, used by the reader thread only
+    Clock::time_point _rx_free;
+    Clock::time_point _device_free;
+    uint32_t _sequence_number = 0;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _reply_cv;
+    std::deque<Reply> _replies;
+    std::vector<SimulatedUser> _users;
+    std::vector<SimulatedUser> _saved_users;
+    std::vector<unsigned int> _corrupt_features;
+    std::vector<std::string> _corrupt_set;
+    std::vector<std::string> _rejected;
+    DeviceSimulatorStats _stats;
+    std::atomic<bool> _stop {false};
+};
+} // namespace RealSenseID
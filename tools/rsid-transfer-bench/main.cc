@@ -0,0 +1,678 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Device DB transfer benchmarks against a simulated device (no device needed).
+// Usage: rsid-transfer-bench [options], see print_usage().
+//
+// A DeviceSimulator serves a synthetic DB on a pseudo terminal at a simulated baudrate, and a FaceAuthenticator
+// connected to it runs the transfers through the real serial and packet layers. Each transfer reports its time,
+// effective faceprints bytes/sec and link utilization, and its result is checked against the simulated DB (the
+// benchmark exits with an error on any mismatch).
+
+#include "DeviceSimulator.h"
+#include "RealSenseID/FaceAuthenticator.h"
+#include "RealSenseID/FaceprintsSync.h"
+#include "RealSenseID/Logging.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+
+using namespace RealSenseID;
+using Clock = std::chrono::steady_clock;
+
+struct Args
+{
+    size_t users = 50;
+    unsigned int baudrate = 115200;
+    unsigned int turnaround_us = 10000;
+    unsigned int depth = 8;
+    unsigned int import_depth = 2;
+    uint64_t seed = 1;
+};
+
+// xorshift64*
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : _state(seed * 0x9E3779B97F4A7C15ull + 1)
+    {
+    }
+
+    uint64_t Next()
+    {
+        _state ^= _state >> 12;
+        _state ^= _state << 25;
+        _state ^= _state >> 27;
+        return _state * 0x2545F4914F6CDD1Dull;
+    }
+
+    // uniform in [min, max]
+    int Range(int min, int max)
+    {
+        return min + static_cast<int>((Next() >> 32) % static_cast<uint64_t>(max - min + 1));
+    }
+
+private:
+    uint64_t _state;
+};
+
+static constexpr int MaxFeatureValue = 1023; // RSID_MAX_FEATURE_VALUE of the matcher
+
+static void random_vector(Random& rnd, feature_t* vec, int flags)
+{
+    for (size_t i = 0; i < RSID_NUM_OF_RECOGNITION_FEATURES; i++)
+    {
+        vec[i] = static_cast<feature_t>(rnd.Range(-MaxFeatureValue, MaxFeatureValue));
+    }
+    vec[RSID_INDEX_IN_FEATURES_VECTOR_TO_FLAGS] = static_cast<feature_t>(flags);
+}
+
+static std::vector<SimulatedUser> make_users(Random& rnd, size_t count)
+{
+    std::vector<SimulatedUser> users(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        char user_id[32];
+        std::snprintf(user_id, sizeof(user_id), "user-%05zu", i);
+        users[i].user_id = user_id;
+        auto& faceprints = users[i].faceprints;
+        random_vector(rnd, faceprints.enrollmentDescriptor, VecFlagValidWithoutMask);
+        random_vector(rnd, faceprints.adaptiveDescriptorWithoutMask, VecFlagValidWithoutMask);
+        if (rnd.Range(0, 2) == 0)
+        {
+            random_vector(rnd, faceprints.adaptiveDescriptorWithMask, VecFlagValidWithMask);
+        }
+    }
+    return users;
+}
+
+// the fields the device transfers (not the host-only reserved fields and flags)
+static bool same_faceprints(const Faceprints& faceprints, const DBFaceprintsElement& expected)
+{
+    const auto& data = faceprints.data;
+    auto same = [](const feature_t* a, const feature_t* b) {
+        return std::memcmp(a, b, RSID_FEATURES_VECTOR_ALLOC_SIZE * sizeof(feature_t)) == 0;
+    };
+    return data.version == expected.version && data.featuresType == expected.featuresType &&
+           same(data.adaptiveDescriptorWithoutMask, expected.adaptiveDescriptorWithoutMask) &&
+           same(data.adaptiveDescriptorWithMask, expected.adaptiveDescriptorWithMask) &&
+           same(data.enrollmentDescriptor, expected.enrollmentDescriptor);
+}
+
+static bool same_users(const std::vector<Faceprints>& faceprints, const std::vector<SimulatedUser>& users)
+{
+    if (faceprints.size() != users.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < users.size(); i++)
+    {
+        if (!same_faceprints(faceprints[i], users[i].faceprints))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// collects the exported faceprints by index, and stops the export after stop_after users if set.
+class CollectCallback : public FaceprintsExportCallback
+{
+public:
+    explicit CollectCallback(std::vector<Faceprints>& faceprints) : _faceprints(faceprints)
+    {
+    }
+
+    bool OnFaceprints(unsigned int index, const Faceprints& faceprints, const FaceprintsExportStats& stats) override
+    {
+        if (index < _faceprints.size())
+        {
+            _faceprints[index] = faceprints;
+        }
+        return stop_after == 0 || stats.exported_users < stop_after;
+    }
+
+    unsigned int stop_after = 0;
+
+private:
+    std::vector<Faceprints>& _faceprints;
+};
+
+static void print_header()
+{
+    std::printf("%-22s %6s %7s %10s %10s %12s %10s %10s\n", "transfer", "depth", "users", "seconds", "users/s", "bytes/s", "link %",
+                "identical");
+}
+
+static void print_row(const char* name, unsigned int depth, size_t users, double seconds, double bytes, double link_bytes,
+                      const Args& args, bool identical)
+{
+    // share of the link's capacity in the busier (device to host) direction
+    double link_percent = args.baudrate > 0 && seconds > 0 ? 100.0 * link_bytes / (seconds * args.baudrate / 10.0) : 0;
+    double users_per_second = seconds > 0 ? static_cast<double>(users) / seconds : 0;
+    std::printf("%-22s %6u %7zu %10.2f %10.1f %12.0f %10.1f %10s\n", name, depth, users, seconds, users_per_second,
+                seconds > 0 ? bytes / seconds : 0, link_percent, identical ? "yes" : "NO");
+}
+
+// all users with GetUsersFaceprints(), one request at a time.
+static bool bench_get_users_faceprints(FaceAuthenticator& authenticator, DeviceSimulator& simulator, const Args& args)
+{
+    const auto users = simulator.Users();
+    std::vector<Faceprints> faceprints(users.size());
+    auto tx_before = simulator.Stats().tx_bytes;
+    auto start = Clock::now();
+    unsigned int num_of_users = 0;
+    auto status = authenticator.GetUsersFaceprints(faceprints.data(), num_of_users);
+    double seconds = seconds_since(start);
+    auto link_bytes = static_cast<double>(simulator.Stats().tx_bytes - tx_before);
+    bool identical = status == Status::Ok && num_of_users == users.size() && same_users(faceprints, users);
+    print_row("GetUsersFaceprints", 1, users.size(), seconds, static_cast<double>(users.size() * sizeof(DBFaceprintsElement)),
+              link_bytes, args, identical);
+    return identical;
+}
+
+// all users with ExportUsersFaceprints().
+static bool bench_export(FaceAuthenticator& authenticator, DeviceSimulator& simulator, const Args& args, unsigned int depth)
+{
+    const auto users = simulator.Users();
+    std::vector<Faceprints> faceprints(users.size());
+    CollectCallback callback(faceprints);
+    FaceprintsExportStats stats;
+    auto tx_before = simulator.Stats().tx_bytes;
+    auto status = authenticator.ExportUsersFaceprints(callback, 0, depth, &stats);
+    auto link_bytes = static_cast<double>(simulator.Stats().tx_bytes - tx_before);
+    bool identical = status == Status::Ok && stats.exported_users == users.size() && same_users(faceprints, users);
+    print_row("ExportUsersFaceprints", depth, users.size(), stats.seconds, static_cast<double>(stats.bytes), link_bytes, args, identical);
+    return identical;
+}
+
+// an export stopped by its callback, then interrupted by a corrupt reply, resumed each time from stats.next_index: every user
+// must be exported exactly once, and the result must equal the DB.
+static bool check_resume(FaceAuthenticator& authenticator, DeviceSimulator& simulator, const Args& args)
+{
+    const auto users = simulator.Users();
+    const auto n_users = static_cast<unsigned int>(users.size());
+    if (n_users < 4)
+    {
+        return true;
+    }
+    std::vector<Faceprints> faceprints(users.size());
+    CollectCallback callback(faceprints);
+    FaceprintsExportStats stats;
+    unsigned int exported = 0;
+
+    std::printf("\n%-22s %10s %10s %10s %12s\n", "resume", "status", "from", "next", "exported");
+    auto print_step = [](const char* name, Status status, unsigned int from, const FaceprintsExportStats& stats) {
+        std::printf("%-22s %10s %10u %10u %12u\n", name, Description(status), from, stats.next_index, stats.exported_users);
+    };
+
+    // stopped by the callback after a quarter of the users
+    callback.stop_after = n_users / 4;
+    auto status = authenticator.ExportUsersFaceprints(callback, 0, args.depth, &stats);
+    print_step("callback stop", status, 0, stats);
+    bool ok = status == Status::Ok && stats.next_index == n_users / 4;
+    exported += stats.exported_users;
+
+    // interrupted at the half
+    callback.stop_after = 0;
+    simulator.CorruptFeaturesReply(n_users / 2);
+    auto from = stats.next_index;
+    status = authenticator.ExportUsersFaceprints(callback, from, args.depth, &stats);
+    print_step("corrupt reply", status, from, stats);
+    ok = ok && status != Status::Ok && stats.next_index == n_users / 2;
+    exported += stats.exported_users;
+
+    from = stats.next_index;
+    status = authenticator.ExportUsersFaceprints(callback, from, args.depth, &stats);
+    print_step("resumed", status, from, stats);
+    ok = ok && status == Status::Ok && stats.next_index == n_users;
+    exported += stats.exported_users;
+
+    bool identical = ok && exported == n_users && same_users(faceprints, users);
+    std::printf("%-22s %10s\n", "identical", identical ? "yes" : "NO");
+    return identical;
+}
+
+static std::vector<UserFaceprints> to_user_faceprints(const std::vector<SimulatedUser>& users)
+{
+    std::vector<UserFaceprints> user_faceprints(users.size());
+    for (size_t i = 0; i < users.size(); i++)
+    {
+        std::snprintf(user_faceprints[i].user_id, sizeof(user_faceprints[i].user_id), "%s", users[i].user_id.c_str());
+        user_faceprints[i].faceprints.data = users[i].faceprints;
+    }
+    return user_faceprints;
+}
+
+static bool same_db(const std::vector<SimulatedUser>& db, const std::vector<SimulatedUser>& expected)
+{
+    if (db.size() != expected.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < db.size(); i++)
+    {
+        Faceprints faceprints;
+        faceprints.data = db[i].faceprints;
+        if (db[i].user_id != expected[i].user_id || !same_faceprints(faceprints, expected[i].faceprints))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_import_header()
+{
+    std::printf("\n%-22s %6s %7s %10s %10s %12s %10s %10s %10s\n", "import", "depth", "users", "seconds", "users/s", "bytes/s",
+                "link %", "saves", "identical");
+}
+
+static void print_import_row(const char* name, unsigned int depth, size_t users, double seconds, double bytes, double link_bytes,
+                             uint64_t saves, const Args& args, bool identical)
+{
+    // share of the link's capacity in the busier (host to device) direction
+    double link_percent = args.baudrate > 0 && seconds > 0 ? 100.0 * link_bytes / (seconds * args.baudrate / 10.0) : 0;
+    double users_per_second = seconds > 0 ? static_cast<double>(users) / seconds : 0;
+    std::printf("%-22s %6u %7zu %10.2f %10.1f %12.0f %10.1f %10llu %10s\n", name, depth, users, seconds, users_per_second,
+                seconds > 0 ? bytes / seconds : 0, link_percent, static_cast<unsigned long long>(saves), identical ? "yes" : "NO");
+}
+
+// all users into an empty device with SetUsersFaceprints(): chunks of 50 users, each saved, with a 500ms pause after each.
+static bool bench_set_users_faceprints(FaceAuthenticator& authenticator, DeviceSimulator& simulator,
+                                       const std::vector<SimulatedUser>& users, const Args& args)
+{
+    auto user_faceprints = to_user_faceprints(users);
+    simulator.SetUsers({});
+    auto before = simulator.Stats();
+    auto start = Clock::now();
+    auto status = authenticator.SetUsersFaceprints(user_faceprints.data(), static_cast<unsigned int>(users.size()));
+    double seconds = seconds_since(start);
+    auto after = simulator.Stats();
+    bool identical = status == Status::Ok && same_db(simulator.SavedUsers(), users);
+    print_import_row("SetUsersFaceprints", 1, users.size(), seconds, static_cast<double>(users.size() * sizeof(DBFaceprintsElement)),
+                     static_cast<double>(after.rx_bytes - before.rx_bytes), after.saves - before.saves, args, identical);
+    return identical;
+}
+
+// all users into an empty device with ImportUsersFaceprints(), then SaveDatabase(). nothing may be saved before the commit.
+static bool bench_import(FaceAuthenticator& authenticator, DeviceSimulator& simulator, const std::vector<SimulatedUser>& users,
+                         const Args& args, unsigned int depth)
+{
+    auto user_faceprints = to_user_faceprints(users);
+    simulator.SetUsers({});
+    auto before = simulator.Stats();
+    auto start = Clock::now();
+    FaceprintsImportStats stats;
+    auto status = authenticator.ImportUsersFaceprints(user_faceprints.data(), static_cast<unsigned int>(users.size()), nullptr, depth,
+                                                      &stats);
+    bool saved_before_commit = !simulator.SavedUsers().empty();
+    auto save_status = authenticator.SaveDatabase();
+    double seconds = seconds_since(start);
+    auto after = simulator.Stats();
+    bool identical = status == Status::Ok && save_status == Status::Ok && !saved_before_commit && stats.imported_users == users.size() &&
+                     same_db(simulator.SavedUsers(), users);
+    print_import_row("ImportUsersFaceprints", depth, users.size(), seconds, static_cast<double>(stats.bytes),
+                     static_cast<double>(after.rx_bytes - before.rx_bytes), after.saves - before.saves, args, identical);
+    return identical;
+}
+
+// an import where the device rejects two users and the acknowledgement of a third arrives corrupt: the import must go on,
+// report the two rejected users only, send the third again, and save all the others.
+static bool check_partial_import(FaceAuthenticator& authenticator, DeviceSimulator& simulator, const std::vector<SimulatedUser>& users,
+                                 const Args& args)
+{
+    const auto n_users = users.size();
+    if (n_users < 4)
+    {
+        return true;
+    }
+    auto user_faceprints = to_user_faceprints(users);
+    simulator.SetUsers({});
+    const size_t rejected[] = {1, n_users / 2};
+    for (auto i : rejected)
+    {
+        simulator.RejectUser(users[i].user_id);
+    }
+    simulator.CorruptSetReply(users[n_users / 3].user_id);
+
+    std::vector<Status> statuses(n_users, Status::Ok);
+    FaceprintsImportStats stats;
+    auto status = authenticator.ImportUsersFaceprints(user_faceprints.data(), static_cast<unsigned int>(n_users), statuses.data(),
+                                                      args.import_depth, &stats);
+    auto save_status = authenticator.SaveDatabase();
+
+    std::vector<SimulatedUser> expected;
+    bool statuses_ok = true;
+    for (size_t i = 0; i < n_users; i++)
+    {
+        bool is_rejected = std::find(std::begin(rejected), std::end(rejected), i) != std::end(rejected);
+        statuses_ok = statuses_ok && (statuses[i] == (is_rejected ? Status::Error : Status::Ok));
+        if (!is_rejected)
+        {
+            expected.push_back(users[i]);
+        }
+    }
+    bool ok = status == Status::Error && save_status == Status::Ok && statuses_ok && stats.failed_users == 2 && stats.resent_users == 1 &&
+              same_db(simulator.SavedUsers(), expected);
+
+    std::printf("\n%-22s %10s %10s %10s %10s %10s\n", "partial import", "status", "imported", "failed", "resent", "identical");
+    std::printf("%-22s %10s %10u %10u %10u %10s\n", "2 rejected, 1 corrupt", Description(status), stats.imported_users, stats.failed_users,
+                stats.resent_users, ok ? "yes" : "NO");
+    return ok;
+}
+
+// the DB in any order: the device appends added users, so a synced DB isn't in the host's order.
+static bool same_db_by_id(std::vector<SimulatedUser> db, std::vector<SimulatedUser> expected)
+{
+    auto by_id = [](const SimulatedUser& a, const SimulatedUser& b) { return a.user_id < b.user_id; };
+    std::sort(db.begin(), db.end(), by_id);
+    std::sort(expected.begin(), expected.end(), by_id);
+    return same_db(db, expected);
+}
+
+struct SyncStep
+{
+    Status status = Status::Error;
+    FaceprintsSyncStats stats;
+    uint64_t requests = 0;
+    uint64_t saves = 0;
+    bool identical = false; // the saved DB is the target
+
+    bool Synced() const
+    {
+        return status == Status::Ok && stats.failed_users == 0 && identical;
+    }
+};
+
+static const char* verify_name(SyncVerify verify)
+{
+    switch (verify)
+    {
+    case SyncVerify::UserCount:
+        return "count";
+    case SyncVerify::UserIds:
+        return "ids";
+    default:
+        return "faceprints";
+    }
+}
+
+static void print_sync_header()
+{
+    std::printf("\n%-20s %-10s %-10s %7s %7s %6s %8s %8s %10s %9s %11s %6s %8s %10s\n", "sync", "verify", "status", "device", "hashed",
+                "added", "changed", "removed", "unchanged", "requests", "link bytes", "saves", "seconds", "identical");
+}
+
+static void print_sync_row(const char* name, const char* verify, Status status, const FaceprintsSyncStats& stats, uint64_t requests,
+                           uint64_t link_bytes, uint64_t saves, double seconds, bool identical)
+{
+    std::printf("%-20s %-10s %-10s %7u %7u %6u %8u %8u %10u %9llu %11llu %6llu %8.2f %10s\n", name, verify, Description(status),
+                stats.device_users, stats.hashed_users, stats.added_users, stats.changed_users, stats.removed_users, stats.unchanged_users,
+                static_cast<unsigned long long>(requests), static_cast<unsigned long long>(link_bytes),
+                static_cast<unsigned long long>(saves), seconds, identical ? "yes" : "NO");
+}
+
+// sync the device to target, and check its saved DB.
+static SyncStep run_sync(const char* name, FaceprintsSync& sync, FaceAuthenticator& authenticator, DeviceSimulator& simulator,
+                         const std::vector<SimulatedUser>& target, SyncVerify verify)
+{
+    auto user_faceprints = to_user_faceprints(target);
+    auto before = simulator.Stats();
+    SyncStep step;
+    step.status = sync.Sync(authenticator, user_faceprints.data(), static_cast<unsigned int>(target.size()), verify, nullptr, &step.stats);
+    auto after = simulator.Stats();
+    step.requests = after.requests - before.requests;
+    step.saves = after.saves - before.saves;
+    step.identical = same_db_by_id(simulator.SavedUsers(), target);
+    auto link_bytes = after.rx_bytes - before.rx_bytes + after.tx_bytes - before.tx_bytes;
+    print_sync_row(name, verify_name(verify), step.status, step.stats, step.requests, link_bytes, step.saves, step.stats.seconds,
+                   step.identical);
+    return step;
+}
+
+// a device mirroring a subset of the users, kept in sync with FaceprintsSync: only the difference may be transferred, and a
+// sync with no change must be a single GetNumberOfUsers exchange (a StartSession and a request).
+static bool check_sync(FaceAuthenticator& authenticator, DeviceSimulator& simulator, const std::vector<SimulatedUser>& users,
+                       const Args& args)
+{
+    const auto n_users = users.size();
+    if (n_users < 8)
+    {
+        return true;
+    }
+    Random rnd(args.seed + 1);
+    simulator.ClearFaults();
+    const size_t quarter = n_users / 4;
+
+    // the device has a stale mirror: the first quarter missing, two users changed, and the last quarter no longer wanted
+    std::vector<SimulatedUser> target(users.begin(), users.end() - quarter);
+    std::vector<SimulatedUser> stale(users.begin() + quarter, users.end());
+    random_vector(rnd, stale[1].faceprints.enrollmentDescriptor, VecFlagValidWithoutMask);
+    random_vector(rnd, stale[2].faceprints.enrollmentDescriptor, VecFlagValidWithoutMask);
+    simulator.SetUsers(stale);
+
+    print_sync_header();
+    FaceprintsSync sync;
+    auto step = run_sync("first sync", sync, authenticator, simulator, target, SyncVerify::UserCount);
+    bool ok = step.Synced() && step.stats.hashed_users == stale.size() && step.stats.added_users == quarter &&
+              step.stats.changed_users == 2 && step.stats.removed_users == quarter && step.saves == 1;
+
+    step = run_sync("no change", sync, authenticator, simulator, target, SyncVerify::UserCount);
+    ok = ok && step.Synced() && step.stats.unchanged_users == target.size() && step.requests == 2 && step.saves == 0;
+
+    step = run_sync("no change", sync, authenticator, simulator, target, SyncVerify::UserIds);
+    ok = ok && step.Synced() && step.stats.unchanged_users == target.size() && step.stats.hashed_users == 0 && step.saves == 0;
+
+    // two users leave the subset, two join it and three are re-enrolled
+    target.erase(target.begin(), target.begin() + 2);
+    target.push_back(users[n_users - quarter]);
+    target.push_back(users[n_users - quarter + 1]);
+    for (size_t i = 0; i < 3; i++)
+    {
+        random_vector(rnd, target[i].faceprints.enrollmentDescriptor, VecFlagValidWithoutMask);
+    }
+    step = run_sync("delta", sync, authenticator, simulator, target, SyncVerify::UserCount);
+    ok = ok && step.Synced() && step.stats.hashed_users == 0 && step.stats.added_users == 2 && step.stats.changed_users == 3 &&
+         step.stats.removed_users == 2 && step.saves == 1;
+
+    // the manifest survives the host process
+    auto manifest_path = std::string(P_tmpdir) + "/rsid-transfer-bench-" + std::to_string(::getpid()) + ".manifest";
+    FaceprintsSync reloaded;
+    ok = ok && sync.SaveManifest(manifest_path.c_str()) == Status::Ok && reloaded.LoadManifest(manifest_path.c_str()) == Status::Ok;
+    std::remove(manifest_path.c_str());
+    step = run_sync("reloaded manifest", reloaded, authenticator, simulator, target, SyncVerify::UserCount);
+    ok = ok && step.Synced() && step.requests == 2 && step.saves == 0;
+
+    // users removed and added on the device by someone else: the ids show it, the removed users are set again and the added
+    // one is removed, without reading the device's faceprints
+    auto device_users = simulator.SavedUsers();
+    device_users.erase(device_users.begin(), device_users.begin() + 2);
+    device_users.push_back(make_users(rnd, 1).front());
+    device_users.back().user_id = "added-by-others";
+    simulator.SetUsers(device_users);
+    step = run_sync("changed by others", reloaded, authenticator, simulator, target, SyncVerify::UserCount);
+    ok = ok && step.Synced() && step.stats.hashed_users == 0 && step.stats.added_users == 2 && step.stats.removed_users == 1 &&
+         step.saves == 1;
+
+    // a change whose acknowledgement arrives corrupt twice: the sync fails and can't tell whether the user was set, so the next
+    // sync rebuilds the manifest from the device's faceprints, finds the user set, and saves it
+    random_vector(rnd, target[3].faceprints.enrollmentDescriptor, VecFlagValidWithoutMask);
+    simulator.CorruptSetReply(target[3].user_id);
+    simulator.CorruptSetReply(target[3].user_id);
+    step = run_sync("unacknowledged", reloaded, authenticator, simulator, target, SyncVerify::UserCount);
+    ok = ok && step.status == Status::CrcError && step.stats.failed_users == 1 && step.saves == 0;
+    step = run_sync("after unacknowledged", reloaded, authenticator, simulator, target, SyncVerify::UserCount);
+    ok = ok && step.Synced() && step.stats.hashed_users == target.size() && step.stats.unchanged_users == target.size() &&
+         step.saves == 1;
+
+    // what a full re-upload of the same subset costs
+    auto user_faceprints = to_user_faceprints(target);
+    auto before = simulator.Stats();
+    auto start = Clock::now();
+    auto status = authenticator.RemoveAll();
+    if (status == Status::Ok)
+    {
+        status = authenticator.ImportUsersFaceprints(user_faceprints.data(), static_cast<unsigned int>(target.size()));
+    }
+    if (status == Status::Ok)
+    {
+        status = authenticator.SaveDatabase();
+    }
+    auto after = simulator.Stats();
+    FaceprintsSyncStats full;
+    full.added_users = static_cast<unsigned int>(target.size());
+    bool identical = status == Status::Ok && same_db_by_id(simulator.SavedUsers(), target);
+    auto link_bytes = after.rx_bytes - before.rx_bytes + after.tx_bytes - before.tx_bytes;
+    print_sync_row("full upload", "-", status, full, after.requests - before.requests, link_bytes, after.saves - before.saves,
+                   seconds_since(start), identical);
+    return ok && identical;
+}
+
+static void print_usage()
+{
+    std::cout << "Usage: rsid-transfer-bench [options]\n"
+              << "  --users N           users in the simulated device DB (default 50)\n"
+              << "  --baud N            simulated link baudrate, 0 for unlimited (default 115200)\n"
+              << "  --turnaround-us N   simulated device time per request (default 10000)\n"
+              << "  --depth N           export pipeline depth, 1 to 16 (default 8)\n"
+              << "  --import-depth N    import pipeline depth, 1 to 8 (default 2)\n"
+              << "  --seed N            synthetic DB seed (default 1)\n";
+}
+
+static Args config_from_argv(int argc, char* argv[])
+{
+    Args args;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc)
+            {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--users")
+        {
+            args.users = std::stoul(next());
+        }
+        else if (arg == "--baud")
+        {
+            args.baudrate = static_cast<unsigned int>(std::stoul(next()));
+        }
+        else if (arg == "--turnaround-us")
+        {
+            args.turnaround_us = static_cast<unsigned int>(std::stoul(next()));
+        }
+        else if (arg == "--depth")
+        {
+            args.depth = static_cast<unsigned int>(std::stoul(next()));
+        }
+        else if (arg == "--import-depth")
+        {
+            args.import_depth = static_cast<unsigned int>(std::stoul(next()));
+        }
+        else if (arg == "--seed")
+        {
+            args.seed = std::stoull(next());
+        }
+        else if (arg == "--help" || arg == "-h")
+        {
+            print_usage();
+            std::exit(0);
+        }
+        else
+        {
+            print_usage();
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+    if (args.users == 0 || args.users > 0x10000 || args.depth == 0 || args.import_depth == 0)
+    {
+        throw std::invalid_argument("invalid --users, --depth or --import-depth");
+    }
+    return args;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        auto args = config_from_argv(argc, argv);
+
+        // errors only. the resume check's corrupt reply logs a crc error
+        RealSenseID::SetLogCallback([](LogLevel, const char* msg) { std::cerr << msg << std::endl; }, LogLevel::Error, false);
+
+        DeviceSimulatorOptions options;
+        options.baudrate = args.baudrate;
+        options.turnaround = std::chrono::microseconds(args.turnaround_us);
+        DeviceSimulator simulator(options);
+        Random rnd(args.seed);
+        simulator.SetUsers(make_users(rnd, args.users));
+        if (!simulator.Start())
+        {
+            std::cerr << "Failed to open a pseudo terminal for the simulated device" << std::endl;
+            return 1;
+        }
+
+        FaceAuthenticator authenticator;
+        SerialConfig config;
+        config.port = simulator.Port();
+        if (authenticator.Connect(config) != Status::Ok)
+        {
+            std::cerr << "Failed to connect to the simulated device at " << simulator.Port() << std::endl;
+            return 1;
+        }
+        std::cout << "Simulated device at " << simulator.Port() << ": " << args.users << " users, " << args.baudrate << " baud, "
+                  << args.turnaround_us << "us turnaround" << std::endl
+                  << std::endl;
+
+        print_header();
+        bool ok = bench_get_users_faceprints(authenticator, simulator, args);
+        ok = bench_export(authenticator, simulator, args, 1) && ok;
+        if (args.depth != 1)
+        {
+            ok = bench_export(authenticator, simulator, args, args.depth) && ok;
+        }
+        ok = check_resume(authenticator, simulator, args) && ok;
+
+        const auto users = simulator.Users();
+        print_import_header();
+        ok = bench_set_users_faceprints(authenticator, simulator, users, args) && ok;
+        ok = bench_import(authenticator, simulator, users, args, 1) && ok;
+        if (args.import_depth != 1)
+        {
+            ok = bench_import(authenticator, simulator, users, args, args.import_depth) && ok;
+        }
+        ok = check_partial_import(authenticator, simulator, users, args) && ok;
+        ok = check_sync(authenticator, simulator, users, args) && ok;
+
+        authenticator.Disconnect();
+        simulator.Stop();
+        if (!ok)
+        {
+            std::cerr << "Transferred faceprints differ from the simulated device DB" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception occurred: " << ex.what() << std::endl;
+        return 1;
+    }
+}